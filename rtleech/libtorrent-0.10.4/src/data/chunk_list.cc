@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include "torrent/bitfield.h"
 #include "torrent/exceptions.h"
 #include "torrent/chunk_manager.h"
 
@@ -230,6 +231,16 @@ ChunkList::sync_chunk(ChunkListNode* node, std::pair<int,bool> options) {
   return true;
 }
 
+void
+ChunkList::writable_chunks(Bitfield* bitfield) const {
+  if (!empty() && bitfield->size_bits() != size())
+    throw internal_error("ChunkList::writable_chunks(...) bitfield has the wrong size.");
+
+  for (base_type::const_iterator itr = base_type::begin(), last = base_type::end(); itr != last; ++itr)
+    if (itr->writable() > 0)
+      bitfield->set(itr->index());
+}
+
 uint32_t
 ChunkList::sync_chunks(int flags) {
   Queue::iterator split;
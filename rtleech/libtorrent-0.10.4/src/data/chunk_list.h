@@ -46,6 +46,7 @@
 
 namespace torrent {
 
+class Bitfield;
 class ChunkManager;
 class Content;
 class DownloadWrapper;
@@ -93,6 +94,9 @@ public:
 
   size_type           queue_size() const                      { return m_queue.size(); }
 
+  // Set the bits of the chunks that are currently mapped writable.
+  void                writable_chunks(Bitfield* bitfield) const;
+
   // Replace use_timeout with something like performance related
   // keyword. Then use that flag to decide if we should skip
   // non-continious regions.
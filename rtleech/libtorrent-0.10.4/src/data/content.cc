@@ -103,11 +103,11 @@ Content::add_file(const Path& path, uint64_t size) {
 }
 
 void
-Content::set_complete_hash(const std::string& hash) {
-  if (chunk_total())
-    throw internal_error("Tried to set hash on a torrent::Content that is initialized.");
+Content::swap_complete_hash(std::string& hash) {
+  if (chunk_total() && !hash.empty() && hash.size() / 20 < chunk_total())
+    throw input_error("Torrent size and 'info:pieces' length does not match.");
 
-  m_hash = hash;
+  m_hash.swap(hash);
 }
 
 uint32_t
@@ -48,8 +48,8 @@
 
 namespace torrent {
 
-// Since g++ uses reference counted strings, it's cheaper to just hand
-// over bencode's string.
+// The piece hashes are swapped out of the bencode tree so only one
+// copy is kept. They may be released while the download is closed.
 
 // The ranges in the ContentFile elements spans from the first chunk
 // they have data on, to the last plus one. This means the range end
@@ -74,8 +74,9 @@ public:
   // Do not modify chunk size after files have been added.
   void                   add_file(const Path& path, uint64_t size);
 
-  const std::string&     complete_hash()                                { return m_hash; }
-  void                   set_complete_hash(const std::string& hash);
+  bool                   has_complete_hash() const                      { return !m_hash.empty(); }
+  const std::string&     complete_hash() const                          { return m_hash; }
+  void                   swap_complete_hash(std::string& hash);
 
   uint32_t               chunks_completed() const                       { return m_bitfield.size_set(); }
 
@@ -38,60 +38,59 @@
 
 #include <stdlib.h>
 #include <algorithm>
-#include <iterator>
 
 #include "torrent/exceptions.h"
 #include "available_list.h"
 
 namespace torrent {
 
+void
+AvailableList::erase_position(size_type pos) {
+  m_index.erase_position(pos);
+
+  base_type::operator[](pos) = base_type::back();
+  base_type::pop_back();
+}
+
 AvailableList::value_type
 AvailableList::pop_random() {
   if (empty())
     throw internal_error("AvailableList::pop_random() called on an empty container");
 
   size_type idx = random() % size();
+  value_type tmp = base_type::operator[](idx);
 
-  value_type tmp = *(begin() + idx);
-  *(begin() + idx) = back();
-
-  pop_back();
+  erase_position(idx);
 
   return tmp;
 }
 
 void
 AvailableList::push_back(const rak::socket_address* sa) {
-  if (std::find(begin(), end(), *sa) != end())
+  if (!sa->is_valid() || has(*sa))
     return;
 
   base_type::push_back(*sa);
+  m_index.insert_back();
 }
 
 void
-AvailableList::insert(AddressList* l) {
-  if (size() > m_maxSize)
+AvailableList::insert(const AddressList* l) {
+  if (size() >= m_maxSize)
     return;
 
-  std::sort(begin(), end());
-
-  // Can i use use the std::remove* semantics for this, and just copy
-  // to 'l'?.
-  //
-  // 'l' is guaranteed to be sorted, so we can just do
-  // std::set_difference.
-  AddressList difference;
-  std::set_difference(l->begin(), l->end(), begin(), end(), std::back_inserter(difference));
+  m_index.reserve(std::min<size_type>(size() + l->size(), m_maxSize));
 
-  std::copy(difference.begin(), difference.end(), std::back_inserter(*static_cast<base_type*>(this)));
+  for (AddressList::const_iterator itr = l->begin(), last = l->end(); itr != last && size() < m_maxSize; ++itr)
+    push_back(&*itr);
 }
 
 void
 AvailableList::erase(const rak::socket_address& sa) {
-  iterator itr = std::find(begin(), end(), sa);
+  size_type pos = m_index.find(sa);
 
-  if (itr != end())
-    erase(itr);
+  if (pos != index_type::npos)
+    erase_position(pos);
 }
 
 }
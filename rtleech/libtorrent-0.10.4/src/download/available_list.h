@@ -38,37 +38,47 @@
 #define LIBTORRENT_DOWNLOAD_AVAILABLE_LIST_H
 
 #include <vector>
-#include <list>
-
+#include <rak/hash_index.h>
 #include <rak/socket_address.h>
 
 namespace torrent {
 
+struct available_list_traits {
+  static uint32_t hash(const rak::socket_address& sa) {
+    return rak::socket_address_host_hash(sa) ^ (sa.port() * 0x85ebca6b);
+  }
+
+  static bool equal(const rak::socket_address& sa1, const rak::socket_address& sa2) {
+    return sa1 == sa2;
+  }
+};
+
+// The addresses are kept in a vector for cheap random picks, with a
+// hash index of their positions so lookups, inserts and erases don't
+// need to scan or sort the container.
+
 class AvailableList : private std::vector<rak::socket_address> {
 public:
-  typedef std::vector<rak::socket_address> base_type;
-  typedef std::list<rak::socket_address>   AddressList;
-  typedef uint32_t                         size_type;
+  typedef std::vector<rak::socket_address>                  base_type;
+  typedef std::vector<rak::socket_address>                  AddressList;
+  typedef rak::hash_index<base_type, available_list_traits> index_type;
+  typedef uint32_t                                          size_type;
 
   using base_type::value_type;
   using base_type::reference;
   using base_type::const_reference;
 
-  using base_type::iterator;
   using base_type::const_iterator;
-  using base_type::reverse_iterator;
+  using base_type::const_reverse_iterator;
   using base_type::size;
   using base_type::empty;
-  using base_type::clear;
 
-  using base_type::back;
-  using base_type::pop_back;
-  using base_type::begin;
-  using base_type::end;
-  using base_type::rbegin;
-  using base_type::rend;
+  AvailableList() : m_maxSize(1000), m_index(this) {}
+
+  const_iterator      begin() const                       { return base_type::begin(); }
+  const_iterator      end() const                         { return base_type::end(); }
 
-  AvailableList() : m_maxSize(1000) {}
+  bool                has(const rak::socket_address& sa) const { return m_index.find(sa) != index_type::npos; }
 
   value_type          pop_random();
 
@@ -76,21 +86,23 @@ public:
   size_type           max_size() const                   { return m_maxSize; }
   void                set_max_size(size_type s)          { m_maxSize = s; }
 
-  // This push is somewhat inefficient as it iterates through the
-  // whole container to see if the address already exists.
+  void                clear()                             { base_type::clear(); m_index.clear(); }
+
   void                push_back(const rak::socket_address* sa);
 
-  void                insert(AddressList* l);
+  void                insert(const AddressList* l);
   void                erase(const rak::socket_address& sa);
-  void                erase(iterator itr)                 { *itr = back(); pop_back(); }
   
   // A place to temporarily put addresses before re-adding them to the
   // AvailableList.
   AddressList*        buffer()                            { return &m_buffer; }
 
 private:
+  void                erase_position(size_type pos);
+
   size_type           m_maxSize;
 
+  index_type          m_index;
   AddressList         m_buffer;
 };
 
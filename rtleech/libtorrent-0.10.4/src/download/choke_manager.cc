@@ -38,72 +38,75 @@
 
 #include <algorithm>
 #include <functional>
+#include <iterator>
 #include <stdlib.h>
 
 #include "protocol/peer_connection_base.h"
+#include "torrent/exceptions.h"
 
 #include "choke_manager.h"
 
 namespace torrent {
 
 ChokeManager::~ChokeManager() {
-  if (m_currentlyUnchoked != 0)
-    throw internal_error("ChokeManager::~ChokeManager() called but m_currentlyUnchoked != 0.");
+  if (!m_unchoked.empty())
+    throw internal_error("ChokeManager::~ChokeManager() called but m_unchoked is not empty.");
 
-  if (m_currentlyUnchoked != 0)
-    throw internal_error("ChokeManager::~ChokeManager() called but m_currentlyInterested != 0.");
+  if (!m_queued.empty())
+    throw internal_error("ChokeManager::~ChokeManager() called but m_queued is not empty.");
 }
 
-struct choke_manager_read_rate_increasing {
-  bool operator () (PeerConnectionBase* p1, PeerConnectionBase* p2) const {
-    return *p1->peer_chunks()->download_throttle()->rate() < *p2->peer_chunks()->download_throttle()->rate();
+struct choke_manager_read_rate {
+  void operator () (ChokeManager::value_type& v) const {
+    v.second = v.first->peer_chunks()->download_throttle()->rate()->rate();
   }
 };
 
-struct choke_manager_write_rate_increasing {
-  bool operator () (PeerConnectionBase* p1, PeerConnectionBase* p2) const {
-    return *p1->peer_chunks()->upload_throttle()->rate() < *p2->peer_chunks()->upload_throttle()->rate();
+struct choke_manager_write_rate {
+  void operator () (ChokeManager::value_type& v) const {
+    v.second = v.first->peer_chunks()->upload_throttle()->rate()->rate();
   }
 };
 
-struct choke_manager_read_rate_decreasing {
-  bool operator () (PeerConnectionBase* p1, PeerConnectionBase* p2) const {
-    return *p1->peer_chunks()->download_throttle()->rate() > *p2->peer_chunks()->download_throttle()->rate();
+struct choke_manager_weight_increasing {
+  bool operator () (const ChokeManager::value_type& v1, const ChokeManager::value_type& v2) const {
+    return v1.second < v2.second;
   }
 };
 
-struct choke_manager_is_remote_not_uploading {
-  bool operator () (PeerConnectionBase* p1) const {
-    return *p1->peer_chunks()->download_throttle()->rate() == 0;
+struct choke_manager_weight_decreasing {
+  bool operator () (const ChokeManager::value_type& v1, const ChokeManager::value_type& v2) const {
+    return v1.second > v2.second;
   }
 };
 
-struct choke_manager_is_remote_uploading {
-  bool operator () (PeerConnectionBase* p1) const {
-    return *p1->peer_chunks()->download_throttle()->rate() != 0;
+// These assume the weight has been set by choke_manager_read_rate.
+struct choke_manager_is_remote_not_uploading {
+  bool operator () (const ChokeManager::value_type& v) const {
+    return v.second == 0;
   }
 };
 
-struct choke_manager_is_interested {
-  bool operator () (PeerConnectionBase* p) const {
-    return p->is_upload_wanted();
+struct choke_manager_is_remote_uploading {
+  bool operator () (const ChokeManager::value_type& v) const {
+    return v.second != 0;
   }
 };
 
 struct choke_manager_not_recently_unchoked {
-  bool operator () (PeerConnectionBase* p) const {
-    return p->time_last_choked() + rak::timer::from_seconds(10) < cachedTime;
+  bool operator () (const ChokeManager::value_type& v) const {
+    return v.first->time_last_choked() + rak::timer::from_seconds(10) < cachedTime;
   }
 };
 
-inline ChokeManager::iterator
-ChokeManager::seperate_interested(iterator first, iterator last) {
-  return std::partition(first, last, choke_manager_is_interested());
-}
+// Place the 'max' connections with the lowest weight at the start of
+// the range, in increasing order. Returns the number placed.
+inline static unsigned int
+choke_manager_select_lowest(ChokeManager::iterator first, ChokeManager::iterator last, unsigned int max) {
+  max = std::min<unsigned int>(max, std::distance(first, last));
 
-inline ChokeManager::iterator
-ChokeManager::seperate_unchoked(iterator first, iterator last) {
-  return std::partition(first, last, std::not1(std::mem_fun(&PeerConnectionBase::is_up_choked)));
+  std::partial_sort(first, first + max, last, choke_manager_weight_increasing());
+  return max;
 }
 
 // 1  > 1
@@ -115,23 +118,48 @@ ChokeManager::seperate_unchoked(iterator first, iterator last) {
 
 inline unsigned int
 ChokeManager::max_alternate() const {
-  if (m_currentlyUnchoked < 31)
-    return (m_currentlyUnchoked + 7) / 8;
+  if (m_unchoked.size() < 31)
+    return (m_unchoked.size() + 7) / 8;
   else
-    return (m_currentlyUnchoked + 9) / 10;
+    return (m_unchoked.size() + 9) / 10;
 }
 
 inline void
-ChokeManager::alternate_ranges(iterator firstUnchoked, iterator lastUnchoked,
-                               iterator firstChoked, iterator lastChoked,
-                               unsigned int max) {
-  max = std::min(max, std::min<unsigned int>(std::distance(firstUnchoked, lastUnchoked), std::distance(firstChoked, lastChoked)));
+ChokeManager::alternate_ranges(size_type unchokedSize, size_type queuedSize, unsigned int max) {
+  max = std::min(max, std::min<unsigned int>(unchokedSize, queuedSize));
+
+  // Unchoke first so that the connections we choke don't get
+  // unchoked in the same cycle. The newly unchoked connections are
+  // placed after 'unchokedSize' and thus won't be choked.
+  unchoke_range(queuedSize, max);
+  choke_range(unchokedSize, max);
+}
 
-  // Do unchoke first, then choke. Take the return value of the first
-  // unchoke and use it for choking. Don't need the above min call.
+void
+ChokeManager::container_push(container_type* container, const value_type& v) {
+  container->push_back(v);
+  v.first->set_choke_index(container->size() - 1);
+}
+
+// Moves the last connection into the hole, so only its index needs
+// to be updated.
+void
+ChokeManager::container_erase(container_type* container, PeerConnectionBase* pc) {
+  uint32_t index = pc->choke_index();
 
-  choke_range(firstUnchoked, lastUnchoked, max);
-  unchoke_range(firstChoked, lastChoked, max);
+  if (index >= container->size() || (container->begin() + index)->first != pc)
+    throw internal_error("ChokeManager::container_erase(...) could not find the connection.");
+
+  container->erase(container->begin() + index);
+
+  if (index < container->size())
+    (container->begin() + index)->first->set_choke_index(index);
+}
+
+void
+ChokeManager::container_reindex(container_type* container) {
+  for (iterator itr = container->begin(), last = container->end(); itr != last; ++itr)
+    itr->first->set_choke_index(std::distance(container->begin(), itr));
 }
 
 inline void
@@ -151,17 +179,13 @@ ChokeManager::swap_with_shift(iterator first, iterator source) {
 void
 ChokeManager::balance() {
   // Return if no balance is needed.
-  if (m_currentlyUnchoked == m_maxUnchoked)
+  if (m_unchoked.size() == m_maxUnchoked)
     return;
 
-  iterator beginUninterested = seperate_interested(m_connectionList->begin(), m_connectionList->end());
-  iterator beginChoked       = seperate_unchoked(m_connectionList->begin(), beginUninterested);
-
-  int adjust = m_maxUnchoked - m_currentlyUnchoked;
+  int adjust = m_maxUnchoked - m_unchoked.size();
 
   if (adjust > 0) {
-    adjust = unchoke_range(beginChoked, beginUninterested,
-			   std::min((unsigned int)adjust, m_slotCanUnchoke()));
+    adjust = unchoke_range(m_queued.size(), std::min((unsigned int)adjust, m_slotCanUnchoke()));
 
     m_slotUnchoke(adjust);
 
@@ -169,7 +193,7 @@ ChokeManager::balance() {
     // We can do the choking before the slot is called as this
     // ChokeManager won't be unchoking the same peers due to the
     // call-back.
-    adjust = choke_range(m_connectionList->begin(), beginChoked, -adjust);
+    adjust = choke_range(m_unchoked.size(), -adjust);
 
     m_slotChoke(adjust);
   }
@@ -177,133 +201,167 @@ ChokeManager::balance() {
 
 int
 ChokeManager::cycle(unsigned int quota) {
-  iterator lastChoked = seperate_interested(m_connectionList->begin(), m_connectionList->end());
-  iterator firstChoked = seperate_unchoked(m_connectionList->begin(), lastChoked);
-
-  // Partition away the connections we shall not choke.
-
-  if (std::distance(m_connectionList->begin(), firstChoked) != (ConnectionList::difference_type)m_currentlyUnchoked)
-    throw internal_error("ChokeManager::cycle() std::distance(m_connectionList->begin(), firstChoked) != m_currentlyUnchoked.");
-
-  if (std::distance(m_connectionList->begin(), lastChoked) != (ConnectionList::difference_type)m_currentlyInterested)
-    throw internal_error("ChokeManager::cycle() std::distance(m_connectionList->begin(), lastChoked) != m_currentlyInterested.");
-
-  iterator firstUnchoked = m_connectionList->begin();
-  iterator lastUnchoked = firstChoked;
-
   int cycled, adjust;
 
+  // Connections moved by un/choke_range are placed at the end of the
+  // other container, so keeping track of the number of untouched
+  // connections at the start is enough to not alternate them.
+  size_type unchokedSize = m_unchoked.size();
+  size_type queuedSize   = m_queued.size();
+
   // We don't call the resource manager slots, the number of un/choked
   // connections is returned.
 
-  adjust = std::min(quota, m_maxUnchoked) - m_currentlyUnchoked;
+  adjust = std::min(quota, m_maxUnchoked) - m_unchoked.size();
 
   if (adjust > 0)
-    firstChoked += (cycled = unchoke_range(firstChoked, lastChoked, adjust));
+    queuedSize -= (cycled = unchoke_range(queuedSize, adjust));
   else if (adjust < 0)
-    firstUnchoked -= (cycled = -choke_range(firstUnchoked, lastUnchoked, -adjust));
+    unchokedSize += (cycled = -choke_range(unchokedSize, -adjust));
   else
     cycled = 0;
 
   adjust = max_alternate() - std::abs(cycled);
 
-  // Consider rolling this into the above calls.
   if (adjust > 0)
-    alternate_ranges(firstUnchoked, lastUnchoked, firstChoked, lastChoked, adjust);
+    alternate_ranges(unchokedSize, queuedSize, adjust);
 
-  if (m_currentlyUnchoked > quota)
-    throw internal_error("ChokeManager::cycle() m_currentlyUnchoked > quota.");
+  if (m_unchoked.size() > quota)
+    throw internal_error("ChokeManager::cycle() m_unchoked.size() > quota.");
 
   return cycled;
 }
 
 void
 ChokeManager::set_interested(PeerConnectionBase* pc) {
-  m_currentlyInterested++;
-
-  if (!pc->is_up_choked())
+  if (!pc->is_up_choked()) {
+    container_push(&m_unchoked, value_type(pc, 0));
     return;
+  }
 
-  if (m_currentlyUnchoked < m_maxUnchoked &&
+  if (m_unchoked.size() < m_maxUnchoked &&
       pc->time_last_choked() + rak::timer::from_seconds(10) < cachedTime &&
       m_slotCanUnchoke()) {
     pc->receive_choke(false);
 
-    m_currentlyUnchoked++;
+    container_push(&m_unchoked, value_type(pc, 0));
     m_slotUnchoke(1);
+
+  } else {
+    container_push(&m_queued, value_type(pc, 0));
   }
 }
 
 void
 ChokeManager::set_not_interested(PeerConnectionBase* pc) {
-  m_currentlyInterested--;
-
-  if (pc->is_up_choked())
+  if (pc->is_up_choked()) {
+    container_erase(&m_queued, pc);
     return;
+  }
 
-  pc->receive_choke(true);
+  container_erase(&m_unchoked, pc);
 
-  m_currentlyUnchoked--;
+  pc->receive_choke(true);
   m_slotChoke(1);
 }
 
 // We are no longer be in m_connectionList.
 void
 ChokeManager::disconnected(PeerConnectionBase* pc) {
-  if (pc->is_upload_wanted())
-    m_currentlyInterested--;
+  if (!pc->is_upload_wanted())
+    return;
 
-  if (!pc->is_up_choked()) {
-    m_currentlyUnchoked--;
+  container_erase(pc->is_up_choked() ? &m_queued : &m_unchoked, pc);
+
+  if (!pc->is_up_choked())
     m_slotChoke(1);
-  }
 }
 
+// Choke order: connections not uploading to us by increasing upload
+// rate, then those uploading to us by increasing download rate, and
+// last those that were recently unchoked.
 unsigned int
-ChokeManager::choke_range(iterator first, iterator last, unsigned int max) {
-  max = std::min(max, (unsigned int)distance(first, last));
+ChokeManager::choke_range(size_type size, unsigned int max) {
+  iterator first = m_unchoked.begin();
+  iterator last  = m_unchoked.begin() + size;
+
+  max = std::min<unsigned int>(max, size);
+
+  if (max == 0)
+    return 0;
+
+  std::for_each(first, last, choke_manager_read_rate());
+
+  iterator recent    = std::partition(first, last, choke_manager_not_recently_unchoked());
+  iterator uploading = std::partition(first, recent, choke_manager_is_remote_not_uploading());
 
-  std::sort(first, last, choke_manager_read_rate_increasing());
+  std::for_each(first, uploading, choke_manager_write_rate());
 
-  iterator split;
-  split = std::stable_partition(first, last, choke_manager_not_recently_unchoked());
-  split = std::find_if(first, split, choke_manager_is_remote_uploading());
+  unsigned int count = choke_manager_select_lowest(first, uploading, max);
 
-  std::sort(first, split, choke_manager_write_rate_increasing());
+  if (count < max)
+    count += choke_manager_select_lowest(uploading, recent, max - count);
 
-  std::for_each(first, first + max, std::bind2nd(std::mem_fun(&PeerConnectionBase::receive_choke), true));
+  if (count < max)
+    count += choke_manager_select_lowest(recent, last, max - count);
+
+  for (iterator itr = first; itr != first + max; ++itr) {
+    itr->first->receive_choke(true);
+    m_queued.push_back(*itr);
+  }
+
+  m_unchoked.erase(first, first + max);
+
+  container_reindex(&m_unchoked);
+  container_reindex(&m_queued);
 
-  m_currentlyUnchoked -= max;
   return max;
 }
   
 unsigned int
-ChokeManager::unchoke_range(iterator first, iterator last, unsigned int max) {
-  std::sort(first, last, choke_manager_read_rate_decreasing());
+ChokeManager::unchoke_range(size_type size, unsigned int max) {
+  iterator first = m_queued.begin();
+  iterator last  = m_queued.begin() + size;
 
-  unsigned int count = 0;
+  max = std::min<unsigned int>(max, size);
+
+  if (max == 0)
+    return 0;
+
+  std::for_each(first, last, choke_manager_read_rate());
 
   // Find the split between the ones that are uploading to us, and
   // those that arn't. When unchoking, circa every third unchoke is of
   // a connection in the list of those not uploading to us.
   //
+  // Only the connections we might unchoke need to be sorted.
+  //
   // Perhaps we should prefer those we are interested in?
 
-  iterator split = std::find_if(first, last, choke_manager_is_remote_not_uploading());
+  iterator split = std::partition(first, last, choke_manager_is_remote_uploading());
+
+  std::partial_sort(first, first + std::min<unsigned int>(max, std::distance(first, split)), split, choke_manager_weight_decreasing());
+
+  unsigned int count = 0;
 
-  for ( ; count != max && first != last; count++, first++) {
+  for (iterator itr = first; count != max; count++, itr++) {
 
     if (split != last &&
-	(*(*first)->peer_chunks()->download_throttle()->rate() < 500 || ::random() % m_generousUnchokes == 0)) {
+	(itr->second < 500 || ::random() % m_generousUnchokes == 0)) {
       // Use a random connection that is not uploading to us.
       std::iter_swap(split, split + ::random() % std::distance(split, last));
-      swap_with_shift(first, split++);
+      swap_with_shift(itr, split++);
     }
     
-    (*first)->receive_choke(false);
+    itr->first->receive_choke(false);
+    m_unchoked.push_back(*itr);
   }
 
-  m_currentlyUnchoked += count;
+  m_queued.erase(first, first + count);
+
+  container_reindex(&m_unchoked);
+  container_reindex(&m_queued);
+
   return count;
 }
 
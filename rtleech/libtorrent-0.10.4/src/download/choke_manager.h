@@ -37,37 +37,56 @@
 #ifndef LIBTORRENT_DOWNLOAD_CHOKE_MANAGER_H
 #define LIBTORRENT_DOWNLOAD_CHOKE_MANAGER_H
 
-#include <list>
+#include <inttypes.h>
 #include <rak/functional.h>
-
-#include "connection_list.h"
+#include <rak/unordered_vector.h>
 
 namespace torrent {
 
 class ResourceManager;
 class PeerConnectionBase;
 
+// The choke manager keeps the interested connections in two
+// containers, those we have unchoked and those queued for an
+// unchoke. The containers are updated as the interested state of the
+// connections change, so a choke cycle only needs to look at the
+// interested connections.
+//
+// The second member of value_type is a weight that is filled in once
+// per choke or unchoke pass, so each Rate is only read once instead
+// of for every comparison.
+//
+// Each connection knows its position in the container, so interest
+// changes and disconnects are O(1). A choke pass still reads the rate
+// of every candidate, as a ranking kept between cycles would be
+// stale once the rates move.
+
 class ChokeManager {
 public:
-  typedef ConnectionList::iterator                          iterator;
+  typedef std::pair<PeerConnectionBase*, uint32_t>           value_type;
+  typedef rak::unordered_vector<value_type>                  container_type;
+  typedef container_type::iterator                           iterator;
+  typedef container_type::size_type                          size_type;
+
   typedef rak::mem_fun1<ResourceManager, void, unsigned int> SlotChoke;
   typedef rak::mem_fun1<ResourceManager, void, unsigned int> SlotUnchoke;
   typedef rak::mem_fun0<ResourceManager, unsigned int>       SlotCanUnchoke;
 
-  ChokeManager(ConnectionList* cl) :
-    m_connectionList(cl),
-    m_currentlyUnchoked(0),
-    m_currentlyInterested(0),
+  ChokeManager() :
     m_maxUnchoked(15),
     m_generousUnchokes(3) {}
   ~ChokeManager();
   
-  unsigned int        currently_unchoked() const              { return m_currentlyUnchoked; }
-  unsigned int        currently_interested() const            { return m_currentlyInterested; }
+  unsigned int        currently_unchoked() const              { return m_unchoked.size(); }
+  unsigned int        currently_queued() const                { return m_queued.size(); }
+  unsigned int        currently_interested() const            { return m_unchoked.size() + m_queued.size(); }
 
   unsigned int        max_unchoked() const                    { return m_maxUnchoked; }
   void                set_max_unchoked(unsigned int v)        { m_maxUnchoked = v; }
 
+  const container_type* unchoked() const                      { return &m_unchoked; }
+  const container_type* queued() const                        { return &m_queued; }
+
   unsigned int        generous_unchokes() const               { return m_generousUnchokes; }
   void                set_generous_unchokes(unsigned int v)   { m_generousUnchokes = v; }
 
@@ -86,24 +105,24 @@ public:
   void                slot_can_unchoke(SlotCanUnchoke s)       { m_slotCanUnchoke = s; }
 
 private:
-  static iterator     seperate_interested(iterator first, iterator last);
-  static iterator     seperate_unchoked(iterator first, iterator last);
-
   inline unsigned int max_alternate() const;
 
-  unsigned int        choke_range(iterator first, iterator last, unsigned int max);
-  unsigned int        unchoke_range(iterator first, iterator last, unsigned int max);
+  // Only the first 'size' connections of the containers are
+  // considered, so that connections moved by a previous call in the
+  // same cycle are left alone.
+  unsigned int        choke_range(size_type size, unsigned int max);
+  unsigned int        unchoke_range(size_type size, unsigned int max);
 
-  inline void         alternate_ranges(iterator firstUnchoked, iterator lastUnchoked,
-				       iterator firstChoked, iterator lastChoked,
-				       unsigned int max);
+  inline void         alternate_ranges(size_type unchokedSize, size_type queuedSize, unsigned int max);
 
   inline static void  swap_with_shift(iterator first, iterator source);
 
-  ConnectionList*     m_connectionList;
+  static void         container_push(container_type* container, const value_type& v);
+  static void         container_erase(container_type* container, PeerConnectionBase* pc);
+  static void         container_reindex(container_type* container);
 
-  unsigned int        m_currentlyUnchoked;
-  unsigned int        m_currentlyInterested;
+  container_type      m_unchoked;
+  container_type      m_queued;
 
   unsigned int        m_maxUnchoked;
   unsigned int        m_generousUnchokes;
@@ -41,6 +41,7 @@
 #include "download/download_info.h"
 #include "download/download_main.h"
 #include "protocol/peer_connection_base.h"
+#include "torrent/block_transfer.h"
 #include "torrent/exceptions.h"
 #include "torrent/peer_info.h"
 
@@ -55,16 +56,16 @@ ConnectionList::clear() {
 }
 
 PeerConnectionBase*
-ConnectionList::insert(PeerInfo* peerInfo, const SocketFd& fd, Bitfield* bitfield) {
+ConnectionList::insert(PeerInfo* peerInfo, const SocketFd& fd, Bitfield* bitfield, EncryptionInfo* encryptionInfo) {
   if (size() >= m_maxSize)
     return NULL;
 
   PeerConnectionBase* peerConnection = m_slotNewConnection();
 
-  if (peerConnection == NULL || bitfield == NULL)
+  if (peerConnection == NULL || bitfield == NULL || encryptionInfo == NULL)
     throw internal_error("ConnectionList::insert(...) received a NULL pointer.");
 
-  peerConnection->initialize(m_download, peerInfo, fd, bitfield);
+  peerConnection->initialize(m_download, peerInfo, fd, bitfield, encryptionInfo);
 
   base_type::push_back(peerConnection);
   m_download->info()->set_accepting_new_peers(size() < m_maxSize);
@@ -169,6 +170,16 @@ ConnectionList::send_finished_chunk(uint32_t index) {
   std::for_each(begin(), end(), std::bind2nd(std::mem_fun(&PeerConnectionBase::receive_finished_chunk), index));
 }
 
+void
+ConnectionList::cancel_transfer(BlockTransfer* transfer) {
+  iterator itr = std::find_if(begin(), end(), rak::equal(transfer->peer_info(), std::mem_fun(&PeerConnectionBase::peer_info)));
+
+  if (itr == end())
+    throw internal_error("ConnectionList::cancel_transfer(...) could not find the peer.");
+
+  (*itr)->cancel_transfer(transfer);
+}
+
 void
 ConnectionList::set_max_size(size_type v) { 
   m_maxSize = v;
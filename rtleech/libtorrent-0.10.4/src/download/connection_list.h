@@ -37,7 +37,7 @@
 #ifndef LIBTORRENT_DOWNLOAD_CONNECTION_LIST_H
 #define LIBTORRENT_DOWNLOAD_CONNECTION_LIST_H
 
-#include <list>
+#include <vector>
 #include <rak/functional.h>
 #include <rak/socket_address.h>
 #include <rak/unordered_vector.h>
@@ -45,8 +45,10 @@
 namespace torrent {
 
 class Bitfield;
+class BlockTransfer;
 class DownloadMain;
 class DownloadWrapper;
+class EncryptionInfo;
 class PeerConnectionBase;
 class PeerInfo;
 class SocketFd;
@@ -54,7 +56,7 @@ class SocketFd;
 class ConnectionList : private rak::unordered_vector<PeerConnectionBase*> {
 public:
   typedef rak::unordered_vector<PeerConnectionBase*> base_type;
-  typedef std::list<rak::socket_address>             AddressList;
+  typedef std::vector<rak::socket_address>           AddressList;
   typedef uint32_t                                   size_type;
 
   typedef rak::mem_fun1<DownloadWrapper, void, PeerConnectionBase*> slot_peer_type;
@@ -92,7 +94,7 @@ public:
   // responsible for cleaning up 'fd'.
   //
   // Clean this up, don't use this many arguments.
-  PeerConnectionBase* insert(PeerInfo* p, const SocketFd& fd, Bitfield* bitfield);
+  PeerConnectionBase* insert(PeerInfo* p, const SocketFd& fd, Bitfield* bitfield, EncryptionInfo* encryptionInfo);
 
   iterator            erase(iterator pos, int flags);
   void                erase(PeerInfo* peerInfo, int flags);
@@ -115,6 +117,10 @@ public:
 
   void                send_finished_chunk(uint32_t index);
 
+  // Ask the peer holding 'transfer' to cancel the request, used when
+  // a duplicate block request was finished by another peer.
+  void                cancel_transfer(BlockTransfer* transfer);
+
   // When a peer is connected it should be removed from the list of
   // available peers.
   void                slot_connected(slot_peer_type s)                 { m_slotConnected = s; }
@@ -154,11 +154,12 @@ Delegator::delegate(PeerChunks* peerChunks, int affinity) {
   if ((target = new_chunk(peerChunks, false)))
     return target->insert(peerChunks->peer_info());
 
-  if (!m_aggressive)
+  if (!m_aggressive || peerChunks->download_throttle()->rate()->rate() < m_aggressiveRate)
     return NULL;
 
   // Aggressive mode, look for possible downloads that already have
-  // one or more queued.
+  // one or more queued. Only the fastest peers get here, the
+  // duplicates are canceled when the first copy arrives.
 
   // No more than 4 per piece.
   uint16_t overlapped = 5;
@@ -168,6 +169,17 @@ Delegator::delegate(PeerChunks* peerChunks, int affinity) {
   return target ? target->insert(peerChunks->peer_info()) : NULL;
 }
   
+uint32_t
+Delegator::count_unrequested() const {
+  uint32_t count = 0;
+
+  for (TransferList::const_iterator itr = m_transfers.begin(), last = m_transfers.end(); itr != last; ++itr)
+    for (BlockList::const_iterator itr2 = (*itr)->begin(), last2 = (*itr)->end(); itr2 != last2; ++itr2)
+      count += !itr2->is_finished() && itr2->size_all() == 0;
+
+  return count;
+}
+
 Block*
 Delegator::delegate_seeder(PeerChunks* peerChunks) {
   Block* target = NULL;
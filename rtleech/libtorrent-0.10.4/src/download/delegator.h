@@ -64,7 +64,7 @@ public:
 
   static const unsigned int block_size = 1 << 14;
 
-  Delegator() : m_aggressive(false) { }
+  Delegator() : m_aggressive(false), m_aggressiveRate(0) { }
 
   TransferList*       transfer_list()                     { return &m_transfers; }
   const TransferList* transfer_list() const               { return &m_transfers; }
@@ -74,6 +74,15 @@ public:
   bool               get_aggressive()                     { return m_aggressive; }
   void               set_aggressive(bool a)               { m_aggressive = a; }
 
+  // Peers downloading slower than this do not get to request
+  // duplicate blocks in aggressive mode.
+  uint32_t           get_aggressive_rate() const          { return m_aggressiveRate; }
+  void               set_aggressive_rate(uint32_t r)      { m_aggressiveRate = r; }
+
+  // Number of unfinished blocks in the transfer list that are not
+  // requested from any peer.
+  uint32_t           count_unrequested() const;
+
   void               slot_chunk_find(SlotChunkFind s)     { m_slotChunkFind = s; }
   void               slot_chunk_size(SlotChunkSize s)     { m_slotChunkSize = s; }
 
@@ -91,6 +100,7 @@ private:
   TransferList       m_transfers;
 
   bool               m_aggressive;
+  uint32_t           m_aggressiveRate;
 
   // Propably should add a m_slotChunkStart thing, which will take
   // care of enabling etc, and will be possible to listen to.
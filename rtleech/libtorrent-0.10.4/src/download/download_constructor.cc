@@ -76,7 +76,7 @@ struct download_constructor_encoding_match :
 };
 
 void
-DownloadConstructor::initialize(const Object& b) {
+DownloadConstructor::initialize(Object& b) {
   if (b.has_key_string("encoding"))
     m_defaultEncoding = b.get_key_string("encoding");
 
@@ -119,7 +119,7 @@ DownloadConstructor::parse_name(const Object& b) {
 }
 
 void
-DownloadConstructor::parse_info(const Object& b) {
+DownloadConstructor::parse_info(Object& b) {
   Content* c = m_download->main()->content();
 
   if (!c->entry_list()->empty())
@@ -144,8 +144,10 @@ DownloadConstructor::parse_info(const Object& b) {
 
   // Set chunksize before adding files to make sure the index range is
   // correct.
-  c->set_complete_hash(b.get_key_string("pieces"));
+  c->swap_complete_hash(b.get_key_string("pieces"));
   c->initialize(b.get_key_value("piece length"));
+
+  m_download->info()->set_private(b.has_key_value("private") && b.get_key_value("private") == 1);
 }
 
 void
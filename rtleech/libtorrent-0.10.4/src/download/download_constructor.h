@@ -58,7 +58,8 @@ public:
 
   DownloadConstructor() : m_download(NULL), m_encodingList(NULL) {}
 
-  void                initialize(const Object& b);
+  // The piece hashes are moved out of 'info:pieces'.
+  void                initialize(Object& b);
 
   void                set_download(DownloadWrapper* d)         { m_download = d; }
   void                set_encoding_list(const EncodingList* e) { m_encodingList = e; }
@@ -66,7 +67,7 @@ public:
 private:  
   void                parse_name(const Object& b);
   void                parse_tracker(const Object& b);
-  void                parse_info(const Object& b);
+  void                parse_info(Object& b);
 
   void                add_tracker_group(const Object& b);
   void                add_tracker_single(const Object& b, int group);
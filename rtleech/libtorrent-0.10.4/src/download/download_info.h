@@ -74,6 +74,7 @@ public:
     m_isActive(false),
     m_isCompact(true),
     m_isAcceptingNewPeers(true),
+    m_isPrivate(false),
 
     m_key(0),
     m_numwant(-1),
@@ -90,6 +91,11 @@ public:
   const std::string&  hash() const                                 { return m_hash; }
   void                set_hash(const std::string& hash)            { m_hash = hash; }
 
+  // HASH('req2', info hash), identifies the download in encrypted
+  // handshakes.
+  const std::string&  hash_obfuscated() const                      { return m_hashObfuscated; }
+  void                set_hash_obfuscated(const std::string& hash) { m_hashObfuscated = hash; }
+
   const std::string&  local_id() const                             { return m_localId; }
   void                set_local_id(const std::string& id)          { m_localId = id; }
 
@@ -104,6 +110,10 @@ public:
 
   bool                is_accepting_new_peers() const               { return m_isAcceptingNewPeers; }
   void                set_accepting_new_peers(bool s)              { m_isAcceptingNewPeers = s; }
+
+  // Private torrents must only get peers from the trackers.
+  bool                is_private() const                           { return m_isPrivate; }
+  void                set_private(bool s)                          { m_isPrivate = s; }
   
   uint32_t            key() const                                  { return m_key; }
   void                set_key(uint32_t key)                        { m_key = key; }
@@ -134,12 +144,14 @@ public:
 private:
   std::string         m_name;
   std::string         m_hash;
+  std::string         m_hashObfuscated;
   std::string         m_localId;
 
   bool                m_isOpen;
   bool                m_isActive;
   bool                m_isCompact;
   bool                m_isAcceptingNewPeers;
+  bool                m_isPrivate;
 
   uint32_t            m_key;
   int32_t             m_numwant;
@@ -36,14 +36,19 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cstring>
+#include <functional>
 #include <limits>
+#include <vector>
+#include <rak/socket_address.h>
 
 #include "data/chunk_list.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_connection_base.h"
 #include "tracker/tracker_manager.h"
 #include "torrent/exceptions.h"
+#include "torrent/peer_info.h"
 
 #include "available_list.h"
 #include "choke_manager.h"
@@ -66,7 +71,7 @@ DownloadMain::DownloadMain() :
   m_downloadThrottle(NULL) {
 
   m_connectionList = new ConnectionList(this);
-  m_chokeManager = new ChokeManager(m_connectionList);
+  m_chokeManager = new ChokeManager;
 
   m_delegator.slot_chunk_find(rak::make_mem_fun(m_chunkSelector, &ChunkSelector::find));
   m_delegator.slot_chunk_size(rak::make_mem_fun(&m_content, &Content::chunk_index_size));
@@ -143,7 +148,8 @@ void DownloadMain::start() {
   m_lastConnectedSize = 0;
 
   m_delegator.set_aggressive(false);
-  update_endgame();  
+  m_delegator.set_aggressive_rate(0);
+  update_endgame();
 
   receive_connect_peers();
 }  
@@ -164,10 +170,59 @@ DownloadMain::stop() {
   priority_queue_erase(&taskScheduler, &m_taskTrackerRequest);
 }
 
+// Endgame starts once every remaining block has been requested from
+// some peer, rather than at a fixed number of chunks left. The
+// duplicate requests are then limited to the fastest peers.
 void
 DownloadMain::update_endgame() {
-  if (!m_delegator.get_aggressive() && m_content.chunks_completed() + m_delegator.transfer_list()->size() + 5 >= m_content.chunk_total())
+  if (!m_delegator.get_aggressive()) {
+    if (m_content.chunks_completed() + m_delegator.transfer_list()->size() < m_content.chunk_total() ||
+        m_delegator.count_unrequested() != 0)
+      return;
+
     m_delegator.set_aggressive(true);
+  }
+
+  std::vector<uint32_t> rates;
+  rates.reserve(connection_list()->size());
+
+  for (ConnectionList::iterator itr = connection_list()->begin(), last = connection_list()->end(); itr != last; ++itr)
+    if (!(*itr)->is_down_choked())
+      rates.push_back((*itr)->peer_chunks()->download_throttle()->rate()->rate());
+
+  if (rates.size() <= endgame_peers) {
+    m_delegator.set_aggressive_rate(0);
+    return;
+  }
+
+  std::nth_element(rates.begin(), rates.begin() + endgame_peers - 1, rates.end(), std::greater<uint32_t>());
+  m_delegator.set_aggressive_rate(rates[endgame_peers - 1]);
+}
+
+// Send the connected peers with a known listening port to all peers
+// supporting ut_pex, each connection only sends the difference from
+// what it sent the last time.
+void
+DownloadMain::update_pex() {
+  if (info()->is_private())
+    return;
+
+  ProtocolExtension::PexList current;
+  current.reserve(connection_list()->size());
+
+  for (ConnectionList::iterator itr = connection_list()->begin(), last = connection_list()->end(); itr != last; ++itr) {
+    const PeerInfo* peerInfo = (*itr)->c_peer_info();
+    const rak::socket_address* sa = rak::socket_address::cast_from(peerInfo->socket_address());
+
+    if (peerInfo->listen_port() == 0 || sa->family() != rak::socket_address::af_inet)
+      continue;
+
+    current.push_back(SocketAddressCompact(sa->sa_inet()->address_n(), htons(peerInfo->listen_port())));
+  }
+
+  std::sort(current.begin(), current.end(), socket_address_compact_less());
+
+  std::for_each(connection_list()->begin(), connection_list()->end(), std::bind2nd(std::mem_fun(&PeerConnectionBase::send_pex), &current));
 }
 
 void
@@ -200,19 +255,62 @@ DownloadMain::receive_connect_peers() {
   AvailableList::AddressList* alist = peer_list()->available_list()->buffer();
 
   if (!alist->empty()) {
-    alist->sort();
     peer_list()->available_list()->insert(alist);
     alist->clear();
   }
 
-  while (!peer_list()->available_list()->empty() &&
-         connection_list()->size() < connection_list()->get_min_size() &&
-         connection_list()->size() + m_slotCountHandshakes(this) < connection_list()->get_max_size()) {
-    rak::socket_address sa = peer_list()->available_list()->pop_random();
+  if (is_connect_wanted())
+    m_slotQueueConnect(this);
+}
+
+bool
+DownloadMain::is_connect_wanted() {
+  return
+    info()->is_active() &&
+    !peer_list()->available_list()->empty() &&
+    connection_list()->size() < connection_list()->get_min_size() &&
+    connection_list()->size() + m_slotCountHandshakes(this) < connection_list()->get_max_size();
+}
+
+// Connected peers per 1024 of the target, used to let the downloads
+// furthest below their target connect first.
+uint32_t
+DownloadMain::connect_fill() {
+  return connection_list()->size() * 1024 / std::max<uint32_t>(connection_list()->get_min_size(), 1);
+}
 
-    if (connection_list()->find(sa) == connection_list()->end())
-      m_slotStartHandshake(sa, this);
+// Seconds to wait before retrying a host after 'failed' consecutive
+// failed connection attempts.
+inline uint32_t
+connect_backoff(uint32_t failed) {
+  return failed == 0 ? 0 : 30 << std::min<uint32_t>(failed - 1, 7);
+}
+
+// Addresses still backing off are moved to the buffer so they get
+// re-added on the next call to receive_connect_peers().
+bool
+DownloadMain::connect_one() {
+  AvailableList* available = peer_list()->available_list();
+
+  for (int tries = 0; tries < 16 && !available->empty(); ++tries) {
+    rak::socket_address sa = available->pop_random();
+    PeerInfo* peerInfo = peer_list()->find(sa.c_sockaddr());
+
+    // Connected and handshaking hosts are flagged in the PeerList, so
+    // there's no need to scan the connection list.
+    if (peerInfo != NULL && peerInfo->is_connected())
+      continue;
+
+    if (peerInfo != NULL && peerInfo->last_connection() + connect_backoff(peerInfo->failed_connects()) > cachedTime.seconds()) {
+      available->buffer()->push_back(sa);
+      continue;
+    }
+
+    m_slotStartHandshake(sa, this);
+    return true;
   }
+
+  return false;
 }
 
 void
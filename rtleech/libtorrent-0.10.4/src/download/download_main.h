@@ -56,6 +56,7 @@ class ChunkSelector;
 class ChunkStatistics;
 
 class ChokeManager;
+class ConnectScheduler;
 class DownloadWrapper;
 class HandshakeManager;
 class TrackerManager;
@@ -64,6 +65,10 @@ class ThrottleList;
 
 class DownloadMain {
 public:
+  // Number of the fastest peers allowed to request duplicate blocks
+  // in endgame mode.
+  static const uint32_t endgame_peers = 4;
+
   DownloadMain();
   ~DownloadMain();
 
@@ -105,13 +110,22 @@ public:
 
   typedef rak::mem_fun2<HandshakeManager, void, const rak::socket_address&, DownloadMain*> slot_start_handshake_type;
   typedef rak::mem_fun1<HandshakeManager, void, DownloadMain*>                             slot_stop_handshakes_type;
+  typedef rak::mem_fun1<ConnectScheduler, void, DownloadMain*>                             slot_queue_connect_type;
 
   void                slot_start_handshake(slot_start_handshake_type s) { m_slotStartHandshake = s; }
   void                slot_stop_handshakes(slot_stop_handshakes_type s) { m_slotStopHandshakes = s; }
+  void                slot_queue_connect(slot_queue_connect_type s)     { m_slotQueueConnect = s; }
   void                slot_count_handshakes(SlotCountHandshakes s) { m_slotCountHandshakes = s; }
   void                slot_hash_check_add(SlotHashCheckAdd s)      { m_slotHashCheckAdd = s; }
 
+  // Queues the download with the ConnectScheduler, which calls
+  // connect_one() while is_connect_wanted().
   void                receive_connect_peers();
+
+  bool                is_connect_wanted();
+  uint32_t            connect_fill();
+  bool                connect_one();
+
   void                receive_chunk_done(unsigned int index);
   void                receive_corrupt_chunk(PeerInfo* peerInfo);
 
@@ -119,6 +133,7 @@ public:
   void                receive_tracker_request();
 
   void                update_endgame();
+  void                update_pex();
 
 private:
   // Disable copy ctor and assignment.
@@ -150,6 +165,7 @@ private:
 
   slot_start_handshake_type m_slotStartHandshake;
   slot_stop_handshakes_type m_slotStopHandshakes;
+  slot_queue_connect_type   m_slotQueueConnect;
 
   SlotCountHandshakes m_slotCountHandshakes;
   SlotHashCheckAdd    m_slotHashCheckAdd;
@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <rak/functional.h>
 
 #include "torrent/exceptions.h"
@@ -45,27 +46,87 @@
 
 namespace torrent {
 
+// The hashes are SHA1 digests, so the first bytes are already
+// uniformly distributed.
+inline static uint32_t
+download_manager_hash(const std::string& hash) {
+  uint32_t h = 0;
+
+  for (std::string::const_iterator itr = hash.begin(), last = hash.begin() + std::min<std::string::size_type>(hash.size(), 4); itr != last; ++itr)
+    h = (h << 8) + (unsigned char)*itr;
+
+  return h;
+}
+
+uint32_t
+DownloadManager::hash_traits::hash(const std::string& hash) {
+  return download_manager_hash(hash);
+}
+
+uint32_t
+DownloadManager::hash_traits::hash(const iterator& itr) {
+  return download_manager_hash((*itr)->info()->hash());
+}
+
+bool
+DownloadManager::hash_traits::equal(const iterator& itr, const std::string& hash) {
+  return (*itr)->info()->hash() == hash;
+}
+
+uint32_t
+DownloadManager::obfuscated_traits::hash(const std::string& hash) {
+  return download_manager_hash(hash);
+}
+
+uint32_t
+DownloadManager::obfuscated_traits::hash(const iterator& itr) {
+  return download_manager_hash((*itr)->info()->hash_obfuscated());
+}
+
+bool
+DownloadManager::obfuscated_traits::equal(const iterator& itr, const std::string& hash) {
+  return (*itr)->info()->hash_obfuscated() == hash;
+}
+
 DownloadManager::iterator
 DownloadManager::insert(DownloadWrapper* d) {
   if (find(d->info()->hash()) != end())
     throw client_error("Could not add torrent as it already exists.");
 
-  return base_type::insert(end(), d);
+  iterator itr = base_type::insert(end(), d);
+
+  m_indexList.push_back(itr);
+  m_hashIndex.insert_back();
+  m_obfuscatedIndex.insert_back();
+
+  return itr;
 }
 
 DownloadManager::iterator
 DownloadManager::erase(DownloadWrapper* d) {
-  iterator itr = std::find(begin(), end(), d);
+  hash_index_type::size_type pos = m_hashIndex.find(d->info()->hash());
 
-  if (itr == end())
+  if (pos == hash_index_type::npos || *m_indexList[pos] != d)
     throw client_error("Tried to remove a torrent that doesn't exist");
-    
+
+  iterator itr = m_indexList[pos];
+
+  m_hashIndex.erase_position(pos);
+  m_obfuscatedIndex.erase_position(pos);
+
+  m_indexList[pos] = m_indexList.back();
+  m_indexList.pop_back();
+
   delete *itr;
   return base_type::erase(itr);
 }
 
 void
 DownloadManager::clear() {
+  m_indexList.clear();
+  m_hashIndex.clear();
+  m_obfuscatedIndex.clear();
+
   while (!empty()) {
     delete base_type::front();
     base_type::pop_front();
@@ -74,7 +135,9 @@ DownloadManager::clear() {
 
 DownloadManager::iterator
 DownloadManager::find(const std::string& hash) {
-  return std::find_if(begin(), end(), rak::equal(hash, rak::on(std::mem_fun(&DownloadWrapper::info), std::mem_fun(&DownloadInfo::hash))));
+  hash_index_type::size_type pos = m_hashIndex.find(hash);
+
+  return pos != hash_index_type::npos ? m_indexList[pos] : end();
 }
 
 DownloadManager::iterator
@@ -84,13 +147,23 @@ DownloadManager::find(DownloadInfo* info) {
 
 DownloadMain*
 DownloadManager::find_main(const std::string& hash) {
-  iterator itr = std::find_if(begin(), end(), rak::equal(hash, rak::on(std::mem_fun(&DownloadWrapper::info), std::mem_fun(&DownloadInfo::hash))));
+  hash_index_type::size_type pos = m_hashIndex.find(hash);
 
   // TODO: Move these checks somewhere else.
-  if (itr == end() || !(*itr)->info()->is_active())
+  if (pos == hash_index_type::npos || !(*m_indexList[pos])->info()->is_active())
+    return NULL;
+  else
+    return (*m_indexList[pos])->main();
+}
+
+DownloadMain*
+DownloadManager::find_main_obfuscated(const std::string& hash) {
+  obfuscated_index_type::size_type pos = m_obfuscatedIndex.find(hash);
+
+  if (pos == obfuscated_index_type::npos || !(*m_indexList[pos])->info()->is_active())
     return NULL;
   else
-    return (*itr)->main();
+    return (*m_indexList[pos])->main();
 }
 
 }
@@ -38,6 +38,10 @@
 #define LIBTORRENT_DOWNLOAD_MANAGER_H
 
 #include <list>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include <rak/hash_index.h>
 
 namespace torrent {
 
@@ -69,6 +73,7 @@ public:
   using base_type::rbegin;
   using base_type::rend;
 
+  DownloadManager() : m_hashIndex(&m_indexList), m_obfuscatedIndex(&m_indexList) {}
   ~DownloadManager() { clear(); }
 
   iterator            insert(DownloadWrapper* d);
@@ -79,6 +84,31 @@ public:
   iterator            find(const std::string& hash);
   iterator            find(DownloadInfo* info);
   DownloadMain*       find_main(const std::string& hash);
+  DownloadMain*       find_main_obfuscated(const std::string& hash);
+
+private:
+  struct hash_traits {
+    static uint32_t     hash(const std::string& hash);
+    static uint32_t     hash(const iterator& itr);
+    static bool         equal(const iterator& itr, const std::string& hash);
+  };
+
+  struct obfuscated_traits {
+    static uint32_t     hash(const std::string& hash);
+    static uint32_t     hash(const iterator& itr);
+    static bool         equal(const iterator& itr, const std::string& hash);
+  };
+
+  typedef std::vector<iterator>                          index_list;
+  typedef rak::hash_index<index_list, hash_traits>       hash_index_type;
+  typedef rak::hash_index<index_list, obfuscated_traits> obfuscated_index_type;
+
+  // Incoming handshakes look up the download by hash, so keep the
+  // lookups independent of the number of downloads. Both indexes
+  // hold positions into 'm_indexList'.
+  index_list            m_indexList;
+  hash_index_type       m_hashIndex;
+  obfuscated_index_type m_obfuscatedIndex;
 };
 
 }
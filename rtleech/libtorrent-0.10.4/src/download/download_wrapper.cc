@@ -47,6 +47,7 @@
 #include "data/hash_torrent.h"
 #include "data/file_manager.h"
 #include "data/file_meta.h"
+#include "protocol/handshake_encryption.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_connection_base.h"
 #include "torrent/exceptions.h"
@@ -89,7 +90,11 @@ void
 DownloadWrapper::initialize(const std::string& hash, const std::string& id) {
   m_main.slot_hash_check_add(rak::make_mem_fun(this, &DownloadWrapper::check_chunk_hash));
 
+  char obfuscated[HandshakeEncryption::hash_size];
+  HandshakeEncryption::hash_obfuscated(hash, obfuscated);
+
   info()->set_hash(hash);
+  info()->set_hash_obfuscated(std::string(obfuscated, HandshakeEncryption::hash_size));
   info()->set_local_id(id);
 
   info()->slot_completed() = rak::make_mem_fun(m_main.content(), &Content::bytes_completed);
@@ -298,6 +303,13 @@ DownloadWrapper::receive_tick(uint32_t ticks) {
         itr++;
   }
 
+  if (info()->is_active())
+    m_main.update_endgame();
+
+  // BEP-11 asks for at most one ut_pex message a minute.
+  if (ticks % 2 == 0)
+    m_main.update_pex();
+
   m_main.receive_connect_peers();
 }
 
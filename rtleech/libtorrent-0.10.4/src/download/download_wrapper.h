@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_DOWNLOAD_WRAPPER_H
 #define LIBTORRENT_DOWNLOAD_WRAPPER_H
 
+#include <vector>
 #include <rak/socket_address.h>
 #include <sigc++/connection.h>
 #include <sigc++/signal.h>
@@ -60,7 +61,7 @@ class Object;
 
 class DownloadWrapper {
 public:
-  typedef std::list<rak::socket_address>          AddressList;
+  typedef std::vector<rak::socket_address>        AddressList;
 
   typedef sigc::signal0<void>                     Signal;
   typedef sigc::signal1<void, uint32_t>           SignalChunk;
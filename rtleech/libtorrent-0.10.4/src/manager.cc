@@ -44,10 +44,15 @@
 #include "download/download_main.h"
 #include "data/file_manager.h"
 #include "data/hash_torrent.h"
+#include "protocol/connect_scheduler.h"
 #include "protocol/handshake_manager.h"
 #include "data/hash_queue.h"
 #include "net/throttle_manager.h"
 #include "net/listen.h"
+#include "net/utp_manager.h"
+#include "tracker/dht_router.h"
+#include "tracker/scrape_manager.h"
+#include "tracker/tracker_udp_client.h"
 
 #include "torrent/chunk_manager.h"
 #include "torrent/connection_manager.h"
@@ -68,6 +73,11 @@ Manager::Manager() :
 
   m_chunkManager(new ChunkManager),
   m_connectionManager(new ConnectionManager),
+  m_connectScheduler(new ConnectScheduler(m_handshakeManager)),
+  m_trackerUdpClient(new TrackerUdpClient),
+  m_scrapeManager(new ScrapeManager),
+  m_dhtRouter(new DhtRouter),
+  m_utpManager(new UtpManager),
 
   m_poll(NULL),
 
@@ -81,12 +91,17 @@ Manager::Manager() :
   priority_queue_insert(&taskScheduler, &m_taskTick, cachedTime.round_seconds());
 
   m_handshakeManager->slot_download_id(rak::make_mem_fun(m_downloadManager, &DownloadManager::find_main));
+  m_handshakeManager->slot_download_obfuscated(rak::make_mem_fun(m_downloadManager, &DownloadManager::find_main_obfuscated));
   m_connectionManager->listen()->slot_incoming(rak::make_mem_fun(m_handshakeManager, &HandshakeManager::add_incoming));
+  m_utpManager->slot_incoming(rak::make_mem_fun(m_handshakeManager, &HandshakeManager::add_incoming_utp));
 }
 
 Manager::~Manager() {
   priority_queue_erase(&taskScheduler, &m_taskTick);
 
+  m_dhtRouter->stop();
+  m_utpManager->close();
+
   m_handshakeManager->clear();
   m_downloadManager->clear();
 
@@ -96,7 +111,12 @@ Manager::~Manager() {
   delete m_hashQueue;
 
   delete m_resourceManager;
+  delete m_scrapeManager;
+  delete m_dhtRouter;
+  delete m_utpManager;
+  delete m_trackerUdpClient;
   delete m_connectionManager;
+  delete m_connectScheduler;
   delete m_chunkManager;
 
   delete m_uploadThrottle;
@@ -108,6 +128,7 @@ Manager::initialize_download(DownloadWrapper* d) {
   d->main()->slot_count_handshakes(rak::make_mem_fun(m_handshakeManager, &HandshakeManager::size_info));
   d->main()->slot_start_handshake(rak::make_mem_fun(m_handshakeManager, &HandshakeManager::add_outgoing));
   d->main()->slot_stop_handshakes(rak::make_mem_fun(m_handshakeManager, &HandshakeManager::erase_download));
+  d->main()->slot_queue_connect(rak::make_mem_fun(m_connectScheduler, &ConnectScheduler::insert));
 
   d->hash_checker()->set_queue(m_hashQueue);
 
@@ -133,6 +154,7 @@ Manager::cleanup_download(DownloadWrapper* d) {
 
   m_resourceManager->erase(d->main());
   m_chunkManager->erase(d->main()->chunk_list());
+  m_connectScheduler->erase(d->main());
 
   m_downloadManager->erase(d);
 }
@@ -143,6 +165,7 @@ Manager::receive_tick() {
 
   m_resourceManager->receive_tick();
   m_chunkManager->periodic_sync();
+  m_scrapeManager->receive_tick();
 
   std::for_each(m_downloadManager->begin(), m_downloadManager->end(), std::bind2nd(std::mem_fun(&DownloadWrapper::receive_tick), m_ticks));
 
@@ -56,8 +56,13 @@ class FileManager;
 class ResourceManager;
 class PeerInfo;
 class ChunkManager;
+class ConnectScheduler;
 class ConnectionManager;
 class ThrottleManager;
+class ScrapeManager;
+class DhtRouter;
+class TrackerUdpClient;
+class UtpManager;
 
 typedef std::list<std::string> EncodingList;
 
@@ -74,6 +79,11 @@ public:
 
   ChunkManager*       chunk_manager()                           { return m_chunkManager; }
   ConnectionManager*  connection_manager()                      { return m_connectionManager; }
+  ConnectScheduler*   connect_scheduler()                       { return m_connectScheduler; }
+  TrackerUdpClient*   tracker_udp_client()                      { return m_trackerUdpClient; }
+  ScrapeManager*      scrape_manager()                          { return m_scrapeManager; }
+  DhtRouter*          dht_router()                              { return m_dhtRouter; }
+  UtpManager*         utp_manager()                             { return m_utpManager; }
   
   Poll*               poll()                                    { return m_poll; }
   void                set_poll(Poll* p)                         { m_poll = p; }
@@ -97,6 +107,11 @@ private:
 
   ChunkManager*       m_chunkManager;
   ConnectionManager*  m_connectionManager;
+  ConnectScheduler*   m_connectScheduler;
+  TrackerUdpClient*   m_trackerUdpClient;
+  ScrapeManager*      m_scrapeManager;
+  DhtRouter*          m_dhtRouter;
+  UtpManager*         m_utpManager;
   Poll*               m_poll;
 
   EncodingList        m_encodingList;
@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include <cstring>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -51,6 +52,31 @@
 
 namespace torrent {
 
+#ifdef RAK_USE_INET6
+// Peers connecting over inet to a dual-stack socket show up as
+// ::ffff:a.b.c.d, convert them so filters and the peer list only see
+// the inet address.
+static void
+listen_unmap_address(rak::socket_address* sa) {
+  if (sa->family() != rak::socket_address::af_inet6)
+    return;
+
+  const uint8_t* bytes = sa->sa_inet6()->address_bytes();
+  static const uint8_t mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+  if (std::memcmp(bytes, mapped_prefix, 12) != 0)
+    return;
+
+  uint16_t port = sa->sa_inet6()->port_n();
+  uint32_t addr;
+  std::memcpy(&addr, bytes + 12, sizeof(uint32_t));
+
+  sa->sa_inet()->clear();
+  sa->sa_inet()->set_port_n(port);
+  sa->sa_inet()->set_address_n(addr);
+}
+#endif
+
 bool
 Listen::open(uint16_t first, uint16_t last, const rak::socket_address* bindAddress) {
   close();
@@ -62,70 +88,127 @@ Listen::open(uint16_t first, uint16_t last, const rak::socket_address* bindAddre
       bindAddress->family() != rak::socket_address::af_inet6)
     throw input_error("Listening socket must be bound to an inet or inet6 address.");
 
-  if (!get_fd().open_stream() || !get_fd().set_nonblock())
-    throw local_error("Could not allocate socket for listening.");
-
-  if (!get_fd().set_reuse_address(true))
-    throw local_error("Could not set listening port to reuse address.");
-
   rak::socket_address sa;
   sa.copy(*bindAddress, bindAddress->length());
 
+#ifdef RAK_USE_INET6
+  if (manager->connection_manager()->listen_inet6() &&
+      sa.family() == rak::socket_address::af_inet && sa.is_address_any())
+    sa.sa_inet6()->clear();
+#endif
+
   for (uint16_t i = first; i <= last; ++i) {
     sa.set_port(i);
 
-    if (get_fd().bind(sa) && get_fd().listen(50)) {
+    if (open_port(sa)) {
       m_port = i;
+      return true;
+    }
+  }
+
+  return false;
+}
 
-      manager->connection_manager()->inc_socket_count();
+// Returns false if the port is taken, the sockets opened so far are
+// closed again. Failure to allocate or configure a socket is not
+// related to the port and throws.
+bool
+Listen::open_port(const rak::socket_address& sa) {
+  ConnectionManager* cm = manager->connection_manager();
+  uint32_t count = cm->listen_sockets();
 
-      manager->poll()->open(this);
-      manager->poll()->insert_read(this);
-      manager->poll()->insert_error(this);
+  while (size() < count) {
+    ListenSocket* s = new ListenSocket(this);
+    SocketFd& fd = s->get_fd();
 
-      return true;
+    bool opened = sa.family() == rak::socket_address::af_inet ? fd.open_stream() : fd.open_stream_inet6();
+
+    if (!opened || !fd.set_nonblock()) {
+      if (fd.is_valid()) {
+        fd.close();
+        fd.clear();
+      }
+
+      delete s;
+      close();
+      throw local_error("Could not allocate socket for listening.");
     }
-  }
 
-  // This needs to be done if local_error is thrown too...
-  get_fd().close();
-  get_fd().clear();
+    if (!fd.set_reuse_address(true) ||
+        (count > 1 && !fd.set_reuse_port(true)) ||
+        (sa.family() == rak::socket_address::af_inet6 && !fd.set_ipv6_only(false))) {
+      fd.close();
+      fd.clear();
+      delete s;
+      close();
+      throw local_error("Could not set socket options on listening port.");
+    }
 
-  return false;
+    if (!fd.bind(sa) || !fd.listen(cm->listen_backlog())) {
+      fd.close();
+      fd.clear();
+      delete s;
+      close();
+      return false;
+    }
+
+    cm->inc_socket_count();
+    push_back(s);
+
+    manager->poll()->open(s);
+    manager->poll()->insert_read(s);
+    manager->poll()->insert_error(s);
+  }
+
+  return true;
 }
 
-void Listen::close() {
-  if (!get_fd().is_valid())
-    return;
+void
+Listen::close() {
+  for (iterator itr = begin(), last = end(); itr != last; ++itr) {
+    manager->poll()->remove_read(*itr);
+    manager->poll()->remove_error(*itr);
+    manager->poll()->close(*itr);
+
+    manager->connection_manager()->dec_socket_count();
 
-  manager->poll()->remove_read(this);
-  manager->poll()->remove_error(this);
-  manager->poll()->close(this);
+    (*itr)->get_fd().close();
+    (*itr)->get_fd().clear();
 
-  manager->connection_manager()->dec_socket_count();
+    delete *itr;
+  }
 
-  get_fd().close();
-  get_fd().clear();
-  
+  base_type::clear();
   m_port = 0;
 }
-  
+
+// The accepted sockets are already non-blocking, see SocketFd::accept.
 void
-Listen::event_read() {
+Listen::receive_accept(ListenSocket* s) {
   rak::socket_address sa;
   SocketFd fd;
 
-  while ((fd = get_fd().accept(&sa)).is_valid())
+  while ((fd = s->get_fd().accept(&sa)).is_valid()) {
+#ifdef RAK_USE_INET6
+    listen_unmap_address(&sa);
+#endif
+
     m_slotIncoming(fd, sa);
+  }
+}
+
+void
+ListenSocket::event_read() {
+  m_listen->receive_accept(this);
 }
 
 void
-Listen::event_write() {
+ListenSocket::event_write() {
   throw internal_error("Listener does not support write().");
 }
 
 void
-Listen::event_error() {
+ListenSocket::event_error() {
   throw local_error("Listener port received an error event.");
 }
 
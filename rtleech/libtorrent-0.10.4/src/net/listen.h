@@ -38,6 +38,7 @@
 #define LIBTORRENT_LISTEN_H
 
 #include <inttypes.h>
+#include <vector>
 #include <rak/functional.h>
 
 #include <rak/socket_address.h>
@@ -47,28 +48,54 @@
 namespace torrent {
 
 class HandshakeManager;
+class Listen;
 
-class Listen : public SocketBase {
+class ListenSocket : public SocketBase {
 public:
+  ListenSocket(Listen* l) : m_listen(l) {}
+
+  virtual void        event_read();
+  virtual void        event_write();
+  virtual void        event_error();
+
+private:
+  Listen*             m_listen;
+};
+
+// Holds one or more sockets listening on the same port. With
+// 'listen_sockets' above one they are opened with SO_REUSEPORT so the
+// kernel spreads incoming connections across their accept queues,
+// and with 'listen_inet6' a dual-stack inet6 socket takes inet
+// connections as v4-mapped addresses.
+
+class Listen : private std::vector<ListenSocket*> {
+public:
+  typedef std::vector<ListenSocket*> base_type;
   typedef rak::mem_fun2<HandshakeManager, void, SocketFd, const rak::socket_address&> SlotIncoming;
 
+  using base_type::size;
+
   Listen() : m_port(0) {}
   ~Listen() { close(); }
 
   bool                open(uint16_t first, uint16_t last, const rak::socket_address* bindAddress);
   void                close();
 
-  bool                is_open()                            { return get_fd().is_valid(); }
+  bool                is_open() const                      { return !empty(); }
 
   uint16_t            port() const                         { return m_port; }
 
   void                slot_incoming(const SlotIncoming& s) { m_slotIncoming = s; }
 
-  virtual void        event_read();
-  virtual void        event_write();
-  virtual void        event_error();
+  // Drains the accept queue of the socket.
+  void                receive_accept(ListenSocket* s);
 
 private:
+  Listen(const Listen&);
+  void operator = (const Listen&);
+
+  bool                open_port(const rak::socket_address& sa);
+
   uint64_t            m_port;
   SlotIncoming        m_slotIncoming;
 };
@@ -37,6 +37,7 @@
 #ifndef LIBTORRENT_NET_PROTOCOL_BUFFER_H
 #define LIBTORRENT_NET_PROTOCOL_BUFFER_H
 
+#include <cstring>
 #include <inttypes.h>
 #include <netinet/in.h>
 
@@ -62,6 +63,10 @@ public:
   void                set_end(size_type v)          { m_end = m_buffer + v; }
   void                move_end(difference_type v)   { m_end += v; }
 
+  // Move the data between position and end to the beginning of the
+  // buffer.
+  void                move_unused();
+
   uint8_t             read_8()                      { return *m_position++; }
   uint8_t             peek_8()                      { return *m_position; }
   uint16_t            read_16();
@@ -116,6 +121,17 @@ private:
   value_type          m_buffer[tmpl_size];
 };
 
+template <uint16_t tmpl_size>
+inline void
+ProtocolBuffer<tmpl_size>::move_unused() {
+  size_type r = remaining();
+
+  std::memmove(m_buffer, m_position, r);
+
+  reset_position();
+  set_end(r);
+}
+
 template <uint16_t tmpl_size>
 inline uint16_t
 ProtocolBuffer<tmpl_size>::read_16() {
@@ -81,6 +81,32 @@ SocketFd::set_reuse_address(bool state) {
   return setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == 0;
 }
 
+bool
+SocketFd::set_reuse_port(bool state) {
+  check_valid();
+
+#ifdef SO_REUSEPORT
+  int opt = state;
+
+  return setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == 0;
+#else
+  return !state;
+#endif
+}
+
+bool
+SocketFd::set_ipv6_only(bool state) {
+  check_valid();
+
+#ifdef RAK_USE_INET6
+  int opt = state;
+
+  return setsockopt(m_fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt)) == 0;
+#else
+  return false;
+#endif
+}
+
 bool
 SocketFd::set_send_buffer_size(uint32_t s) {
   check_valid();
@@ -115,11 +141,33 @@ SocketFd::open_stream() {
   return (m_fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) != -1;
 }
 
+bool
+SocketFd::open_stream_inet6() {
+#ifdef RAK_USE_INET6
+  return (m_fd = socket(PF_INET6, SOCK_STREAM, IPPROTO_TCP)) != -1;
+#else
+  return false;
+#endif
+}
+
 bool
 SocketFd::open_datagram() {
   return (m_fd = socket(PF_INET, SOCK_DGRAM, 0)) != -1;
 }
 
+bool
+SocketFd::open_socket_pair(SocketFd& fd1, SocketFd& fd2) {
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+    return false;
+
+  fd1.set_fd(fds[0]);
+  fd2.set_fd(fds[1]);
+
+  return true;
+}
+
 void
 SocketFd::close() {
   if (::close(m_fd) && errno == EBADF)
@@ -152,7 +200,22 @@ SocketFd::accept(rak::socket_address* sa) {
   check_valid();
   socklen_t len = sizeof(rak::socket_address);
 
-  return SocketFd(::accept(m_fd, sa != NULL ? sa->c_sockaddr() : NULL, &len));
+#if defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+  int fd = ::accept4(m_fd, sa != NULL ? sa->c_sockaddr() : NULL, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  // Headers may define the flags for a kernel without accept4.
+  if (fd != -1 || errno != ENOSYS)
+    return SocketFd(fd);
+#endif
+
+  SocketFd fd2(::accept(m_fd, sa != NULL ? sa->c_sockaddr() : NULL, &len));
+
+  if (fd2.is_valid() && (!fd2.set_nonblock() || fcntl(fd2.get_fd(), F_SETFD, FD_CLOEXEC) == -1)) {
+    fd2.close();
+    return SocketFd();
+  }
+
+  return fd2;
 }
 
 // unsigned int
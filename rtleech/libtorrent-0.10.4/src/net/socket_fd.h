@@ -59,6 +59,11 @@ public:
 
   bool                set_nonblock();
   bool                set_reuse_address(bool state);
+  bool                set_reuse_port(bool state);
+
+  // Let an inet6 socket accept inet connections as v4-mapped
+  // addresses.
+  bool                set_ipv6_only(bool state);
 
   bool                set_priority(priority_type p);
 
@@ -68,15 +73,21 @@ public:
   int                 get_error() const;
 
   bool                open_stream();
+  bool                open_stream_inet6();
   bool                open_datagram();
   void                close();
 
+  // A connected pair of local stream sockets.
+  static bool         open_socket_pair(SocketFd& fd1, SocketFd& fd2);
+
   void                clear()                                 { m_fd = -1; }
 
   bool                bind(const rak::socket_address& sa);
   bool                connect(const rak::socket_address& sa);
 
   bool                listen(int size);
+
+  // The accepted socket is non-blocking and closed on exec.
   SocketFd            accept(rak::socket_address* sa);
 
 //   unsigned int        get_read_queue_size() const;
@@ -0,0 +1,333 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <cstdlib>
+#include <rak/functional.h>
+
+#include "torrent/connection_manager.h"
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+
+#include "utp_manager.h"
+
+#include "globals.h"
+#include "manager.h"
+
+namespace torrent {
+
+UtpManager::UtpManager() :
+  m_port(0),
+  m_outgoing(false),
+  m_targetDelay(100000),
+
+  m_simulatedDelay(0),
+  m_simulatedLoss(0) {
+
+  m_taskTick.set_slot(rak::mem_fn(this, &UtpManager::receive_tick));
+  m_taskDelayed.set_slot(rak::mem_fn(this, &UtpManager::receive_delayed));
+}
+
+UtpManager::~UtpManager() {
+  close();
+}
+
+bool
+UtpManager::open(uint16_t port, const rak::socket_address* bindAddress) {
+  if (is_open())
+    throw internal_error("UtpManager::open(...) called on an open socket.");
+
+  rak::socket_address sa = *bindAddress;
+  sa.set_port(port);
+
+  if (!get_fd().open_datagram() ||
+      !get_fd().set_nonblock() ||
+      !get_fd().bind(sa)) {
+
+    if (get_fd().is_valid())
+      get_fd().close();
+
+    get_fd().clear();
+    return false;
+  }
+
+  m_port = port;
+
+  manager->poll()->open(this);
+  manager->poll()->insert_read(this);
+  manager->poll()->insert_error(this);
+
+  return true;
+}
+
+void
+UtpManager::close() {
+  if (!is_open())
+    return;
+
+  // The sockets are only moved to 'm_closed' by UtpSocket::close().
+  for (SocketMap::iterator itr = m_sockets.begin(); itr != m_sockets.end(); ++itr)
+    itr->second->close();
+
+  cleanup();
+
+  m_acks.clear();
+  m_delayed.clear();
+
+  priority_queue_erase(&taskScheduler, &m_taskTick);
+  priority_queue_erase(&taskScheduler, &m_taskDelayed);
+
+  manager->poll()->remove_read(this);
+  manager->poll()->remove_error(this);
+  manager->poll()->close(this);
+
+  get_fd().close();
+  get_fd().clear();
+}
+
+void
+UtpManager::set_simulated(uint32_t delay, uint32_t loss) {
+  if (loss > 1000)
+    throw input_error("Simulated uTP loss must be at most 1000 per thousand.");
+
+  m_simulatedDelay = delay;
+  m_simulatedLoss = loss;
+}
+
+bool
+UtpManager::connect(const rak::socket_address& sa, SocketFd* fd) {
+  if (!is_open() || m_sockets.size() >= max_sockets)
+    return false;
+
+  // The peer answers on 'id' and we send on 'id + 1'.
+  uint16_t id = random();
+
+  while (m_sockets.find(SocketKey(sa, id)) != m_sockets.end())
+    id++;
+
+  UtpSocket* s = insert(sa, id, id + 1, fd);
+
+  if (s == NULL)
+    return false;
+
+  s->connect();
+  return true;
+}
+
+UtpSocket*
+UtpManager::insert(const rak::socket_address& sa, uint16_t receiveId, uint16_t sendId, SocketFd* fd) {
+  UtpSocket* s = new UtpSocket(this, sa, receiveId, sendId);
+
+  if (!s->open(fd)) {
+    delete s;
+    return NULL;
+  }
+
+  m_sockets[SocketKey(sa, receiveId)] = s;
+
+  if (!m_taskTick.is_queued())
+    priority_queue_insert(&taskScheduler, &m_taskTick, cachedTime + rak::timer::from_milliseconds(tick_interval));
+
+  return s;
+}
+
+void
+UtpManager::receive_closed(UtpSocket* s) {
+  m_closed.push_back(s);
+}
+
+void
+UtpManager::cleanup() {
+  for (SocketList::iterator itr = m_closed.begin(); itr != m_closed.end(); ++itr) {
+    m_sockets.erase(SocketKey((*itr)->address(), (*itr)->receive_id()));
+    delete *itr;
+  }
+
+  m_closed.clear();
+}
+
+void
+UtpManager::send(const rak::socket_address& sa, const char* buffer, uint32_t length) {
+  if (m_simulatedLoss != 0 && (uint32_t)random() % 1000 < m_simulatedLoss)
+    return;
+
+  if (m_simulatedDelay == 0)
+    return write_packet(sa, buffer, length);
+
+  m_delayed.push_back(Delayed());
+  m_delayed.back().m_time = cachedTime + rak::timer::from_milliseconds(m_simulatedDelay);
+  m_delayed.back().m_address = sa;
+  m_delayed.back().m_data.assign(buffer, length);
+
+  if (!m_taskDelayed.is_queued())
+    priority_queue_insert(&taskScheduler, &m_taskDelayed, m_delayed.front().m_time);
+}
+
+// Packets that can't be sent right away are dropped, the sockets
+// handle them like any other loss.
+void
+UtpManager::write_packet(const rak::socket_address& sa, const char* buffer, uint32_t length) {
+  rak::socket_address address = sa;
+
+  write_datagram(buffer, length, &address);
+}
+
+void
+UtpManager::event_read() {
+  rak::socket_address sa;
+
+  while (true) {
+    int s = read_datagram(m_readBuffer, sizeof(m_readBuffer), &sa);
+
+    if (s < 0)
+      break;
+
+    if (s == 0 || sa.family() != rak::socket_address::af_inet)
+      continue;
+
+    process_packet(sa, m_readBuffer, s);
+  }
+
+  // A single ack for everything read on each connection.
+  for (SocketList::iterator itr = m_acks.begin(); itr != m_acks.end(); ++itr)
+    if ((*itr)->state() != UtpSocket::CLOSED && (*itr)->is_ack_pending())
+      (*itr)->send_state();
+
+  m_acks.clear();
+  cleanup();
+}
+
+void
+UtpManager::event_write() {
+  manager->poll()->remove_write(this);
+}
+
+void
+UtpManager::event_error() {
+}
+
+void
+UtpManager::process_packet(const rak::socket_address& sa, const char* buffer, uint32_t length) {
+  UtpHeader header;
+  uint32_t offset = header.decode(buffer, length);
+
+  if (offset == 0)
+    return;
+
+  SocketMap::iterator itr;
+
+  switch (header.m_type) {
+  case UtpHeader::st_syn:
+    // A repeated SYN goes to the connection it opened.
+    itr = m_sockets.find(SocketKey(sa, header.m_connectionId + 1));
+
+    if (itr == m_sockets.end())
+      return process_syn(sa, header);
+
+    break;
+
+  case UtpHeader::st_reset:
+    // Some clients reset with the id they receive on.
+    itr = m_sockets.find(SocketKey(sa, header.m_connectionId));
+
+    if (itr == m_sockets.end())
+      itr = m_sockets.find(SocketKey(sa, header.m_connectionId - 1));
+
+    if (itr == m_sockets.end())
+      itr = m_sockets.find(SocketKey(sa, header.m_connectionId + 1));
+
+    break;
+
+  default:
+    itr = m_sockets.find(SocketKey(sa, header.m_connectionId));
+    break;
+  }
+
+  if (itr == m_sockets.end() || itr->second->state() == UtpSocket::CLOSED)
+    return;
+
+  UtpSocket* s = itr->second;
+  bool ackPending = s->is_ack_pending();
+
+  s->receive_packet(header, buffer + offset, length - offset);
+
+  if (!ackPending && s->is_ack_pending())
+    m_acks.push_back(s);
+}
+
+void
+UtpManager::process_syn(const rak::socket_address& sa, const UtpHeader& header) {
+  // Checked before the socket pair is created, so spoofed SYNs
+  // can't use up the file descriptors.
+  if (m_sockets.size() >= max_sockets ||
+      !manager->connection_manager()->can_connect() ||
+      !manager->connection_manager()->filter(sa.c_sockaddr()))
+    return;
+
+  SocketFd fd;
+  UtpSocket* s = insert(sa, header.m_connectionId + 1, header.m_connectionId, &fd);
+
+  if (s == NULL)
+    return;
+
+  s->accept(header);
+  m_slotIncoming(fd, sa);
+}
+
+void
+UtpManager::receive_tick() {
+  for (SocketMap::iterator itr = m_sockets.begin(); itr != m_sockets.end(); ++itr)
+    itr->second->receive_tick();
+
+  cleanup();
+
+  if (!m_sockets.empty())
+    priority_queue_insert(&taskScheduler, &m_taskTick, cachedTime + rak::timer::from_milliseconds(tick_interval));
+}
+
+void
+UtpManager::receive_delayed() {
+  while (!m_delayed.empty() && m_delayed.front().m_time <= cachedTime) {
+    write_packet(m_delayed.front().m_address, m_delayed.front().m_data.c_str(), m_delayed.front().m_data.size());
+    m_delayed.pop_front();
+  }
+
+  if (!m_delayed.empty())
+    priority_queue_insert(&taskScheduler, &m_taskDelayed, m_delayed.front().m_time);
+}
+
+}
@@ -0,0 +1,161 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_NET_UTP_MANAGER_H
+#define LIBTORRENT_NET_UTP_MANAGER_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include <rak/functional.h>
+#include <rak/priority_queue_default.h>
+#include <rak/socket_address.h>
+
+#include "socket_datagram.h"
+#include "socket_fd.h"
+#include "utp_socket.h"
+
+namespace torrent {
+
+class HandshakeManager;
+
+// Owns the UDP socket shared by all uTP connections, usually bound
+// to the listen port. Packets are demultiplexed on the sender's
+// address and the connection id, and a single task drives the
+// retransmission and keepalive timers of every connection.
+//
+// For testing over loopback a fixed delay and a random loss may be
+// added to outgoing packets.
+
+class UtpManager : public SocketDatagram {
+public:
+  typedef rak::mem_fun2<HandshakeManager, void, SocketFd, const rak::socket_address&> SlotIncoming;
+  typedef uint32_t size_type;
+
+  static const uint32_t tick_interval = 100;
+  static const uint32_t max_sockets   = 4096;
+
+  UtpManager();
+  ~UtpManager();
+
+  bool                is_open() const                          { return get_fd().is_valid(); }
+
+  bool                open(uint16_t port, const rak::socket_address* bindAddress);
+  void                close();
+
+  uint16_t            port() const                             { return m_port; }
+  size_type           size() const                             { return m_sockets.size(); }
+
+  // Try uTP before TCP on outgoing connections.
+  bool                is_outgoing() const                      { return m_outgoing; }
+  void                set_outgoing(bool state)                 { m_outgoing = state; }
+
+  // LEDBAT target queuing delay in microseconds.
+  uint32_t            target_delay() const                     { return m_targetDelay; }
+  void                set_target_delay(uint32_t usec)          { m_targetDelay = usec; }
+
+  // Milliseconds added to, and parts per thousand dropped of, the
+  // outgoing packets.
+  uint32_t            simulated_delay() const                  { return m_simulatedDelay; }
+  uint32_t            simulated_loss() const                   { return m_simulatedLoss; }
+  void                set_simulated(uint32_t delay, uint32_t loss);
+
+  // Starts a connection to 'sa', 'fd' is set to the stream end for
+  // the handshake.
+  bool                connect(const rak::socket_address& sa, SocketFd* fd);
+
+  void                slot_incoming(const SlotIncoming& s)     { m_slotIncoming = s; }
+
+  // For UtpSocket.
+  void                send(const rak::socket_address& sa, const char* buffer, uint32_t length);
+  void                receive_closed(UtpSocket* s);
+
+  virtual void        event_read();
+  virtual void        event_write();
+  virtual void        event_error();
+
+private:
+  UtpManager(const UtpManager&);
+  void operator = (const UtpManager&);
+
+  typedef std::pair<rak::socket_address, uint16_t> SocketKey;
+  typedef std::map<SocketKey, UtpSocket*>          SocketMap;
+  typedef std::vector<UtpSocket*>                  SocketList;
+
+  struct Delayed {
+    rak::timer          m_time;
+    rak::socket_address m_address;
+    std::string         m_data;
+  };
+
+  typedef std::deque<Delayed>                      DelayedList;
+
+  void                process_packet(const rak::socket_address& sa, const char* buffer, uint32_t length);
+  void                process_syn(const rak::socket_address& sa, const UtpHeader& header);
+
+  void                write_packet(const rak::socket_address& sa, const char* buffer, uint32_t length);
+
+  UtpSocket*          insert(const rak::socket_address& sa, uint16_t receiveId, uint16_t sendId, SocketFd* fd);
+  void                cleanup();
+
+  void                receive_tick();
+  void                receive_delayed();
+
+  uint16_t            m_port;
+  bool                m_outgoing;
+  uint32_t            m_targetDelay;
+
+  SocketMap           m_sockets;
+  SocketList          m_acks;
+  SocketList          m_closed;
+
+  uint32_t            m_simulatedDelay;
+  uint32_t            m_simulatedLoss;
+  DelayedList         m_delayed;
+
+  SlotIncoming        m_slotIncoming;
+
+  char                m_readBuffer[2048];
+
+  rak::priority_item  m_taskTick;
+  rak::priority_item  m_taskDelayed;
+};
+
+}
+
+#endif
@@ -0,0 +1,837 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <rak/functional.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/poll.h"
+
+#include "utp_manager.h"
+#include "utp_socket.h"
+
+#include "globals.h"
+#include "manager.h"
+
+namespace torrent {
+
+inline static uint16_t
+read_16(const char* buffer) {
+  uint16_t v;
+  std::memcpy(&v, buffer, sizeof(v));
+
+  return ntohs(v);
+}
+
+inline static uint32_t
+read_32(const char* buffer) {
+  uint32_t v;
+  std::memcpy(&v, buffer, sizeof(v));
+
+  return ntohl(v);
+}
+
+inline static void
+write_16(char* buffer, uint16_t v) {
+  v = htons(v);
+  std::memcpy(buffer, &v, sizeof(v));
+}
+
+inline static void
+write_32(char* buffer, uint32_t v) {
+  v = htonl(v);
+  std::memcpy(buffer, &v, sizeof(v));
+}
+
+uint32_t
+UtpHeader::decode(const char* buffer, uint32_t length) {
+  if (length < size ||
+      ((uint8_t)buffer[0] & 0xf) != version ||
+      ((uint8_t)buffer[0] >> 4) > st_syn)
+    return 0;
+
+  m_type                = (uint8_t)buffer[0] >> 4;
+  m_connectionId        = read_16(buffer + 2);
+  m_timestamp           = read_32(buffer + 4);
+  m_timestampDifference = read_32(buffer + 8);
+  m_window              = read_32(buffer + 12);
+  m_seq                 = read_16(buffer + 16);
+  m_ack                 = read_16(buffer + 18);
+
+  m_sack                = NULL;
+  m_sackLength          = 0;
+
+  // Each extension starts with the type of the next one and its
+  // length.
+  uint32_t offset = size;
+  uint8_t extension = buffer[1];
+
+  while (extension != 0) {
+    if (offset + 2 > length || offset + 2 + (uint8_t)buffer[offset + 1] > length)
+      return 0;
+
+    if (extension == ext_sack) {
+      m_sack = buffer + offset + 2;
+      m_sackLength = (uint8_t)buffer[offset + 1];
+    }
+
+    extension = buffer[offset];
+    offset += 2 + (uint8_t)buffer[offset + 1];
+  }
+
+  return offset;
+}
+
+uint32_t
+UtpHeader::encode(char* buffer) const {
+  buffer[0] = (m_type << 4) | version;
+  buffer[1] = m_sackLength != 0 ? ext_sack : 0;
+
+  write_16(buffer + 2, m_connectionId);
+  write_32(buffer + 4, m_timestamp);
+  write_32(buffer + 8, m_timestampDifference);
+  write_32(buffer + 12, m_window);
+  write_16(buffer + 16, m_seq);
+  write_16(buffer + 18, m_ack);
+
+  if (m_sackLength == 0)
+    return size;
+
+  buffer[size] = 0;
+  buffer[size + 1] = m_sackLength;
+  std::memcpy(buffer + size + 2, m_sack, m_sackLength);
+
+  return size + 2 + m_sackLength;
+}
+
+UtpSocket::UtpSocket(UtpManager* m, const rak::socket_address& sa, uint16_t receiveId, uint16_t sendId) :
+  m_manager(m),
+  m_state(CLOSED),
+
+  m_address(sa),
+  m_receiveId(receiveId),
+  m_sendId(sendId),
+
+  m_reading(false),
+  m_writing(false),
+  m_ackPending(false),
+
+  m_seqNr(1),
+  m_inFlight(0),
+
+  m_window(min_window),
+  m_peerWindow(max_payload),
+  m_slowStart(true),
+
+  m_lastAck(0),
+  m_duplicateAcks(0),
+
+  m_rtt(0),
+  m_rttVariance(0),
+  m_timeout(1000),
+
+  m_ackNr(0),
+  m_replyDifference(0),
+
+  m_reorderSize(0),
+  m_pendingPos(0),
+
+  m_finReceived(false),
+  m_finDone(false),
+  m_finSeq(0) {
+
+  m_baseDelayValid[0] = m_baseDelayValid[1] = false;
+}
+
+UtpSocket::~UtpSocket() {
+  std::for_each(m_outgoing.begin(), m_outgoing.end(), rak::call_delete<Packet>());
+}
+
+bool
+UtpSocket::open(SocketFd* fd) {
+  SocketFd local;
+
+  if (!SocketFd::open_socket_pair(local, *fd))
+    return false;
+
+  if (!local.set_nonblock() || !fd->set_nonblock()) {
+    local.close();
+    fd->close();
+    fd->clear();
+
+    return false;
+  }
+
+  set_fd(local);
+
+  manager->poll()->open(this);
+  manager->poll()->insert_error(this);
+
+  m_lastReceived = cachedTime;
+  m_lastSent = cachedTime;
+  m_baseDelayRotate = cachedTime + rak::timer::from_seconds(delay_history);
+
+  return true;
+}
+
+void
+UtpSocket::close() {
+  if (m_state == CLOSED && !get_fd().is_valid())
+    return;
+
+  m_state = CLOSED;
+
+  manager->poll()->remove_read(this);
+  manager->poll()->remove_write(this);
+  manager->poll()->remove_error(this);
+  manager->poll()->close(this);
+
+  get_fd().close();
+  get_fd().clear();
+
+  std::for_each(m_outgoing.begin(), m_outgoing.end(), rak::call_delete<Packet>());
+  m_outgoing.clear();
+  m_inFlight = 0;
+
+  m_reorder.clear();
+  m_pending.clear();
+
+  m_manager->receive_closed(this);
+}
+
+void
+UtpSocket::connect() {
+  if (m_state != CLOSED || !get_fd().is_valid())
+    throw internal_error("UtpSocket::connect() called on a connected socket.");
+
+  m_state = SYN_SENT;
+  m_seqNr = 1;
+  m_lastAck = 0;
+
+  queue_packet(new Packet, UtpHeader::st_syn, 0);
+}
+
+void
+UtpSocket::accept(const UtpHeader& syn) {
+  if (m_state != CLOSED || !get_fd().is_valid())
+    throw internal_error("UtpSocket::accept(...) called on a connected socket.");
+
+  m_state = CONNECTED;
+
+  m_seqNr = random();
+  m_lastAck = m_seqNr - 1;
+  m_ackNr = syn.m_seq;
+
+  m_peerWindow = syn.m_window;
+  m_replyDifference = timestamp() - syn.m_timestamp;
+
+  send_state();
+  set_reading(true);
+}
+
+uint32_t
+UtpSocket::advertised_window() const {
+  uint32_t used = m_pending.size() - m_pendingPos + m_reorderSize;
+
+  return used < receive_window ? receive_window - used : 0;
+}
+
+uint32_t
+UtpSocket::send_room() const {
+  uint32_t window = std::min(m_window, m_peerWindow);
+
+  if (m_state != CONNECTED || m_inFlight >= window)
+    return 0;
+
+  return window - m_inFlight;
+}
+
+uint32_t
+UtpSocket::encode_header(char* buffer, uint8_t type, uint16_t seq, bool sack) {
+  UtpHeader header;
+  char bits[max_sack];
+
+  header.m_type = type;
+  header.m_connectionId = type == UtpHeader::st_syn ? m_receiveId : m_sendId;
+  header.m_timestamp = timestamp();
+  header.m_timestampDifference = m_replyDifference;
+  header.m_window = advertised_window();
+  header.m_seq = seq;
+  header.m_ack = m_ackNr;
+
+  header.m_sack = bits;
+  header.m_sackLength = 0;
+
+  // Acks the packets received out of order, the length must be a
+  // multiple of four.
+  if (sack && !m_reorder.empty()) {
+    std::memset(bits, 0, max_sack);
+
+    for (ReorderMap::const_iterator itr = m_reorder.begin(); itr != m_reorder.end(); ++itr) {
+      uint16_t i = itr->first - m_ackNr - 2;
+
+      if (i >= max_sack * 8)
+        continue;
+
+      bits[i / 8] |= 1 << (i % 8);
+      header.m_sackLength = std::max<uint32_t>(header.m_sackLength, (i / 32 + 1) * 4);
+    }
+  }
+
+  return header.encode(buffer);
+}
+
+void
+UtpSocket::send_state() {
+  char buffer[UtpHeader::size + 2 + max_sack];
+
+  m_manager->send(m_address, buffer, encode_header(buffer, UtpHeader::st_state, m_seqNr, true));
+
+  m_ackPending = false;
+  m_lastSent = cachedTime;
+}
+
+void
+UtpSocket::queue_packet(Packet* p, uint8_t type, uint32_t length) {
+  p->m_type = type;
+  p->m_seq = m_seqNr++;
+  p->m_length = length;
+  p->m_transmissions = 0;
+  p->m_sacked = false;
+
+  if (m_outgoing.empty())
+    m_resendTime = cachedTime + rak::timer::from_milliseconds(m_timeout);
+
+  m_outgoing.push_back(p);
+  m_inFlight += length;
+
+  send_packet(p);
+}
+
+void
+UtpSocket::send_packet(Packet* p) {
+  encode_header(p->m_data, p->m_type, p->m_seq, false);
+  m_manager->send(m_address, p->m_data, UtpHeader::size + p->m_length);
+
+  p->m_transmissions++;
+  p->m_sent = rak::timer::current();
+
+  m_ackPending = false;
+  m_lastSent = cachedTime;
+}
+
+// Reads from the socket pair while the window has room, waiting for
+// room for a full packet unless nothing is in flight.
+void
+UtpSocket::fill_window() {
+  uint32_t maxPayload = max_payload;
+
+  while (true) {
+    uint32_t room = send_room();
+
+    if (room == 0 || (room < max_payload && m_inFlight != 0)) {
+      set_reading(false);
+      return;
+    }
+
+    Packet* p = new Packet;
+    uint32_t length;
+
+    try {
+      length = read_stream_throws(p->m_data + UtpHeader::size, std::min(room, maxPayload));
+
+    } catch (network_error& e) {
+      delete p;
+      throw;
+    }
+
+    if (length == 0) {
+      delete p;
+      set_reading(true);
+      return;
+    }
+
+    queue_packet(p, UtpHeader::st_data, length);
+  }
+}
+
+// The peer connection closed its end, so anything still arriving
+// can be dropped.
+void
+UtpSocket::send_fin() {
+  if (m_state != CONNECTED)
+    return;
+
+  m_state = FIN_SENT;
+  set_reading(false);
+
+  m_pending.clear();
+  m_pendingPos = 0;
+
+  queue_packet(new Packet, UtpHeader::st_fin, 0);
+}
+
+void
+UtpSocket::receive_packet(const UtpHeader& header, const char* payload, uint32_t length) {
+  m_lastReceived = cachedTime;
+  m_replyDifference = timestamp() - header.m_timestamp;
+  m_peerWindow = header.m_window;
+
+  if (header.m_type == UtpHeader::st_reset)
+    return close();
+
+  if (m_state == SYN_SENT) {
+    if (header.m_type != UtpHeader::st_state)
+      return;
+
+    m_state = CONNECTED;
+    m_ackNr = header.m_seq - 1;
+  }
+
+  // Our reply to the SYN was lost.
+  if (header.m_type == UtpHeader::st_syn) {
+    m_ackPending = true;
+    return;
+  }
+
+  process_ack(header);
+
+  if (m_state == CLOSED)
+    return;
+
+  try {
+    if (header.m_type == UtpHeader::st_data && length != 0) {
+      receive_data(header.m_seq, payload, length);
+
+    } else if (header.m_type == UtpHeader::st_fin) {
+      if (!m_finReceived) {
+        m_finReceived = true;
+        m_finSeq = header.m_seq;
+      }
+
+      m_ackPending = true;
+      advance_receive();
+    }
+
+    if (m_finDone && m_pending.empty()) {
+      send_state();
+      return close();
+    }
+
+    fill_window();
+
+  } catch (network_error& e) {
+    send_fin();
+  }
+}
+
+void
+UtpSocket::process_ack(const UtpHeader& header) {
+  // Ignore acks of packets we have not sent.
+  if (!seq_less_equal(header.m_ack, m_seqNr - 1))
+    return;
+
+  bool windowLimited = m_inFlight + max_payload >= std::min(m_window, m_peerWindow);
+  bool acked = false;
+
+  uint32_t bytesAcked = 0;
+  int64_t sample = -1;
+
+  while (!m_outgoing.empty() && seq_less_equal(m_outgoing.front()->m_seq, header.m_ack)) {
+    Packet* p = m_outgoing.front();
+
+    // Only packets sent once give an unambiguous round trip.
+    if (p->m_transmissions == 1)
+      sample = (rak::timer::current() - p->m_sent).usec() / 1000;
+
+    acked = true;
+
+    if (!p->m_sacked) {
+      bytesAcked += p->m_length;
+      m_inFlight -= p->m_length;
+    }
+
+    delete p;
+    m_outgoing.pop_front();
+  }
+
+  bytesAcked += process_sack(header);
+
+  if (acked) {
+    m_lastAck = header.m_ack;
+    m_duplicateAcks = 0;
+
+    if (sample >= 0)
+      update_round_trip(sample);
+
+    m_resendTime = cachedTime + rak::timer::from_milliseconds(m_timeout);
+
+  } else if (header.m_type == UtpHeader::st_state && header.m_ack == m_lastAck &&
+             !m_outgoing.empty() && ++m_duplicateAcks == 3) {
+    // Three duplicate acks of the same packet signal that the next
+    // one was lost.
+    cut_window();
+    send_packet(m_outgoing.front());
+  }
+
+  if (bytesAcked != 0)
+    update_window(bytesAcked, header.m_timestampDifference, windowLimited);
+
+  if (m_state == FIN_SENT && m_outgoing.empty())
+    close();
+}
+
+// Returns the bytes newly acked. A packet is taken as lost once three
+// packets sent after it, or all of them if fewer, have been acked. It
+// is sent again unless that was done within the last round trip.
+uint32_t
+UtpSocket::process_sack(const UtpHeader& header) {
+  if (header.m_sack == NULL || m_outgoing.empty())
+    return 0;
+
+  uint32_t bytesAcked = 0;
+
+  for (uint32_t i = 0; i < header.m_sackLength * 8; ++i) {
+    if (!(header.m_sack[i / 8] & (1 << (i % 8))))
+      continue;
+
+    // The packets in 'm_outgoing' have consecutive sequence numbers.
+    uint16_t index = header.m_ack + 2 + i - m_outgoing.front()->m_seq;
+
+    if (index >= m_outgoing.size() || m_outgoing[index]->m_sacked)
+      continue;
+
+    m_outgoing[index]->m_sacked = true;
+
+    bytesAcked += m_outgoing[index]->m_length;
+    m_inFlight -= m_outgoing[index]->m_length;
+  }
+
+  rak::timer resendBefore = rak::timer::current() - rak::timer::from_milliseconds(m_rtt);
+  uint32_t after = 0;
+  uint32_t sackedAfter = 0;
+  bool lost = false;
+
+  for (PacketList::reverse_iterator itr = m_outgoing.rbegin(); itr != m_outgoing.rend(); ++itr, ++after) {
+    if ((*itr)->m_sacked) {
+      sackedAfter++;
+
+    } else if ((sackedAfter >= 3 || (sackedAfter != 0 && sackedAfter == after)) && (*itr)->m_sent <= resendBefore) {
+      send_packet(*itr);
+      lost = true;
+    }
+  }
+
+  if (lost)
+    cut_window();
+
+  return bytesAcked;
+}
+
+void
+UtpSocket::update_round_trip(uint32_t sample) {
+  if (m_rtt == 0) {
+    m_rtt = std::max<uint32_t>(sample, 1);
+    m_rttVariance = sample / 2;
+
+  } else {
+    int32_t delta = (int32_t)sample - (int32_t)m_rtt;
+
+    m_rttVariance += (std::abs(delta) - (int32_t)m_rttVariance) / 4;
+    m_rtt += delta / 8;
+  }
+
+  uint32_t minTimeout = min_timeout;
+  uint32_t maxTimeout = max_timeout;
+
+  m_timeout = std::min(std::max(m_rtt + 4 * m_rttVariance, minTimeout), maxTimeout);
+}
+
+// 'delay' is the one-way delay of our packets as measured by the
+// peer, offset by the difference between our clocks. The offset
+// cancels out against the base delay.
+void
+UtpSocket::update_window(uint32_t bytesAcked, uint32_t delay, bool windowLimited) {
+  int64_t target = m_manager->target_delay();
+  int64_t queuing = 0;
+
+  if (delay != 0) {
+    if (cachedTime >= m_baseDelayRotate) {
+      m_baseDelay[1] = m_baseDelay[0];
+      m_baseDelayValid[1] = m_baseDelayValid[0];
+      m_baseDelayValid[0] = false;
+
+      m_baseDelayRotate = cachedTime + rak::timer::from_seconds(delay_history);
+    }
+
+    if (!m_baseDelayValid[0] || (int32_t)(delay - m_baseDelay[0]) < 0) {
+      m_baseDelay[0] = delay;
+      m_baseDelayValid[0] = true;
+    }
+
+    uint32_t base = m_baseDelay[0];
+
+    if (m_baseDelayValid[1] && (int32_t)(m_baseDelay[1] - base) < 0)
+      base = m_baseDelay[1];
+
+    queuing = (uint32_t)(delay - base);
+  }
+
+  int64_t window = m_window;
+
+  if (m_slowStart && queuing <= target / 2) {
+    if (windowLimited)
+      window += bytesAcked;
+
+  } else {
+    m_slowStart = false;
+
+    // Scaled by how far we are from the target and by the part of
+    // the window that was acked.
+    int64_t gain = (int64_t)max_window_gain * (target - queuing) * bytesAcked / (target * window);
+
+    if (gain < 0 || windowLimited)
+      window += gain;
+  }
+
+  m_window = std::min<int64_t>(std::max<int64_t>(window, min_window), max_window);
+}
+
+// Halve the window at most once per round trip.
+void
+UtpSocket::cut_window() {
+  if (cachedTime < m_lastWindowCut + rak::timer::from_milliseconds(m_rtt))
+    return;
+
+  m_window = std::max<int64_t>(m_window / 2, min_window);
+  m_slowStart = false;
+  m_lastWindowCut = cachedTime;
+}
+
+void
+UtpSocket::receive_data(uint16_t seq, const char* payload, uint32_t length) {
+  m_ackPending = true;
+
+  // Zero means the next packet in order, duplicates wrap around to
+  // large offsets.
+  uint16_t offset = seq - m_ackNr - 1;
+
+  if (offset >= max_reorder || m_finDone)
+    return;
+
+  // Data beyond the window we advertised is dropped without being
+  // acked, the peer sends it again once there is room.
+  if (length > advertised_window() && (offset != 0 || !m_pending.empty()))
+    return;
+
+  if (offset != 0) {
+    if (m_reorder.find(seq) == m_reorder.end()) {
+      m_reorder[seq].assign(payload, length);
+      m_reorderSize += length;
+    }
+
+    return;
+  }
+
+  m_ackNr = seq;
+  deliver(payload, length);
+
+  advance_receive();
+}
+
+void
+UtpSocket::advance_receive() {
+  while (!m_finDone) {
+    uint16_t next = m_ackNr + 1;
+
+    if (m_finReceived && next == m_finSeq) {
+      m_ackNr = next;
+      m_finDone = true;
+      return;
+    }
+
+    ReorderMap::iterator itr = m_reorder.find(next);
+
+    if (itr == m_reorder.end())
+      return;
+
+    std::string data;
+    data.swap(itr->second);
+
+    m_reorder.erase(itr);
+    m_reorderSize -= data.size();
+    m_ackNr = next;
+
+    deliver(data.c_str(), data.size());
+  }
+}
+
+void
+UtpSocket::deliver(const char* data, uint32_t length) {
+  if (m_state != CONNECTED || length == 0)
+    return;
+
+  if (m_pending.empty()) {
+    uint32_t written = write_stream_throws(data, length);
+
+    data += written;
+    length -= written;
+
+    if (length == 0)
+      return;
+  }
+
+  m_pending.append(data, length);
+  set_writing(true);
+}
+
+bool
+UtpSocket::flush_pending() {
+  while (m_pendingPos != m_pending.size()) {
+    uint32_t written = write_stream_throws(m_pending.c_str() + m_pendingPos, m_pending.size() - m_pendingPos);
+
+    if (written == 0) {
+      if (m_pendingPos >= (1 << 16)) {
+        m_pending.erase(0, m_pendingPos);
+        m_pendingPos = 0;
+      }
+
+      return false;
+    }
+
+    m_pendingPos += written;
+  }
+
+  m_pending.clear();
+  m_pendingPos = 0;
+
+  return true;
+}
+
+void
+UtpSocket::receive_tick() {
+  if (m_state == CLOSED)
+    return;
+
+  if (cachedTime >= m_lastReceived + rak::timer::from_seconds(idle_timeout))
+    return close();
+
+  if (!m_outgoing.empty() && cachedTime >= m_resendTime) {
+    Packet* p = m_outgoing.front();
+
+    if (p->m_transmissions >= (p->m_type == UtpHeader::st_syn ? syn_transmissions : max_transmissions))
+      return close();
+
+    // Nothing was acked for a whole timeout, start over from the
+    // smallest window.
+    m_window = min_window;
+    m_slowStart = true;
+    m_timeout = std::min<int64_t>(m_timeout * 2, max_timeout);
+
+    send_packet(p);
+    m_resendTime = cachedTime + rak::timer::from_milliseconds(m_timeout);
+  }
+
+  if (m_state != SYN_SENT && cachedTime >= m_lastSent + rak::timer::from_seconds(keepalive_interval))
+    send_state();
+}
+
+void
+UtpSocket::set_reading(bool state) {
+  if (m_reading == state)
+    return;
+
+  m_reading = state;
+
+  if (state)
+    manager->poll()->insert_read(this);
+  else
+    manager->poll()->remove_read(this);
+}
+
+void
+UtpSocket::set_writing(bool state) {
+  if (m_writing == state)
+    return;
+
+  m_writing = state;
+
+  if (state)
+    manager->poll()->insert_write(this);
+  else
+    manager->poll()->remove_write(this);
+}
+
+void
+UtpSocket::event_read() {
+  try {
+    fill_window();
+
+  } catch (network_error& e) {
+    send_fin();
+  }
+}
+
+void
+UtpSocket::event_write() {
+  try {
+    if (!flush_pending())
+      return;
+
+  } catch (network_error& e) {
+    return send_fin();
+  }
+
+  set_writing(false);
+
+  if (m_finDone)
+    return close();
+
+  // Let the peer know the window has opened again.
+  send_state();
+}
+
+void
+UtpSocket::event_error() {
+  close();
+}
+
+}
@@ -0,0 +1,261 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_NET_UTP_SOCKET_H
+#define LIBTORRENT_NET_UTP_SOCKET_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <inttypes.h>
+#include <rak/socket_address.h>
+#include <rak/timer.h>
+
+#include "socket_stream.h"
+
+namespace torrent {
+
+class UtpManager;
+
+// The fixed 20 byte header of a BEP 29 packet.
+struct UtpHeader {
+  static const uint32_t size     = 20;
+  static const uint8_t  version  = 1;
+
+  static const uint8_t  st_data  = 0;
+  static const uint8_t  st_fin   = 1;
+  static const uint8_t  st_state = 2;
+  static const uint8_t  st_reset = 3;
+  static const uint8_t  st_syn   = 4;
+
+  static const uint8_t  ext_sack = 1;
+
+  // Returns the offset of the payload, or zero if the packet is
+  // malformed. Only the selective ack extension is used.
+  uint32_t            decode(const char* buffer, uint32_t length);
+
+  // The selective ack, if any, is written after the header. Returns
+  // the length written.
+  uint32_t            encode(char* buffer) const;
+
+  uint8_t             m_type;
+  uint16_t            m_connectionId;
+  uint32_t            m_timestamp;
+  uint32_t            m_timestampDifference;
+  uint32_t            m_window;
+  uint16_t            m_seq;
+  uint16_t            m_ack;
+
+  // Bit 'i' acks packet 'm_ack + 2 + i'.
+  const char*         m_sack;
+  uint32_t            m_sackLength;
+};
+
+// A uTP connection multiplexed on UtpManager's UDP socket. The
+// handshake and peer connection are given the other end of a local
+// socket pair, so they run unchanged over either transport. Data is
+// only read from the pair while the congestion window has room,
+// which leaves the pair's socket buffer as our send queue.
+//
+// The window follows LEDBAT: the one-way delay echoed by the peer is
+// compared to the lowest delay seen in the last two minutes, and the
+// window grows while the queuing delay is below the target and
+// shrinks in proportion when it is above.
+
+class UtpSocket : public SocketStream {
+public:
+  typedef enum {
+    SYN_SENT,
+    CONNECTED,
+    FIN_SENT,
+    CLOSED
+  } State;
+
+  static const uint32_t packet_size        = 1400;
+  static const uint32_t max_payload        = packet_size - UtpHeader::size;
+  static const uint32_t max_sack           = 32;
+
+  static const uint32_t min_window         = 2 * max_payload;
+  static const uint32_t max_window         = 1 << 20;
+  static const uint32_t receive_window     = 1 << 20;
+
+  // Bytes the window may grow per round trip when there is no
+  // queuing delay.
+  static const uint32_t max_window_gain    = 3000;
+  static const uint32_t max_reorder        = 1024;
+
+  static const uint32_t min_timeout        = 500;
+  static const uint32_t max_timeout        = 60000;
+  static const uint32_t max_transmissions  = 6;
+  static const uint32_t syn_transmissions  = 3;
+
+  static const uint32_t keepalive_interval = 29;
+  static const uint32_t idle_timeout       = 90;
+  static const uint32_t delay_history      = 60;
+
+  UtpSocket(UtpManager* m, const rak::socket_address& sa, uint16_t receiveId, uint16_t sendId);
+  ~UtpSocket();
+
+  State               state() const                          { return m_state; }
+
+  const rak::socket_address& address() const                 { return m_address; }
+  uint16_t            receive_id() const                     { return m_receiveId; }
+
+  uint32_t            window() const                         { return m_window; }
+  uint32_t            round_trip() const                     { return m_rtt; }
+
+  // Opens the socket pair, 'fd' is set to the end meant for the
+  // handshake.
+  bool                open(SocketFd* fd);
+  void                close();
+
+  void                connect();
+  void                accept(const UtpHeader& syn);
+
+  void                receive_packet(const UtpHeader& header, const char* payload, uint32_t length);
+
+  // Acks are sent once per batch of packets read by UtpManager.
+  bool                is_ack_pending() const                 { return m_ackPending; }
+  void                send_state();
+
+  void                receive_tick();
+
+  virtual void        event_read();
+  virtual void        event_write();
+  virtual void        event_error();
+
+private:
+  UtpSocket(const UtpSocket&);
+  void operator = (const UtpSocket&);
+
+  struct Packet {
+    uint8_t             m_type;
+    uint16_t            m_seq;
+    uint32_t            m_length;
+    uint32_t            m_transmissions;
+    bool                m_sacked;
+    rak::timer          m_sent;
+
+    char                m_data[packet_size];
+  };
+
+  typedef std::deque<Packet*>               PacketList;
+  typedef std::map<uint16_t, std::string>   ReorderMap;
+
+  static bool         seq_less_equal(uint16_t a, uint16_t b) { return (uint16_t)(b - a) < 0x8000; }
+
+  static uint32_t     timestamp()                            { return rak::timer::current().usec(); }
+
+  uint32_t            advertised_window() const;
+  uint32_t            send_room() const;
+
+  uint32_t            encode_header(char* buffer, uint8_t type, uint16_t seq, bool sack);
+
+  void                fill_window();
+  void                send_fin();
+
+  void                queue_packet(Packet* p, uint8_t type, uint32_t length);
+  void                send_packet(Packet* p);
+
+  void                process_ack(const UtpHeader& header);
+  uint32_t            process_sack(const UtpHeader& header);
+  void                update_round_trip(uint32_t sample);
+  void                update_window(uint32_t bytesAcked, uint32_t delay, bool windowLimited);
+  void                cut_window();
+
+  void                receive_data(uint16_t seq, const char* payload, uint32_t length);
+  void                advance_receive();
+  void                deliver(const char* data, uint32_t length);
+  bool                flush_pending();
+
+  void                set_reading(bool state);
+  void                set_writing(bool state);
+
+  UtpManager*         m_manager;
+  State               m_state;
+
+  rak::socket_address m_address;
+  uint16_t            m_receiveId;
+  uint16_t            m_sendId;
+
+  bool                m_reading;
+  bool                m_writing;
+  bool                m_ackPending;
+
+  // Sending side.
+  uint16_t            m_seqNr;
+  PacketList          m_outgoing;
+  uint32_t            m_inFlight;
+
+  uint32_t            m_window;
+  uint32_t            m_peerWindow;
+  bool                m_slowStart;
+
+  uint16_t            m_lastAck;
+  uint32_t            m_duplicateAcks;
+  rak::timer          m_lastWindowCut;
+
+  uint32_t            m_rtt;
+  uint32_t            m_rttVariance;
+  uint32_t            m_timeout;
+  rak::timer          m_resendTime;
+
+  // Lowest one-way delay of the current and previous minute.
+  uint32_t            m_baseDelay[2];
+  bool                m_baseDelayValid[2];
+  rak::timer          m_baseDelayRotate;
+
+  // Receiving side.
+  uint16_t            m_ackNr;
+  uint32_t            m_replyDifference;
+
+  ReorderMap          m_reorder;
+  uint32_t            m_reorderSize;
+
+  std::string         m_pending;
+  uint32_t            m_pendingPos;
+
+  bool                m_finReceived;
+  bool                m_finDone;
+  uint16_t            m_finSeq;
+
+  rak::timer          m_lastReceived;
+  rak::timer          m_lastSent;
+};
+
+}
+
+#endif
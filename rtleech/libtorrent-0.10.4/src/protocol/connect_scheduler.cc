@@ -0,0 +1,116 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "download/download_main.h"
+
+#include "connect_scheduler.h"
+#include "handshake_manager.h"
+
+namespace torrent {
+
+struct connect_scheduler_less : public std::binary_function<DownloadMain*, DownloadMain*, bool> {
+  bool operator () (DownloadMain* d1, DownloadMain* d2) const {
+    return d1->connect_fill() < d2->connect_fill();
+  }
+};
+
+ConnectScheduler::ConnectScheduler(HandshakeManager* h) :
+  m_handshakeManager(h),
+  m_rate(100),
+  m_maxHalfOpen(100) {
+
+  m_taskSlice.set_slot(rak::mem_fn(this, &ConnectScheduler::receive_slice));
+}
+
+ConnectScheduler::~ConnectScheduler() {
+  priority_queue_erase(&taskScheduler, &m_taskSlice);
+}
+
+void
+ConnectScheduler::insert(DownloadMain* d) {
+  if (std::find(base_type::begin(), base_type::end(), d) == base_type::end())
+    base_type::push_back(d);
+
+  if (!m_taskSlice.is_queued())
+    priority_queue_insert(&taskScheduler, &m_taskSlice, std::max(cachedTime, m_lastSlice + rak::timer::from_milliseconds(slice_msec)));
+}
+
+void
+ConnectScheduler::erase(DownloadMain* d) {
+  iterator itr = std::find(base_type::begin(), base_type::end(), d);
+
+  if (itr != base_type::end())
+    base_type::erase(itr);
+
+  if (base_type::empty())
+    priority_queue_erase(&taskScheduler, &m_taskSlice);
+}
+
+void
+ConnectScheduler::receive_slice() {
+  m_lastSlice = cachedTime;
+
+  base_type::erase(std::remove_if(base_type::begin(), base_type::end(), std::not1(std::mem_fun(&DownloadMain::is_connect_wanted))),
+                   base_type::end());
+
+  uint32_t budget   = std::max<uint32_t>(m_rate * slice_msec / 1000, 1);
+  uint32_t halfOpen = m_handshakeManager->size_outgoing();
+
+  while (budget != 0 && halfOpen < m_maxHalfOpen && !base_type::empty()) {
+    iterator itr = std::min_element(base_type::begin(), base_type::end(), connect_scheduler_less());
+
+    if (!(*itr)->connect_one()) {
+      base_type::erase(itr);
+      continue;
+    }
+
+    budget--;
+    halfOpen++;
+
+    if (!(*itr)->is_connect_wanted())
+      base_type::erase(itr);
+  }
+
+  if (!base_type::empty())
+    priority_queue_insert(&taskScheduler, &m_taskSlice, cachedTime + rak::timer::from_milliseconds(slice_msec));
+}
+
+}
@@ -0,0 +1,97 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_PROTOCOL_CONNECT_SCHEDULER_H
+#define LIBTORRENT_PROTOCOL_CONNECT_SCHEDULER_H
+
+#include <vector>
+#include <inttypes.h>
+#include <rak/priority_queue_default.h>
+
+namespace torrent {
+
+class DownloadMain;
+class HandshakeManager;
+
+// Paces outgoing connection attempts across all downloads. Each
+// 100 ms slice starts at most rate() / 10 connections while the
+// number of outgoing handshakes stays below max_half_open(). The
+// downloads with the smallest share of their peer target connect
+// first.
+
+class ConnectScheduler : private std::vector<DownloadMain*> {
+public:
+  typedef std::vector<DownloadMain*> base_type;
+  typedef uint32_t                   size_type;
+
+  static const uint32_t slice_msec = 100;
+
+  using base_type::size;
+  using base_type::empty;
+
+  ConnectScheduler(HandshakeManager* h);
+  ~ConnectScheduler();
+
+  // Connection attempts per second.
+  uint32_t            rate() const                          { return m_rate; }
+  void                set_rate(uint32_t r)                  { m_rate = r; }
+
+  uint32_t            max_half_open() const                 { return m_maxHalfOpen; }
+  void                set_max_half_open(uint32_t s)         { m_maxHalfOpen = s; }
+
+  // Queue a download that wants more peers. Downloads that no longer
+  // want peers are dropped in the next slice.
+  void                insert(DownloadMain* d);
+  void                erase(DownloadMain* d);
+
+private:
+  ConnectScheduler(const ConnectScheduler&);
+  void operator = (const ConnectScheduler&);
+
+  void                receive_slice();
+
+  HandshakeManager*   m_handshakeManager;
+
+  uint32_t            m_rate;
+  uint32_t            m_maxHalfOpen;
+
+  rak::timer          m_lastSlice;
+  rak::priority_item  m_taskSlice;
+};
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#ifndef LIBTORRENT_PROTOCOL_ENCRYPTION_INFO_H
+#define LIBTORRENT_PROTOCOL_ENCRYPTION_INFO_H
+
+#include "utils/rc4.h"
+
+namespace torrent {
+
+// The RC4 stream state of an encrypted peer connection, handed from
+// the Handshake to the PeerConnectionBase once the handshake is
+// done.
+
+class EncryptionInfo {
+public:
+  EncryptionInfo() : m_encrypted(false) {}
+
+  bool                is_encrypted() const                                        { return m_encrypted; }
+  void                set_encrypted(bool v)                                       { m_encrypted = v; }
+
+  RC4*                encrypt_state()                                             { return &m_encrypt; }
+  RC4*                decrypt_state()                                             { return &m_decrypt; }
+  const RC4*          decrypt_state() const                                       { return &m_decrypt; }
+
+  void                encrypt(void* buffer, uint32_t length)                      { m_encrypt.crypt(buffer, length); }
+  void                encrypt(const void* src, void* dest, uint32_t length)       { m_encrypt.crypt(src, dest, length); }
+  void                decrypt(void* buffer, uint32_t length)                      { m_decrypt.crypt(buffer, length); }
+
+private:
+  bool                m_encrypted;
+
+  RC4                 m_encrypt;
+  RC4                 m_decrypt;
+};
+
+}
+
+#endif
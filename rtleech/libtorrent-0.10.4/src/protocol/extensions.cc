@@ -0,0 +1,252 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <rak/socket_address.h>
+
+#include "download/download_main.h"
+#include "torrent/exceptions.h"
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+#include "torrent/peer_info.h"
+#include "torrent/peer_list.h"
+
+#include "extensions.h"
+
+namespace torrent {
+
+ProtocolExtension::ProtocolExtension() :
+  m_localPex(false),
+
+  m_read(NULL),
+  m_readId(FIRST_INVALID),
+  m_readSize(0),
+  m_readPos(0),
+
+  m_writeId(HANDSHAKE),
+  m_writePos(0) {
+
+  std::fill(m_remoteId, m_remoteId + FIRST_INVALID, 0);
+}
+
+void
+ProtocolExtension::generate_handshake(uint16_t port, bool pex) {
+  if (has_write())
+    throw internal_error("ProtocolExtension::generate_handshake() has_write().");
+
+  Object message(Object::TYPE_MAP);
+  Object& m = message.insert_key("m", Object(Object::TYPE_MAP));
+
+  m_localPex = pex;
+
+  if (m_localPex)
+    m.insert_key("ut_pex", (int64_t)UT_PEX);
+
+  if (port != 0)
+    message.insert_key("p", (int64_t)port);
+
+  message.insert_key("v", std::string("libTorrent ") + VERSION);
+
+  std::ostringstream s;
+  s << message;
+
+  m_write = s.str();
+  m_writeId = HANDSHAKE;
+  m_writePos = 0;
+}
+
+bool
+ProtocolExtension::generate_pex(const PexList* current) {
+  if (!is_remote_pex() || !m_localPex)
+    throw internal_error("ProtocolExtension::generate_pex(...) ut_pex not enabled.");
+
+  if (has_write())
+    throw internal_error("ProtocolExtension::generate_pex(...) has_write().");
+
+  PexList added;
+  PexList dropped;
+
+  std::set_difference(current->begin(), current->end(), m_pexSent.begin(), m_pexSent.end(),
+                      std::back_inserter(added), socket_address_compact_less());
+  std::set_difference(m_pexSent.begin(), m_pexSent.end(), current->begin(), current->end(),
+                      std::back_inserter(dropped), socket_address_compact_less());
+
+  if (added.empty() && dropped.empty())
+    return false;
+
+  // The remaining addresses get sent in the next round.
+  if (added.size() > max_pex_added)
+    added.erase(added.begin() + max_pex_added, added.end());
+
+  PexList sent;
+  sent.reserve(m_pexSent.size() + added.size() - dropped.size());
+
+  std::set_difference(m_pexSent.begin(), m_pexSent.end(), dropped.begin(), dropped.end(),
+                      std::back_inserter(sent), socket_address_compact_less());
+
+  m_pexSent.clear();
+  std::merge(sent.begin(), sent.end(), added.begin(), added.end(),
+             std::back_inserter(m_pexSent), socket_address_compact_less());
+
+  // Bencode by hand as the compact strings are already in the right
+  // format, the keys must be in sorted order.
+  std::ostringstream s;
+  s << "d5:added" << added.size() * 6 << ':';
+  s.write(added.empty() ? "" : added.front().c_str(), added.size() * 6);
+
+  s << "7:added.f" << added.size() << ':' << std::string(added.size(), '\0');
+
+  s << "7:dropped" << dropped.size() * 6 << ':';
+  s.write(dropped.empty() ? "" : dropped.front().c_str(), dropped.size() * 6);
+  s << 'e';
+
+  m_write = s.str();
+  m_writeId = m_remoteId[UT_PEX];
+  m_writePos = 0;
+
+  return true;
+}
+
+void
+ProtocolExtension::read_start(uint8_t id, uint32_t length) {
+  if (length > max_message_size)
+    throw network_error("Received an extension message that is too large.");
+
+  if (m_readSize < length || m_read == NULL) {
+    delete [] m_read;
+    m_read = new char[std::max<uint32_t>(length, 1)];
+  }
+
+  m_readId = id;
+  m_readSize = length;
+  m_readPos = 0;
+}
+
+void
+ProtocolExtension::read_done(DownloadMain* download, PeerInfo* peerInfo) {
+  if (read_remaining() != 0)
+    throw internal_error("ProtocolExtension::read_done(...) read_remaining() != 0.");
+
+  // Ignore messages we did not ask for, the id was assigned by us in
+  // the handshake.
+  if (m_readId >= FIRST_INVALID || (m_readId == UT_PEX && !m_localPex))
+    return;
+
+  Object message;
+
+  if (object_read_bencode_c(m_read, m_read + m_readSize, &message) == NULL || !message.is_map())
+    throw network_error("Received an invalid extension message.");
+
+  try {
+    switch (m_readId) {
+    case HANDSHAKE:
+      parse_handshake(message, peerInfo);
+      break;
+
+    case UT_PEX:
+      parse_pex(message, download);
+      break;
+
+    default:
+      break;
+    }
+
+  } catch (bencode_error& e) {
+    throw network_error("Received an invalid extension message.");
+  }
+}
+
+void
+ProtocolExtension::write_move(uint32_t size) {
+  m_writePos += size;
+
+  if (m_writePos > m_write.size())
+    throw internal_error("ProtocolExtension::write_move(...) m_writePos > m_write.size().");
+
+  if (m_writePos == m_write.size()) {
+    m_write.clear();
+    m_writePos = 0;
+  }
+}
+
+void
+ProtocolExtension::parse_handshake(const Object& message, PeerInfo* peerInfo) {
+  if (message.has_key_map("m")) {
+    const Object& m = message.get_key("m");
+
+    // A zero value disables the extension.
+    if (m.has_key_value("ut_pex") && m.get_key_value("ut_pex") >= 0 && m.get_key_value("ut_pex") < 256)
+      m_remoteId[UT_PEX] = m.get_key_value("ut_pex");
+  }
+
+  // Remember the listening port of incoming peers so the address is
+  // useful after it disconnects.
+  if (peerInfo->is_incoming() && message.has_key_value("p") &&
+      message.get_key_value("p") > 0 && message.get_key_value("p") < (1 << 16))
+    peerInfo->set_listen_port(message.get_key_value("p"));
+}
+
+void
+ProtocolExtension::parse_pex(const Object& message, DownloadMain* download) {
+  if (!message.has_key_string("added"))
+    return;
+
+  const std::string& added = message.get_key_string("added");
+
+  const SocketAddressCompact* first = reinterpret_cast<const SocketAddressCompact*>(added.c_str());
+  const SocketAddressCompact* last  = first + std::min<uint32_t>(added.size() / sizeof(SocketAddressCompact), max_pex_received);
+
+  uint32_t inserted = 0;
+
+  for (; first != last; ++first) {
+    rak::socket_address sa = *first;
+
+    if (sa.port() == 0 || sa.sa_inet()->address_n() == 0)
+      continue;
+
+    if (download->peer_list()->insert_address(sa.c_sockaddr(), PeerList::address_available) != NULL)
+      inserted++;
+  }
+
+  if (inserted != 0)
+    download->receive_connect_peers();
+}
+
+}
@@ -0,0 +1,135 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_PROTOCOL_EXTENSIONS_H
+#define LIBTORRENT_PROTOCOL_EXTENSIONS_H
+
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+#include "download/download_info.h"
+
+namespace torrent {
+
+class DownloadMain;
+class Object;
+class PeerInfo;
+
+// The BEP-10 extension protocol, the only extension supported is
+// ut_pex. The message payloads are too large for the protocol
+// buffers so they are read and written from a separate buffer, much
+// like pieces are.
+
+struct socket_address_compact_less {
+  bool operator () (const SocketAddressCompact& a, const SocketAddressCompact& b) const {
+    return a.addr < b.addr || (a.addr == b.addr && a.port < b.port);
+  }
+};
+
+class ProtocolExtension {
+public:
+  typedef std::vector<SocketAddressCompact> PexList;
+
+  typedef enum {
+    HANDSHAKE = 0,
+    UT_PEX,
+    FIRST_INVALID
+  } MessageType;
+
+  static const uint32_t max_message_size   = 1 << 15;
+
+  // Added addresses per ut_pex message, as recommended by BEP-11.
+  static const uint32_t max_pex_added      = 50;
+  static const uint32_t max_pex_received   = 200;
+
+  ProtocolExtension();
+  ~ProtocolExtension()                                 { delete [] m_read; }
+
+  bool                is_remote_pex() const            { return m_remoteId[UT_PEX] != 0; }
+  bool                is_local_pex() const             { return m_localPex; }
+
+  uint8_t             remote_id(MessageType t) const   { return m_remoteId[t]; }
+
+  void                generate_handshake(uint16_t port, bool pex);
+
+  // Returns false if there was no change since the last message.
+  bool                generate_pex(const PexList* current);
+
+  // Reading, 'length' excludes the extension id.
+  void                read_start(uint8_t id, uint32_t length);
+  void                read_done(DownloadMain* download, PeerInfo* peerInfo);
+
+  char*               read_position()                  { return m_read + m_readPos; }
+  uint32_t            read_remaining() const           { return m_readSize - m_readPos; }
+  void                read_move(uint32_t size)         { m_readPos += size; }
+
+  // Writing, the header is written to the protocol buffer and the
+  // payload from here.
+  bool                has_write() const                { return !m_write.empty(); }
+  uint8_t             write_id() const                 { return m_writeId; }
+  uint32_t            write_size() const               { return m_write.size(); }
+
+  const char*         write_position() const           { return m_write.c_str() + m_writePos; }
+  uint32_t            write_remaining() const          { return m_write.size() - m_writePos; }
+  void                write_move(uint32_t size);
+
+private:
+  ProtocolExtension(const ProtocolExtension&);
+  void operator = (const ProtocolExtension&);
+
+  void                parse_handshake(const Object& message, PeerInfo* peerInfo);
+  void                parse_pex(const Object& message, DownloadMain* download);
+
+  uint8_t             m_remoteId[FIRST_INVALID];
+  bool                m_localPex;
+
+  char*               m_read;
+  uint8_t             m_readId;
+  uint32_t            m_readSize;
+  uint32_t            m_readPos;
+
+  std::string         m_write;
+  uint8_t             m_writeId;
+  uint32_t            m_writePos;
+
+  // The sorted list of addresses the peer knows we are connected to.
+  PexList             m_pexSent;
+};
+
+}
+
+#endif
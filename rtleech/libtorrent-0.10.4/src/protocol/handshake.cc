@@ -36,16 +36,21 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <stdlib.h>
+
 #include "data/content.h"
 #include "download/download_info.h"
 #include "download/download_main.h"
 #include "torrent/exceptions.h"
 #include "torrent/connection_manager.h"
 #include "torrent/poll.h"
+#include "utils/random.h"
 
 #include "globals.h"
 #include "manager.h"
 
+#include "extensions.h"
 #include "handshake.h"
 #include "handshake_manager.h"
 
@@ -53,29 +58,30 @@ namespace torrent {
 
 const char* Handshake::m_protocol = "BitTorrent protocol";
 
-Handshake::Handshake(SocketFd fd, HandshakeManager* m) :
+Handshake::Handshake(SocketFd fd, HandshakeManager* m, uint32_t encryptionOptions) :
   m_state(INACTIVE),
 
   m_manager(m),
   m_peerInfo(NULL),
   m_download(NULL),
 
+  m_readBuffer(m->allocate_buffer()),
   m_readDone(false),
-  m_writeDone(false) {
 
-  set_fd(fd);
+  m_writeBuffer(m->allocate_buffer()),
+  m_writeDone(false),
+
+  m_utp(false),
 
-  m_readBuffer.reset();
-  m_writeBuffer.reset();      
+  m_encryption(encryptionOptions) {
 
-  m_taskTimeout.clear_time();
-  m_taskTimeout.set_slot(rak::bind_mem_fn(m, &HandshakeManager::receive_failed, this));
+  set_fd(fd);
+
+  m_readBuffer->reset();
+  m_writeBuffer->reset();
 }
 
 Handshake::~Handshake() {
-  if (m_taskTimeout.is_queued())
-    throw internal_error("Handshake m_taskTimeout bork bork bork.");
-
   if (get_fd().is_valid())
     throw internal_error("Handshake dtor called but m_fd is still open.");
 
@@ -85,6 +91,23 @@ Handshake::~Handshake() {
     m_peerInfo->unset_flags(PeerInfo::flag_handshake);
     m_peerInfo = NULL;
   }
+
+  m_manager->release_buffer(m_readBuffer);
+  m_manager->release_buffer(m_writeBuffer);
+}
+
+bool
+Handshake::should_retry() const {
+  if (m_incoming)
+    return false;
+
+  if (m_utp && m_readBuffer->size_end() == 0 && (m_state == READ_ENC_KEY || m_state == READ_INFO))
+    return true;
+
+  return
+    m_state == READ_ENC_KEY &&
+    (m_encryption.options() & ConnectionManager::encryption_enable_retry) &&
+    !(m_encryption.options() & ConnectionManager::encryption_require);
 }
 
 void
@@ -103,7 +126,7 @@ Handshake::initialize_outgoing(const rak::socket_address& sa, DownloadMain* d, P
   manager->poll()->insert_write(this);
   manager->poll()->insert_error(this);
 
-  priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(60)).round_seconds());
+  m_timeout = cachedTime + rak::timer::from_seconds(60);
 }
 
 void
@@ -118,53 +141,297 @@ Handshake::initialize_incoming(const rak::socket_address& sa) {
   manager->poll()->insert_error(this);
 
   // Use lower timeout here.
-  priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(60)).round_seconds());
+  m_timeout = cachedTime + rak::timer::from_seconds(60);
 }
 
 void
 Handshake::clear() {
   m_state = INACTIVE;
 
-  priority_queue_erase(&taskScheduler, &m_taskTimeout);
-
   manager->poll()->remove_read(this);
   manager->poll()->remove_write(this);
   manager->poll()->remove_error(this);
   manager->poll()->close(this);
 }
 
+inline uint32_t
+Handshake::read_stream_crypt(void* buf, uint32_t length) {
+  length = read_stream_throws(buf, length);
+
+  if (m_encryption.info()->is_encrypted())
+    m_encryption.info()->decrypt(buf, length);
+
+  return length;
+}
+
+bool
+Handshake::fill_read_buffer(uint32_t length) {
+  if (m_readBuffer->remaining() >= length)
+    return true;
+
+  if (m_readBuffer->size_position() + length > m_readBuffer->reserved())
+    throw internal_error("Handshake::fill_read_buffer(...) length too large.");
+
+  m_readBuffer->move_end(read_stream_throws(m_readBuffer->end(), length - m_readBuffer->remaining()));
+
+  return m_readBuffer->remaining() >= length;
+}
+
+// The key exchange reads only as much as each step needs, except
+// when looking for the end of the padding, so whatever follows the
+// handshake and the bitfield always fits in the peer connection's
+// read buffer.
+bool
+Handshake::read_encryption_key() {
+  if (!fill_read_buffer(HandshakeEncryption::key_size))
+    return false;
+
+  if (m_incoming)
+    m_encryption.initialize();
+
+  if (!m_encryption.compute_secret((const char*)m_readBuffer->position()))
+    throw close_connection();
+
+  m_readBuffer->move_position(HandshakeEncryption::key_size);
+  m_readBuffer->move_unused();
+
+  if (m_incoming)
+    prepare_key_plus_pad();
+  else
+    prepare_enc_request();
+
+  manager->poll()->insert_write(this);
+
+  m_state = READ_ENC_SYNC;
+  return true;
+}
+
+// The receiver looks for HASH('req1', S) and the initiator for
+// ENCRYPT(VC), either of which must follow at most 'pad_size' bytes
+// of padding.
+bool
+Handshake::read_encryption_sync() {
+  uint32_t syncSize = m_incoming ? HandshakeEncryption::hash_size : HandshakeEncryption::vc_size;
+  uint32_t window   = HandshakeEncryption::pad_size + syncSize;
+
+  if (m_readBuffer->size_end() < window)
+    m_readBuffer->move_end(read_stream_throws(m_readBuffer->end(), window - m_readBuffer->size_end()));
+
+  uint8_t sync[HandshakeEncryption::hash_size];
+
+  if (m_incoming)
+    m_encryption.hash_req1((char*)sync);
+  else
+    m_encryption.sync_verify((char*)sync);
+
+  Buffer::iterator itr = std::search(m_readBuffer->begin(), m_readBuffer->end(), sync, sync + syncSize);
+
+  if (itr == m_readBuffer->end()) {
+    if (m_readBuffer->size_end() >= window)
+      throw close_connection();
+
+    return false;
+  }
+
+  // Keep the decrypt stream in step with the peer.
+  if (!m_incoming)
+    m_encryption.info()->decrypt(itr, syncSize);
+
+  m_readBuffer->set_position_itr(itr + syncSize);
+  m_readBuffer->move_unused();
+
+  m_state = m_incoming ? READ_ENC_SKEY : READ_ENC_NEGOT;
+  return true;
+}
+
+bool
+Handshake::read_encryption_skey() {
+  if (!fill_read_buffer(HandshakeEncryption::hash_size))
+    return false;
+
+  char hash[HandshakeEncryption::hash_size];
+
+  m_readBuffer->read_range(hash, hash + HandshakeEncryption::hash_size);
+  m_encryption.deobfuscate_hash(hash);
+
+  m_download = m_manager->download_info_obfuscated(std::string(hash, HandshakeEncryption::hash_size));
+
+  if (m_download == NULL || !m_download->info()->is_accepting_new_peers())
+    throw close_connection();
+
+  m_manager->receive_download(this);
+  m_encryption.initialize_streams(m_download->info()->hash(), true);
+
+  m_state = READ_ENC_NEGOT;
+  return true;
+}
+
+bool
+Handshake::read_encryption_negotiation() {
+  uint32_t length = (m_incoming ? HandshakeEncryption::vc_size : 0) + 4 + 2;
+
+  if (!fill_read_buffer(length))
+    return false;
+
+  m_encryption.info()->decrypt(m_readBuffer->position(), length);
+
+  if (m_incoming) {
+    for (unsigned int i = 0; i < HandshakeEncryption::vc_size; ++i)
+      if (m_readBuffer->read_8() != 0)
+        throw close_connection();
+
+    if (!m_encryption.crypto_select(m_readBuffer->read_32()))
+      throw close_connection();
+
+  } else {
+    if (!m_encryption.crypto_accept(m_readBuffer->read_32()))
+      throw close_connection();
+  }
+
+  m_readPos = m_readBuffer->read_16();
+
+  if (m_readPos > HandshakeEncryption::pad_size)
+    throw close_connection();
+
+  m_readBuffer->move_unused();
+
+  m_state = READ_ENC_PAD;
+  return true;
+}
+
+bool
+Handshake::read_encryption_pad() {
+  // The receiver gets len(IA) along with the padding.
+  uint32_t length = m_readPos + (m_incoming ? 2 : 0);
+
+  if (!fill_read_buffer(length))
+    return false;
+
+  m_encryption.info()->decrypt(m_readBuffer->position(), length);
+  m_readBuffer->move_position(m_readPos);
+
+  if (m_incoming) {
+    m_readPos = m_readBuffer->read_16();
+
+    if (m_readPos > handshake_size)
+      throw close_connection();
+
+    m_readBuffer->move_unused();
+
+    prepare_enc_negotiation();
+    manager->poll()->insert_write(this);
+
+    m_state = READ_ENC_IA;
+    return true;
+  }
+
+  // The payload following the padding uses the selected method.
+  if (m_encryption.crypto() == HandshakeEncryption::crypto_rc4)
+    m_encryption.info()->decrypt(m_readBuffer->position(), m_readBuffer->remaining());
+  else
+    m_encryption.info()->set_encrypted(false);
+
+  m_readBuffer->move_unused();
+
+  m_state = READ_INFO;
+  return true;
+}
+
+bool
+Handshake::read_encryption_ia() {
+  if (!fill_read_buffer(m_readPos))
+    return false;
+
+  // The initial payload is always encrypted, what follows it only if
+  // RC4 was selected.
+  if (m_encryption.crypto() == HandshakeEncryption::crypto_rc4) {
+    m_encryption.info()->decrypt(m_readBuffer->position(), m_readBuffer->remaining());
+
+  } else {
+    m_encryption.info()->decrypt(m_readBuffer->position(), m_readPos);
+    m_encryption.info()->set_encrypted(false);
+  }
+
+  m_state = READ_INFO;
+  return true;
+}
+
 void
 Handshake::event_read() {
   try {
 
     switch (m_state) {
+    case READ_ENC_KEY:
+      if (!read_encryption_key())
+        return;
+
+    case READ_ENC_SYNC:
+      if (!read_encryption_sync())
+        return;
+
+    case READ_ENC_SKEY:
+      if (m_incoming && !read_encryption_skey())
+        return;
+
+    case READ_ENC_NEGOT:
+      if (!read_encryption_negotiation())
+        return;
+
+    case READ_ENC_PAD:
+      if (!read_encryption_pad())
+        return;
+
+    case READ_ENC_IA:
+      if (m_incoming && !read_encryption_ia())
+        return;
+
     case READ_INFO:
-      m_readBuffer.move_end(read_stream_throws(m_readBuffer.end(), handshake_size - m_readBuffer.size_end()));
+      if (m_readBuffer->size_end() < handshake_size)
+        m_readBuffer->move_end(read_stream_crypt(m_readBuffer->end(), handshake_size - m_readBuffer->size_end()));
 
       // Check the first byte as early as possible so we can
-      // disconnect non-BT connections if they send less than 20 bytes.
-      if (m_readBuffer.size_end() >= 1 && m_readBuffer.peek_8() != 19)
+      // disconnect non-BT connections if they send less than 20
+      // bytes. From incoming peers it may instead be the start of an
+      // encrypted handshake.
+      if (m_readBuffer->size_end() >= 1 && m_readBuffer->peek_8() != 19) {
+        if (!m_incoming || m_encryption.is_active() ||
+            !(m_encryption.options() & ConnectionManager::encryption_allow_incoming))
+          return m_manager->receive_failed(this);
+
+        m_state = READ_ENC_KEY;
+        return event_read();
+      }
+
+      if (m_readBuffer->size_end() >= 1 && !m_encryption.is_active() &&
+          (m_encryption.options() & ConnectionManager::encryption_require))
         return m_manager->receive_failed(this);
-      
-      if (m_readBuffer.size_end() < part1_size)
+
+      if (m_readBuffer->size_end() < part1_size)
         return;
 
-      if (std::memcmp(m_readBuffer.position() + 1, m_protocol, 19) != 0)
+      if (std::memcmp(m_readBuffer->position() + 1, m_protocol, 19) != 0)
         return m_manager->receive_failed(this);
 
-      m_readBuffer.move_position(20);
+      m_readBuffer->move_position(20);
 
       // Should do some option field stuff here, for now just copy.
-      m_readBuffer.read_range(m_options, m_options + 8);
+      m_readBuffer->read_range(m_options, m_options + 8);
 
       // Check the info hash.
       if (m_incoming) {
-        m_download = m_manager->download_info(std::string(m_readBuffer.position(), m_readBuffer.position() + 20));
-        m_readBuffer.move_position(20);
+        DownloadMain* download = m_manager->download_info(std::string(m_readBuffer->position(), m_readBuffer->position() + 20));
+        m_readBuffer->move_position(20);
 
-        if (m_download == NULL || !m_download->info()->is_accepting_new_peers())
+        // An encrypted handshake has already picked the download.
+        if (download == NULL || !download->info()->is_accepting_new_peers() ||
+            (m_download != NULL && m_download != download))
           return m_manager->receive_failed(this);
 
+        if (m_download == NULL) {
+          m_download = download;
+          m_manager->receive_download(this);
+        }
+
         m_state = WRITE_FILL;
 
         manager->poll()->remove_read(this);
@@ -173,24 +440,25 @@ Handshake::event_read() {
         return;
 
       } else {
-        if (std::memcmp(m_download->info()->hash().c_str(), m_readBuffer.position(), 20) != 0)
+        if (std::memcmp(m_download->info()->hash().c_str(), m_readBuffer->position(), 20) != 0)
           return m_manager->receive_failed(this);
 
         m_state = READ_PEER;
-        m_readBuffer.move_position(20);
+        m_readBuffer->move_position(20);
       }
 
     case READ_PEER:
-      if (m_readBuffer.size_end() < handshake_size)
-        m_readBuffer.move_end(read_stream_throws(m_readBuffer.end(), handshake_size - m_readBuffer.size_end()));
+      if (m_readBuffer->size_end() < handshake_size)
+        m_readBuffer->move_end(read_stream_crypt(m_readBuffer->end(), handshake_size - m_readBuffer->size_end()));
 
-      if (m_readBuffer.size_end() < handshake_size)
+      if (m_readBuffer->size_end() < handshake_size)
         return;
 
       prepare_peer_info();
-      
-      m_readBuffer.reset();
-      m_writeBuffer.reset();
+
+      // Keep anything the peer sent after the handshake.
+      m_readBuffer->move_position(20);
+      m_readBuffer->move_unused();
 
       // The download is just starting so we're not sending any
       // bitfield.
@@ -203,8 +471,7 @@ Handshake::event_read() {
       manager->poll()->insert_write(this);
 
       // Give some extra time for reading/writing the bitfield.
-      priority_queue_erase(&taskScheduler, &m_taskTimeout);
-      priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(120)).round_seconds());
+      m_timeout = cachedTime + rak::timer::from_seconds(120);
 
       // Trigger event_write() directly and then skip straight to read
       // BITFIELD. This avoids going through polling for the first
@@ -213,40 +480,38 @@ Handshake::event_read() {
 
     case BITFIELD:
       if (m_bitfield.empty()) {
-        m_readBuffer.move_end(read_stream_throws(m_readBuffer.end(), 5 - m_readBuffer.size_end()));
+        if (m_readBuffer->remaining() < 5)
+          m_readBuffer->move_end(read_stream_crypt(m_readBuffer->end(), 5 - m_readBuffer->remaining()));
 
         // Received a keep-alive message which means we won't be
         // getting any bitfield.
-        if (m_readBuffer.size_end() >= 4 && m_readBuffer.peek_32() == 0) {
-          m_readBuffer.read_32();
+        if (m_readBuffer->remaining() >= 4 && m_readBuffer->peek_32() == 0) {
+          m_readBuffer->read_32();
           return read_done();
         }
 
-        if (m_readBuffer.size_end() < 5)
+        if (m_readBuffer->remaining() < 5)
           return;
 
         // Received a non-bitfield command.
-        if (m_readBuffer.peek_8_at(4) != protocol_bitfield)
+        if (m_readBuffer->peek_8_at(4) != protocol_bitfield)
           return read_done();
 
-        if (m_readBuffer.read_32() != m_download->content()->bitfield()->size_bytes() + 1)
+        if (m_readBuffer->read_32() != m_download->content()->bitfield()->size_bytes() + 1)
           return m_manager->receive_failed(this);
 
-        m_readBuffer.read_8();
-        m_readPos = 0;
+        m_readBuffer->read_8();
 
         m_bitfield.set_size_bits(m_download->content()->bitfield()->size_bits());
         m_bitfield.allocate();
 
-        if (m_readBuffer.remaining() != 0)
-          throw internal_error("Handshake::event_read() m_readBuffer.remaining() != 0.");
-
-        // Copy any unread data to bitfield here.
+        // Copy any unread data to the bitfield.
+        m_readPos = std::min<uint32_t>(m_readBuffer->remaining(), m_bitfield.size_bytes());
+        m_readBuffer->read_range(m_bitfield.begin(), m_bitfield.begin() + m_readPos);
       }
 
-      // We're guaranteed that we still got bytes remaining to be
-      // read of the bitfield.
-      m_readPos += read_stream_throws(m_bitfield.begin() + m_readPos, m_bitfield.size_bytes() - m_readPos);
+      if (m_readPos != m_bitfield.size_bytes())
+        m_readPos += read_stream_crypt(m_bitfield.begin() + m_readPos, m_bitfield.size_bytes() - m_readPos);
       
       if (m_readPos == m_bitfield.size_bytes())
         read_done();
@@ -264,7 +529,7 @@ Handshake::event_read() {
 
 inline void
 Handshake::prepare_peer_info() {
-  if (std::memcmp(m_readBuffer.position(), m_download->info()->local_id().c_str(), 20) == 0)
+  if (std::memcmp(m_readBuffer->position(), m_download->info()->local_id().c_str(), 20) == 0)
     throw close_connection();
 
   // PeerInfo handling for outgoing connections needs to be moved to
@@ -282,23 +547,119 @@ Handshake::prepare_peer_info() {
   }
 
   std::memcpy(m_peerInfo->set_options(), m_options, 8);
-  m_peerInfo->set_id(std::string(m_readBuffer.position(), m_readBuffer.position() + 20));
+  m_peerInfo->set_id(std::string(m_readBuffer->position(), m_readBuffer->position() + 20));
+}
+
+inline Handshake::Buffer::iterator
+Handshake::write_begin() {
+  m_writeBuffer->move_unused();
+  m_writeBuffer->set_position_itr(m_writeBuffer->end());
+
+  return m_writeBuffer->position();
+}
+
+inline void
+Handshake::write_end(Buffer::iterator first, bool encrypt) {
+  if (encrypt)
+    m_encryption.info()->encrypt(first, m_writeBuffer->position() - first);
+
+  m_writeBuffer->prepare_end();
+}
+
+// Ya or Yb followed by random padding.
+void
+Handshake::prepare_key_plus_pad() {
+  Buffer::iterator first = write_begin();
+
+  m_writeBuffer->write_range(m_encryption.public_key(), m_encryption.public_key() + HandshakeEncryption::key_size);
+
+  uint16_t length;
+  random_bytes(&length, sizeof(length));
+  length %= HandshakeEncryption::pad_size;
+
+  random_bytes(m_writeBuffer->position(), length);
+  m_writeBuffer->move_position(length);
+  m_writeBuffer->validate_position();
+
+  write_end(first, false);
+}
+
+// The initiator's request, with our BitTorrent handshake as the
+// initial payload.
+void
+Handshake::prepare_enc_request() {
+  Buffer::iterator first = write_begin();
+
+  m_encryption.hash_req1((char*)m_writeBuffer->position());
+  m_writeBuffer->move_position(HandshakeEncryption::hash_size);
+
+  m_encryption.hash_req2_req3(m_download->info()->hash(), (char*)m_writeBuffer->position());
+  m_writeBuffer->move_position(HandshakeEncryption::hash_size);
+
+  m_encryption.initialize_streams(m_download->info()->hash(), false);
+
+  // ENCRYPT(VC, crypto_provide, len(PadC), PadC, len(IA), IA)
+  Buffer::iterator encrypted = m_writeBuffer->position();
+
+  std::memset(m_writeBuffer->position(), 0, HandshakeEncryption::vc_size);
+  m_writeBuffer->move_position(HandshakeEncryption::vc_size);
+
+  m_writeBuffer->write_32(m_encryption.crypto_provide());
+  m_writeBuffer->write_16(0);
+  m_writeBuffer->write_16(handshake_size);
+
+  prepare_handshake();
+
+  m_encryption.info()->encrypt(encrypted, m_writeBuffer->position() - encrypted);
+  write_end(first, false);
+}
+
+// ENCRYPT(VC, crypto_select, len(padD), padD)
+void
+Handshake::prepare_enc_negotiation() {
+  Buffer::iterator first = write_begin();
+
+  std::memset(m_writeBuffer->position(), 0, HandshakeEncryption::vc_size);
+  m_writeBuffer->move_position(HandshakeEncryption::vc_size);
+
+  m_writeBuffer->write_32(m_encryption.crypto());
+  m_writeBuffer->write_16(0);
+
+  write_end(first, true);
+}
+
+void
+Handshake::prepare_handshake() {
+  m_writeBuffer->write_8(19);
+  m_writeBuffer->write_range(m_protocol, m_protocol + 19);
+
+  //       m_writeBuffer->write_range(m_peerInfo->get_options(), m_peerInfo->get_options() + 8);
+  std::memset(m_writeBuffer->position(), 0, 8);
+  m_writeBuffer->position()[PeerInfo::option_extension_byte] |= PeerInfo::option_extension_bit;
+  m_writeBuffer->move_position(8);
+
+  m_writeBuffer->write_range(m_download->info()->hash().c_str(), m_download->info()->hash().c_str() + 20);
+  m_writeBuffer->write_range(m_download->info()->local_id().c_str(), m_download->info()->local_id().c_str() + 20);
 }
 
 inline void
 Handshake::prepare_write_bitfield() {
-  m_writeBuffer.write_32(m_download->content()->bitfield()->size_bytes() + 1);
-  m_writeBuffer.write_8(protocol_bitfield);
-  m_writeBuffer.prepare_end();
+  Buffer::iterator first = write_begin();
+
+  m_writeBuffer->write_32(m_download->content()->bitfield()->size_bytes() + 1);
+  m_writeBuffer->write_8(protocol_bitfield);
+  write_end(first, m_encryption.info()->is_encrypted());
 
   m_writePos = 0;
 }
 
 inline void
 Handshake::prepare_write_keepalive() {
+  Buffer::iterator first = write_begin();
+
   // Write a keep-alive message.
-  m_writeBuffer.write_32(0);
-  m_writeBuffer.prepare_end();
+  m_writeBuffer->write_32(0);
+  write_end(first, m_encryption.info()->is_encrypted());
 
   // Skip writting the bitfield.
   m_writePos = m_download->content()->bitfield()->size_bytes();
@@ -335,29 +696,27 @@ Handshake::event_write() {
     case CONNECTING:
       if (get_fd().get_error())
         return m_manager->receive_failed(this);
- 
-    case WRITE_FILL:
-      m_writeBuffer.write_8(19);
-      m_writeBuffer.write_range(m_protocol, m_protocol + 19);
 
-      //       m_writeBuffer.write_range(m_peerInfo->get_options(), m_peerInfo->get_options() + 8);
-      std::memset(m_writeBuffer.position(), 0, 8);
-      m_writeBuffer.move_position(8);
+      if (m_encryption.options() & ConnectionManager::encryption_try_outgoing) {
+        m_encryption.initialize();
+        prepare_key_plus_pad();
 
-      m_writeBuffer.write_range(m_download->info()->hash().c_str(), m_download->info()->hash().c_str() + 20);
-      m_writeBuffer.write_range(m_download->info()->local_id().c_str(), m_download->info()->local_id().c_str() + 20);
-
-      m_writeBuffer.prepare_end();
+        m_state = READ_ENC_KEY;
+        manager->poll()->insert_read(this);
+        break;
+      }
+ 
+    case WRITE_FILL: {
+      Buffer::iterator first = write_begin();
 
-      if (m_writeBuffer.size_end() != handshake_size)
-        throw internal_error("Handshake::event_write() wrong fill size.");
+      prepare_handshake();
+      write_end(first, m_encryption.info()->is_encrypted());
 
       m_state = WRITE_SEND;
+    }
 
     case WRITE_SEND:
-      m_writeBuffer.move_position(write_stream_throws(m_writeBuffer.position(), m_writeBuffer.remaining()));
-
-      if (m_writeBuffer.remaining())
+      if (!write_flush())
         return;
 
       if (m_incoming)
@@ -372,35 +731,71 @@ Handshake::event_write() {
 
     case BITFIELD:
       write_bitfield();
+      return;
 
- 
-     return;
+    // Sending the key exchange while reading the peer's part.
+    case READ_ENC_KEY:
+    case READ_ENC_SYNC:
+    case READ_ENC_SKEY:
+    case READ_ENC_NEGOT:
+    case READ_ENC_PAD:
+    case READ_ENC_IA:
+    case READ_INFO:
+    case READ_PEER:
+      break;
 
     default:
       throw internal_error("Handshake::event_write() called in invalid state.");
     }
 
+    if (write_flush())
+      manager->poll()->remove_write(this);
+
   } catch (network_error& e) {
     m_manager->receive_failed(this);
   }
 }
 
+bool
+Handshake::write_flush() {
+  if (m_writeBuffer->remaining())
+    m_writeBuffer->move_position(write_stream_throws(m_writeBuffer->position(), m_writeBuffer->remaining()));
+
+  return m_writeBuffer->remaining() == 0;
+}
+
 void
 Handshake::write_bitfield() {
   if (m_writeDone != false)
     throw internal_error("Handshake::event_write() m_writeDone != false.");
 
-  if (m_writeBuffer.remaining())
-    m_writeBuffer.move_position(write_stream_throws(m_writeBuffer.position(), m_writeBuffer.remaining()));
-      
-  if (m_writeBuffer.remaining())
+  if (!write_flush())
     return;
 
-  if (m_writePos != m_download->content()->bitfield()->size_bytes())
-    m_writePos += write_stream_throws(m_download->content()->bitfield()->begin() + m_writePos,
-                                      m_download->content()->bitfield()->size_bytes() - m_writePos);
+  const Bitfield* bitfield = m_download->content()->bitfield();
+
+  if (m_writePos != bitfield->size_bytes()) {
+
+    if (m_encryption.info()->is_encrypted()) {
+      // The bitfield is shared with every other connection, so it
+      // goes through the write buffer a part at a time.
+      uint32_t length = std::min<uint32_t>(bitfield->size_bytes() - m_writePos, m_writeBuffer->reserved());
+
+      m_writeBuffer->reset();
+      m_encryption.info()->encrypt(bitfield->begin() + m_writePos, m_writeBuffer->begin(), length);
+      m_writeBuffer->set_end(length);
+
+      m_writePos += length;
+
+      if (!write_flush())
+        return;
+
+    } else {
+      m_writePos += write_stream_throws(bitfield->begin() + m_writePos, bitfield->size_bytes() - m_writePos);
+    }
+  }
 
-  if (m_writePos == m_download->content()->bitfield()->size_bytes()) {
+  if (m_writePos == bitfield->size_bytes() && m_writeBuffer->remaining() == 0) {
     m_writeDone = true;
     manager->poll()->remove_write(this);
 
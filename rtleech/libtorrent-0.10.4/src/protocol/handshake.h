@@ -37,18 +37,25 @@
 #ifndef LIBTORRENT_HANDSHAKE_H
 #define LIBTORRENT_HANDSHAKE_H
 
-#include <rak/priority_queue_default.h>
+#include <rak/timer.h>
 
 #include "net/protocol_buffer.h"
 #include "net/socket_stream.h"
 #include "torrent/bitfield.h"
 #include "torrent/peer_info.h"
 
+#include "handshake_encryption.h"
+
 namespace torrent {
 
 class HandshakeManager;
 class DownloadMain;
 
+// Large enough for the key exchange with the longest padding, the
+// pooled buffers are handed out by HandshakeManager.
+class HandshakeBuffer : public ProtocolBuffer<1024> {
+};
+
 class Handshake : public SocketStream {
 public:
   static const uint32_t part1_size     = 20 + 28;
@@ -57,23 +64,41 @@ public:
 
   static const uint32_t protocol_bitfield = 5;
 
-  typedef ProtocolBuffer<handshake_size> Buffer;
+  typedef HandshakeBuffer Buffer;
 
   typedef enum {
     INACTIVE,
     CONNECTING,
     WRITE_FILL,
     WRITE_SEND,
+
+    READ_ENC_KEY,
+    READ_ENC_SYNC,
+    READ_ENC_SKEY,
+    READ_ENC_NEGOT,
+    READ_ENC_PAD,
+    READ_ENC_IA,
+
     READ_INFO,
     READ_PEER,
 
     BITFIELD
   } State;
 
-  Handshake(SocketFd fd, HandshakeManager* m);
+  Handshake(SocketFd fd, HandshakeManager* m, uint32_t encryptionOptions);
   ~Handshake();
 
   bool                is_active() const             { return m_state != INACTIVE; }
+  bool                is_incoming() const           { return m_incoming; }
+
+  // Connected through UtpManager rather than TCP.
+  bool                is_utp() const                { return m_utp; }
+  void                set_utp(bool state)           { m_utp = state; }
+
+  // An outgoing encrypted handshake dropped before the peer sent its
+  // key may be retried in plaintext, and a uTP peer that never
+  // answered may be retried over TCP.
+  bool                should_retry() const;
 
   void                initialize_outgoing(const rak::socket_address& sa, DownloadMain* d, PeerInfo* peerInfo);
   void                initialize_incoming(const rak::socket_address& sa);
@@ -87,13 +112,21 @@ public:
 
   DownloadMain*       download()                    { return m_download; }
   Bitfield*           bitfield()                    { return &m_bitfield; }
-  
+
+  HandshakeEncryption* encryption()                 { return &m_encryption; }
+
+  // Position in HandshakeManager's list, for constant time removal.
+  uint32_t            index() const                 { return m_index; }
+  void                set_index(uint32_t i)         { m_index = i; }
+
+  rak::timer          timeout() const               { return m_timeout; }
+
   // Make sure the fd is valid when this is called. The caller is
   // responsible for closing the socket if nessesary.
   void                clear();
 
-  const void*         unread_data()                 { return m_readBuffer.position(); }
-  uint32_t            unread_size() const           { return m_readBuffer.remaining(); }
+  const void*         unread_data()                 { return m_readBuffer->position(); }
+  uint32_t            unread_size() const           { return m_readBuffer->remaining(); }
 
   virtual void        event_read();
   virtual void        event_write();
@@ -105,11 +138,34 @@ protected:
   
   void                read_done();
 
+  bool                read_encryption_key();
+  bool                read_encryption_sync();
+  bool                read_encryption_skey();
+  bool                read_encryption_negotiation();
+  bool                read_encryption_pad();
+  bool                read_encryption_ia();
+
+  // Read raw bytes until 'length' bytes remain in the read buffer.
+  bool                fill_read_buffer(uint32_t length);
+
+  inline uint32_t     read_stream_crypt(void* buf, uint32_t length);
+
   inline void         prepare_peer_info();
 
+  void                prepare_key_plus_pad();
+  void                prepare_enc_request();
+  void                prepare_enc_negotiation();
+  void                prepare_handshake();
+
   inline void         prepare_write_bitfield();
   inline void         prepare_write_keepalive();
 
+  // New data is appended after anything not yet written. Everything
+  // from 'first' is encrypted if the stream is.
+  inline Buffer::iterator write_begin();
+  inline void         write_end(Buffer::iterator first, bool encrypt);
+
+  bool                write_flush();
   void                write_bitfield();
 
   static const char*  m_protocol;
@@ -122,20 +178,24 @@ protected:
   DownloadMain*       m_download;
   Bitfield            m_bitfield;
 
-  rak::priority_item  m_taskTimeout;
+  rak::timer          m_timeout;
+  uint32_t            m_index;
 
   uint32_t            m_readPos;
-  Buffer              m_readBuffer;
+  Buffer*             m_readBuffer;
   bool                m_readDone;
 
   uint32_t            m_writePos;
-  Buffer              m_writeBuffer;
+  Buffer*             m_writeBuffer;
   bool                m_writeDone;
 
   bool                m_incoming;
+  bool                m_utp;
 
   rak::socket_address m_address;
   char                m_options[8];
+
+  HandshakeEncryption m_encryption;
 };
 
 }
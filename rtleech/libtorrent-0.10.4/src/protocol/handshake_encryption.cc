@@ -0,0 +1,170 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#include "config.h"
+
+#include <cstring>
+
+#include "torrent/connection_manager.h"
+#include "torrent/exceptions.h"
+#include "utils/sha1.h"
+
+#include "handshake_encryption.h"
+
+namespace torrent {
+
+void
+HandshakeEncryption::initialize() {
+  if (m_key != NULL)
+    throw internal_error("HandshakeEncryption::initialize() called on an active key exchange.");
+
+  m_key = new DiffieHellman;
+}
+
+bool
+HandshakeEncryption::compute_secret(const char* key) {
+  return m_key->compute_secret(key, m_secret);
+}
+
+void
+HandshakeEncryption::hash_req1(char* dest) const {
+  Sha1 sha;
+
+  sha.init();
+  sha.update("req1", 4);
+  sha.update(m_secret, key_size);
+  sha.final_c(dest);
+}
+
+void
+HandshakeEncryption::hash_req2_req3(const std::string& infoHash, char* dest) const {
+  hash_obfuscated(infoHash, dest);
+  deobfuscate_hash(dest);
+}
+
+void
+HandshakeEncryption::deobfuscate_hash(char* hash) const {
+  char req3[hash_size];
+  Sha1 sha;
+
+  sha.init();
+  sha.update("req3", 4);
+  sha.update(m_secret, key_size);
+  sha.final_c(req3);
+
+  for (unsigned int i = 0; i < hash_size; ++i)
+    hash[i] ^= req3[i];
+}
+
+void
+HandshakeEncryption::initialize_streams(const std::string& infoHash, bool incoming) {
+  char keyA[hash_size];
+  char keyB[hash_size];
+  Sha1 sha;
+
+  sha.init();
+  sha.update("keyA", 4);
+  sha.update(m_secret, key_size);
+  sha.update(infoHash.c_str(), infoHash.size());
+  sha.final_c(keyA);
+
+  sha.init();
+  sha.update("keyB", 4);
+  sha.update(m_secret, key_size);
+  sha.update(infoHash.c_str(), infoHash.size());
+  sha.final_c(keyB);
+
+  // The initiator encrypts with keyA and the receiver with keyB.
+  m_info.encrypt_state()->set_key(incoming ? keyB : keyA, hash_size);
+  m_info.decrypt_state()->set_key(incoming ? keyA : keyB, hash_size);
+
+  m_info.encrypt_state()->discard(1024);
+  m_info.decrypt_state()->discard(1024);
+
+  m_info.set_encrypted(true);
+}
+
+void
+HandshakeEncryption::sync_verify(char* dest) const {
+  RC4 rc4 = *m_info.decrypt_state();
+
+  std::memset(dest, 0, vc_size);
+  rc4.crypt(dest, vc_size);
+}
+
+uint32_t
+HandshakeEncryption::crypto_provide() const {
+  if (m_options & ConnectionManager::encryption_require)
+    return crypto_rc4;
+  else
+    return crypto_rc4 | crypto_plain;
+}
+
+bool
+HandshakeEncryption::crypto_select(uint32_t provide) {
+  bool plain = (provide & crypto_plain) && !(m_options & ConnectionManager::encryption_require);
+
+  if ((provide & crypto_rc4) && !(plain && (m_options & ConnectionManager::encryption_prefer_plaintext)))
+    m_crypto = crypto_rc4;
+  else if (plain)
+    m_crypto = crypto_plain;
+  else
+    return false;
+
+  return true;
+}
+
+bool
+HandshakeEncryption::crypto_accept(uint32_t select) {
+  if ((select != crypto_rc4 && select != crypto_plain) || !(select & crypto_provide()))
+    return false;
+
+  m_crypto = select;
+  return true;
+}
+
+void
+HandshakeEncryption::hash_obfuscated(const std::string& infoHash, char* dest) {
+  Sha1 sha;
+
+  sha.init();
+  sha.update("req2", 4);
+  sha.update(infoHash.c_str(), infoHash.size());
+  sha.final_c(dest);
+}
+
+}
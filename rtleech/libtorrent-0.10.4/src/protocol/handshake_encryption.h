@@ -0,0 +1,124 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#ifndef LIBTORRENT_PROTOCOL_HANDSHAKE_ENCRYPTION_H
+#define LIBTORRENT_PROTOCOL_HANDSHAKE_ENCRYPTION_H
+
+#include <string>
+
+#include "utils/diffie_hellman.h"
+
+#include "encryption_info.h"
+
+namespace torrent {
+
+// Key exchange and stream setup for the message stream encryption
+// handshake:
+//
+// A->B: Ya, PadA
+// B->A: Yb, PadB
+// A->B: HASH('req1', S), HASH('req2', SKEY) xor HASH('req3', S),
+//       ENCRYPT(VC, crypto_provide, len(PadC), PadC, len(IA)), ENCRYPT(IA)
+// B->A: ENCRYPT(VC, crypto_select, len(padD), padD), ENCRYPT2(payload)
+//
+// where SKEY is the info hash, VC eight zero bytes and the RC4 keys
+// HASH('keyA', S, SKEY) and HASH('keyB', S, SKEY) with the first 1024
+// bytes of the keystream discarded. The Diffie-Hellman key is only
+// generated when the handshake turns out to be encrypted.
+
+class HandshakeEncryption {
+public:
+  static const uint32_t crypto_plain     = 1;
+  static const uint32_t crypto_rc4       = 2;
+
+  static const uint32_t key_size         = DiffieHellman::key_size;
+  static const uint32_t pad_size         = 512;
+  static const uint32_t vc_size          = 8;
+  static const uint32_t hash_size        = 20;
+
+  HandshakeEncryption(uint32_t options) : m_options(options), m_key(NULL), m_crypto(0) {}
+  ~HandshakeEncryption()                                                  { delete m_key; }
+
+  bool                is_active() const                                   { return m_key != NULL; }
+
+  uint32_t            options() const                                     { return m_options; }
+  void                set_options(uint32_t o)                             { m_options = o; }
+
+  uint32_t            crypto() const                                      { return m_crypto; }
+
+  EncryptionInfo*     info()                                              { return &m_info; }
+
+  const char*         public_key() const                                  { return m_key->public_key(); }
+
+  void                initialize();
+  bool                compute_secret(const char* key);
+
+  void                hash_req1(char* dest) const;
+  void                hash_req2_req3(const std::string& infoHash, char* dest) const;
+
+  // Turns the received 'HASH('req2', SKEY) xor HASH('req3', S)' into
+  // 'HASH('req2', SKEY)', in place.
+  void                deobfuscate_hash(char* hash) const;
+
+  void                initialize_streams(const std::string& infoHash, bool incoming);
+
+  // What the peer would send as ENCRYPT(VC) with the current decrypt
+  // state, used to find the end of its padding.
+  void                sync_verify(char* dest) const;
+
+  uint32_t            crypto_provide() const;
+  bool                crypto_select(uint32_t provide);
+  bool                crypto_accept(uint32_t select);
+
+  static void         hash_obfuscated(const std::string& infoHash, char* dest);
+
+private:
+  HandshakeEncryption(const HandshakeEncryption&);
+  void operator = (const HandshakeEncryption&);
+
+  uint32_t            m_options;
+
+  DiffieHellman*      m_key;
+  char                m_secret[key_size];
+
+  uint32_t            m_crypto;
+  EncryptionInfo      m_info;
+};
+
+}
+
+#endif
@@ -43,11 +43,13 @@
 #include "download/download_main.h"
 #include "torrent/connection_manager.h"
 #include "torrent/peer_info.h"
+#include "net/utp_manager.h"
 
 #include "peer_connection_base.h"
 #include "handshake.h"
 #include "handshake_manager.h"
 
+#include "globals.h"
 #include "manager.h"
 
 namespace torrent {
@@ -63,44 +65,101 @@ HandshakeManager::delete_handshake(Handshake* h) {
   delete h;
 }
 
+HandshakeManager::HandshakeManager() :
+  m_sizeOutgoing(0) {
+
+  m_taskTimeout.set_slot(rak::mem_fn(this, &HandshakeManager::receive_timeout));
+}
+
+HandshakeManager::~HandshakeManager() {
+  clear();
+
+  std::for_each(m_bufferPool.begin(), m_bufferPool.end(), rak::call_delete<HandshakeBuffer>());
+}
+
 HandshakeManager::size_type
 HandshakeManager::size_info(DownloadMain* info) const {
-  return std::count_if(base_type::begin(), base_type::end(), rak::equal(info, std::mem_fun(&Handshake::download)));
+  DownloadCount::const_iterator itr = m_downloadCount.find(info);
+
+  return itr != m_downloadCount.end() ? itr->second : 0;
 }
 
 void
 HandshakeManager::clear() {
   std::for_each(base_type::begin(), base_type::end(), std::bind1st(std::mem_fun(&HandshakeManager::delete_handshake), this));
   base_type::clear();
+
+  m_sizeOutgoing = 0;
+  m_downloadCount.clear();
+
+  priority_queue_erase(&taskScheduler, &m_taskTimeout);
 }
 
 void
-HandshakeManager::erase(Handshake* handshake) {
-  iterator itr = std::find(base_type::begin(), base_type::end(), handshake);
+HandshakeManager::insert(Handshake* h) {
+  h->set_index(base_type::size());
+  base_type::push_back(h);
 
-  if (itr == base_type::end())
-    throw internal_error("HandshakeManager::erase(...) could not find handshake.");
+  if (!h->is_incoming())
+    m_sizeOutgoing++;
+
+  if (h->download() != NULL)
+    m_downloadCount[h->download()]++;
 
-  base_type::erase(itr);
+  if (!m_taskTimeout.is_queued())
+    priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(timeout_interval)).round_seconds());
 }
 
-struct handshake_manager_equal : std::binary_function<const rak::socket_address*, const Handshake*, bool> {
-  bool operator () (const rak::socket_address* sa1, const Handshake* p2) const {
-    return p2->peer_info() != NULL && *sa1 == *rak::socket_address::cast_from(p2->peer_info()->socket_address());
+void
+HandshakeManager::erase(Handshake* handshake) {
+  if (handshake->index() >= base_type::size() || *(base_type::begin() + handshake->index()) != handshake)
+    throw internal_error("HandshakeManager::erase(...) could not find handshake.");
+
+  // The last handshake takes the place of the erased one.
+  iterator itr = base_type::erase(base_type::begin() + handshake->index());
+
+  if (itr != base_type::end())
+    (*itr)->set_index(handshake->index());
+
+  if (!handshake->is_incoming())
+    m_sizeOutgoing--;
+
+  if (handshake->download() != NULL) {
+    DownloadCount::iterator count = m_downloadCount.find(handshake->download());
+
+    if (count == m_downloadCount.end())
+      throw internal_error("HandshakeManager::erase(...) download count not found.");
+
+    if (--count->second == 0)
+      m_downloadCount.erase(count);
   }
-};
+
+  if (base_type::empty())
+    priority_queue_erase(&taskScheduler, &m_taskTimeout);
+}
 
 bool
-HandshakeManager::find(const rak::socket_address& sa) {
-  return std::find_if(base_type::begin(), base_type::end(), std::bind1st(handshake_manager_equal(), &sa)) != base_type::end();
+HandshakeManager::find(DownloadMain* info, const rak::socket_address& sa) {
+  PeerInfo* peerInfo = info->peer_list()->find(sa.c_sockaddr());
+
+  return
+    peerInfo != NULL && peerInfo->is_handshake() &&
+    *rak::socket_address::cast_from(peerInfo->socket_address()) == sa;
 }
 
+// Walk backwards so the handshakes moved into erased positions have
+// already been checked.
 void
 HandshakeManager::erase_download(DownloadMain* info) {
-  iterator split = std::partition(base_type::begin(), base_type::end(), rak::not_equal(info, std::mem_fun(&Handshake::download)));
+  for (size_type i = base_type::size(); i != 0; --i) {
+    Handshake* h = *(base_type::begin() + i - 1);
+
+    if (h->download() != info)
+      continue;
 
-  std::for_each(split, base_type::end(), std::bind1st(std::mem_fun(&HandshakeManager::delete_handshake), this));
-  base_type::erase(split, base_type::end());
+    erase(h);
+    delete_handshake(h);
+  }
 }
 
 void
@@ -114,14 +173,38 @@ HandshakeManager::add_incoming(SocketFd fd, const rak::socket_address& sa) {
 
   manager->connection_manager()->inc_socket_count();
 
-  Handshake* h = new Handshake(fd, this);
+  Handshake* h = new Handshake(fd, this, manager->connection_manager()->encryption_options());
   h->initialize_incoming(sa);
 
-  base_type::push_back(h);
+  insert(h);
+}
+
+// The socket is our end of UtpManager's local pair, so the TCP
+// options do not apply.
+void
+HandshakeManager::add_incoming_utp(SocketFd fd, const rak::socket_address& sa) {
+  if (!manager->connection_manager()->can_connect() ||
+      !manager->connection_manager()->filter(sa.c_sockaddr())) {
+    fd.close();
+    return;
+  }
+
+  manager->connection_manager()->inc_socket_count();
+
+  Handshake* h = new Handshake(fd, this, manager->connection_manager()->encryption_options());
+  h->set_utp(true);
+  h->initialize_incoming(sa);
+
+  insert(h);
 }
   
 void
 HandshakeManager::add_outgoing(const rak::socket_address& sa, DownloadMain* download) {
+  create_outgoing(sa, download, manager->connection_manager()->encryption_options(), manager->utp_manager()->is_outgoing());
+}
+
+void
+HandshakeManager::create_outgoing(const rak::socket_address& sa, DownloadMain* download, uint32_t encryptionOptions, bool utp) {
   if (!manager->connection_manager()->can_connect() ||
       !manager->connection_manager()->filter(sa.c_sockaddr()))
     return;
@@ -131,27 +214,22 @@ HandshakeManager::add_outgoing(const rak::socket_address& sa, DownloadMain* down
   if (peerInfo == NULL)
     return;
 
-  SocketFd fd;
-  const rak::socket_address* bindAddress = rak::socket_address::cast_from(manager->connection_manager()->bind_address());
-
-  if (!fd.open_stream() ||
-      !setup_socket(fd) ||
-      (bindAddress->is_bindable() && !fd.bind(*bindAddress)) ||
-      !fd.connect(sa)) {
+  utp = utp && manager->utp_manager()->is_open();
 
-    if (fd.is_valid())
-      fd.close();
+  SocketFd fd;
 
+  if (!open_socket(&fd, sa, utp)) {
     download->peer_list()->disconnected(peerInfo, 0);
     return;
   }
 
   manager->connection_manager()->inc_socket_count();
 
-  Handshake* h = new Handshake(fd, this);
+  Handshake* h = new Handshake(fd, this, encryptionOptions);
+  h->set_utp(utp);
   h->initialize_outgoing(sa, download, peerInfo);
 
-  base_type::push_back(h);
+  insert(h);
 }
 
 void
@@ -162,6 +240,7 @@ HandshakeManager::receive_succeeded(Handshake* h) {
   erase(h);
   h->clear();
   h->peer_info()->unset_flags(PeerInfo::flag_handshake);
+  h->peer_info()->set_failed_connects(0);
 
   PeerConnectionBase* pcb;
 
@@ -171,7 +250,7 @@ HandshakeManager::receive_succeeded(Handshake* h) {
       // connects to, and to move this somewhere else.
       (!h->download()->content()->is_done() || !h->bitfield()->is_all_set()) &&
 
-      (pcb = h->download()->connection_list()->insert(h->peer_info(), h->get_fd(), h->bitfield())) != NULL) {
+      (pcb = h->download()->connection_list()->insert(h->peer_info(), h->get_fd(), h->bitfield(), h->encryption()->info())) != NULL) {
 
 //     h->download()->info()->signal_network_log().emit("Successful handshake: " + h->peer_info()->socket_address()->address_str());
     h->set_peer_info(NULL);
@@ -206,14 +285,92 @@ HandshakeManager::receive_failed(Handshake* h) {
 //     h->download()->info()->signal_network_log().emit("Failed handshake: " + h->socket_address()->address_str());
 
   erase(h);
+
+  // Peers that did not answer over uTP are tried over TCP, and
+  // those that dropped our encrypted handshake without encryption.
+  if (h->should_retry()) {
+    rak::socket_address sa = *h->socket_address();
+    DownloadMain* download = h->download();
+    uint32_t options = h->encryption()->options();
+
+    if (!h->is_utp())
+      options &= ~ConnectionManager::encryption_try_outgoing;
+
+    delete_handshake(h);
+    create_outgoing(sa, download, options, false);
+    return;
+  }
+
+  if (!h->is_incoming() && h->peer_info() != NULL)
+    h->peer_info()->set_failed_connects(h->peer_info()->failed_connects() + 1);
+
   delete_handshake(h);
 }
 
+void
+HandshakeManager::receive_download(Handshake* h) {
+  if (h->download() == NULL)
+    throw internal_error("HandshakeManager::receive_download(...) h->download() == NULL.");
+
+  m_downloadCount[h->download()]++;
+}
+
+void
+HandshakeManager::receive_timeout() {
+  for (size_type i = base_type::size(); i != 0; --i) {
+    Handshake* h = *(base_type::begin() + i - 1);
+
+    if (h->timeout() <= cachedTime)
+      receive_failed(h);
+  }
+
+  if (!base_type::empty())
+    priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(timeout_interval)).round_seconds());
+}
+
+HandshakeBuffer*
+HandshakeManager::allocate_buffer() {
+  if (m_bufferPool.empty())
+    return new HandshakeBuffer;
+
+  HandshakeBuffer* buffer = m_bufferPool.back();
+  m_bufferPool.pop_back();
+
+  return buffer;
+}
+
+void
+HandshakeManager::release_buffer(HandshakeBuffer* buffer) {
+  if (m_bufferPool.size() < max_buffer_pool)
+    m_bufferPool.push_back(buffer);
+  else
+    delete buffer;
+}
+
 bool
-HandshakeManager::setup_socket(SocketFd fd) {
-  if (!fd.set_nonblock())
+HandshakeManager::open_socket(SocketFd* fd, const rak::socket_address& sa, bool utp) {
+  if (utp)
+    return manager->utp_manager()->connect(sa, fd);
+
+  const rak::socket_address* bindAddress = rak::socket_address::cast_from(manager->connection_manager()->bind_address());
+
+  if (!fd->open_stream() ||
+      !fd->set_nonblock() ||
+      !setup_socket(*fd) ||
+      (bindAddress->is_bindable() && !fd->bind(*bindAddress)) ||
+      !fd->connect(sa)) {
+
+    if (fd->is_valid())
+      fd->close();
+
     return false;
+  }
 
+  return true;
+}
+
+bool
+HandshakeManager::setup_socket(SocketFd fd) {
   ConnectionManager* m = manager->connection_manager();
 
   if (m->priority() != ConnectionManager::iptos_default && !fd.set_priority(ConnectionManager::iptos_throughput))
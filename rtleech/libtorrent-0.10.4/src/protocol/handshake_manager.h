@@ -37,9 +37,12 @@
 #ifndef LIBTORRENT_NET_HANDSHAKE_MANAGER_H
 #define LIBTORRENT_NET_HANDSHAKE_MANAGER_H
 
+#include <map>
 #include <string>
+#include <vector>
 #include <inttypes.h>
 #include <rak/functional.h>
+#include <rak/priority_queue_default.h>
 #include <rak/unordered_vector.h>
 #include <rak/socket_address.h>
 
@@ -48,10 +51,17 @@
 namespace torrent {
 
 class Handshake;
+class HandshakeBuffer;
 class DownloadManager;
 class DownloadMain;
 class PeerConnectionBase;
 
+// Each handshake knows its own position in the list so it can be
+// removed in constant time, and the per-download and outgoing counts
+// are kept up to date instead of being counted. Timeouts are checked
+// by a single periodic sweep rather than a task per handshake, and
+// the read/write buffers are recycled through a free list.
+
 class HandshakeManager : private rak::unordered_vector<Handshake*> {
 public:
   typedef rak::unordered_vector<Handshake*> base_type;
@@ -59,42 +69,73 @@ public:
 
   typedef rak::mem_fun1<DownloadManager, DownloadMain*, const std::string&> SlotDownloadId;
 
+  static const size_type max_buffer_pool  = 128;
+  static const int32_t   timeout_interval = 5;
+
   using base_type::empty;
 
-  HandshakeManager() { }
-  ~HandshakeManager() { clear(); }
+  HandshakeManager();
+  ~HandshakeManager();
 
   size_type           size() const { return base_type::size(); }
   size_type           size_info(DownloadMain* info) const;
+  size_type           size_outgoing() const                     { return m_sizeOutgoing; }
 
   void                clear();
 
-  bool                find(const rak::socket_address& sa);
+  // Looked up through the download's PeerList index.
+  bool                find(DownloadMain* info, const rak::socket_address& sa);
 
   void                erase_download(DownloadMain* info);
 
   // Cleanup.
   void                add_incoming(SocketFd fd, const rak::socket_address& sa);
+  void                add_incoming_utp(SocketFd fd, const rak::socket_address& sa);
   void                add_outgoing(const rak::socket_address& sa, DownloadMain* info);
 
   void                slot_download_id(SlotDownloadId s)        { m_slotDownloadId = s; }
+  void                slot_download_obfuscated(SlotDownloadId s) { m_slotDownloadObfuscated = s; }
 
   void                receive_succeeded(Handshake* h);
   void                receive_failed(Handshake* h);
 
+  // Called when an incoming handshake has found its download.
+  void                receive_download(Handshake* h);
+
   // This needs to be filterable slot.
   DownloadMain*       download_info(const std::string& hash)    { return m_slotDownloadId(hash); }
+  DownloadMain*       download_info_obfuscated(const std::string& hash) { return m_slotDownloadObfuscated(hash); }
+
+  HandshakeBuffer*    allocate_buffer();
+  void                release_buffer(HandshakeBuffer* buffer);
 
 private:
+  typedef std::map<DownloadMain*, size_type> DownloadCount;
+  typedef std::vector<HandshakeBuffer*>      BufferPool;
+
+  void                insert(Handshake* h);
   void                erase(Handshake* handshake);
 
+  void                create_outgoing(const rak::socket_address& sa, DownloadMain* info, uint32_t encryptionOptions, bool utp);
+
   bool                setup_socket(SocketFd fd);
+  bool                open_socket(SocketFd* fd, const rak::socket_address& sa, bool utp);
 
   inline void         delete_handshake(Handshake* h);
 
   inline void         post_insert(Handshake* h, PeerConnectionBase* pcb);
 
+  void                receive_timeout();
+
   SlotDownloadId      m_slotDownloadId;
+  SlotDownloadId      m_slotDownloadObfuscated;
+
+  size_type           m_sizeOutgoing;
+  DownloadCount       m_downloadCount;
+
+  BufferPool          m_bufferPool;
+
+  rak::priority_item  m_taskTimeout;
 };
 
 }
@@ -75,6 +75,7 @@ public:
   //RequestList*        download_queue()              { return &m_downloadQueue; }
 
   piece_list_type*    upload_queue()                { return &m_uploadQueue; }
+  piece_list_type*    cancel_queue()                { return &m_cancelQueue; }
   index_list_type*    have_queue()                  { return &m_haveQueue; }
 
   Rate*               peer_rate()                   { return &m_peerRate; }
@@ -93,6 +94,7 @@ private:
   rak::partial_queue  m_downloadCache;
 
   piece_list_type     m_uploadQueue;
+  piece_list_type     m_cancelQueue;
   index_list_type     m_haveQueue;
 
   Rate                m_peerRate;
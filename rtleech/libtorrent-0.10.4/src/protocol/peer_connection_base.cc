@@ -36,6 +36,8 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <functional>
 #include <sstream>
 #include <rak/error_number.h>
 
@@ -69,16 +71,22 @@ PeerConnectionBase::PeerConnectionBase() :
   m_downStall(0),
 
   m_sendChoked(false),
-  m_sendInterested(false) {
+  m_sendInterested(false),
+
+  m_chokeIndex(0),
+
+  m_encryptBuffer(NULL) {
 }
 
 PeerConnectionBase::~PeerConnectionBase() {
   delete m_up;
   delete m_down;
+
+  delete m_encryptBuffer;
 }
 
 void
-PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, SocketFd fd, Bitfield* bitfield) {
+PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, SocketFd fd, Bitfield* bitfield, EncryptionInfo* encryptionInfo) {
   if (get_fd().is_valid())
     throw internal_error("Tried to re-set PeerConnection.");
 
@@ -93,6 +101,13 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
   m_peerChunks.set_peer_info(m_peerInfo);
   m_peerChunks.bitfield()->swap(*bitfield);
 
+  m_encryption = *encryptionInfo;
+
+  if (m_encryption.is_encrypted()) {
+    m_encryptBuffer = new EncryptBuffer;
+    m_encryptBuffer->reset();
+  }
+
   m_peerChunks.upload_throttle()->set_list_iterator(m_download->upload_throttle()->end());
   m_peerChunks.upload_throttle()->slot_activate(rak::make_mem_fun(this, &PeerConnectionBase::receive_throttle_up_activate));
 
@@ -111,6 +126,9 @@ PeerConnectionBase::initialize(DownloadMain* download, PeerInfo* peerInfo, Socke
 
   m_download->chunk_statistics()->received_connect(&m_peerChunks);
 
+  if (m_peerInfo->supports_extensions())
+    m_extensions.generate_handshake(manager->connection_manager()->listen_port(), !m_download->info()->is_private());
+
   // Hmm... cleanup?
   update_interested();
 
@@ -215,6 +233,31 @@ PeerConnectionBase::receive_throttle_up_activate() {
   manager->poll()->insert_write(this);
 }
 
+void
+PeerConnectionBase::cancel_transfer(BlockTransfer* transfer) {
+  if (!get_fd().is_valid())
+    throw internal_error("PeerConnectionBase::cancel_transfer(...) fd is not valid.");
+
+  Piece piece = transfer->piece();
+
+  // Transfers in the canceled list are not expected to arrive, so
+  // only those still queued need a cancel message.
+  if (!m_downloadQueue.erase(transfer))
+    return;
+
+  m_peerChunks.cancel_queue()->push_back(piece);
+  write_insert_poll_safe();
+}
+
+void
+PeerConnectionBase::send_pex(const ProtocolExtension::PexList* current) {
+  if (!m_extensions.is_local_pex() || !m_extensions.is_remote_pex() || m_extensions.has_write())
+    return;
+
+  if (m_extensions.generate_pex(current))
+    write_insert_poll_safe();
+}
+
 void
 PeerConnectionBase::event_error() {
   m_download->connection_list()->erase(this, 0);
@@ -252,9 +295,17 @@ PeerConnectionBase::down_chunk_finished() {
     if (!m_downChunk.is_valid())
       throw internal_error("PeerConnectionBase::down_chunk_finished() Transfer is the leader, but no chunk allocated.");
 
+    // Block::completed(...) invalidates the transfers other peers
+    // have queued for this block, so copy them first to be able to
+    // send cancel messages. Only non-empty in endgame or when
+    // requesting stalled blocks.
+    Block::transfer_list_type duplicates(*download_queue()->transfer()->block()->queued());
+
     download_queue()->finished();
     m_downChunk.object()->set_time_modified(cachedTime);
 
+    std::for_each(duplicates.begin(), duplicates.end(), std::bind1st(std::mem_fun(&ConnectionList::cancel_transfer), m_download->connection_list()));
+
   } else {
     download_queue()->skipped();
   }
@@ -293,7 +344,7 @@ PeerConnectionBase::down_chunk() {
 
   do {
     data = itr.data();
-    data.second = read_stream_throws(data.first, data.second);
+    data.second = read_stream_decrypt(data.first, data.second);
 
     bytesTransfered += data.second;
 
@@ -322,7 +373,7 @@ PeerConnectionBase::down_chunk_from_buffer() {
 // don't really care that much about performance.
 bool
 PeerConnectionBase::down_chunk_skip() {
-  uint32_t length = read_stream_throws(m_nullBuffer, m_downloadQueue.transfer()->piece().length() - m_downloadQueue.transfer()->position());
+  uint32_t length = read_stream_decrypt(m_nullBuffer, m_downloadQueue.transfer()->piece().length() - m_downloadQueue.transfer()->position());
 
   if (down_chunk_skip_process(m_nullBuffer, length) != length)
     throw internal_error("PeerConnectionBase::down_chunk_skip() down_chunk_skip_process(m_nullBuffer, length) != length.");
@@ -440,7 +491,7 @@ PeerConnectionBase::up_chunk() {
 
   do {
     data = itr.data();
-    data.second = write_stream_throws(data.first, data.second);
+    data.second = write_stream_encrypt(data.first, data.second);
 
     bytesTransfered += data.second;
 
@@ -457,6 +508,43 @@ PeerConnectionBase::up_chunk() {
   return m_upPiece.length() == 0;
 }
 
+// Start reading an extension message of 'length' bytes, excluding
+// the extension id, using what is left in the read buffer.
+bool
+PeerConnectionBase::down_extension_start(uint32_t length) {
+  m_extensions.read_start(m_down->buffer()->read_8(), length);
+
+  uint32_t size = std::min<uint32_t>(length, m_down->buffer()->remaining());
+
+  std::memcpy(m_extensions.read_position(), m_down->buffer()->position(), size);
+  m_extensions.read_move(size);
+  m_down->buffer()->move_position(size);
+
+  if (m_extensions.read_remaining() != 0)
+    return false;
+
+  m_extensions.read_done(m_download, m_peerInfo);
+  return true;
+}
+
+bool
+PeerConnectionBase::down_extension() {
+  m_extensions.read_move(read_stream_decrypt(m_extensions.read_position(), m_extensions.read_remaining()));
+
+  if (m_extensions.read_remaining() != 0)
+    return false;
+
+  m_extensions.read_done(m_download, m_peerInfo);
+  return true;
+}
+
+bool
+PeerConnectionBase::up_extension() {
+  m_extensions.write_move(write_stream_encrypt(m_extensions.write_position(), m_extensions.write_remaining()));
+
+  return !m_extensions.has_write();
+}
+
 void
 PeerConnectionBase::down_chunk_release() {
   if (m_downChunk.is_valid())
@@ -488,14 +576,42 @@ PeerConnectionBase::read_cancel_piece(const Piece& p) {
     m_peerChunks.upload_queue()->erase(itr);
 }  
 
+// Encrypted data goes through 'm_encryptBuffer' as most of what we
+// send can't be modified in place, piece data in particular is
+// written straight from the mapped chunk. Returns the number of bytes
+// taken from 'buf', whatever could not be sent yet is flushed before
+// more is accepted.
+uint32_t
+PeerConnectionBase::write_stream_encrypt(const void* buf, uint32_t length) {
+  if (!m_encryption.is_encrypted())
+    return write_stream_throws(buf, length);
+
+  if (!write_encrypt_flush())
+    return 0;
+
+  length = std::min<uint32_t>(length, m_encryptBuffer->reserved());
+
+  m_encryptBuffer->reset();
+  m_encryption.encrypt(buf, m_encryptBuffer->begin(), length);
+  m_encryptBuffer->set_end(length);
+
+  write_encrypt_flush();
+  return length;
+}
+
+bool
+PeerConnectionBase::write_encrypt_flush() {
+  if (m_encryptBuffer == NULL || m_encryptBuffer->remaining() == 0)
+    return true;
+
+  m_encryptBuffer->move_position(write_stream_throws(m_encryptBuffer->position(), m_encryptBuffer->remaining()));
+
+  return m_encryptBuffer->remaining() == 0;
+}
+
 void
 PeerConnectionBase::read_buffer_move_unused() {
-  uint32_t remaining = m_down->buffer()->remaining();
-  
-  std::memmove(m_down->buffer()->begin(), m_down->buffer()->position(), remaining);
-  
-  m_down->buffer()->reset_position();
-  m_down->buffer()->set_end(remaining);
+  m_down->buffer()->move_unused();
 }
 
 void
@@ -561,8 +677,19 @@ PeerConnectionBase::try_request_pieces() {
 
     const Piece* p = download_queue()->delegate();
 
-    if (p == NULL)
-      break;
+    if (p == NULL) {
+      // Nothing left to delegate might mean all remaining blocks
+      // have been requested, retry once if we entered endgame.
+      if (m_download->delegator()->get_aggressive())
+        break;
+
+      m_download->update_endgame();
+
+      if (!m_download->delegator()->get_aggressive())
+        break;
+
+      continue;
+    }
 
     if (!m_download->content()->is_valid_piece(*p) || !m_peerChunks.bitfield()->get(p->index()))
       throw internal_error("PeerConnectionBase::try_request_pieces() tried to use an invalid piece.");
@@ -41,6 +41,8 @@
 #include "net/socket_stream.h"
 #include "torrent/poll.h"
 
+#include "encryption_info.h"
+#include "extensions.h"
 #include "peer_chunks.h"
 #include "protocol_base.h"
 #include "request_list.h"
@@ -68,10 +70,12 @@ public:
   // Find an optimal number for this.
   static const uint32_t read_size = 64;
 
+  typedef ProtocolBuffer<16384> EncryptBuffer;
+
   PeerConnectionBase();
   virtual ~PeerConnectionBase();
   
-  void                initialize(DownloadMain* download, PeerInfo* p, SocketFd fd, Bitfield* bitfield);
+  void                initialize(DownloadMain* download, PeerInfo* p, SocketFd fd, Bitfield* bitfield, EncryptionInfo* encryptionInfo);
   void                cleanup();
 
   bool                is_up_choked()                { return m_up->choked(); }
@@ -82,6 +86,7 @@ public:
   bool                is_upload_wanted() const      { return m_down->interested() && !m_peerChunks.is_snubbed(); }
 
   bool                is_seeder() const             { return m_peerChunks.is_seeder(); }
+  bool                is_encrypted() const          { return m_encryption.is_encrypted(); }
 
   PeerInfo*           peer_info()                   { return m_peerInfo; }
   const PeerInfo*     c_peer_info() const           { return m_peerInfo; }
@@ -89,6 +94,8 @@ public:
 
   RequestList*        download_queue()              { return &m_downloadQueue; }
 
+  ProtocolExtension*  extensions()                  { return &m_extensions; }
+
   // Make sure you choke the peer when snubbing. Snubbing a peer will
   // only cause it not to be unchoked.
   //
@@ -97,6 +104,11 @@ public:
 
   rak::timer          time_last_choked() const      { return m_timeLastChoked; }
 
+  // Position in the ChokeManager container that holds this
+  // connection, only valid while interested.
+  uint32_t            choke_index() const           { return m_chokeIndex; }
+  void                set_choke_index(uint32_t i)   { m_chokeIndex = i; }
+
   // These must be implemented by the child class.
   virtual void        initialize_custom() = 0;
 
@@ -106,6 +118,14 @@ public:
   virtual bool        receive_keepalive() = 0;
   void                receive_choke(bool v);
 
+  // Called when another peer finished a block we had queued from
+  // this peer, sends a cancel message if it is still requested.
+  void                cancel_transfer(BlockTransfer* transfer);
+
+  // Queue a ut_pex message if the peer supports it and the list of
+  // connected peers has changed since the last one.
+  void                send_pex(const ProtocolExtension::PexList* current);
+
   virtual void        event_error();
 
   void                push_unread(const void* data, uint32_t size);
@@ -114,6 +134,12 @@ protected:
   inline bool         read_remaining();
   inline bool         write_remaining();
 
+  inline uint32_t     read_stream_decrypt(void* buf, uint32_t length);
+  uint32_t            write_stream_encrypt(const void* buf, uint32_t length);
+
+  // Returns true when no encrypted data is waiting to be sent.
+  bool                write_encrypt_flush();
+
   void                load_up_chunk();
 
   void                receive_throttle_down_activate();
@@ -139,6 +165,10 @@ protected:
 
   bool                up_chunk();
 
+  bool                down_extension_start(uint32_t length);
+  bool                down_extension();
+  bool                up_extension();
+
   void                down_chunk_release();
   void                up_chunk_release();
 
@@ -161,6 +191,7 @@ protected:
   PeerChunks          m_peerChunks;
 
   RequestList         m_downloadQueue;
+  ProtocolExtension   m_extensions;
   ChunkHandle         m_downChunk;
   uint32_t            m_downStall;
 
@@ -172,6 +203,10 @@ protected:
 
   rak::timer          m_timeLastChoked;
   rak::timer          m_timeLastRead;
+  uint32_t            m_chokeIndex;
+
+  EncryptionInfo      m_encryption;
+  EncryptBuffer*      m_encryptBuffer;
 };
 
 inline void
@@ -182,18 +217,28 @@ PeerConnectionBase::push_unread(const void* data, uint32_t size) {
 
 inline bool
 PeerConnectionBase::read_remaining() {
-  m_down->buffer()->move_position(read_stream_throws(m_down->buffer()->position(), m_down->buffer()->remaining()));
+  m_down->buffer()->move_position(read_stream_decrypt(m_down->buffer()->position(), m_down->buffer()->remaining()));
 
   return !m_down->buffer()->remaining();
 }
 
 inline bool
 PeerConnectionBase::write_remaining() {
-  m_up->buffer()->move_position(write_stream_throws(m_up->buffer()->position(), m_up->buffer()->remaining()));
+  m_up->buffer()->move_position(write_stream_encrypt(m_up->buffer()->position(), m_up->buffer()->remaining()));
 
   return !m_up->buffer()->remaining();
 }
 
+inline uint32_t
+PeerConnectionBase::read_stream_decrypt(void* buf, uint32_t length) {
+  length = read_stream_throws(buf, length);
+
+  if (m_encryption.is_encrypted())
+    m_encryption.decrypt(buf, length);
+
+  return length;
+}
+
 inline void
 PeerConnectionBase::read_insert_poll_safe() {
   if (m_down->get_state() != ProtocolRead::IDLE)
@@ -173,6 +173,7 @@ PeerConnectionLeech::read_message() {
     m_down->set_choked(true);
 
     m_peerChunks.download_cache()->disable();
+    m_peerChunks.cancel_queue()->clear();
 
     download_queue()->cancel();
     m_download->download_throttle()->erase(m_peerChunks.download_throttle());
@@ -252,6 +253,20 @@ PeerConnectionLeech::read_message() {
     read_cancel_piece(m_down->read_request());
     return true;
 
+  case ProtocolBase::EXTENSION_PROTOCOL:
+    if (!m_down->can_read_extension_body())
+      break;
+
+    if (length < 2)
+      throw network_error("Received an extension message with an invalid length.");
+
+    if (!down_extension_start(length - 2)) {
+      m_down->set_state(ProtocolRead::READ_EXTENSION);
+      return false;
+    }
+
+    return true;
+
   default:
     throw network_error("Received unsupported message type.");
   }
@@ -285,10 +300,10 @@ PeerConnectionLeech::event_read() {
 
       switch (m_down->get_state()) {
       case ProtocolRead::IDLE:
-        if (m_down->buffer()->size_end() == read_size)
-          throw internal_error("PeerConnectionLeech::event_read() m_down->buffer()->size_end() == read_size.");
-
-        m_down->buffer()->move_end(read_stream_throws(m_down->buffer()->end(), read_size - m_down->buffer()->size_end()));
+        // Data left over from the handshake may fill more than
+        // 'read_size' of the buffer.
+        if (m_down->buffer()->size_end() < read_size)
+          m_down->buffer()->move_end(read_stream_decrypt(m_down->buffer()->end(), read_size - m_down->buffer()->size_end()));
         
         while (read_message());
         
@@ -317,6 +332,13 @@ PeerConnectionLeech::event_read() {
         down_chunk_finished();
         break;
 
+      case ProtocolRead::READ_EXTENSION:
+        if (!down_extension())
+          return;
+
+        m_down->set_state(ProtocolRead::IDLE);
+        break;
+
       case ProtocolRead::READ_SKIP_PIECE:
         if (download_queue()->transfer()->is_leader()) {
           m_down->set_state(ProtocolRead::READ_PIECE);
@@ -393,6 +415,13 @@ PeerConnectionLeech::fill_write_buffer() {
     m_sendInterested = false;
   }
 
+  // Send cancels for blocks that were finished by other peers in
+  // endgame mode before any new requests.
+  while (!m_peerChunks.cancel_queue()->empty() && m_up->can_write_request()) {
+    m_up->write_request(m_peerChunks.cancel_queue()->front(), false);
+    m_peerChunks.cancel_queue()->pop_front();
+  }
+
   if (m_tryRequest &&
 
       !(m_tryRequest = !should_request()) &&
@@ -408,6 +437,13 @@ PeerConnectionLeech::fill_write_buffer() {
     m_peerChunks.have_queue()->pop_front();
   }
 
+  // The extension payload is written after the buffer, so nothing
+  // may follow it.
+  if (m_extensions.has_write() && m_up->can_write_extension()) {
+    m_up->write_extension(m_extensions.write_id(), m_extensions.write_size());
+    return;
+  }
+
   if (!m_up->choked() &&
       !m_peerChunks.upload_queue()->empty() &&
       m_up->can_write_piece())
@@ -432,7 +468,11 @@ PeerConnectionLeech::event_write() {
         fill_write_buffer();
 
         if (m_up->buffer()->size_position() == 0) {
-          manager->poll()->remove_write(this);
+          // Stay in the poll until any buffered encrypted data has
+          // been sent.
+          if (write_encrypt_flush())
+            manager->poll()->remove_write(this);
+
           return;
         }
 
@@ -440,13 +480,18 @@ PeerConnectionLeech::event_write() {
         m_up->buffer()->prepare_end();
 
       case ProtocolWrite::MSG:
-        m_up->buffer()->move_position(write_stream_throws(m_up->buffer()->position(), m_up->buffer()->remaining()));
+        m_up->buffer()->move_position(write_stream_encrypt(m_up->buffer()->position(), m_up->buffer()->remaining()));
 
         if (m_up->buffer()->remaining())
           return;
 
         m_up->buffer()->reset();
 
+        if (m_up->last_command() == ProtocolBase::EXTENSION_PROTOCOL) {
+          m_up->set_state(ProtocolWrite::WRITE_EXTENSION);
+          break;
+        }
+
         if (m_up->last_command() != ProtocolBase::PIECE) {
           // Break or loop? Might do an ifelse based on size of the
           // write buffer. Also the write buffer is relatively large.
@@ -466,6 +511,13 @@ PeerConnectionLeech::event_write() {
 
         break;
 
+      case ProtocolWrite::WRITE_EXTENSION:
+        if (!up_extension())
+          return;
+
+        m_up->set_state(ProtocolWrite::IDLE);
+        break;
+
       default:
         throw internal_error("PeerConnectionLeech::event_write() wrong state.");
       }
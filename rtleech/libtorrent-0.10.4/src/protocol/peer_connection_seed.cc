@@ -183,6 +183,20 @@ PeerConnectionSeed::read_message() {
     read_cancel_piece(m_down->read_request());
     return true;
 
+  case ProtocolBase::EXTENSION_PROTOCOL:
+    if (!m_down->can_read_extension_body())
+      break;
+
+    if (length < 2)
+      throw network_error("Received an extension message with an invalid length.");
+
+    if (!down_extension_start(length - 2)) {
+      m_down->set_state(ProtocolRead::READ_EXTENSION);
+      return false;
+    }
+
+    return true;
+
   default:
     throw network_error("Received unsupported message type.");
   }
@@ -214,10 +228,17 @@ PeerConnectionSeed::event_read() {
 
     do {
 
-      if (m_down->buffer()->size_end() == read_size)
-        throw internal_error("PeerConnectionSeed::event_read() m_down->buffer()->size_end() == read_size.");
+      if (m_down->get_state() == ProtocolRead::READ_EXTENSION) {
+        if (!down_extension())
+          return;
 
-      m_down->buffer()->move_end(read_stream_throws(m_down->buffer()->end(), read_size - m_down->buffer()->size_end()));
+        m_down->set_state(ProtocolRead::IDLE);
+      }
+
+      // Data left over from the handshake may fill more than
+      // 'read_size' of the buffer.
+      if (m_down->buffer()->size_end() < read_size)
+        m_down->buffer()->move_end(read_stream_decrypt(m_down->buffer()->end(), read_size - m_down->buffer()->size_end()));
         
       while (read_message());
         
@@ -277,6 +298,13 @@ PeerConnectionSeed::fill_write_buffer() {
     }
   }
 
+  // The extension payload is written after the buffer, so nothing
+  // may follow it.
+  if (m_extensions.has_write() && m_up->can_write_extension()) {
+    m_up->write_extension(m_extensions.write_id(), m_extensions.write_size());
+    return;
+  }
+
   if (!m_up->choked() &&
       !m_peerChunks.upload_queue()->empty() &&
       m_up->can_write_piece())
@@ -301,7 +329,11 @@ PeerConnectionSeed::event_write() {
         fill_write_buffer();
 
         if (m_up->buffer()->size_position() == 0) {
-          manager->poll()->remove_write(this);
+          // Stay in the poll until any buffered encrypted data has
+          // been sent.
+          if (write_encrypt_flush())
+            manager->poll()->remove_write(this);
+
           return;
         }
 
@@ -309,13 +341,18 @@ PeerConnectionSeed::event_write() {
         m_up->buffer()->prepare_end();
 
       case ProtocolWrite::MSG:
-        m_up->buffer()->move_position(write_stream_throws(m_up->buffer()->position(), m_up->buffer()->remaining()));
+        m_up->buffer()->move_position(write_stream_encrypt(m_up->buffer()->position(), m_up->buffer()->remaining()));
 
         if (m_up->buffer()->remaining())
           return;
 
         m_up->buffer()->reset();
 
+        if (m_up->last_command() == ProtocolBase::EXTENSION_PROTOCOL) {
+          m_up->set_state(ProtocolWrite::WRITE_EXTENSION);
+          break;
+        }
+
         if (m_up->last_command() != ProtocolBase::PIECE) {
           // Break or loop? Might do an ifelse based on size of the
           // write buffer. Also the write buffer is relatively large.
@@ -335,6 +372,13 @@ PeerConnectionSeed::event_write() {
 
         break;
 
+      case ProtocolWrite::WRITE_EXTENSION:
+        if (!up_extension())
+          return;
+
+        m_up->set_state(ProtocolWrite::IDLE);
+        break;
+
       default:
         throw internal_error("PeerConnectionSeed::event_write() wrong state.");
       }
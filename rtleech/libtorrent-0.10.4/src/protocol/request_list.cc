@@ -202,6 +202,22 @@ RequestList::transfer_dissimilar() {
   m_transfer = dummy;
 }
 
+bool
+RequestList::erase(BlockTransfer* transfer) {
+  ReserveeList::iterator itr = std::find(m_queued.begin(), m_queued.end(), transfer);
+
+  if (itr == m_queued.end())
+    return false;
+
+  if (transfer->is_valid())
+    throw internal_error("RequestList::erase(...) transfer is still valid.");
+
+  m_queued.erase(itr);
+  Block::release(transfer);
+
+  return true;
+}
+
 struct equals_reservee : public std::binary_function<BlockTransfer*, uint32_t, bool> {
   bool operator () (BlockTransfer* r, uint32_t index) const {
     return r->is_valid() && index == r->index();
@@ -74,6 +74,10 @@ public:
 
   void                 transfer_dissimilar();
 
+  // Remove a queued transfer that was invalidated by another peer
+  // finishing the block. Returns false if it is not in the queue.
+  bool                 erase(BlockTransfer* transfer);
+
   bool                 is_downloading()                 { return m_transfer != NULL; }
   bool                 is_interested_in_active() const;
 
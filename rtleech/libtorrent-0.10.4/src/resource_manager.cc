@@ -37,12 +37,15 @@
 #include "config.h"
 
 #include <algorithm>
+#include <functional>
 #include <limits>
+#include <vector>
 #include <rak/functional.h>
 
 #include "torrent/exceptions.h"
 #include "download/choke_manager.h"
 #include "download/download_main.h"
+#include "protocol/peer_connection_base.h"
 
 #include "resource_manager.h"
 
@@ -118,50 +121,108 @@ ResourceManager::retrieve_can_unchoke() {
 
 void
 ResourceManager::receive_tick() {
-  unsigned int totalWeight = total_weight();
-
-  balance_unchoked(totalWeight);
+  balance_unchoked();
 }
 
-unsigned int
-ResourceManager::total_weight() const {
-  return std::for_each(begin(), end(), rak::accumulate((unsigned int)0, rak::const_mem_ref(&value_type::first))).result;
-}
+// The rank of a connection is the rate it uploads to us plus the rate
+// we upload to it, multiplied by the priority of the download.
+// Connections already unchoked get 'm_unchokeChangeCost' added. Ties
+// are broken by 'm_index', the position of the download counted from
+// the current rotation.
+struct resource_manager_rank {
+  typedef std::vector<std::pair<uint64_t, unsigned int> > rank_list;
+
+  resource_manager_rank(rank_list* r, unsigned int i, uint16_t p, uint32_t c) : m_ranks(r), m_index(i), m_priority(p), m_cost(c) {}
 
-struct resource_manager_interested_increasing {
-  bool operator () (const ResourceManager::value_type& v1, const ResourceManager::value_type& v2) const {
-    return v1.second->choke_manager()->currently_interested() < v2.second->choke_manager()->currently_interested();
+  void operator () (const ChokeManager::value_type& v) {
+    uint64_t rate = (uint64_t)v.first->peer_chunks()->download_throttle()->rate()->rate() +
+                    (uint64_t)v.first->peer_chunks()->upload_throttle()->rate()->rate();
+
+    m_ranks->push_back(rank_list::value_type(rate * m_priority + (v.first->is_up_choked() ? 0 : m_cost), m_index));
   }
+
+  rank_list*   m_ranks;
+  unsigned int m_index;
+  uint16_t     m_priority;
+  uint32_t     m_cost;
 };
 
 void
-ResourceManager::balance_unchoked(unsigned int weight) {
-  if (m_maxUnchoked != 0) {
-    unsigned int quota = m_maxUnchoked;
-
-    // We put the downloads with fewest interested first so that those
-    // with more interested will gain any unused slots from the
-    // preceding downloads. Consider multiplying with priority.
-    //
-    // Consider skipping the leading zero interested downloads. Though
-    // that won't work as they need to choke peers once their priority
-    // is turned off.
-    sort(begin(), end(), resource_manager_interested_increasing());
-
-    for (iterator itr = begin(); itr != end(); ++itr) {
-      m_currentlyUnchoked += itr->second->choke_manager()->cycle(weight != 0 ? (quota * itr->first) / weight : 0);
-
-      quota -= itr->second->choke_manager()->currently_unchoked();
-      weight -= itr->first;
+ResourceManager::balance_unchoked() {
+  if (m_maxUnchoked == 0) {
+    for (iterator itr = begin(); itr != end(); ++itr)
+      m_currentlyUnchoked += itr->second->choke_manager()->cycle(std::numeric_limits<unsigned int>::max());
+
+    return;
+  }
+
+  if (empty())
+    return;
+
+  // Rotate which download wins ties and gets the reserved slots when
+  // there are more downloads than reserved slots.
+  unsigned int rotation = m_unchokeRotation++ % size();
+  unsigned int slots = m_maxUnchoked;
+
+  // At most a quarter of the slots are reserved, so the rank decides
+  // most of them even when there are more downloads than slots.
+  unsigned int reserved = (m_maxUnchoked + 3) / 4;
+
+  // Rank the interested connections of all downloads, downloads with
+  // priority off are skipped and thus get a zero quota.
+  resource_manager_rank::rank_list ranks;
+  std::vector<unsigned int> quotas(size(), 0);
+
+  for (unsigned int i = 0; i < size(); ++i) {
+    unsigned int index = (rotation + i) % size();
+    value_type& download = *(begin() + index);
+
+    if (download.first == 0)
+      continue;
+
+    ChokeManager* chokeManager = download.second->choke_manager();
+
+    if (chokeManager->unchoked()->empty() && chokeManager->queued()->empty())
+      continue;
+
+    // Reserve a slot so a download without rate, which would lose
+    // against the unchoke cost of the others, can still unchoke.
+    if (reserved != 0 && chokeManager->max_unchoked() != 0) {
+      quotas[index]++;
+      reserved--;
+      slots--;
     }
 
-    if (weight != 0)
-      throw internal_error("ResourceManager::balance_unchoked(...) weight did not reach zero.");
+    resource_manager_rank rank(&ranks, size() - i, download.first, m_unchokeChangeCost);
 
-  } else {
-    for (iterator itr = begin(); itr != end(); ++itr)
-      m_currentlyUnchoked += itr->second->choke_manager()->cycle(std::numeric_limits<unsigned int>::max());
+    std::for_each(chokeManager->unchoked()->begin(), chokeManager->unchoked()->end(), rank);
+    std::for_each(chokeManager->queued()->begin(), chokeManager->queued()->end(), rank);
   }
+
+  std::sort(ranks.begin(), ranks.end(), std::greater<resource_manager_rank::rank_list::value_type>());
+
+  // Hand out the rest of the slots in rank order, skipping downloads
+  // that have reached their own max so the slots go to the next
+  // download instead of being left idle.
+  for (resource_manager_rank::rank_list::iterator itr = ranks.begin(); itr != ranks.end() && slots != 0; ++itr) {
+    unsigned int index = (rotation + size() - itr->second) % size();
+
+    if (quotas[index] >= (begin() + index)->second->choke_manager()->max_unchoked())
+      continue;
+
+    quotas[index]++;
+    slots--;
+  }
+
+  // Do the choking first so the slots are free before any download
+  // unchokes.
+  for (iterator itr = begin(); itr != end(); ++itr)
+    if (quotas[std::distance(begin(), itr)] < itr->second->choke_manager()->currently_unchoked())
+      m_currentlyUnchoked += itr->second->choke_manager()->cycle(quotas[std::distance(begin(), itr)]);
+
+  for (iterator itr = begin(); itr != end(); ++itr)
+    if (quotas[std::distance(begin(), itr)] >= itr->second->choke_manager()->currently_unchoked())
+      m_currentlyUnchoked += itr->second->choke_manager()->cycle(quotas[std::distance(begin(), itr)]);
 }
 
 }
@@ -45,6 +45,14 @@ namespace torrent {
 // This class will handle the division of various resources like
 // uploads. For now the weight is equal to the value of the priority.
 //
+// When the number of unchoked connections is limited, the interested
+// connections of all downloads are ranked together by how much they
+// transfer, and each download is given as many unchoke slots as it
+// has connections among the best ranked. Every download with
+// interested connections is first given one slot, so new or idle
+// downloads can still unchoke. The ChokeManager of each download then
+// picks which of its connections to unchoke.
+//
 // Add unlimited handling later.
 
 class DownloadMain;
@@ -59,7 +67,9 @@ public:
 
   ResourceManager() :
     m_currentlyUnchoked(0),
-    m_maxUnchoked(0) {}
+    m_maxUnchoked(0),
+    m_unchokeChangeCost(1 << 10),
+    m_unchokeRotation(0) {}
   ~ResourceManager();
 
   void                insert(DownloadMain* d, uint16_t priority);
@@ -74,6 +84,12 @@ public:
   unsigned int        max_unchoked() const             { return m_maxUnchoked; }
   void                set_max_unchoked(unsigned int m) { m_maxUnchoked = m; }
 
+  // Bytes per second added to the rank of connections that are
+  // already unchoked, so that slots only move between downloads when
+  // the gain is worth the cost of choking and unchoking.
+  uint32_t            unchoke_change_cost() const         { return m_unchokeChangeCost; }
+  void                set_unchoke_change_cost(uint32_t c) { m_unchokeChangeCost = c; }
+
   void                receive_choke(unsigned int num);
   void                receive_unchoke(unsigned int num);
   unsigned int        retrieve_can_unchoke();
@@ -81,11 +97,12 @@ public:
   void                receive_tick();
 
 private:
-  unsigned int        total_weight() const;
-  void                balance_unchoked(unsigned int weight);
+  void                balance_unchoked();
 
   unsigned int        m_currentlyUnchoked;
   unsigned int        m_maxUnchoked;
+  uint32_t            m_unchokeChangeCost;
+  unsigned int        m_unchokeRotation;
 };
 
 }
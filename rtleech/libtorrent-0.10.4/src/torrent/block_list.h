@@ -55,6 +55,7 @@ public:
   using base_type::difference_type;
 
   using base_type::iterator;
+  using base_type::const_iterator;
   using base_type::reverse_iterator;
   using base_type::size;
   using base_type::empty;
@@ -52,8 +52,12 @@ ConnectionManager::ConnectionManager() :
   m_priority(iptos_throughput),
   m_sendBufferSize(0),
   m_receiveBufferSize(0),
+  m_encryptionOptions(encryption_allow_incoming),
 
-  m_listen(new Listen) {
+  m_listen(new Listen),
+  m_listenBacklog(128),
+  m_listenSockets(1),
+  m_listenInet6(false) {
 
   m_bindAddress = (new rak::socket_address())->c_sockaddr();
   rak::socket_address::cast_from(m_bindAddress)->sa_inet()->clear();
@@ -84,6 +88,22 @@ ConnectionManager::set_receive_buffer_size(uint32_t s) {
   m_receiveBufferSize = s;
 }
 
+void
+ConnectionManager::set_encryption_options(uint32_t options) {
+  if (options & ~(uint32_t)(encryption_allow_incoming | encryption_try_outgoing | encryption_require |
+                            encryption_enable_retry | encryption_prefer_plaintext))
+    throw input_error("Invalid encryption options.");
+
+  if ((options & encryption_require) && (options & encryption_prefer_plaintext))
+    throw input_error("Cannot both require encryption and prefer plaintext.");
+
+  // Requiring encryption implies both accepting and initiating it.
+  if (options & encryption_require)
+    options |= encryption_allow_incoming | encryption_try_outgoing;
+
+  m_encryptionOptions = options;
+}
+
 void
 ConnectionManager::set_bind_address(const sockaddr* sa) {
   const rak::socket_address* rsa = rak::socket_address::cast_from(sa);
@@ -127,4 +147,35 @@ ConnectionManager::listen_close() {
   m_listen->close();
 }
 
+void
+ConnectionManager::set_listen_backlog(uint32_t s) {
+  if (s < 1 || s > (1 << 16))
+    throw input_error("Listen backlog out of range.");
+
+  m_listenBacklog = s;
+}
+
+void
+ConnectionManager::set_listen_sockets(uint32_t s) {
+  if (s < 1 || s > 16)
+    throw input_error("Number of listening sockets out of range.");
+
+#ifndef SO_REUSEPORT
+  if (s > 1)
+    throw input_error("Multiple listening sockets require SO_REUSEPORT.");
+#endif
+
+  m_listenSockets = s;
+}
+
+void
+ConnectionManager::set_listen_inet6(bool state) {
+#ifndef RAK_USE_INET6
+  if (state)
+    throw input_error("Compiled without inet6 support.");
+#endif
+
+  m_listenInet6 = state;
+}
+
 }
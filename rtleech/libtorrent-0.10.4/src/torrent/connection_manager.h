@@ -74,6 +74,19 @@ public:
   static const priority_type iptos_mincost     = iptos_throughput;
 #endif
 
+  // Message stream encryption of peer connections. Incoming
+  // encrypted handshakes are only accepted with 'allow_incoming', and
+  // outgoing connections only attempt it with 'try_outgoing'.
+  // 'require' refuses plaintext peers in both directions, while
+  // 'enable_retry' reconnects without encryption to peers that drop
+  // an encrypted handshake.
+  static const uint32_t encryption_none             = 0;
+  static const uint32_t encryption_allow_incoming   = (1 << 0);
+  static const uint32_t encryption_try_outgoing     = (1 << 1);
+  static const uint32_t encryption_require          = (1 << 2);
+  static const uint32_t encryption_enable_retry     = (1 << 3);
+  static const uint32_t encryption_prefer_plaintext = (1 << 4);
+
   ConnectionManager();
   ~ConnectionManager();
   
@@ -101,6 +114,9 @@ public:
   uint32_t            receive_buffer_size() const             { return m_receiveBufferSize; }
   void                set_receive_buffer_size(uint32_t s);
 
+  uint32_t            encryption_options() const              { return m_encryptionOptions; }
+  void                set_encryption_options(uint32_t options);
+
   // Propably going to have to make m_bindAddress a pointer to make it
   // safe.
   //
@@ -119,6 +135,18 @@ public:
   bool                listen_open(port_type begin, port_type end);
   void                listen_close();  
 
+  // Takes effect the next time the listening port is opened. More
+  // than one listening socket requires SO_REUSEPORT, and 'inet6'
+  // opens a dual-stack socket when bound to the inet any address.
+  uint32_t            listen_backlog() const                  { return m_listenBacklog; }
+  void                set_listen_backlog(uint32_t s);
+
+  uint32_t            listen_sockets() const                  { return m_listenSockets; }
+  void                set_listen_sockets(uint32_t s);
+
+  bool                listen_inet6() const                    { return m_listenInet6; }
+  void                set_listen_inet6(bool state);
+
   // Since trackers need our port number, it doesn't get cleared after
   // 'listen_close()'. The client may change the reported port number,
   // but do note that it gets overwritten after 'listen_open(...)'.
@@ -138,12 +166,16 @@ private:
   priority_type       m_priority;
   uint32_t            m_sendBufferSize;
   uint32_t            m_receiveBufferSize;
+  uint32_t            m_encryptionOptions;
 
   sockaddr*           m_bindAddress;
   sockaddr*           m_localAddress;
 
   Listen*             m_listen;
   port_type           m_listenPort;
+  uint32_t            m_listenBacklog;
+  uint32_t            m_listenSockets;
+  bool                m_listenInet6;
 
   slot_filter_type    m_slotFilter;
 };
@@ -51,6 +51,7 @@
 #include "protocol/peer_connection_base.h"
 #include "protocol/peer_factory.h"
 #include "download/download_info.h"
+#include "tracker/tracker_base.h"
 #include "tracker/tracker_manager.h"
 
 #include "exceptions.h"
@@ -66,6 +67,9 @@ namespace torrent {
 
 void
 Download::open() {
+  if (!m_ptr->main()->content()->has_complete_hash())
+    throw client_error("Tried to open a download without piece hashes.");
+
   m_ptr->open();
 }
 
@@ -372,11 +376,34 @@ Download::bitfield() const {
   return m_ptr->main()->content()->bitfield();
 }
 
+bool
+Download::has_piece_hashes() const {
+  return m_ptr->main()->content()->has_complete_hash();
+}
+
+const std::string&
+Download::piece_hashes() const {
+  return m_ptr->main()->content()->complete_hash();
+}
+
+void
+Download::swap_piece_hashes(std::string& hashes) {
+  if (m_ptr->info()->is_open())
+    throw input_error("Download::swap_piece_hashes(...) Download is open.");
+
+  m_ptr->main()->content()->swap_complete_hash(hashes);
+}
+
 void
 Download::sync_chunks() {
   m_ptr->main()->chunk_list()->sync_chunks(ChunkList::sync_all | ChunkList::sync_force);
 }
 
+void
+Download::writable_chunks(Bitfield* bitfield) const {
+  m_ptr->main()->chunk_list()->writable_chunks(bitfield);
+}
+
 uint32_t
 Download::peers_min() const {
   return m_ptr->main()->connection_list()->get_min_size();
@@ -407,6 +434,26 @@ Download::peers_accounted() const {
   return m_ptr->main()->chunk_statistics()->accounted();
 }
 
+bool
+Download::is_scraped() const {
+  return m_ptr->main()->tracker_manager()->is_scraped();
+}
+
+uint32_t
+Download::scrape_complete() const {
+  return m_ptr->main()->tracker_manager()->scrape_max(&TrackerBase::scrape_complete);
+}
+
+uint32_t
+Download::scrape_incomplete() const {
+  return m_ptr->main()->tracker_manager()->scrape_max(&TrackerBase::scrape_incomplete);
+}
+
+uint32_t
+Download::scrape_downloaded() const {
+  return m_ptr->main()->tracker_manager()->scrape_max(&TrackerBase::scrape_downloaded);
+}
+
 uint32_t
 Download::peers_currently_unchoked() const {
   return m_ptr->main()->choke_manager()->currently_unchoked();
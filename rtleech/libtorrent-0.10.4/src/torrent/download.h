@@ -147,10 +147,22 @@ public:
 
   const Bitfield*     bitfield() const;
 
+  // The piece hashes are moved out of the bencode tree when the
+  // download is created, leaving 'info:pieces' empty. The client may
+  // swap them out while the download is closed, and must swap them
+  // back in before opening it.
+  bool                has_piece_hashes() const;
+  const std::string&  piece_hashes() const;
+  void                swap_piece_hashes(std::string& hashes);
+
   // Temporary hack for syncing chunks to disk before hash resume is
   // saved.
   void                sync_chunks();
 
+  // Mark the chunks being written to, they may be completed after
+  // the resume data is saved. The bitfield must be allocated.
+  void                writable_chunks(Bitfield* bitfield) const;
+
   uint32_t            peers_min() const;
   uint32_t            peers_max() const;
   uint32_t            peers_connected() const;
@@ -158,6 +170,13 @@ public:
   uint32_t            peers_complete() const;
   uint32_t            peers_accounted() const;
 
+  // The largest swarm counts reported by the download's trackers,
+  // zero until a tracker has replied to a scrape.
+  bool                is_scraped() const;
+  uint32_t            scrape_complete() const;
+  uint32_t            scrape_incomplete() const;
+  uint32_t            scrape_downloaded() const;
+
   uint32_t            peers_currently_unchoked() const;
   uint32_t            peers_currently_interested() const;
 
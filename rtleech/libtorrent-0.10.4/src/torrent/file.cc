@@ -77,6 +77,11 @@ File::chunk_end() const {
   return m_entry->range().second;
 }  
 
+uint64_t
+File::position() const {
+  return m_entry->position();
+}
+
 priority_t
 File::priority() const {
   return m_entry->priority();
@@ -62,6 +62,9 @@ public:
   uint32_t            chunk_begin() const;
   uint32_t            chunk_end() const;
 
+  // Offset of the first byte of the file within the torrent.
+  uint64_t            position() const;
+
   // Need this?
   //uint64_t            byte_begin();
   //uint64_t            byte_end();
@@ -0,0 +1,433 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <rak/file_stat.h>
+#include <rak/functional.h>
+#include <rak/priority_queue_default.h>
+
+#include "utils/sha1.h"
+
+#include "exceptions.h"
+#include "make_torrent.h"
+
+#include "globals.h"
+
+namespace torrent {
+
+MakeTorrent::MakeTorrent() :
+  m_chunkSize(0),
+  m_pieceLength(0),
+  m_threads(0),
+  m_private(false),
+
+  m_bytesTotal(0),
+  m_bytesHashed(0),
+
+  m_chunkCount(0),
+  m_pieces(NULL),
+
+  m_chunkNext(0),
+  m_threadsRunning(0),
+  m_bytesRead(0),
+
+  m_taskHash(new rak::priority_item) {
+
+  pthread_mutex_init(&m_lock, NULL);
+  m_taskHash->set_slot(rak::mem_fn(this, &MakeTorrent::receive_hash));
+}
+
+MakeTorrent::~MakeTorrent() {
+  stop();
+
+  delete [] m_pieces;
+  delete m_taskHash;
+
+  pthread_mutex_destroy(&m_lock);
+}
+
+bool
+MakeTorrent::is_active() const {
+  return m_taskHash->is_queued();
+}
+
+void
+MakeTorrent::start() {
+  if (is_active())
+    throw input_error("Torrent is already being made.");
+
+  m_files.clear();
+  m_error.clear();
+  m_torrent = Object();
+
+  rak::file_stat fs;
+
+  if (!fs.update(m_path))
+    throw input_error("Could not find \"" + m_path + "\".");
+
+  if (fs.is_directory())
+    add_directory(std::string());
+  else if (fs.is_regular())
+    m_files.push_back(file_type(std::string(), fs.size()));
+
+  m_bytesTotal = 0;
+  m_bytesHashed = 0;
+  m_fileOffsets.clear();
+
+  for (file_list::const_iterator itr = m_files.begin(), last = m_files.end(); itr != last; ++itr) {
+    m_fileOffsets.push_back(m_bytesTotal);
+    m_bytesTotal += itr->second;
+  }
+
+  if (m_bytesTotal == 0)
+    throw input_error("Nothing to make a torrent of in \"" + m_path + "\".");
+
+  if (m_chunkSize == 0) {
+    m_pieceLength = min_chunk_size;
+
+    while (m_pieceLength < max_chunk_size && m_bytesTotal / m_pieceLength > target_chunks)
+      m_pieceLength <<= 1;
+
+  } else if (m_chunkSize <= (1 << 10) || m_chunkSize > (128 << 20) || (m_chunkSize & (m_chunkSize - 1)) != 0) {
+    throw input_error("Invalid chunk size.");
+
+  } else {
+    m_pieceLength = m_chunkSize;
+  }
+
+  m_root = m_path;
+  m_chunkCount = (m_bytesTotal + m_pieceLength - 1) / m_pieceLength;
+
+  delete [] m_pieces;
+  m_pieces = new char[20 * m_chunkCount];
+
+  m_chunkNext = 0;
+  m_bytesRead = 0;
+  m_threadError.clear();
+
+  unsigned int threads = m_threads;
+
+  if (threads == 0) {
+    long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+
+  threads = std::min(threads, m_chunkCount);
+  m_threadsRunning = threads;
+
+  // Signals are blocked in the threads so that they are delivered to
+  // the client's main loop.
+  sigset_t blocked;
+  sigset_t previous;
+
+  sigfillset(&blocked);
+  pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+
+  while (m_threadList.size() != threads) {
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, &MakeTorrent::hash_thread, this) != 0)
+      break;
+
+    m_threadList.push_back(thread);
+  }
+
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+  // The threads that did start take the chunks of those that didn't.
+  pthread_mutex_lock(&m_lock);
+  m_threadsRunning -= threads - m_threadList.size();
+  pthread_mutex_unlock(&m_lock);
+
+  if (m_threadList.empty())
+    throw local_error("Could not start a thread for hashing.");
+
+  priority_queue_insert(&taskScheduler, m_taskHash, cachedTime + poll_interval);
+}
+
+void
+MakeTorrent::stop() {
+  priority_queue_erase(&taskScheduler, m_taskHash);
+
+  // Hand out no more chunks, the threads finish their current one.
+  pthread_mutex_lock(&m_lock);
+  m_chunkNext = m_chunkCount;
+  pthread_mutex_unlock(&m_lock);
+
+  join_threads();
+}
+
+void
+MakeTorrent::join_threads() {
+  for (std::vector<pthread_t>::iterator itr = m_threadList.begin(), last = m_threadList.end(); itr != last; ++itr)
+    pthread_join(*itr, NULL);
+
+  m_threadList.clear();
+}
+
+// Adds the regular files below 'dir', sorted by name so the layout
+// doesn't depend on the order of the directory. Symlinks to files are
+// followed, symlinked directories are skipped as they might loop.
+void
+MakeTorrent::add_directory(const std::string& dir) {
+  DIR* d = opendir((m_path + '/' + dir).c_str());
+
+  if (d == NULL)
+    throw input_error("Could not open directory \"" + m_path + '/' + dir + "\".");
+
+  std::vector<std::string> entries;
+
+  while (dirent* entry = readdir(d))
+    if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0)
+      entries.push_back(dir + entry->d_name);
+
+  closedir(d);
+  std::sort(entries.begin(), entries.end());
+
+  for (std::vector<std::string>::iterator itr = entries.begin(), last = entries.end(); itr != last; ++itr) {
+    rak::file_stat fs;
+
+    if (!fs.update_link(m_path + '/' + *itr))
+      continue;
+
+    if (fs.is_link() && (!fs.update(m_path + '/' + *itr) || fs.is_directory()))
+      continue;
+
+    if (fs.is_directory())
+      add_directory(*itr + '/');
+    else if (fs.is_regular())
+      m_files.push_back(file_type(*itr, fs.size()));
+  }
+}
+
+void*
+MakeTorrent::hash_thread(void* maker) {
+  static_cast<MakeTorrent*>(maker)->hash_chunks();
+  return NULL;
+}
+
+// Runs in the threads, each takes the next chunk until all have been
+// handed out. Only the settings copied by start() and the chunk's own
+// piece are touched outside of 'm_lock'.
+void
+MakeTorrent::hash_chunks() {
+  Sha1 sha1;
+  std::string buffer(read_size, '\0');
+
+  file_list::size_type fileIndex = m_files.size();
+  int fd = -1;
+
+  while (true) {
+    pthread_mutex_lock(&m_lock);
+    uint32_t index = m_chunkNext != m_chunkCount ? m_chunkNext++ : m_chunkCount;
+    pthread_mutex_unlock(&m_lock);
+
+    if (index == m_chunkCount || !hash_chunk(index, &sha1, &buffer, &fileIndex, &fd))
+      break;
+  }
+
+  if (fd != -1)
+    ::close(fd);
+
+  pthread_mutex_lock(&m_lock);
+  m_threadsRunning--;
+  pthread_mutex_unlock(&m_lock);
+}
+
+// Reads a chunk that may span several files, the file last read from
+// is kept open for the next chunk. On failure the error is recorded
+// and no more chunks are handed out.
+bool
+MakeTorrent::hash_chunk(uint32_t index, Sha1* sha1, std::string* buffer, file_list::size_type* fileIndex, int* fd) {
+  uint64_t position = (uint64_t)index * m_pieceLength;
+  uint64_t last = std::min<uint64_t>(position + m_pieceLength, m_bytesTotal);
+
+  uint64_t readSize = read_size;
+  std::string error;
+
+  sha1->init();
+
+  while (position != last && error.empty()) {
+    file_list::size_type i = std::upper_bound(m_fileOffsets.begin(), m_fileOffsets.end(), position) - m_fileOffsets.begin() - 1;
+    std::string path = m_files[i].first.empty() ? m_root : m_root + '/' + m_files[i].first;
+
+    if (i != *fileIndex) {
+      if (*fd != -1)
+        ::close(*fd);
+
+      *fileIndex = i;
+
+      if ((*fd = ::open(path.c_str(), O_RDONLY)) == -1) {
+        error = "Could not open \"" + path + "\": " + std::strerror(errno);
+        break;
+      }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+      ::posix_fadvise(*fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+
+    uint64_t fileEnd = m_fileOffsets[i] + m_files[i].second;
+    uint32_t length = std::min(std::min(readSize, last - position), fileEnd - position);
+
+    ssize_t r = ::pread(*fd, &(*buffer)[0], length, position - m_fileOffsets[i]);
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r == -1)
+      error = "Could not read \"" + path + "\": " + std::strerror(errno);
+    else if (r == 0)
+      error = "File \"" + path + "\" changed size while hashing.";
+    else
+      sha1->update(buffer->c_str(), r);
+
+    pthread_mutex_lock(&m_lock);
+    m_bytesRead += std::max<ssize_t>(r, 0);
+    pthread_mutex_unlock(&m_lock);
+
+    position += std::max<ssize_t>(r, 0);
+  }
+
+  if (error.empty()) {
+    sha1->final_c(m_pieces + 20 * index);
+    return true;
+  }
+
+  pthread_mutex_lock(&m_lock);
+
+  if (m_threadError.empty())
+    m_threadError = error;
+
+  m_chunkNext = m_chunkCount;
+  pthread_mutex_unlock(&m_lock);
+
+  return false;
+}
+
+void
+MakeTorrent::receive_hash() {
+  pthread_mutex_lock(&m_lock);
+  bool done = m_threadsRunning == 0;
+  m_bytesHashed = m_bytesRead;
+  pthread_mutex_unlock(&m_lock);
+
+  if (!done) {
+    priority_queue_insert(&taskScheduler, m_taskHash, cachedTime + poll_interval);
+    m_slotProgress();
+    return;
+  }
+
+  join_threads();
+
+  if (m_threadError.empty())
+    build_torrent();
+  else
+    m_error = m_threadError;
+
+  // Call a copy, the slot may delete this object.
+  SlotVoid slotDone = m_slotDone;
+  slotDone();
+}
+
+void
+MakeTorrent::build_torrent() {
+  std::string::size_type last = m_path.find_last_not_of('/');
+  std::string::size_type first = m_path.find_last_of('/', last);
+
+  std::string name = m_path.substr(first != std::string::npos ? first + 1 : 0, last != std::string::npos ? last - first : 0);
+
+  Object info(Object::TYPE_MAP);
+
+  info.insert_key("name", name);
+  info.insert_key("piece length", (int64_t)m_pieceLength);
+
+  if (m_files.size() == 1 && m_files.front().first.empty()) {
+    info.insert_key("length", (int64_t)m_files.front().second);
+
+  } else {
+    Object::list_type& files = info.insert_key("files", Object(Object::TYPE_LIST)).as_list();
+
+    for (file_list::const_iterator itr = m_files.begin(), last = m_files.end(); itr != last; ++itr) {
+      Object& file = *files.insert(files.end(), Object(Object::TYPE_MAP));
+      file.insert_key("length", (int64_t)itr->second);
+
+      Object::list_type& path = file.insert_key("path", Object(Object::TYPE_LIST)).as_list();
+
+      for (std::string::size_type pos = 0, next; pos != std::string::npos; pos = next != std::string::npos ? next + 1 : next) {
+        next = itr->first.find('/', pos);
+        path.push_back(Object(itr->first.substr(pos, next != std::string::npos ? next - pos : std::string::npos)));
+      }
+    }
+  }
+
+  if (m_private)
+    info.insert_key("private", (int64_t)1);
+
+  info.insert_key("pieces", std::string(m_pieces, 20 * m_chunkCount));
+
+  Object torrent(Object::TYPE_MAP);
+
+  if (!m_trackers.empty())
+    torrent.insert_key("announce", m_trackers.front());
+
+  if (m_trackers.size() > 1) {
+    Object::list_type& groups = torrent.insert_key("announce-list", Object(Object::TYPE_LIST)).as_list();
+
+    for (tracker_list::const_iterator itr = m_trackers.begin(), last = m_trackers.end(); itr != last; ++itr)
+      groups.insert(groups.end(), Object(Object::TYPE_LIST))->as_list().push_back(Object(*itr));
+  }
+
+  if (!m_comment.empty())
+    torrent.insert_key("comment", m_comment);
+
+  torrent.insert_key("created by", std::string("libTorrent ") + VERSION);
+  torrent.insert_key("creation date", (int64_t)rak::timer::current().seconds());
+
+  torrent.insert_key("info", Object()).swap(info);
+
+  m_torrent.swap(torrent);
+}
+
+}
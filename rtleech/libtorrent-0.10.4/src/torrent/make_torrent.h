@@ -0,0 +1,182 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+// MakeTorrent creates the metainfo for a file or directory. The
+// chunks are hashed by worker threads that only read the files and
+// fill in the pieces, the task scheduler polls them for progress and
+// builds the torrent on the main thread once they are done.
+//
+// Settings must not be changed while the torrent is being made.
+
+#ifndef LIBTORRENT_MAKE_TORRENT_H
+#define LIBTORRENT_MAKE_TORRENT_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sigc++/slot.h>
+#include <torrent/object.h>
+
+namespace rak {
+  class priority_item;
+}
+
+namespace torrent {
+
+class Sha1;
+
+class MakeTorrent {
+public:
+  typedef std::list<std::string>                 tracker_list;
+  typedef std::pair<std::string, uint64_t>       file_type;
+  typedef std::vector<file_type>                 file_list;
+  typedef sigc::slot0<void>                      SlotVoid;
+
+  // The chunk size is picked so the torrent has about
+  // 'target_chunks' chunks.
+  static const uint32_t min_chunk_size = (1 << 15);
+  static const uint32_t max_chunk_size = (1 << 24);
+  static const uint32_t target_chunks  = 1500;
+
+  // Size of the reads, and time in microseconds between checks on
+  // the progress of the threads.
+  static const uint32_t read_size      = (1 << 20);
+  static const int64_t  poll_interval  = 100000;
+
+  MakeTorrent();
+  ~MakeTorrent();
+
+  bool                is_active() const;
+  bool                is_done() const                        { return m_torrent.is_map(); }
+
+  const std::string&  path() const                           { return m_path; }
+  void                set_path(const std::string& path)      { m_path = path; }
+
+  // Zero picks the chunk size from the total size on each start,
+  // otherwise it must be a power of two.
+  uint32_t            chunk_size() const                     { return m_chunkSize; }
+  void                set_chunk_size(uint32_t s)             { m_chunkSize = s; }
+
+  // Zero uses a thread per online processor.
+  unsigned int        threads() const                        { return m_threads; }
+  void                set_threads(unsigned int t)            { m_threads = t; }
+
+  bool                is_private() const                     { return m_private; }
+  void                set_private(bool p)                    { m_private = p; }
+
+  const std::string&  comment() const                        { return m_comment; }
+  void                set_comment(const std::string& c)      { m_comment = c; }
+
+  // Each tracker is put in its own group.
+  tracker_list&       trackers()                             { return m_trackers; }
+
+  // Files relative to the path, in the order they are hashed.
+  const file_list&    files() const                          { return m_files; }
+
+  // The bytes hashed are updated each time the threads are polled.
+  uint64_t            bytes_total() const                    { return m_bytesTotal; }
+  uint64_t            bytes_hashed() const                   { return m_bytesHashed; }
+
+  // Walks the path and starts hashing, throws input_error if there's
+  // nothing to hash and local_error if no thread could be started.
+  void                start();
+  void                stop();
+
+  // The metainfo once the hashing is done, see is_done() and error().
+  const Object&       torrent() const                        { return m_torrent; }
+  const std::string&  error() const                          { return m_error; }
+
+  // Progress is called each time the threads are polled, done is called
+  // once hashing succeeded or failed. The object may be deleted from
+  // the done slot.
+  void                slot_progress(SlotVoid s)              { m_slotProgress = s; }
+  void                slot_done(SlotVoid s)                  { m_slotDone = s; }
+
+private:
+  MakeTorrent(const MakeTorrent&);
+  void operator = (const MakeTorrent&);
+
+  void                add_directory(const std::string& dir);
+
+  static void*        hash_thread(void* maker);
+  void                hash_chunks();
+  bool                hash_chunk(uint32_t index, Sha1* sha1, std::string* buffer, file_list::size_type* fileIndex, int* fd);
+
+  void                join_threads();
+
+  void                receive_hash();
+  void                build_torrent();
+
+  std::string         m_path;
+  uint32_t            m_chunkSize;
+  uint32_t            m_pieceLength;
+  unsigned int        m_threads;
+  bool                m_private;
+  std::string         m_comment;
+  tracker_list        m_trackers;
+
+  file_list           m_files;
+  uint64_t            m_bytesTotal;
+  uint64_t            m_bytesHashed;
+
+  // Only read by the threads while they run.
+  std::string         m_root;
+  std::vector<uint64_t> m_fileOffsets;
+  uint32_t            m_chunkCount;
+  char*               m_pieces;
+
+  std::vector<pthread_t> m_threadList;
+
+  // Protected by 'm_lock'.
+  pthread_mutex_t     m_lock;
+  uint32_t            m_chunkNext;
+  unsigned int        m_threadsRunning;
+  uint64_t            m_bytesRead;
+  std::string         m_threadError;
+
+  Object              m_torrent;
+  std::string         m_error;
+
+  SlotVoid            m_slotProgress;
+  SlotVoid            m_slotDone;
+  rak::priority_item* m_taskHash;
+};
+
+}
+
+#endif
@@ -108,10 +108,9 @@ Object::merge_copy(const Object& object, uint32_t maxDepth) {
     while (srcItr != srcLast) {
       destItr = std::find_if(destItr, dest.end(), rak::less_equal(srcItr->first, rak::mem_ref(&map_type::value_type::first)));
 
-      if (srcItr->first < destItr->first)
-        // destItr remains valid and pointing to the next possible
-        // position.
-        dest.insert(destItr, *srcItr);
+      if (destItr == dest.end() || srcItr->first < destItr->first)
+        // Inserting invalidates destItr, continue from the new entry.
+        destItr = dest.insert(destItr, *srcItr);
       else
         destItr->second.merge_copy(srcItr->second, maxDepth - 1);
 
@@ -134,6 +133,7 @@ Object::merge_copy(const Object& object, uint32_t maxDepth) {
       else
         destItr->merge_copy(*srcItr, maxDepth - 1);
 
+      srcItr++;
       destItr++;
     }
 
@@ -37,23 +37,99 @@
 #ifndef LIBTORRENT_OBJECT_H
 #define LIBTORRENT_OBJECT_H
 
+#include <algorithm>
+#include <cstring>
 #include <string>
-#include <map>
-#include <list>
+#include <vector>
 #include <inttypes.h>
 #include <torrent/exceptions.h>
 
 namespace torrent {
 
-// Look into making a custom comp and allocator classes for the
-// map_type which use a const char* for key_type.
+// A map kept as a vector sorted on the key. Bencode dictionaries are
+// small and arrive sorted, so this avoids a tree node allocation per
+// entry and appending in order is constant time. Inserting or erasing
+// invalidates iterators and references to the entries.
+
+template <typename Key, typename Value>
+class ObjectMap : private std::vector<std::pair<Key, Value> > {
+public:
+  typedef std::vector<std::pair<Key, Value> > base_type;
+
+  typedef Key                                  key_type;
+  typedef Value                                mapped_type;
+  typedef typename base_type::value_type       value_type;
+  typedef typename base_type::size_type        size_type;
+  typedef typename base_type::reference        reference;
+  typedef typename base_type::const_reference  const_reference;
+  typedef typename base_type::iterator         iterator;
+  typedef typename base_type::const_iterator   const_iterator;
+
+  using base_type::begin;
+  using base_type::end;
+  using base_type::rbegin;
+  using base_type::rend;
+  using base_type::size;
+  using base_type::empty;
+  using base_type::clear;
+  using base_type::reserve;
+
+  iterator            lower_bound(const key_type& k)       { return std::lower_bound(begin(), end(), k, key_less()); }
+  const_iterator      lower_bound(const key_type& k) const { return std::lower_bound(begin(), end(), k, key_less()); }
+
+  iterator            find(const key_type& k)              { iterator itr = lower_bound(k); return itr != end() && itr->first == k ? itr : end(); }
+  const_iterator      find(const key_type& k) const        { const_iterator itr = lower_bound(k); return itr != end() && itr->first == k ? itr : end(); }
+
+  // Like std::map, an existing entry is not replaced. The hint is
+  // only used when appending.
+  iterator            insert(iterator hint, const value_type& v);
+
+  void                erase(iterator itr)                  { base_type::erase(itr); }
+  size_type           erase(const key_type& k);
+
+  mapped_type&        operator [] (const key_type& k)      { return insert(end(), value_type(k, mapped_type()))->second; }
+
+private:
+  struct key_less {
+    bool operator () (const value_type& v, const key_type& k) const { return v.first < k; }
+  };
+};
+
+template <typename Key, typename Value>
+inline typename ObjectMap<Key, Value>::iterator
+ObjectMap<Key, Value>::insert(iterator hint, const value_type& v) {
+  if (hint == end() && (empty() || base_type::back().first < v.first))
+    return base_type::insert(end(), v);
+
+  iterator itr = lower_bound(v.first);
+
+  if (itr != end() && itr->first == v.first)
+    return itr;
+
+  return base_type::insert(itr, v);
+}
+
+template <typename Key, typename Value>
+inline typename ObjectMap<Key, Value>::size_type
+ObjectMap<Key, Value>::erase(const key_type& k) {
+  iterator itr = find(k);
+
+  if (itr == end())
+    return 0;
+
+  base_type::erase(itr);
+  return 1;
+}
+
+// Lists and maps are stored in vectors, so a reference to a child is
+// invalidated by inserting into its parent.
 
 class Object {
 public:
   typedef int64_t                         value_type;
   typedef std::string                     string_type;
-  typedef std::list<Object>               list_type;
-  typedef std::map<std::string, Object>   map_type;
+  typedef std::vector<Object>             list_type;
+  typedef ObjectMap<std::string, Object>  map_type;
   typedef map_type::key_type              key_type;
 
   enum type_type {
@@ -70,6 +146,12 @@ public:
   Object(const string_type& s) : m_type(TYPE_STRING), m_string(new string_type(s)) {}
   Object(const Object& b);
 
+#if __cplusplus >= 201103L
+  // Lets the vectors relocate children without deep copies.
+  Object(Object&& b) noexcept                  { std::memcpy(this, &b, sizeof(Object)); b.m_type = TYPE_NONE; }
+  Object&             operator = (Object&& b) noexcept { Object tmp(static_cast<Object&&>(b)); return swap(tmp); }
+#endif
+
   explicit Object(type_type t);
   
   ~Object() { clear(); }
@@ -119,7 +201,9 @@ public:
   map_type&           get_key_map(const key_type& k)                 { return get_key(k).as_map(); }
   const map_type&     get_key_map(const key_type& k) const           { return get_key(k).as_map(); }
 
-  Object&             insert_key(const key_type& k, const Object& b) { check_throw(TYPE_MAP); return (*m_map)[k] = b; }
+  // The copy is made before inserting as 'b' may be an entry of this
+  // map.
+  Object&             insert_key(const key_type& k, const Object& b) { check_throw(TYPE_MAP); Object tmp(b); return (*m_map)[k].swap(tmp); }
   void                erase_key(const key_type& k)                   { check_throw(TYPE_MAP); m_map->erase(k); }
 
   Object&             insert_front(const Object& b)                  { check_throw(TYPE_LIST); return *m_list->insert(m_list->begin(), b); }
@@ -36,6 +36,8 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iterator>
 #include <sstream>
 #include <rak/functional.h>
@@ -138,66 +140,367 @@ object_read_bencode(std::istream* input, Object* object, uint32_t depth) {
   object->clear();
 }
 
+// Returns the start of the string data, the length has been checked
+// against the end of the buffer.
+static const char*
+object_read_string_c(const char* first, const char* last, size_t* length) {
+  if (first == last || *first < '0' || *first > '9')
+    return NULL;
+
+  uint64_t size = 0;
+
+  while (first != last && *first >= '0' && *first <= '9') {
+    size = size * 10 + (*first++ - '0');
+
+    if (size > (uint64_t)(last - first))
+      return NULL;
+  }
+
+  if (first == last || *first++ != ':' || size > (uint64_t)(last - first))
+    return NULL;
+
+  *length = size;
+  return first;
+}
+
+static const char*
+object_read_value_c(const char* first, const char* last, int64_t* value) {
+  bool negative = first != last && *first == '-';
+
+  if (negative)
+    first++;
+
+  if (first == last || *first < '0' || *first > '9')
+    return NULL;
+
+  uint64_t v = 0;
+
+  while (first != last && *first >= '0' && *first <= '9') {
+    uint64_t next = v * 10 + (*first++ - '0');
+
+    if (next / 10 != v)
+      return NULL;
+
+    v = next;
+  }
+
+  if (first == last || *first++ != 'e' || v > (uint64_t)1 << 63 || (!negative && v == (uint64_t)1 << 63))
+    return NULL;
+
+  *value = negative ? -(int64_t)(v - 1) - 1 : (int64_t)v;
+  return first;
+}
+
+static const char*
+object_read_bencode_c_internal(const char* first, const char* last, Object* object, uint32_t depth) {
+  if (first == last)
+    return NULL;
+
+  switch (*first) {
+  case 'i':
+    *object = Object(Object::TYPE_VALUE);
+    return object_read_value_c(first + 1, last, &object->as_value());
+
+  case 'l':
+  {
+    *object = Object(Object::TYPE_LIST);
+    ++first;
+
+    if (++depth >= 1024)
+      return NULL;
+
+    Object::list_type& list = object->as_list();
+
+    while (first != last) {
+      if (*first == 'e')
+        return first + 1;
+
+      Object::list_type::iterator itr = list.insert(list.end(), Object());
+
+      if ((first = object_read_bencode_c_internal(first, last, &*itr, depth)) == NULL)
+        return NULL;
+    }
+
+    return NULL;
+  }
+
+  case 'd':
+  {
+    *object = Object(Object::TYPE_MAP);
+    ++first;
+
+    if (++depth >= 1024)
+      return NULL;
+
+    Object::map_type& map = object->as_map();
+
+    while (first != last) {
+      if (*first == 'e')
+        return first + 1;
+
+      size_t length;
+
+      if ((first = object_read_string_c(first, last, &length)) == NULL)
+        return NULL;
+
+      // Keys are sorted in valid bencode, so hint at the end of the
+      // map. Duplicates keep the last value like the stream parser.
+      Object::map_type::iterator itr = map.insert(map.end(), Object::map_type::value_type(std::string(first, length), Object()));
+
+      if ((first = object_read_bencode_c_internal(first + length, last, &itr->second, depth)) == NULL)
+        return NULL;
+    }
+
+    return NULL;
+  }
+
+  default:
+  {
+    size_t length;
+
+    if ((first = object_read_string_c(first, last, &length)) == NULL)
+      return NULL;
+
+    *object = Object(Object::TYPE_STRING);
+    object->as_string().assign(first, length);
+
+    return first + length;
+  }
+  }
+}
+
+const char*
+object_read_bencode_c(const char* first, const char* last, Object* object, uint32_t depth) {
+  const char* result = object_read_bencode_c_internal(first, last, object, depth);
+
+  if (result == NULL)
+    object->clear();
+
+  return result;
+}
+
+const char*
+object_read_bencode_skip_c(const char* first, const char* last, uint32_t depth) {
+  if (first == last)
+    return NULL;
+
+  switch (*first) {
+  case 'i':
+    int64_t value;
+    return object_read_value_c(first + 1, last, &value);
+
+  case 'l':
+  case 'd':
+  {
+    bool isMap = *first++ == 'd';
+
+    if (++depth >= 1024)
+      return NULL;
+
+    while (first != last) {
+      if (*first == 'e')
+        return first + 1;
+
+      size_t length;
+
+      if (isMap && (first = object_read_string_c(first, last, &length)) == NULL)
+        return NULL;
+
+      if (isMap)
+        first += length;
+
+      if ((first = object_read_bencode_skip_c(first, last, depth)) == NULL)
+        return NULL;
+    }
+
+    return NULL;
+  }
+
+  default:
+  {
+    size_t length;
+
+    if ((first = object_read_string_c(first, last, &length)) == NULL)
+      return NULL;
+
+    return first + length;
+  }
+  }
+}
+
 void
 object_write_bencode(std::ostream* output, const Object* object) {
-  // A decent compiler should be able to optimize away the
-  // Object::check_type calls.
+  char buffer[1024];
+  object_buffer_t result = object_write_bencode_c(&object_write_to_stream, output, object_buffer_t(buffer, buffer + sizeof(buffer)), object);
+
+  object_write_to_stream(output, result);
+}
+
+struct object_write_data_t {
+  object_write_t      writeFunc;
+  void*               data;
+
+  object_buffer_t     buffer;
+  char*               pos;
+};
+
+static void
+object_write_bencode_c_flush(object_write_data_t* output) {
+  output->buffer = output->writeFunc(output->data, object_buffer_t(output->buffer.first, output->pos));
+  output->pos = output->buffer.first;
+
+  if (output->buffer.first == output->buffer.second)
+    throw internal_error("object_write_bencode_c_flush(...) write function returned an empty buffer.");
+}
+
+static inline void
+object_write_bencode_c_char(object_write_data_t* output, char c) {
+  if (output->pos == output->buffer.second)
+    object_write_bencode_c_flush(output);
+
+  *output->pos++ = c;
+}
+
+static void
+object_write_bencode_c_string(object_write_data_t* output, const char* src, size_t length) {
+  while (length != 0) {
+    if (output->pos == output->buffer.second)
+      object_write_bencode_c_flush(output);
+
+    size_t size = std::min<size_t>(length, output->buffer.second - output->pos);
+
+    std::memcpy(output->pos, src, size);
+    output->pos += size;
+
+    src    += size;
+    length -= size;
+  }
+}
+
+// Formats the digits backwards into a small buffer, avoiding the
+// locale handling of the stream operators.
+static void
+object_write_bencode_c_value(object_write_data_t* output, int64_t value) {
+  char buffer[24];
+  char* first = buffer + sizeof(buffer);
+
+  uint64_t v = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+  do {
+    *--first = '0' + v % 10;
+    v /= 10;
+  } while (v != 0);
+
+  if (value < 0)
+    *--first = '-';
+
+  object_write_bencode_c_string(output, first, buffer + sizeof(buffer) - first);
+}
+
+// Entries of TYPE_NONE are skipped, so the output is always valid
+// bencode.
+static void
+object_write_bencode_c_object(object_write_data_t* output, const Object* object) {
   switch (object->type()) {
   case Object::TYPE_NONE:
-    // Consider failing here?
     break;
 
   case Object::TYPE_VALUE:
-    *output << 'i' << object->as_value() << 'e';
+    object_write_bencode_c_char(output, 'i');
+    object_write_bencode_c_value(output, object->as_value());
+    object_write_bencode_c_char(output, 'e');
     break;
 
   case Object::TYPE_STRING:
-    *output << object->as_string().size() << ':' << object->as_string();
+    object_write_bencode_c_value(output, object->as_string().size());
+    object_write_bencode_c_char(output, ':');
+    object_write_bencode_c_string(output, object->as_string().c_str(), object->as_string().size());
     break;
 
   case Object::TYPE_LIST:
-    // Add check for depth here?
-    *output << 'l';
+    object_write_bencode_c_char(output, 'l');
 
-    for (Object::list_type::const_iterator itr = object->as_list().begin(), last = object->as_list().end(); itr != last && output->good(); ++itr)
-      object_write_bencode(output, &*itr);
+    for (Object::list_type::const_iterator itr = object->as_list().begin(), last = object->as_list().end(); itr != last; ++itr)
+      object_write_bencode_c_object(output, &*itr);
 
-    *output << 'e';
+    object_write_bencode_c_char(output, 'e');
     break;
 
   case Object::TYPE_MAP:
-    // Add check for depth here?
-    *output << 'd';
+    object_write_bencode_c_char(output, 'd');
+
+    for (Object::map_type::const_iterator itr = object->as_map().begin(), last = object->as_map().end(); itr != last; ++itr) {
+      if (itr->second.type() == Object::TYPE_NONE)
+        continue;
 
-    for (Object::map_type::const_iterator itr = object->as_map().begin(), last = object->as_map().end(); itr != last && output->good(); ++itr) {
-      *output << itr->first.size() << ':' << itr->first;
-      object_write_bencode(output, &itr->second);
+      object_write_bencode_c_value(output, itr->first.size());
+      object_write_bencode_c_char(output, ':');
+      object_write_bencode_c_string(output, itr->first.c_str(), itr->first.size());
+
+      object_write_bencode_c_object(output, &itr->second);
     }
 
-    *output << 'e';
+    object_write_bencode_c_char(output, 'e');
     break;
   }
 }
 
-// Would be nice to have a straight stream to hash conversion.
-std::string
-object_sha1(const Object* object) {
-  std::stringstream str;
-  str << *object;
+object_buffer_t
+object_write_bencode_c(object_write_t writeFunc, void* data, object_buffer_t buffer, const Object* object) {
+  if (buffer.first == buffer.second)
+    throw internal_error("object_write_bencode_c(...) called with an empty buffer.");
+
+  object_write_data_t output;
+  output.writeFunc = writeFunc;
+  output.data      = data;
+  output.buffer    = buffer;
+  output.pos       = buffer.first;
 
-  if (str.fail())
-    throw bencode_error("Could not write bencode to stream");
+  object_write_bencode_c_object(&output, object);
 
-  std::string s = str.str();
+  return object_buffer_t(output.buffer.first, output.pos);
+}
+
+object_buffer_t
+object_write_to_buffer(void* data, object_buffer_t buffer) {
+  throw internal_error("object_write_to_buffer(...) buffer overflow.");
+}
+
+object_buffer_t
+object_write_to_string(void* data, object_buffer_t buffer) {
+  static_cast<std::string*>(data)->append(buffer.first, buffer.second);
+
+  return buffer;
+}
+
+object_buffer_t
+object_write_to_stream(void* data, object_buffer_t buffer) {
+  static_cast<std::ostream*>(data)->write(buffer.first, buffer.second - buffer.first);
+
+  return buffer;
+}
+
+static object_buffer_t
+object_write_to_sha1(void* data, object_buffer_t buffer) {
+  static_cast<Sha1*>(data)->update(buffer.first, buffer.second - buffer.first);
+
+  return buffer;
+}
+
+std::string
+object_sha1(const Object* object) {
   Sha1 sha1;
+  char buffer[1024];
 
   sha1.init();
-  sha1.update(s.c_str(), s.size());
 
-  char buffer[20];
-  sha1.final_c(buffer);
+  object_buffer_t result = object_write_bencode_c(&object_write_to_sha1, &sha1, object_buffer_t(buffer, buffer + sizeof(buffer)), object);
+  object_write_to_sha1(&sha1, result);
+
+  char hash[20];
+  sha1.final_c(hash);
 
-  return std::string(buffer, 20);
+  return std::string(hash, 20);
 }
 
 std::istream&
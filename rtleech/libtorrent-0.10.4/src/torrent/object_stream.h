@@ -39,6 +39,8 @@
 
 #include <ios>
 #include <string>
+#include <utility>
+#include <inttypes.h>
 
 namespace torrent {
 
@@ -51,9 +53,37 @@ std::string object_sha1(const Object* object);
 // the client.
 void object_read_bencode(std::istream* input, Object* object, uint32_t depth = 0);
 
-// Assumes the stream's locale has been set to POSIX or C.
+// Parses the object at the start of the buffer [first, last) without
+// going through a stream, each string is copied straight out of the
+// buffer. Returns the position after the object, or NULL if the data
+// is invalid or truncated in which case 'object' is cleared. Trailing
+// data is ignored.
+const char* object_read_bencode_c(const char* first, const char* last, Object* object, uint32_t depth = 0);
+
+// Finds the end of the object at 'first' without building it, or
+// returns NULL. Use this to get at the raw bencode of a value.
+const char* object_read_bencode_skip_c(const char* first, const char* last, uint32_t depth = 0);
+
 void object_write_bencode(std::ostream* output, const Object* object);
 
+// Writes bencode into 'buffer', which must not be empty. Whenever it
+// fills up 'writeFunc' is called with the written data and returns
+// the buffer to continue in. Returns the part of the last buffer that
+// has been written but not passed to 'writeFunc'. Map entries and
+// list elements of TYPE_NONE are skipped.
+typedef std::pair<char*, char*> object_buffer_t;
+typedef object_buffer_t (*object_write_t)(void* data, object_buffer_t buffer);
+
+object_buffer_t object_write_bencode_c(object_write_t writeFunc, void* data, object_buffer_t buffer, const Object* object);
+
+// Write functions that return the same buffer after handling the
+// data, 'data' is ignored, a std::string* to append to and a
+// std::ostream* respectively. The first throws internal_error, use it
+// when the buffer is known to be large enough.
+object_buffer_t object_write_to_buffer(void* data, object_buffer_t buffer);
+object_buffer_t object_write_to_string(void* data, object_buffer_t buffer);
+object_buffer_t object_write_to_stream(void* data, object_buffer_t buffer);
+
 std::istream& operator >> (std::istream& input, Object& object);
 std::ostream& operator << (std::ostream& output, const Object& object);
 
@@ -49,6 +49,7 @@ PeerInfo::PeerInfo(const sockaddr* address) :
   m_flags(0),
 
   m_failedCounter(0),
+  m_failedConnects(0),
   m_transferCounter(0),
   m_lastConnection(0),
   m_listenPort(0)
@@ -54,11 +54,17 @@ public:
   friend class Handshake;
   friend class HandshakeManager;
   friend class PeerList;
+  friend class ProtocolExtension;
 
   static const int flag_connected = (1 << 0);
   static const int flag_incoming  = (1 << 1);
   static const int flag_handshake = (1 << 2);
 
+  // The BEP-10 extension protocol bit in the reserved handshake
+  // bytes.
+  static const unsigned int option_extension_byte = 5;
+  static const char         option_extension_bit  = 0x10;
+
   PeerInfo(const sockaddr* address);
   ~PeerInfo();
 
@@ -67,6 +73,8 @@ public:
   bool                is_incoming() const                   { return m_flags & flag_incoming; }
   bool                is_handshake() const                  { return m_flags & flag_handshake; }
 
+  bool                supports_extensions() const           { return m_options[option_extension_byte] & option_extension_bit; }
+
   const std::string&  id() const                            { return m_id; }
 
   int                 flags() const                         { return m_flags; }
@@ -79,6 +87,11 @@ public:
   uint32_t            failed_counter() const                { return m_failedCounter; }
   void                set_failed_counter(uint32_t c)        { m_failedCounter = c; }
 
+  // Consecutive failed outgoing connection attempts, reset on a
+  // successfull handshake.
+  uint32_t            failed_connects() const               { return m_failedConnects; }
+  void                set_failed_connects(uint32_t c)       { m_failedConnects = c; }
+
   uint32_t            transfer_counter() const              { return m_transferCounter; }
   void                set_transfer_counter(uint32_t c)      { m_transferCounter = c; }
 
@@ -107,6 +120,7 @@ private:
   char                m_options[8];
 
   uint32_t            m_failedCounter;
+  uint32_t            m_failedConnects;
   uint32_t            m_transferCounter;
   uint32_t            m_lastConnection;
 
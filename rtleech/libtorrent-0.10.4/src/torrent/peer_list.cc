@@ -39,6 +39,7 @@
 #include <algorithm>
 #include <functional>
 #include <rak/functional.h>
+#include <rak/hash_index.h>
 #include <rak/socket_address.h>
 
 #include "download/available_list.h"
@@ -50,52 +51,74 @@
 
 namespace torrent {
 
-bool
-socket_address_key::operator < (const socket_address_key& sa) const {
-  const rak::socket_address* sa1 = rak::socket_address::cast_from(m_sockaddr);
-  const rak::socket_address* sa2 = rak::socket_address::cast_from(sa.m_sockaddr);
-
-  if (sa1->family() != sa2->family())
-    return sa1->family() > sa2->family();
-
-  else if (sa1->family() == rak::socket_address::af_inet)
-    // Sort by hardware byte order to ensure proper ordering for
-    // humans.
-    return sa1->sa_inet()->address_h() < sa2->sa_inet()->address_h();
+struct peer_list_traits {
+  static uint32_t hash(const PeerInfo* p) {
+    return rak::socket_address_host_hash(*rak::socket_address::cast_from(p->socket_address()));
+  }
 
-  else
-    // When we implement INET6 handling, embed the ipv4 address in
-    // the ipv6 address.
-    throw internal_error("socket_address_key(...) tried to compare an invalid family type.");
-}
+  static uint32_t hash(const sockaddr* sa) {
+    return rak::socket_address_host_hash(*rak::socket_address::cast_from(sa));
+  }
 
-struct peer_list_equal_port : public std::binary_function<PeerList::reference, uint16_t, bool> {
-  bool operator () (PeerList::reference p, uint16_t port) {
-    return rak::socket_address::cast_from(p.second->socket_address())->port() == port;
+  static bool equal(const PeerInfo* p, const sockaddr* sa) {
+    return rak::socket_address_host_equal(*rak::socket_address::cast_from(p->socket_address()), *rak::socket_address::cast_from(sa));
   }
 };
 
+class PeerListIndex : public rak::hash_index<PeerList::base_type, peer_list_traits> {
+public:
+  PeerListIndex(const PeerList::base_type* c) : rak::hash_index<PeerList::base_type, peer_list_traits>(c) {}
+};
+
 PeerList::PeerList() :
-  m_availableList(new AvailableList) {
+  m_availableList(new AvailableList),
+  m_index(new PeerListIndex(this)) {
 }
 
 PeerList::~PeerList() {
-  std::for_each(begin(), end(), rak::on(rak::mem_ref(&value_type::second), rak::call_delete<PeerInfo>()));
+  std::for_each(base_type::begin(), base_type::end(), rak::call_delete<PeerInfo>());
   base_type::clear();
 
+  delete m_index;
   delete m_availableList;
 }
 
+inline void
+PeerList::insert_back(PeerInfo* peerInfo) {
+  base_type::push_back(peerInfo);
+  m_index->insert_back();
+}
+
+inline void
+PeerList::erase_position(size_type pos) {
+  m_index->erase_position(pos);
+
+  base_type::operator[](pos) = base_type::back();
+  base_type::pop_back();
+}
+
 PeerInfo*
-PeerList::insert_address(const sockaddr* sa, int flags) {
-  range_type range = base_type::equal_range(sa);
+PeerList::find(const sockaddr* sa) {
+  size_type pos = m_index->find(sa);
+
+  return pos != PeerListIndex::npos ? base_type::operator[](pos) : NULL;
+}
+
+const PeerInfo*
+PeerList::find(const sockaddr* sa) const {
+  size_type pos = m_index->find(sa);
+
+  return pos != PeerListIndex::npos ? base_type::operator[](pos) : NULL;
+}
 
+PeerInfo*
+PeerList::insert_address(const sockaddr* sa, int flags) {
   // Do some special handling if we got a new port number but the
   // address was present.
   //
   // What we do depends on the flags, but for now just allow one
   // PeerInfo per address key and do nothing.
-  if (range.first != range.second)
+  if (find(sa) != NULL)
     return NULL;
 
   const rak::socket_address* address = rak::socket_address::cast_from(sa);
@@ -103,7 +126,7 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
   PeerInfo* peerInfo = new PeerInfo(sa);
   peerInfo->set_listen_port(address->port());
 
-  base_type::insert(range.second, value_type(socket_address_key(peerInfo->socket_address()), peerInfo));
+  insert_back(peerInfo);
 
   if (flags & address_available && peerInfo->listen_port() != 0)
     m_availableList->push_back(address);
@@ -113,20 +136,17 @@ PeerList::insert_address(const sockaddr* sa, int flags) {
 
 PeerInfo*
 PeerList::connected(const sockaddr* sa, int flags) {
-  PeerInfo* peerInfo;
   const rak::socket_address* address = rak::socket_address::cast_from(sa);
 
-  range_type range = base_type::equal_range(sa);
+  PeerInfo* peerInfo = find(sa);
 
-  if (range.first == range.second) {
+  if (peerInfo == NULL) {
     // Create a new entry.
     peerInfo = new PeerInfo(sa);
+    insert_back(peerInfo);
 
-    base_type::insert(range.second, value_type(socket_address_key(peerInfo->socket_address()), peerInfo));
-
-  } else if (!range.first->second->is_connected()) {
+  } else if (!peerInfo->is_connected()) {
     // Use an old entry.
-    peerInfo = range.first->second;
     peerInfo->set_port(address->port());
 
   } else {
@@ -137,8 +157,8 @@ PeerList::connected(const sockaddr* sa, int flags) {
     // This also ensure we can connect to peers running on the same
     // host as the tracker.
     if (flags & connect_keep_handshakes &&
-        range.first->second->is_handshake() &&
-        rak::socket_address::cast_from(range.first->second->socket_address())->port() != address->port())
+        peerInfo->is_handshake() &&
+        rak::socket_address::cast_from(peerInfo->socket_address())->port() != address->port())
       m_availableList->buffer()->push_back(*address);
 
     return NULL;
@@ -162,17 +182,15 @@ PeerList::connected(const sockaddr* sa, int flags) {
 
 void
 PeerList::disconnected(PeerInfo* p, int flags) {
-  range_type range = base_type::equal_range(p->socket_address());
-  
-  iterator itr = std::find_if(range.first, range.second, rak::equal(p, rak::mem_ref(&value_type::second)));
+  size_type pos = m_index->find(p->socket_address());
 
-  if (itr == range.second)
-    if (std::find_if(base_type::begin(), base_type::end(), rak::equal(p, rak::mem_ref(&value_type::second))) == base_type::end())
-      throw internal_error("PeerList::disconnected(...) itr == range.second, doesn't exist.");
+  if (pos == PeerListIndex::npos || base_type::operator[](pos) != p)
+    if (std::find(base_type::begin(), base_type::end(), p) == base_type::end())
+      throw internal_error("PeerList::disconnected(...) peer info doesn't exist.");
     else
-      throw internal_error("PeerList::disconnected(...) itr == range.second, not in the range.");
+      throw internal_error("PeerList::disconnected(...) peer info not found in the index.");
   
-  disconnected(itr, flags);
+  disconnected(base_type::begin() + pos, flags);
 }
 
 PeerList::iterator
@@ -180,18 +198,18 @@ PeerList::disconnected(iterator itr, int flags) {
   if (itr == base_type::end())
     throw internal_error("PeerList::disconnected(...) itr == end().");
 
-  if (!itr->second->is_connected())
+  if (!(*itr)->is_connected())
     throw internal_error("PeerList::disconnected(...) !itr->is_connected().");
 
-  itr->second->unset_flags(PeerInfo::flag_connected);
-  itr->second->set_last_connection(cachedTime.seconds());
+  (*itr)->unset_flags(PeerInfo::flag_connected);
+  (*itr)->set_last_connection(cachedTime.seconds());
 
   // Replace the socket address port with the listening port so that
   // future outgoing connections will connect to the right port.
-  itr->second->set_port(0);
+  (*itr)->set_port(0);
 
-  if (flags & disconnect_available && itr->second->listen_port() != 0)
-    m_availableList->push_back(rak::socket_address::cast_from(itr->second->socket_address()));
+  if (flags & disconnect_available && (*itr)->listen_port() != 0)
+    m_availableList->push_back(rak::socket_address::cast_from((*itr)->socket_address()));
 
   // Do magic to get rid of unneeded entries.
   return ++itr;
@@ -207,23 +225,20 @@ PeerList::cull_peers(int flags) {
   else
     timer = 0;
 
-  for (iterator itr = base_type::begin(); itr != base_type::end(); ) {
-    if (itr->second->is_connected() ||
-        itr->second->transfer_counter() != 0 ||
-        itr->second->last_connection() >= timer ||
+  for (size_type pos = 0; pos != size(); ) {
+    PeerInfo* peerInfo = base_type::operator[](pos);
+
+    if (peerInfo->is_connected() ||
+        peerInfo->transfer_counter() != 0 ||
+        peerInfo->last_connection() >= timer ||
 
-        (flags & cull_keep_interesting && itr->second->failed_counter() != 0)) {
-      itr++;
+        (flags & cull_keep_interesting && peerInfo->failed_counter() != 0)) {
+      pos++;
       continue;
     }
 
-    // The key is a pointer to a member in the value, although the key
-    // shouldn't actually be used in erase (I think), just ot be safe
-    // we delete it after erase.
-    iterator tmp = itr++;
-    PeerInfo* peerInfo = tmp->second;
-
-    base_type::erase(tmp);
+    // The back entry is moved into 'pos', so don't advance.
+    erase_position(pos);
     delete peerInfo;
 
     counter++;
@@ -37,7 +37,8 @@
 #ifndef LIBTORRENT_PEER_LIST_H
 #define LIBTORRENT_PEER_LIST_H
 
-#include <map>
+#include <vector>
+#include <inttypes.h>
 
 struct sockaddr;
 
@@ -48,26 +49,21 @@ class ConnectionList;
 class Handshake;
 class HandshakeManager;
 class PeerInfo;
+class PeerListIndex;
 
-// Unique key for the address, excluding port numbers etc.
-class socket_address_key {
-public:
-  socket_address_key(const sockaddr* sa) : m_sockaddr(sa) {}
-
-  bool operator < (const socket_address_key& sa) const;
+// The PeerInfo's are kept in a vector with a hash index on their
+// host address, excluding the port, so lookups are O(1). Only one
+// PeerInfo is kept per host. Inet6 hosts are supported when built
+// with ipv6 enabled.
 
-private:
-  const sockaddr*     m_sockaddr;
-};
-
-class PeerList : private std::multimap<socket_address_key, PeerInfo*> {
+class PeerList : private std::vector<PeerInfo*> {
 public:
   friend class Handshake;
   friend class HandshakeManager;
   friend class ConnectionList;
 
-  typedef std::multimap<socket_address_key, PeerInfo*>        base_type;
-  typedef std::pair<base_type::iterator, base_type::iterator> range_type;
+  typedef std::vector<PeerInfo*> base_type;
+  typedef uint32_t               size_type;
 
   using base_type::value_type;
   using base_type::reference;
@@ -99,6 +95,10 @@ public:
 
   PeerInfo*           insert_address(const sockaddr* address, int flags);
 
+  // Returns NULL if there's no PeerInfo for the host.
+  PeerInfo*           find(const sockaddr* sa);
+  const PeerInfo*     find(const sockaddr* sa) const;
+
   AvailableList*      available_list()  { return m_availableList; }
 
   uint32_t            cull_peers(int flags);
@@ -120,7 +120,11 @@ private:
   PeerList(const PeerList&);
   void operator = (const PeerList&);
 
+  void                insert_back(PeerInfo* peerInfo);
+  void                erase_position(size_type pos);
+
   AvailableList*      m_availableList;
+  PeerListIndex*      m_index;
 };
 
 }
@@ -36,16 +36,41 @@
 
 #include "config.h"
 
+#include <algorithm>
+
 #include "globals.h"
+#include "exceptions.h"
 #include "rate.h"
 
 namespace torrent {
 
+// Clear the buckets that have passed out of the span since the last
+// call. Each bucket that is completed is folded into the smoothed
+// rate with a weight of 1/4.
 inline void
 Rate::discard_old() const {
-  while (!m_container.empty() && m_container.back().first < cachedTime.seconds() - m_span) {
-    m_current -= m_container.back().second;
-    m_container.pop_back();
+  timer_type position = cachedTime.seconds() / m_bucketSpan;
+
+  if (position == m_position)
+    return;
+
+  if (position < m_position || position - m_position >= m_bucketSize) {
+    // Idle for longer than the span, or the clock went backwards.
+    std::fill(m_buckets, m_buckets + m_bucketSize, 0);
+
+    m_current = 0;
+    m_smoothed = 0;
+    m_position = position;
+    return;
+  }
+
+  while (m_position != position) {
+    m_smoothed = (3 * m_smoothed + m_buckets[m_position % m_bucketSize] / m_bucketSpan) / 4;
+
+    rate_type& bucket = m_buckets[++m_position % m_bucketSize];
+
+    m_current -= bucket;
+    bucket = 0;
   }
 }
 
@@ -56,17 +81,42 @@ Rate::rate() const {
   return m_current / m_span;
 }
 
+Rate::rate_type
+Rate::rate_smoothed() const {
+  discard_old();
+
+  return m_smoothed;
+}
+
+void
+Rate::set_span(timer_type s) {
+  if (s <= 0)
+    throw internal_error("Rate::set_span(...) received an invalid span.");
+
+  m_span = s;
+  m_bucketSpan = (s + bucket_max - 1) / bucket_max;
+  m_bucketSize = (s + m_bucketSpan - 1) / m_bucketSpan;
+
+  reset_rate();
+}
+
 void
 Rate::insert(rate_type bytes) {
   discard_old();
 
-  if (m_container.empty() || m_container.front().first != cachedTime.seconds())
-    m_container.push_front(value_type(cachedTime.seconds(), bytes));
-  else
-    m_container.front().second += bytes;
+  m_buckets[m_position % m_bucketSize] += bytes;
 
   m_total += bytes;
   m_current += bytes;
 }
 
+void
+Rate::reset_rate() {
+  std::fill(m_buckets, m_buckets + bucket_max, 0);
+
+  m_position = cachedTime.seconds() / m_bucketSpan;
+  m_current = 0;
+  m_smoothed = 0;
+}
+
 }
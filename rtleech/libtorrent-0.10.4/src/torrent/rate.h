@@ -37,14 +37,19 @@
 #ifndef LIBTORRENT_UTILS_RATE_H
 #define LIBTORRENT_UTILS_RATE_H
 
-#include <deque>
 #include <inttypes.h>
 
 namespace torrent {
 
-// Keep the current rate count up to date for each call to rate() and
-// insert(...). This requires a mutable since rate() can be const, but
-// is justified as we avoid iterating the deque for each call.
+// The rate is kept in a fixed size ring of buckets, each covering
+// 'bucket_span()' seconds, with a running sum of the buckets within
+// 'span()'. Expired buckets are cleared lazily on the next call to
+// rate() or insert(...), which requires mutable members since rate()
+// is const. Neither call allocates and both are O(1) except after
+// long idle periods, where at most 'bucket_max' buckets are cleared.
+//
+// A smoothed rate, an exponentially weighted moving average over the
+// completed buckets, is available for display purposes.
 
 class Rate {
 public:
@@ -52,25 +57,30 @@ public:
   typedef uint32_t                         rate_type;
   typedef uint64_t                         total_type;
 
-  typedef std::pair<timer_type, rate_type> value_type;
-  typedef std::deque<value_type>           queue_type;
+  static const timer_type bucket_max = 32;
 
-  Rate(timer_type span) : m_current(0), m_total(0), m_span(span) {}
+  Rate(timer_type span) : m_total(0)                          { set_span(span); }
 
   // Bytes per second.
   rate_type           rate() const;
 
+  // Smoothed bytes per second, lags behind rate() by a few buckets.
+  rate_type           rate_smoothed() const;
+
   // Total bytes transfered.
   total_type          total() const                           { return m_total; }
   void                set_total(total_type bytes)             { m_total = bytes; }
 
-  // Interval in seconds used to calculate the rate.
+  // Interval in seconds used to calculate the rate. Changing the span
+  // resets the rate.
   timer_type          span() const                            { return m_span; }
-  void                set_span(timer_type s)                  { m_span = s; }
+  void                set_span(timer_type s);
+
+  timer_type          bucket_span() const                     { return m_bucketSpan; }
 
   void                insert(rate_type bytes);
 
-  void                reset_rate()                            { m_current = 0; m_container.clear(); }
+  void                reset_rate();
   
   bool                operator <  (Rate& r) const             { return rate() < r.rate(); }
   bool                operator >  (Rate& r) const             { return rate() > r.rate(); }
@@ -85,11 +95,19 @@ public:
 private:
   inline void         discard_old() const;
 
-  mutable queue_type  m_container;
+  mutable rate_type   m_buckets[bucket_max];
+
+  // Index, in units of 'm_bucketSpan' seconds, of the newest bucket.
+  mutable timer_type  m_position;
 
   mutable rate_type   m_current;
+  mutable rate_type   m_smoothed;
+
   total_type          m_total;
+
   timer_type          m_span;
+  timer_type          m_bucketSpan;
+  timer_type          m_bucketSize;
 };
 
 }
@@ -36,6 +36,11 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
 #include <rak/file_stat.h>
 #include <rak/socket_address.h>
 
@@ -59,6 +64,61 @@
 
 namespace torrent {
 
+// The number and size of the blocks read from an incomplete file to
+// check that the chunks it had completed were not replaced.
+static const unsigned int resume_sample_count = 4;
+static const uint32_t     resume_sample_size  = 4096;
+
+// Checksum of a few blocks of the file that belong to chunks marked
+// as completed in the bitfield. Returns zero if the file could not be
+// read.
+static int64_t
+resume_file_sample(Download download, const std::string& path, File file) {
+  const Bitfield* bitfield = download.bitfield();
+  std::vector<uint32_t> done;
+
+  for (uint32_t index = file.chunk_begin(); index != file.chunk_end(); ++index)
+    if (bitfield->get(index))
+      done.push_back(index);
+
+  // FNV-1a.
+  uint64_t hash = 14695981039346656037ull;
+
+  if (done.empty())
+    return hash;
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+
+  if (fd == -1)
+    return 0;
+
+  char buffer[resume_sample_size];
+  unsigned int count = std::min<unsigned int>(resume_sample_count, done.size());
+
+  for (unsigned int i = 0; i < count; ++i) {
+    uint64_t chunkBegin = (uint64_t)done[i * done.size() / count] * download.chunks_size();
+    uint64_t position   = chunkBegin > file.position() ? chunkBegin - file.position() : 0;
+    uint32_t length     = std::min<uint64_t>(resume_sample_size, file.size_bytes() - position);
+
+    ssize_t r;
+
+    do {
+      r = ::pread(fd, buffer, length, position);
+    } while (r == -1 && errno == EINTR);
+
+    if (r != (ssize_t)length) {
+      ::close(fd);
+      return 0;
+    }
+
+    for (char* itr = buffer, *last = buffer + length; itr != last; ++itr)
+      hash = (hash ^ (unsigned char)*itr) * 1099511628211ull;
+  }
+
+  ::close(fd);
+  return hash != 0 ? hash : 1;
+}
+
 void
 resume_load_progress(Download download, const Object& object) {
   if (!object.has_key_list("files"))
@@ -95,17 +155,48 @@ resume_load_progress(Download download, const Object& object) {
   Object::list_type::const_iterator filesLast = files.end();
 
   FileList fileList = download.file_list();
+  std::vector<unsigned int> invalid;
 
+  // Check all the files before clearing any ranges, as the samples
+  // depend on the bitfield.
   for (unsigned int index = 0; index < fileList.size(); ++index, ++filesItr) {
     rak::file_stat fs;
     File file = fileList.get(index);
+    std::string path = fileList.root_dir() + file.path_str();
 
     // Check that the size and modified stamp matches. If not, then
     // clear the resume data for that range.
 
-    if (!fs.update(fileList.root_dir() + file.path_str()) || fs.size() != (off_t)file.size_bytes() ||
-        !filesItr->has_key_value("mtime") || filesItr->get_key_value("mtime") != fs.modified_time())
-      download.clear_range(file.chunk_begin(), file.chunk_end());
+    if (!fs.update(path) || fs.size() != (off_t)file.size_bytes()) {
+      invalid.push_back(index);
+      continue;
+    }
+
+    if (filesItr->has_key_value("mtime") && filesItr->get_key_value("mtime") == fs.modified_time())
+      continue;
+
+    // Incomplete files of an active download are expected to change
+    // after the save, only the chunks that were completed then need
+    // to be unchanged.
+    if (!filesItr->has_key_value("sample") || filesItr->get_key_value("sample") != resume_file_sample(download, path, file))
+      invalid.push_back(index);
+  }
+
+  for (std::vector<unsigned int>::iterator itr = invalid.begin(), last = invalid.end(); itr != last; ++itr)
+    download.clear_range(fileList.get(*itr).chunk_begin(), fileList.get(*itr).chunk_end());
+
+  // Chunks that were being written or not yet synced when the resume
+  // data was saved might have been completed since or lost in a
+  // crash, so they get hashed.
+  if (object.has_key_string("uncertain")) {
+    const Object::string_type& uncertain = object.get_key_string("uncertain");
+
+    if (uncertain.size() != download.bitfield()->size_bytes())
+      return;
+
+    for (uint32_t index = 0; index < download.bitfield()->size_bits(); ++index)
+      if (uncertain[index / 8] & Bitfield::mask_at(index % 8))
+        download.clear_range(index, index + 1);
   }
 }
 
@@ -128,6 +219,18 @@ resume_save_progress(Download download, Object& object, bool onlyCompleted) {
     object.insert_key("bitfield", bitfield->size_set());
   else
     object.insert_key("bitfield", std::string((char*)download.bitfield()->begin(), download.bitfield()->size_bytes()));
+
+  Bitfield writable;
+  writable.set_size_bits(bitfield->size_bits());
+  writable.allocate();
+  writable.unset_all();
+
+  download.writable_chunks(&writable);
+
+  if (writable.is_all_unset())
+    object.erase_key("uncertain");
+  else
+    object.insert_key("uncertain", std::string((char*)writable.begin(), writable.size_bytes()));
   
   Object::list_type& files = object.has_key_list("files")
     ? object.get_key_list("files")
@@ -145,20 +248,38 @@ resume_save_progress(Download download, Object& object, bool onlyCompleted) {
 
     rak::file_stat fs;
     File file = fileList.get(index);
+    std::string path = fileList.root_dir() + file.path_str();
 
-    if (!fs.update(fileList.root_dir() + file.path_str()) ||
-        (onlyCompleted && file.completed_chunks() != file.size_chunks())) {
+    if (!fs.update(path)) {
       filesItr->erase_key("mtime");
+      filesItr->erase_key("sample");
       continue;
     }
 
-    filesItr->insert_key("mtime", (int64_t)fs.modified_time());
+    if (file.completed_chunks() == file.size_chunks()) {
+      filesItr->insert_key("mtime", (int64_t)fs.modified_time());
+      filesItr->erase_key("sample");
+      continue;
+    }
+
+    int64_t sample = resume_file_sample(download, path, file);
+
+    if (sample != 0)
+      filesItr->insert_key("sample", sample);
+    else
+      filesItr->erase_key("sample");
+
+    if (onlyCompleted)
+      filesItr->erase_key("mtime");
+    else
+      filesItr->insert_key("mtime", (int64_t)fs.modified_time());
   }
 }
 
 void
 resume_clear_progress(Download download, Object& object) {
   object.erase_key("bitfield");
+  object.erase_key("uncertain");
 }
 
 void
@@ -253,13 +374,13 @@ resume_save_addresses(Download download, Object& object) {
 
     Object& peer = dest.insert_back(Object(Object::TYPE_MAP));
 
-    const rak::socket_address* sa = rak::socket_address::cast_from(itr->second->socket_address());
+    const rak::socket_address* sa = rak::socket_address::cast_from((*itr)->socket_address());
 
     if (sa->family() == rak::socket_address::af_inet)
-      peer.insert_key("inet", std::string(SocketAddressCompact(sa->sa_inet()->address_n(), htons(itr->second->listen_port())).c_str(), sizeof(SocketAddressCompact)));
+      peer.insert_key("inet", std::string(SocketAddressCompact(sa->sa_inet()->address_n(), htons((*itr)->listen_port())).c_str(), sizeof(SocketAddressCompact)));
 
-    peer.insert_key("failed",  itr->second->failed_counter());
-    peer.insert_key("last",    itr->second->is_connected() ? cachedTime.seconds() : itr->second->last_connection());
+    peer.insert_key("failed",  (*itr)->failed_counter());
+    peer.insert_key("last",    (*itr)->is_connected() ? cachedTime.seconds() : (*itr)->last_connection());
   }
 }
 
@@ -283,6 +404,13 @@ resume_load_tracker_settings(Download download, const Object& object) {
       tracker.disable();
     else
       tracker.enable();
+
+    if (trackerObject.has_key_value("success") && trackerObject.has_key_value("failed") &&
+        trackerObject.has_key_value("latency") && trackerObject.has_key_value("peers"))
+      tracker.set_stats(std::max<int64_t>(trackerObject.get_key_value("success"), 0),
+                        std::max<int64_t>(trackerObject.get_key_value("failed"), 0),
+                        std::max<int64_t>(trackerObject.get_key_value("latency"), 0),
+                        std::max<int64_t>(trackerObject.get_key_value("peers"), 0));
   }    
 }
 
@@ -297,6 +425,11 @@ resume_save_tracker_settings(Download download, Object& object) {
     Object& trackerObject = dest.insert_key(tracker.url(), Object(Object::TYPE_MAP));
 
     trackerObject.insert_key("enabled", Object((int64_t)tracker.is_enabled()));
+
+    trackerObject.insert_key("success", Object((int64_t)tracker.stats_success()));
+    trackerObject.insert_key("failed",  Object((int64_t)tracker.stats_failed()));
+    trackerObject.insert_key("latency", Object((int64_t)tracker.stats_latency()));
+    trackerObject.insert_key("peers",   Object((int64_t)tracker.stats_peers()));
   }
 }
 
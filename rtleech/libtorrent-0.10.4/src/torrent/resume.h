@@ -51,8 +51,10 @@ class Object;
 class Download;
 
 // When saving resume data for a torrent that is currently active, set
-// 'onlyCompleted' to ensure that a crash, etc, will cause incomplete
-// files to be hashed.
+// 'onlyCompleted' so the modification time of incomplete files is not
+// trusted after a crash. Instead a sample of their completed chunks is
+// compared, and only the chunks that were being written when the data
+// was saved are hashed again.
 
 void resume_load_progress(Download download, const Object& object);
 void resume_save_progress(Download download, Object& object, bool onlyCompleted = false);
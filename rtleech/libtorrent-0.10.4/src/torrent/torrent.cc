@@ -37,6 +37,7 @@
 #include "config.h"
 
 #include <rak/address_info.h>
+#include <rak/error_number.h>
 #include <rak/functional.h>
 #include <rak/string_manip.h>
 
@@ -52,6 +53,8 @@
 
 #include "net/throttle_list.h"
 #include "net/throttle_manager.h"
+#include "net/utp_manager.h"
+#include "protocol/connect_scheduler.h"
 #include "protocol/handshake_manager.h"
 #include "protocol/peer_factory.h"
 #include "data/file_manager.h"
@@ -60,6 +63,8 @@
 #include "download/download_constructor.h"
 #include "download/download_manager.h"
 #include "download/download_wrapper.h"
+#include "tracker/dht_router.h"
+#include "tracker/scrape_manager.h"
 
 namespace torrent {
 
@@ -219,6 +224,132 @@ set_max_unchoked(uint32_t count) {
   manager->resource_manager()->set_max_unchoked(count);
 }
 
+uint32_t
+unchoke_change_cost() {
+  return manager->resource_manager()->unchoke_change_cost();
+}
+
+void
+set_unchoke_change_cost(uint32_t bytes) {
+  if (bytes > (1 << 30))
+    throw input_error("Unchoke change cost must be between 0 and 2^30.");
+
+  manager->resource_manager()->set_unchoke_change_cost(bytes);
+}
+
+uint32_t
+scrape_interval() {
+  return manager->scrape_manager()->interval();
+}
+
+void
+set_scrape_interval(uint32_t seconds) {
+  if (seconds != 0 && (seconds < 60 || seconds > 7 * 24 * 60 * 60))
+    throw input_error("Scrape interval must be 0 or between 60 seconds and a week.");
+
+  manager->scrape_manager()->set_interval(seconds);
+}
+
+bool
+dht_is_active() {
+  return manager->dht_router()->is_active();
+}
+
+void
+dht_start(uint16_t port, const Object* cache) {
+  if (manager->dht_router()->is_active())
+    throw input_error("DHT is already active.");
+
+  if (cache != NULL)
+    manager->dht_router()->load_cache(*cache);
+
+  if (!manager->dht_router()->start(port))
+    throw local_error("Could not open DHT socket: " + std::string(rak::error_number::current().c_str()));
+}
+
+void
+dht_stop() {
+  manager->dht_router()->stop();
+}
+
+void
+dht_add_node(const sockaddr* sa) {
+  manager->dht_router()->add_contact(*rak::socket_address::cast_from(sa));
+}
+
+void
+dht_store_cache(Object* cache) {
+  if (!cache->is_map())
+    throw input_error("DHT cache must be a map.");
+
+  manager->dht_router()->store_cache(cache);
+}
+
+uint32_t
+dht_nodes() {
+  return manager->dht_router()->size_nodes();
+}
+
+uint32_t
+dht_query_rate() {
+  return manager->dht_router()->server()->query_rate();
+}
+
+void
+set_dht_query_rate(uint32_t rate) {
+  if (rate < 1 || rate > 1000)
+    throw input_error("DHT query rate must be between 1 and 1000.");
+
+  manager->dht_router()->server()->set_query_rate(rate);
+}
+
+bool
+utp_is_open() {
+  return manager->utp_manager()->is_open();
+}
+
+void
+utp_open(uint16_t port) {
+  if (manager->utp_manager()->is_open())
+    throw input_error("uTP socket is already open.");
+
+  if (!manager->utp_manager()->open(port, rak::socket_address::cast_from(manager->connection_manager()->bind_address())))
+    throw local_error("Could not open uTP socket: " + std::string(rak::error_number::current().c_str()));
+}
+
+void
+utp_close() {
+  manager->utp_manager()->close();
+}
+
+bool
+utp_outgoing() {
+  return manager->utp_manager()->is_outgoing();
+}
+
+void
+set_utp_outgoing(bool state) {
+  manager->utp_manager()->set_outgoing(state);
+}
+
+uint32_t
+utp_target_delay() {
+  return manager->utp_manager()->target_delay() / 1000;
+}
+
+void
+set_utp_target_delay(uint32_t msec) {
+  if (msec < 10 || msec > 1000)
+    throw input_error("uTP target delay must be between 10 and 1000 milliseconds.");
+
+  manager->utp_manager()->set_target_delay(msec * 1000);
+}
+
+void
+utp_simulate(uint32_t delay, uint32_t loss) {
+  manager->utp_manager()->set_simulated(delay, loss);
+}
+
 const Rate*
 down_rate() {
   return manager->download_throttle()->throttle_list()->rate_slow();
@@ -291,6 +422,32 @@ set_max_open_files(uint32_t size) {
   manager->file_manager()->set_max_size(size);
 }
 
+uint32_t
+connect_rate() {
+  return manager->connect_scheduler()->rate();
+}
+
+void
+set_connect_rate(uint32_t rate) {
+  if (rate < 10 || rate > 10000)
+    throw input_error("Connect rate must be between 10 and 10000.");
+
+  manager->connect_scheduler()->set_rate(rate);
+}
+
+uint32_t
+max_half_open() {
+  return manager->connect_scheduler()->max_half_open();
+}
+
+void
+set_max_half_open(uint32_t size) {
+  if (size < 1 || size > (1 << 16))
+    throw input_error("Max half open must be between 1 and 2^16.");
+
+  manager->connect_scheduler()->set_max_half_open(size);
+}
+
 uint32_t
 open_sockets() {
   return manager->connection_manager()->size();
@@ -322,10 +479,12 @@ download_add(Object* object) {
   ctor.set_download(download.get());
   ctor.set_encoding_list(manager->encoding_list());
 
-  ctor.initialize(*object);
-
+  // Hash the info dictionary before the constructor moves the piece
+  // hashes out of it.
   std::string infoHash = object_sha1(&object->get_key("info"));
 
+  ctor.initialize(*object);
+
   if (manager->download_manager()->find(infoHash) != manager->download_manager()->end())
     throw input_error("Info hash already used by another torrent.");
 
@@ -92,6 +92,52 @@ uint32_t            currently_unchoked();
 uint32_t            max_unchoked();
 void                set_max_unchoked(uint32_t count);
 
+// The rate in bytes per second an interested connection must exceed
+// an unchoked one by before its slot is given away.
+uint32_t            unchoke_change_cost();
+void                set_unchoke_change_cost(uint32_t bytes);
+
+// Seconds between scrapes of each download's tracker, 0 disables
+// scraping.
+uint32_t            scrape_interval();
+void                set_scrape_interval(uint32_t seconds);
+
+// Mainline DHT node. The cache is an Object map holding our node id
+// and known nodes, filled by dht_store_cache and only read on start.
+// Nodes may be added before the DHT is started, to be used for
+// bootstrapping.
+bool                dht_is_active();
+void                dht_start(uint16_t port, const Object* cache = NULL);
+void                dht_stop();
+
+void                dht_add_node(const sockaddr* sa);
+void                dht_store_cache(Object* cache);
+
+uint32_t            dht_nodes();
+
+// Outgoing DHT queries per second.
+uint32_t            dht_query_rate();
+void                set_dht_query_rate(uint32_t rate);
+
+// uTP peer connections on a UDP socket, normally opened on the
+// listen port. Incoming uTP connections are accepted while it is
+// open, and with 'utp_outgoing' we connect over uTP first and fall
+// back to TCP when the peer doesn't answer.
+bool                utp_is_open();
+void                utp_open(uint16_t port);
+void                utp_close();
+
+bool                utp_outgoing();
+void                set_utp_outgoing(bool state);
+
+// LEDBAT target queuing delay in milliseconds.
+uint32_t            utp_target_delay();
+void                set_utp_target_delay(uint32_t msec);
+
+// Delay in milliseconds and loss in parts per thousand added to
+// outgoing uTP packets, for testing over loopback.
+void                utp_simulate(uint32_t delay, uint32_t loss);
+
 const Rate*         down_rate();
 const Rate*         up_rate();
 
@@ -111,6 +157,14 @@ uint32_t            open_files();
 uint32_t            max_open_files();
 void                set_max_open_files(uint32_t size);
 
+// Outgoing connection attempts per second, and the maximum number of
+// outgoing handshakes in progress, shared by all downloads.
+uint32_t            connect_rate();
+void                set_connect_rate(uint32_t rate);
+
+uint32_t            max_half_open();
+void                set_max_half_open(uint32_t size);
+
 uint32_t            open_sockets();
 uint32_t            max_open_sockets();
 void                set_max_open_sockets(uint32_t size);
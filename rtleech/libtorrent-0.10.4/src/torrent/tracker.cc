@@ -96,4 +96,34 @@ Tracker::scrape_downloaded() const {
   return m_tracker.second->scrape_downloaded();
 }
 
+uint32_t
+Tracker::health_score() const {
+  return m_tracker.second->health_score();
+}
+
+uint32_t
+Tracker::stats_success() const {
+  return m_tracker.second->stats_success();
+}
+
+uint32_t
+Tracker::stats_failed() const {
+  return m_tracker.second->stats_failed();
+}
+
+uint32_t
+Tracker::stats_latency() const {
+  return m_tracker.second->stats_latency();
+}
+
+uint32_t
+Tracker::stats_peers() const {
+  return m_tracker.second->stats_peers();
+}
+
+void
+Tracker::set_stats(uint32_t success, uint32_t failed, uint32_t latency, uint32_t peers) {
+  m_tracker.second->set_stats(success, failed, latency, peers);
+}
+
 }
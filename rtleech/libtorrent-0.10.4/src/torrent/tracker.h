@@ -77,6 +77,16 @@ public:
   uint32_t            scrape_incomplete() const;
   uint32_t            scrape_downloaded() const;
 
+  // Health statistics, saved in the resume data. The score is used
+  // to order trackers within a group.
+  uint32_t            health_score() const;
+
+  uint32_t            stats_success() const;
+  uint32_t            stats_failed() const;
+  uint32_t            stats_latency() const;
+  uint32_t            stats_peers() const;
+  void                set_stats(uint32_t success, uint32_t failed, uint32_t latency, uint32_t peers);
+
 private:
   value_type          m_tracker;
 };
@@ -83,6 +83,19 @@ TrackerList::set_numwant(int32_t n) {
   m_manager->info()->set_numwant(std::max<int32_t>(n, -1));
 }
 
+uint32_t
+TrackerList::fanout() const {
+  return m_manager->fanout();
+}
+
+void
+TrackerList::set_fanout(uint32_t f) {
+  if (f < 1 || f > 16)
+    throw input_error("Tracker fanout must be between 1 and 16.");
+
+  m_manager->set_fanout(f);
+}
+
 uint32_t
 TrackerList::key() const {
   return m_manager->info()->key();
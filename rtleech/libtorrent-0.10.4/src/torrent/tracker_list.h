@@ -61,6 +61,10 @@ public:
   int16_t             numwant() const;
   void                set_numwant(int32_t n);
 
+  // Number of tracker groups announced to in parallel.
+  uint32_t            fanout() const;
+  void                set_fanout(uint32_t f);
+
   uint32_t            key() const;
   void                set_key(uint32_t k);
 
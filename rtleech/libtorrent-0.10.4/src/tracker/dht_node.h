@@ -0,0 +1,111 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_TRACKER_DHT_NODE_H
+#define LIBTORRENT_TRACKER_DHT_NODE_H
+
+#include <cstring>
+#include <string>
+#include <inttypes.h>
+#include <rak/socket_address.h>
+#include <rak/timer.h>
+
+#include "download/download_info.h"
+#include "globals.h"
+
+namespace torrent {
+
+// A remote DHT node as kept in the routing table. Nodes are good
+// while they keep responding, and are dropped once they fail to
+// respond to 'max_failed' queries in a row. Nodes loaded from the
+// cache start out as never seen.
+
+class DhtNode {
+public:
+  static const uint32_t size_id      = 20;
+  static const uint32_t size_compact = 26;
+  static const uint32_t max_failed   = 3;
+  static const uint32_t good_timeout = 15 * 60;
+
+  DhtNode(const std::string& id, const rak::socket_address& sa) :
+    m_id(id), m_address(sa), m_failed(0) {}
+
+  bool                is_good() const                       { return m_failed == 0 && m_lastSeen + rak::timer::from_seconds(good_timeout) >= cachedTime; }
+  bool                is_bad() const                        { return m_failed >= max_failed; }
+
+  const std::string&  id() const                            { return m_id; }
+  const rak::socket_address& address() const               { return m_address; }
+  void                set_address(const rak::socket_address& sa) { m_address = sa; }
+
+  const rak::timer&   last_seen() const                     { return m_lastSeen; }
+
+  void                set_seen()                            { m_lastSeen = cachedTime; m_failed = 0; }
+  void                set_failed()                          { m_failed++; }
+
+  // Writes the 26 byte compact node info.
+  char*               store_compact(char* buffer) const;
+
+  static rak::socket_address load_address(const char* buffer);
+
+private:
+  std::string         m_id;
+  rak::socket_address m_address;
+
+  rak::timer          m_lastSeen;
+  uint32_t            m_failed;
+};
+
+inline char*
+DhtNode::store_compact(char* buffer) const {
+  SocketAddressCompact sac(m_address.sa_inet()->address_n(), m_address.sa_inet()->port_n());
+
+  std::memcpy(buffer, m_id.c_str(), size_id);
+  std::memcpy(buffer + size_id, sac.c_str(), sizeof(SocketAddressCompact));
+
+  return buffer + size_compact;
+}
+
+inline rak::socket_address
+DhtNode::load_address(const char* buffer) {
+  SocketAddressCompact sac;
+  std::memcpy(&sac, buffer, sizeof(SocketAddressCompact));
+
+  return sac;
+}
+
+}
+
+#endif
@@ -0,0 +1,509 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <rak/functional.h>
+
+#include "download/download_main.h"
+#include "download/download_manager.h"
+#include "download/download_wrapper.h"
+#include "torrent/exceptions.h"
+#include "torrent/object.h"
+#include "torrent/peer_list.h"
+#include "utils/random.h"
+#include "utils/sha1.h"
+
+#include "dht_router.h"
+#include "dht_search.h"
+
+#include "globals.h"
+#include "manager.h"
+
+namespace torrent {
+
+struct dht_node_distance_less {
+  dht_node_distance_less(const std::string& target) : m_target(target) {}
+
+  bool operator () (const DhtNode* n1, const DhtNode* n2) const {
+    for (unsigned int i = 0; i < DhtNode::size_id; ++i) {
+      uint8_t d1 = n1->id()[i] ^ m_target[i];
+      uint8_t d2 = n2->id()[i] ^ m_target[i];
+
+      if (d1 != d2)
+        return d1 < d2;
+    }
+
+    return false;
+  }
+
+  const std::string& m_target;
+};
+
+DhtRouter::DhtRouter() :
+  m_id(DhtNode::size_id, '\0'),
+  m_server(this),
+  m_secretTime(cachedTime) {
+
+  // The node id and the token secrets must not be guessable.
+  random_bytes(&m_id[0], m_id.size());
+  random_bytes(&m_secret, sizeof(m_secret));
+  random_bytes(&m_secretPrevious, sizeof(m_secretPrevious));
+
+  m_taskTick.set_slot(rak::mem_fn(this, &DhtRouter::receive_tick));
+}
+
+DhtRouter::~DhtRouter() {
+  stop();
+
+  for (Bucket* bucket = m_buckets; bucket != m_buckets + num_buckets; ++bucket)
+    std::for_each(bucket->begin(), bucket->end(), rak::call_delete<DhtNode>());
+}
+
+bool
+DhtRouter::start(uint16_t port) {
+  if (is_active())
+    throw internal_error("DhtRouter::start(...) called on an active router.");
+
+  if (!m_server.open(port))
+    return false;
+
+  // Give the client a moment to add bootstrap contacts.
+  priority_queue_insert(&taskScheduler, &m_taskTick, (cachedTime + rak::timer::from_seconds(5)).round_seconds());
+
+  return true;
+}
+
+void
+DhtRouter::stop() {
+  priority_queue_erase(&taskScheduler, &m_taskTick);
+  m_server.close();
+
+  std::for_each(m_searches.begin(), m_searches.end(), rak::call_delete<DhtSearch>());
+  m_searches.clear();
+
+  m_announced.clear();
+}
+
+void
+DhtRouter::add_contact(const rak::socket_address& sa) {
+  if (sa.family() != rak::socket_address::af_inet || !sa.is_valid())
+    return;
+
+  m_contacts.push_back(sa);
+
+  if (is_active())
+    m_server.ping(std::string(), sa);
+}
+
+void
+DhtRouter::load_cache(const Object& cache) {
+  if (is_active())
+    throw internal_error("DhtRouter::load_cache(...) called on an active router.");
+
+  if (!cache.is_map())
+    return;
+
+  if (cache.has_key_string("self_id") && cache.get_key_string("self_id").size() == DhtNode::size_id)
+    m_id = cache.get_key_string("self_id");
+
+  if (!cache.has_key_string("nodes"))
+    return;
+
+  const std::string& nodes = cache.get_key_string("nodes");
+
+  for (std::string::size_type pos = 0; pos + DhtNode::size_compact <= nodes.size(); pos += DhtNode::size_compact) {
+    std::string id = nodes.substr(pos, DhtNode::size_id);
+
+    if (id == m_id)
+      continue;
+
+    Bucket& bucket = m_buckets[bucket_index(id)];
+
+    if (bucket.size() < size_bucket)
+      bucket.push_back(new DhtNode(id, DhtNode::load_address(nodes.c_str() + pos + DhtNode::size_id)));
+  }
+}
+
+void
+DhtRouter::store_cache(Object* cache) const {
+  std::string nodes;
+
+  for (const Bucket* bucket = m_buckets; bucket != m_buckets + num_buckets; ++bucket)
+    for (Bucket::const_iterator itr = bucket->begin(); itr != bucket->end() && nodes.size() < size_cache * DhtNode::size_compact; ++itr) {
+      if ((*itr)->is_bad())
+        continue;
+
+      char buffer[DhtNode::size_compact];
+      (*itr)->store_compact(buffer);
+
+      nodes.append(buffer, DhtNode::size_compact);
+    }
+
+  cache->insert_key("self_id", m_id);
+  cache->insert_key("nodes", nodes);
+}
+
+uint32_t
+DhtRouter::size_nodes() const {
+  uint32_t size = 0;
+
+  for (const Bucket* bucket = m_buckets; bucket != m_buckets + num_buckets; ++bucket)
+    size += bucket->size();
+
+  return size;
+}
+
+void
+DhtRouter::node_seen(const std::string& id, const rak::socket_address& sa) {
+  if (id.size() != DhtNode::size_id || id == m_id)
+    return;
+
+  Bucket& bucket = m_buckets[bucket_index(id)];
+  Bucket::iterator itr = std::find_if(bucket.begin(), bucket.end(), rak::equal(id, std::mem_fun(&DhtNode::id)));
+
+  if (itr == bucket.end()) {
+    if (bucket.size() < size_bucket)
+      itr = bucket.insert(bucket.end(), new DhtNode(id, sa));
+
+    else if ((itr = std::find_if(bucket.begin(), bucket.end(), std::mem_fun(&DhtNode::is_bad))) != bucket.end()) {
+      delete *itr;
+      *itr = new DhtNode(id, sa);
+
+    } else {
+      // Questionable nodes are pinged by update_nodes, and replaced
+      // once they turn bad.
+      return;
+    }
+  }
+
+  (*itr)->set_address(sa);
+  (*itr)->set_seen();
+}
+
+void
+DhtRouter::node_failed(const std::string& id, const rak::socket_address& sa) {
+  if (id.size() != DhtNode::size_id || id == m_id)
+    return;
+
+  Bucket& bucket = m_buckets[bucket_index(id)];
+  Bucket::iterator itr = std::find_if(bucket.begin(), bucket.end(), rak::equal(id, std::mem_fun(&DhtNode::id)));
+
+  if (itr != bucket.end() && (*itr)->address() == sa)
+    (*itr)->set_failed();
+}
+
+void
+DhtRouter::find_closest(const std::string& target, NodeList* result, uint32_t count) const {
+  result->clear();
+
+  for (const Bucket* bucket = m_buckets; bucket != m_buckets + num_buckets; ++bucket)
+    for (Bucket::const_iterator itr = bucket->begin(); itr != bucket->end(); ++itr)
+      if (!(*itr)->is_bad())
+        result->push_back(*itr);
+
+  NodeList::iterator last = result->begin() + std::min<NodeList::size_type>(result->size(), count);
+
+  std::partial_sort(result->begin(), last, result->end(), dht_node_distance_less(target));
+  result->erase(last, result->end());
+}
+
+std::string
+DhtRouter::closest_compact(const std::string& target) const {
+  NodeList nodes;
+  find_closest(target, &nodes, size_bucket);
+
+  std::string result(nodes.size() * DhtNode::size_compact, '\0');
+  char* position = &*result.begin();
+
+  for (NodeList::iterator itr = nodes.begin(); itr != nodes.end(); ++itr)
+    position = (*itr)->store_compact(position);
+
+  return result;
+}
+
+bool
+DhtRouter::get_peers(const std::string& hash, Object* values) const {
+  PeerMap::const_iterator itr = m_peers.find(hash);
+
+  if (itr == m_peers.end() || itr->second.empty())
+    return false;
+
+  // Send a random selection if there are more peers than fit in a
+  // packet.
+  PeerStore::size_type first = itr->second.size() > max_values ? random() % itr->second.size() : 0;
+
+  for (PeerStore::size_type i = 0; i < itr->second.size() && i < max_values; ++i)
+    values->as_list().push_back(std::string(itr->second[(first + i) % itr->second.size()].m_address.c_str(), sizeof(SocketAddressCompact)));
+
+  return true;
+}
+
+void
+DhtRouter::store_peer(const std::string& hash, const rak::socket_address& sa) {
+  if (sa.family() != rak::socket_address::af_inet)
+    return;
+
+  PeerMap::iterator peers = m_peers.find(hash);
+
+  if (peers == m_peers.end()) {
+    if (m_peers.size() >= max_torrents)
+      return;
+
+    peers = m_peers.insert(PeerMap::value_type(hash, PeerStore())).first;
+  }
+
+  SocketAddressCompact address(sa.sa_inet()->address_n(), sa.sa_inet()->port_n());
+  PeerStore::iterator itr = peers->second.begin();
+
+  while (itr != peers->second.end() && (itr->m_address.addr != address.addr || itr->m_address.port != address.port))
+    ++itr;
+
+  if (itr == peers->second.end()) {
+    if (peers->second.size() < max_peers) {
+      itr = peers->second.insert(peers->second.end(), Peer());
+
+    } else {
+      // Replace the peer closest to timing out.
+      itr = peers->second.begin();
+
+      for (PeerStore::iterator p = peers->second.begin(); p != peers->second.end(); ++p)
+        if (p->m_timeout < itr->m_timeout)
+          itr = p;
+    }
+
+    itr->m_address = address;
+  }
+
+  itr->m_timeout = cachedTime + rak::timer::from_seconds(peer_timeout);
+}
+
+std::string
+DhtRouter::make_token(const rak::socket_address& sa) const {
+  return make_token(sa, m_secret);
+}
+
+bool
+DhtRouter::check_token(const std::string& token, const rak::socket_address& sa) const {
+  return token == make_token(sa, m_secret) || token == make_token(sa, m_secretPrevious);
+}
+
+std::string
+DhtRouter::make_token(const rak::socket_address& sa, uint32_t secret) const {
+  uint32_t address = sa.sa_inet()->address_n();
+  char hash[20];
+
+  Sha1 sha;
+  sha.init();
+  sha.update(&secret, sizeof(uint32_t));
+  sha.update(&address, sizeof(uint32_t));
+  sha.final_c(hash);
+
+  return std::string(hash, 8);
+}
+
+void
+DhtRouter::receive_peers(const std::string& hash, const Object& values) {
+  DownloadMain* download = manager->download_manager()->find_main(hash);
+
+  if (download == NULL)
+    return;
+
+  uint32_t inserted = 0;
+
+  for (Object::list_type::const_iterator itr = values.as_list().begin(); itr != values.as_list().end(); ++itr) {
+    if (!itr->is_string() || itr->as_string().size() != sizeof(SocketAddressCompact))
+      continue;
+
+    SocketAddressCompact address;
+    std::memcpy(&address, itr->as_string().c_str(), sizeof(SocketAddressCompact));
+
+    rak::socket_address sa = address;
+
+    if (sa.port() == 0 || sa.sa_inet()->address_n() == 0)
+      continue;
+
+    if (download->peer_list()->insert_address(sa.c_sockaddr(), PeerList::address_available) != NULL)
+      inserted++;
+  }
+
+  if (inserted != 0)
+    download->receive_connect_peers();
+}
+
+uint32_t
+DhtRouter::bucket_index(const std::string& id) const {
+  for (unsigned int i = 0; i < DhtNode::size_id; ++i) {
+    uint8_t distance = m_id[i] ^ id[i];
+
+    if (distance == 0)
+      continue;
+
+    uint32_t bit = 0;
+
+    while (!(distance & (0x80 >> bit)))
+      bit++;
+
+    return i * 8 + bit;
+  }
+
+  return num_buckets - 1;
+}
+
+DhtSearch*
+DhtRouter::find_search(const std::string& target) {
+  SearchList::iterator itr = std::find_if(m_searches.begin(), m_searches.end(), rak::equal(target, std::mem_fun(&DhtSearch::target)));
+
+  return itr != m_searches.end() ? *itr : NULL;
+}
+
+void
+DhtRouter::start_search(const std::string& target, bool getPeers, bool announce) {
+  DhtSearch* search = new DhtSearch(this, target, getPeers, announce);
+
+  m_searches.push_back(search);
+  search->start();
+}
+
+void
+DhtRouter::receive_tick() {
+  if (m_secretTime + rak::timer::from_seconds(secret_interval) <= cachedTime) {
+    m_secretPrevious = m_secret;
+    random_bytes(&m_secret, sizeof(m_secret));
+    m_secretTime = cachedTime;
+  }
+
+  for (SearchList::iterator itr = m_searches.begin(); itr != m_searches.end(); )
+    if ((*itr)->is_done()) {
+      m_server.cancel_search(*itr);
+      delete *itr;
+
+      itr = m_searches.erase(itr);
+    } else {
+      ++itr;
+    }
+
+  update_peers();
+  update_nodes();
+  update_downloads();
+
+  priority_queue_insert(&taskScheduler, &m_taskTick, (cachedTime + rak::timer::from_seconds(tick_interval)).round_seconds());
+}
+
+void
+DhtRouter::update_nodes() {
+  uint32_t size = 0;
+  uint32_t pinged = 0;
+
+  for (Bucket* bucket = m_buckets; bucket != m_buckets + num_buckets; ++bucket) {
+    for (Bucket::iterator itr = bucket->begin(); itr != bucket->end(); ) {
+      if ((*itr)->is_bad()) {
+        delete *itr;
+        itr = bucket->erase(itr);
+        continue;
+      }
+
+      if (!(*itr)->is_good() && pinged < max_ping && m_server.ping((*itr)->id(), (*itr)->address()))
+        pinged++;
+
+      size++;
+      ++itr;
+    }
+  }
+
+  if (size >= size_bootstrap) {
+    m_contacts.clear();
+    return;
+  }
+
+  // Keep pinging the bootstrap contacts and looking up our own id
+  // until the routing table has filled up a bit.
+  for (ContactList::iterator itr = m_contacts.begin(); itr != m_contacts.end(); ++itr)
+    m_server.ping(std::string(), *itr);
+
+  if (size != 0 && find_search(m_id) == NULL)
+    start_search(m_id, false, false);
+}
+
+void
+DhtRouter::update_peers() {
+  for (PeerMap::iterator peers = m_peers.begin(); peers != m_peers.end(); ) {
+    PeerStore::iterator itr = peers->second.begin();
+
+    while (itr != peers->second.end())
+      if (itr->m_timeout <= cachedTime)
+        itr = peers->second.erase(itr);
+      else
+        ++itr;
+
+    if (peers->second.empty())
+      m_peers.erase(peers++);
+    else
+      ++peers;
+  }
+}
+
+void
+DhtRouter::update_downloads() {
+  for (AnnounceMap::iterator itr = m_announced.begin(); itr != m_announced.end(); )
+    if (itr->second + rak::timer::from_seconds(2 * announce_interval) <= cachedTime)
+      m_announced.erase(itr++);
+    else
+      ++itr;
+
+  if (size_nodes() == 0)
+    return;
+
+  for (DownloadManager::iterator itr = manager->download_manager()->begin(); itr != manager->download_manager()->end(); ++itr) {
+    DownloadInfo* info = (*itr)->info();
+
+    if (!info->is_active() || info->is_private() || find_search(info->hash()) != NULL)
+      continue;
+
+    AnnounceMap::iterator announced = m_announced.find(info->hash());
+
+    if (announced != m_announced.end() && announced->second + rak::timer::from_seconds(announce_interval) > cachedTime)
+      continue;
+
+    m_announced[info->hash()] = cachedTime;
+    start_search(info->hash(), true, true);
+  }
+}
+
+}
@@ -0,0 +1,173 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_TRACKER_DHT_ROUTER_H
+#define LIBTORRENT_TRACKER_DHT_ROUTER_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <rak/priority_queue_default.h>
+#include <rak/socket_address.h>
+
+#include "download/download_info.h"
+
+#include "dht_node.h"
+#include "dht_server.h"
+
+namespace torrent {
+
+class DhtSearch;
+class Object;
+
+// A mainline DHT node (BEP-5). The routing table keeps up to
+// 'size_bucket' nodes for each length of the prefix shared with our
+// own id, and the peers announced to us are kept for 'peer_timeout'
+// seconds.
+//
+// Every 'announce_interval' seconds each active public download
+// searches for peers and announces itself to the closest nodes. The
+// peers found are added to the download's PeerList.
+
+class DhtRouter {
+public:
+  typedef std::list<DhtNode*>              Bucket;
+  typedef std::vector<DhtNode*>            NodeList;
+  typedef std::list<rak::socket_address>   ContactList;
+
+  static const uint32_t num_buckets       = 160;
+  static const uint32_t size_bucket       = 8;
+  static const uint32_t size_cache        = 256;
+  static const uint32_t size_bootstrap    = 32;
+
+  static const uint32_t max_peers         = 100;
+  static const uint32_t max_values        = 50;
+  static const uint32_t max_torrents      = 2000;
+  static const uint32_t max_ping          = 8;
+
+  static const uint32_t tick_interval     = 30;
+  static const uint32_t peer_timeout      = 30 * 60;
+  static const uint32_t announce_interval = 15 * 60;
+  static const uint32_t secret_interval   = 5 * 60;
+
+  DhtRouter();
+  ~DhtRouter();
+
+  bool                is_active() const                     { return m_server.is_open(); }
+
+  const std::string&  id() const                            { return m_id; }
+  DhtServer*          server()                              { return &m_server; }
+
+  bool                start(uint16_t port);
+  void                stop();
+
+  // Nodes that are pinged to bootstrap the routing table.
+  void                add_contact(const rak::socket_address& sa);
+
+  // The cache holds our node id and the known nodes, and may only be
+  // loaded while inactive.
+  void                load_cache(const Object& cache);
+  void                store_cache(Object* cache) const;
+
+  uint32_t            size_nodes() const;
+  uint32_t            size_torrents() const                 { return m_peers.size(); }
+
+  // Called by DhtServer when a node responds or queries us, and when
+  // a query times out.
+  void                node_seen(const std::string& id, const rak::socket_address& sa);
+  void                node_failed(const std::string& id, const rak::socket_address& sa);
+
+  void                find_closest(const std::string& target, NodeList* result, uint32_t count) const;
+  std::string         closest_compact(const std::string& target) const;
+
+  // Appends the stored peers as compact strings to 'values'.
+  bool                get_peers(const std::string& hash, Object* values) const;
+  void                store_peer(const std::string& hash, const rak::socket_address& sa);
+
+  std::string         make_token(const rak::socket_address& sa) const;
+  bool                check_token(const std::string& token, const rak::socket_address& sa) const;
+
+  // Called by DhtSearch with the peers found for a download.
+  void                receive_peers(const std::string& hash, const Object& values);
+
+private:
+  DhtRouter(const DhtRouter&);
+  void operator = (const DhtRouter&);
+
+  struct Peer {
+    SocketAddressCompact m_address;
+    rak::timer           m_timeout;
+  };
+
+  typedef std::vector<Peer>                       PeerStore;
+  typedef std::map<std::string, PeerStore>        PeerMap;
+  typedef std::map<std::string, rak::timer>       AnnounceMap;
+  typedef std::list<DhtSearch*>                   SearchList;
+
+  uint32_t            bucket_index(const std::string& id) const;
+
+  std::string         make_token(const rak::socket_address& sa, uint32_t secret) const;
+
+  DhtSearch*          find_search(const std::string& target);
+  void                start_search(const std::string& target, bool getPeers, bool announce);
+
+  void                receive_tick();
+
+  void                update_nodes();
+  void                update_peers();
+  void                update_downloads();
+
+  std::string         m_id;
+  DhtServer           m_server;
+
+  Bucket              m_buckets[num_buckets];
+  ContactList         m_contacts;
+
+  PeerMap             m_peers;
+  AnnounceMap         m_announced;
+  SearchList          m_searches;
+
+  uint32_t            m_secret;
+  uint32_t            m_secretPrevious;
+  rak::timer          m_secretTime;
+
+  rak::priority_item  m_taskTick;
+};
+
+}
+
+#endif
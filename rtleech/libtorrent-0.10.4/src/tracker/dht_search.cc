@@ -0,0 +1,198 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include "torrent/exceptions.h"
+#include "torrent/object.h"
+
+#include "dht_node.h"
+#include "dht_router.h"
+#include "dht_search.h"
+#include "dht_server.h"
+
+namespace torrent {
+
+DhtSearch::DhtSearch(DhtRouter* router, const std::string& target, bool getPeers, bool announce) :
+  m_router(router),
+  m_target(target),
+  m_getPeers(getPeers),
+  m_announce(announce),
+  m_done(false),
+  m_pending(0) {
+}
+
+void
+DhtSearch::start() {
+  DhtRouter::NodeList nodes;
+  m_router->find_closest(m_target, &nodes, max_candidates);
+
+  for (DhtRouter::NodeList::iterator itr = nodes.begin(); itr != nodes.end(); ++itr)
+    add_contact((*itr)->id(), (*itr)->address());
+
+  advance();
+}
+
+std::string
+DhtSearch::distance(const std::string& id) const {
+  std::string result(DhtNode::size_id, '\0');
+
+  for (unsigned int i = 0; i < DhtNode::size_id; ++i)
+    result[i] = id[i] ^ m_target[i];
+
+  return result;
+}
+
+void
+DhtSearch::add_contact(const std::string& id, const rak::socket_address& sa) {
+  if (id.size() != DhtNode::size_id || id == m_router->id() || !sa.is_valid())
+    return;
+
+  std::string key = distance(id);
+
+  if (m_contacts.find(key) != m_contacts.end())
+    return;
+
+  // Don't let the candidate list grow without bounds, nodes further
+  // away than the ones we already have are of little use.
+  if (m_contacts.size() >= max_candidates) {
+    ContactMap::iterator last = --m_contacts.end();
+
+    if (key > last->first || last->second.m_state == state_pending)
+      return;
+
+    m_contacts.erase(last);
+  }
+
+  Contact& contact = m_contacts[key];
+  contact.m_id = id;
+  contact.m_address = sa;
+  contact.m_state = state_unqueried;
+}
+
+void
+DhtSearch::receive_response(const std::string& id, const rak::socket_address& sa, const Object& response) {
+  ContactMap::iterator itr = m_contacts.find(distance(id));
+
+  if (m_pending == 0)
+    throw internal_error("DhtSearch::receive_response(...) called but m_pending == 0.");
+
+  m_pending--;
+
+  if (itr != m_contacts.end()) {
+    itr->second.m_state = state_responded;
+
+    if (response.has_key_string("token"))
+      itr->second.m_token = response.get_key_string("token");
+  }
+
+  if (response.has_key_string("nodes")) {
+    const std::string& nodes = response.get_key_string("nodes");
+
+    for (std::string::size_type pos = 0; pos + DhtNode::size_compact <= nodes.size(); pos += DhtNode::size_compact)
+      add_contact(nodes.substr(pos, DhtNode::size_id), DhtNode::load_address(nodes.c_str() + pos + DhtNode::size_id));
+  }
+
+  if (m_getPeers && response.has_key_list("values"))
+    m_router->receive_peers(m_target, response.get_key("values"));
+
+  advance();
+}
+
+void
+DhtSearch::receive_failed(const std::string& id, const rak::socket_address& sa) {
+  ContactMap::iterator itr = m_contacts.find(distance(id));
+
+  if (m_pending == 0)
+    throw internal_error("DhtSearch::receive_failed(...) called but m_pending == 0.");
+
+  m_pending--;
+
+  if (itr != m_contacts.end())
+    itr->second.m_state = state_failed;
+
+  advance();
+}
+
+void
+DhtSearch::advance() {
+  if (m_done)
+    return;
+
+  uint32_t live = 0;
+
+  for (ContactMap::iterator itr = m_contacts.begin(); itr != m_contacts.end() && live < max_contacts; ++itr) {
+    if (itr->second.m_state == state_failed)
+      continue;
+
+    live++;
+
+    if (itr->second.m_state != state_unqueried || m_pending >= max_concurrent)
+      continue;
+
+    bool sent = m_getPeers ?
+      m_router->server()->get_peers(this, itr->second.m_id, itr->second.m_address, m_target) :
+      m_router->server()->find_node(this, itr->second.m_id, itr->second.m_address, m_target);
+
+    if (sent) {
+      itr->second.m_state = state_pending;
+      m_pending++;
+    } else {
+      itr->second.m_state = state_failed;
+      live--;
+    }
+  }
+
+  if (m_pending == 0)
+    finish();
+}
+
+void
+DhtSearch::finish() {
+  m_done = true;
+
+  if (!m_announce)
+    return;
+
+  uint32_t announced = 0;
+
+  for (ContactMap::iterator itr = m_contacts.begin(); itr != m_contacts.end() && announced < max_contacts; ++itr)
+    if (itr->second.m_state == state_responded && !itr->second.m_token.empty() &&
+        m_router->server()->announce_peer(itr->second.m_id, itr->second.m_address, m_target, itr->second.m_token))
+      announced++;
+}
+
+}
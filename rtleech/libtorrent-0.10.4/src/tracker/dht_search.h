@@ -0,0 +1,113 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_TRACKER_DHT_SEARCH_H
+#define LIBTORRENT_TRACKER_DHT_SEARCH_H
+
+#include <map>
+#include <string>
+#include <rak/socket_address.h>
+
+namespace torrent {
+
+class DhtRouter;
+class Object;
+
+// An iterative lookup of the nodes closest to 'target'. At most
+// 'max_concurrent' queries are outstanding, and the search ends when
+// the 'max_contacts' closest live nodes have all responded. When
+// searching for peers, the download is announced to those nodes
+// using the tokens they returned.
+
+class DhtSearch {
+public:
+  static const uint32_t max_concurrent = 3;
+  static const uint32_t max_contacts   = 8;
+  static const uint32_t max_candidates = 64;
+
+  DhtSearch(DhtRouter* router, const std::string& target, bool getPeers, bool announce);
+
+  bool                is_done() const                       { return m_done; }
+  bool                is_get_peers() const                  { return m_getPeers; }
+
+  const std::string&  target() const                        { return m_target; }
+
+  void                start();
+
+  void                add_contact(const std::string& id, const rak::socket_address& sa);
+
+  // Called by DhtServer for queries sent on behalf of the search.
+  void                receive_response(const std::string& id, const rak::socket_address& sa, const Object& response);
+  void                receive_failed(const std::string& id, const rak::socket_address& sa);
+
+private:
+  DhtSearch(const DhtSearch&);
+  void operator = (const DhtSearch&);
+
+  static const int    state_unqueried = 0;
+  static const int    state_pending   = 1;
+  static const int    state_responded = 2;
+  static const int    state_failed    = 3;
+
+  struct Contact {
+    std::string         m_id;
+    rak::socket_address m_address;
+    int                 m_state;
+    std::string         m_token;
+  };
+
+  // Keyed by the distance to the target.
+  typedef std::map<std::string, Contact> ContactMap;
+
+  std::string         distance(const std::string& id) const;
+
+  void                advance();
+  void                finish();
+
+  DhtRouter*          m_router;
+  std::string         m_target;
+
+  bool                m_getPeers;
+  bool                m_announce;
+  bool                m_done;
+
+  uint32_t            m_pending;
+  ContactMap          m_contacts;
+};
+
+}
+
+#endif
@@ -0,0 +1,458 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <rak/error_number.h>
+
+#include "torrent/connection_manager.h"
+#include "torrent/exceptions.h"
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+#include "torrent/poll.h"
+#include "utils/random.h"
+
+#include "dht_node.h"
+#include "dht_router.h"
+#include "dht_search.h"
+#include "dht_server.h"
+
+#include "globals.h"
+#include "manager.h"
+
+namespace torrent {
+
+static const char* dht_query_names[] = { "ping", "find_node", "get_peers", "announce_peer" };
+
+DhtServer::DhtServer(DhtRouter* router) :
+  m_router(router),
+  m_transactionId(0),
+  m_queryRate(20),
+  m_queriesSent(0) {
+
+  m_taskTimeout.set_slot(rak::mem_fn(this, &DhtServer::receive_timeout));
+}
+
+DhtServer::~DhtServer() {
+  close();
+}
+
+bool
+DhtServer::open(uint16_t port) {
+  rak::socket_address sa = *rak::socket_address::cast_from(manager->connection_manager()->bind_address());
+  sa.set_port(port);
+
+  if (!get_fd().open_datagram() ||
+      !get_fd().set_nonblock() ||
+      !get_fd().bind(sa)) {
+
+    if (get_fd().is_valid())
+      get_fd().close();
+
+    get_fd().clear();
+    return false;
+  }
+
+  manager->poll()->open(this);
+  manager->poll()->insert_read(this);
+  manager->poll()->insert_error(this);
+
+  priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(1)).round_seconds());
+
+  return true;
+}
+
+void
+DhtServer::close() {
+  if (!is_open())
+    return;
+
+  priority_queue_erase(&taskScheduler, &m_taskTimeout);
+
+  manager->poll()->remove_read(this);
+  manager->poll()->remove_write(this);
+  manager->poll()->remove_error(this);
+  manager->poll()->close(this);
+
+  get_fd().close();
+  get_fd().clear();
+
+  m_transactions.clear();
+  m_replies.clear();
+  m_queries.clear();
+}
+
+bool
+DhtServer::ping(const std::string& id, const rak::socket_address& sa) {
+  Object args(Object::TYPE_MAP);
+
+  return add_query(query_ping, NULL, id, sa, args);
+}
+
+bool
+DhtServer::find_node(DhtSearch* search, const std::string& id, const rak::socket_address& sa, const std::string& target) {
+  Object args(Object::TYPE_MAP);
+  args.insert_key("target", target);
+
+  return add_query(query_find_node, search, id, sa, args);
+}
+
+bool
+DhtServer::get_peers(DhtSearch* search, const std::string& id, const rak::socket_address& sa, const std::string& hash) {
+  Object args(Object::TYPE_MAP);
+  args.insert_key("info_hash", hash);
+
+  return add_query(query_get_peers, search, id, sa, args);
+}
+
+bool
+DhtServer::announce_peer(const std::string& id, const rak::socket_address& sa, const std::string& hash, const std::string& token) {
+  Object args(Object::TYPE_MAP);
+  args.insert_key("info_hash", hash);
+  args.insert_key("port", (int64_t)manager->connection_manager()->listen_port());
+  args.insert_key("token", token);
+
+  return add_query(query_announce_peer, NULL, id, sa, args);
+}
+
+void
+DhtServer::cancel_search(DhtSearch* search) {
+  for (TransactionMap::iterator itr = m_transactions.begin(); itr != m_transactions.end(); ++itr)
+    if (itr->second.m_search == search)
+      itr->second.m_search = NULL;
+}
+
+bool
+DhtServer::add_query(int type, DhtSearch* search, const std::string& id, const rak::socket_address& sa, Object& args) {
+  if (!is_open() || m_queries.size() >= max_queued_queries)
+    return false;
+
+  // Random ids, so an off-path attacker can't guess the next one and
+  // spoof the reply.
+  do {
+    random_bytes(&m_transactionId, sizeof(m_transactionId));
+  } while (m_transactions.find(m_transactionId) != m_transactions.end());
+
+  Transaction& transaction = m_transactions[m_transactionId];
+  transaction.m_type = type;
+  transaction.m_id = id;
+  transaction.m_address = sa;
+  transaction.m_search = search;
+
+  args.insert_key("id", m_router->id());
+
+  Object message(Object::TYPE_MAP);
+  message.insert_key("t", std::string((const char*)&m_transactionId, sizeof(uint16_t)));
+  message.insert_key("y", "q");
+  message.insert_key("q", dht_query_names[type]);
+  message.insert_key("a", args);
+
+  if (!send_packet(&m_queries, sa, message, m_transactionId)) {
+    m_transactions.erase(m_transactionId);
+    return false;
+  }
+
+  return true;
+}
+
+void
+DhtServer::send_reply(const rak::socket_address& sa, const std::string& transactionId, Object& reply) {
+  reply.insert_key("id", m_router->id());
+
+  Object message(Object::TYPE_MAP);
+  message.insert_key("t", transactionId);
+  message.insert_key("y", "r");
+  message.insert_key("r", reply);
+
+  send_packet(&m_replies, sa, message, 0);
+}
+
+void
+DhtServer::send_error(const rak::socket_address& sa, const std::string& transactionId, int code, const char* msg) {
+  Object message(Object::TYPE_MAP);
+  message.insert_key("t", transactionId);
+  message.insert_key("y", "e");
+
+  Object& error = message.insert_key("e", Object(Object::TYPE_LIST));
+  error.as_list().push_back((int64_t)code);
+  error.as_list().push_back(msg);
+
+  send_packet(&m_replies, sa, message, 0);
+}
+
+// Messages that don't fit in a packet are dropped. Overflow goes to
+// a string so the size can be checked instead of throwing.
+bool
+DhtServer::send_packet(PacketQueue* queue, const rak::socket_address& sa, const Object& message, uint16_t transactionId) {
+  char buffer[max_packet_size];
+  std::string overflow;
+
+  object_buffer_t result = object_write_bencode_c(&object_write_to_string, &overflow, object_buffer_t(buffer, buffer + max_packet_size), &message);
+
+  if (!overflow.empty())
+    return false;
+
+  queue->push_back(Packet());
+  queue->back().m_address = sa;
+  queue->back().m_data.assign(result.first, result.second);
+  queue->back().m_transactionId = transactionId;
+
+  manager->poll()->insert_write(this);
+  return true;
+}
+
+void
+DhtServer::event_read() {
+  rak::socket_address sa;
+
+  while (true) {
+    int s = read_datagram(m_readBuffer, max_packet_size, &sa);
+
+    if (s < 0)
+      return;
+
+    if (s == 0 || sa.family() != rak::socket_address::af_inet)
+      continue;
+
+    Object message;
+
+    if (object_read_bencode_c(m_readBuffer, m_readBuffer + s, &message) == NULL || !message.is_map() || !message.has_key_string("t") || !message.has_key_string("y"))
+      continue;
+
+    const std::string& type = message.get_key_string("y");
+
+    try {
+      if (type == "q")
+        process_query(sa, message);
+      else if (type == "r")
+        process_response(sa, message);
+      else if (type == "e")
+        process_error(sa, message);
+
+    } catch (bencode_error& e) {
+      // Ignore messages with fields of the wrong type.
+    }
+  }
+}
+
+void
+DhtServer::event_write() {
+  while (!m_replies.empty()) {
+    Packet& packet = m_replies.front();
+
+    if (write_datagram(packet.m_data.c_str(), packet.m_data.size(), &packet.m_address) < 0 &&
+        rak::error_number::current().is_blocked_momentary())
+      return;
+
+    m_replies.pop_front();
+  }
+
+  while (!m_queries.empty() && m_queriesSent < m_queryRate) {
+    Packet& packet = m_queries.front();
+    TransactionMap::iterator itr = m_transactions.find(packet.m_transactionId);
+
+    if (itr == m_transactions.end())
+      throw internal_error("DhtServer::event_write() could not find the transaction of a queued query.");
+
+    if (write_datagram(packet.m_data.c_str(), packet.m_data.size(), &packet.m_address) < 0) {
+      if (rak::error_number::current().is_blocked_momentary())
+        return;
+
+      m_queries.pop_front();
+      transaction_failed(itr);
+      continue;
+    }
+
+    itr->second.m_timeout = cachedTime + rak::timer::from_seconds(transaction_timeout);
+
+    m_queriesSent++;
+    m_queries.pop_front();
+  }
+
+  // Wait for receive_timeout to reset the rate limit.
+  manager->poll()->remove_write(this);
+}
+
+void
+DhtServer::event_error() {
+}
+
+void
+DhtServer::process_query(const rak::socket_address& sa, const Object& message) {
+  const std::string& transactionId = message.get_key_string("t");
+
+  // The transaction id is echoed back, so don't let the sender pick
+  // its size. Drop queries while the replies are backed up.
+  if (transactionId.size() > max_transaction_id || m_replies.size() >= max_queued_replies)
+    return;
+
+  if (!message.has_key_string("q") || !message.has_key_map("a"))
+    return send_error(sa, transactionId, 203, "Protocol error");
+
+  const std::string& query = message.get_key_string("q");
+  const Object& args = message.get_key("a");
+
+  if (!args.has_key_string("id") || args.get_key_string("id").size() != DhtNode::size_id)
+    return send_error(sa, transactionId, 203, "Protocol error");
+
+  m_router->node_seen(args.get_key_string("id"), sa);
+
+  Object reply(Object::TYPE_MAP);
+
+  if (query == "ping") {
+    // Empty reply.
+
+  } else if (query == "find_node") {
+    if (!args.has_key_string("target") || args.get_key_string("target").size() != DhtNode::size_id)
+      return send_error(sa, transactionId, 203, "Protocol error");
+
+    reply.insert_key("nodes", m_router->closest_compact(args.get_key_string("target")));
+
+  } else if (query == "get_peers") {
+    if (!args.has_key_string("info_hash") || args.get_key_string("info_hash").size() != DhtNode::size_id)
+      return send_error(sa, transactionId, 203, "Protocol error");
+
+    reply.insert_key("token", m_router->make_token(sa));
+
+    Object values(Object::TYPE_LIST);
+
+    if (m_router->get_peers(args.get_key_string("info_hash"), &values))
+      reply.insert_key("values", values);
+    else
+      reply.insert_key("nodes", m_router->closest_compact(args.get_key_string("info_hash")));
+
+  } else if (query == "announce_peer") {
+    if (!args.has_key_string("info_hash") || args.get_key_string("info_hash").size() != DhtNode::size_id ||
+        !args.has_key_value("port") || args.get_key_value("port") <= 0 || args.get_key_value("port") >= (1 << 16) ||
+        !args.has_key_string("token"))
+      return send_error(sa, transactionId, 203, "Protocol error");
+
+    if (!m_router->check_token(args.get_key_string("token"), sa))
+      return send_error(sa, transactionId, 203, "Bad token");
+
+    rak::socket_address peer = sa;
+    peer.set_port(args.get_key_value("port"));
+
+    m_router->store_peer(args.get_key_string("info_hash"), peer);
+
+  } else {
+    return send_error(sa, transactionId, 204, "Method unknown");
+  }
+
+  send_reply(sa, transactionId, reply);
+}
+
+void
+DhtServer::process_response(const rak::socket_address& sa, const Object& message) {
+  const std::string& transactionId = message.get_key_string("t");
+
+  if (transactionId.size() != sizeof(uint16_t))
+    return;
+
+  TransactionMap::iterator itr = m_transactions.find(*reinterpret_cast<const uint16_t*>(transactionId.c_str()));
+
+  // Only accept responses to queries we've sent, from the address we
+  // sent them to.
+  if (itr == m_transactions.end() || itr->second.m_timeout == rak::timer() || !(itr->second.m_address == sa))
+    return;
+
+  if (!message.has_key_map("r") ||
+      !message.get_key("r").has_key_string("id") || message.get_key("r").get_key_string("id").size() != DhtNode::size_id)
+    return transaction_failed(itr);
+
+  const Object& response = message.get_key("r");
+  const std::string& id = response.get_key_string("id");
+
+  DhtSearch* search = itr->second.m_search;
+  std::string queriedId = itr->second.m_id;
+
+  m_transactions.erase(itr);
+  m_router->node_seen(id, sa);
+
+  if (search != NULL)
+    search->receive_response(queriedId.empty() ? id : queriedId, sa, response);
+}
+
+void
+DhtServer::process_error(const rak::socket_address& sa, const Object& message) {
+  const std::string& transactionId = message.get_key_string("t");
+
+  if (transactionId.size() != sizeof(uint16_t))
+    return;
+
+  TransactionMap::iterator itr = m_transactions.find(*reinterpret_cast<const uint16_t*>(transactionId.c_str()));
+
+  if (itr == m_transactions.end() || itr->second.m_timeout == rak::timer() || !(itr->second.m_address == sa))
+    return;
+
+  transaction_failed(itr);
+}
+
+void
+DhtServer::transaction_failed(TransactionMap::iterator itr) {
+  DhtSearch* search = itr->second.m_search;
+  std::string id = itr->second.m_id;
+  rak::socket_address sa = itr->second.m_address;
+
+  m_transactions.erase(itr);
+
+  if (!id.empty())
+    m_router->node_failed(id, sa);
+
+  if (search != NULL)
+    search->receive_failed(id, sa);
+}
+
+void
+DhtServer::receive_timeout() {
+  m_queriesSent = 0;
+
+  for (TransactionMap::iterator itr = m_transactions.begin(); itr != m_transactions.end(); ) {
+    TransactionMap::iterator tmp = itr++;
+
+    if (tmp->second.m_timeout != rak::timer() && tmp->second.m_timeout <= cachedTime)
+      transaction_failed(tmp);
+  }
+
+  if (!m_queries.empty() || !m_replies.empty())
+    manager->poll()->insert_write(this);
+
+  priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(1)).round_seconds());
+}
+
+}
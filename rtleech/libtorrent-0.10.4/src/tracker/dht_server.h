@@ -0,0 +1,149 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_TRACKER_DHT_SERVER_H
+#define LIBTORRENT_TRACKER_DHT_SERVER_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <rak/priority_queue_default.h>
+#include <rak/socket_address.h>
+
+#include "net/socket_datagram.h"
+
+namespace torrent {
+
+class DhtRouter;
+class DhtSearch;
+class Object;
+
+// The KRPC transport of the DHT node. Replies are sent as soon as
+// the socket is writable while outgoing queries are queued and sent
+// at no more than 'query_rate' per second. Queries that get no
+// response within 'transaction_timeout' seconds count as failed.
+
+class DhtServer : public SocketDatagram {
+public:
+  static const uint32_t transaction_timeout = 15;
+  static const uint32_t max_queued_queries  = 512;
+  static const uint32_t max_queued_replies  = 512;
+  static const uint32_t max_transaction_id  = 20;
+  static const uint32_t max_packet_size     = 1500;
+
+  static const int      query_ping          = 0;
+  static const int      query_find_node     = 1;
+  static const int      query_get_peers     = 2;
+  static const int      query_announce_peer = 3;
+
+  DhtServer(DhtRouter* router);
+  ~DhtServer();
+
+  bool                is_open() const                        { return get_fd().is_valid(); }
+
+  bool                open(uint16_t port);
+  void                close();
+
+  uint32_t            query_rate() const                     { return m_queryRate; }
+  void                set_query_rate(uint32_t r)             { m_queryRate = r; }
+
+  uint32_t            size_transactions() const              { return m_transactions.size(); }
+
+  // The search, if any, is told about the response or failure. The
+  // id is empty when we don't know the node yet.
+  bool                ping(const std::string& id, const rak::socket_address& sa);
+  bool                find_node(DhtSearch* search, const std::string& id, const rak::socket_address& sa, const std::string& target);
+  bool                get_peers(DhtSearch* search, const std::string& id, const rak::socket_address& sa, const std::string& hash);
+  bool                announce_peer(const std::string& id, const rak::socket_address& sa, const std::string& hash, const std::string& token);
+
+  // Clear pending references to a search that is being deleted.
+  void                cancel_search(DhtSearch* search);
+
+  virtual void        event_read();
+  virtual void        event_write();
+  virtual void        event_error();
+
+private:
+  struct Transaction {
+    int                 m_type;
+    std::string         m_id;
+    rak::socket_address m_address;
+    DhtSearch*          m_search;
+    rak::timer          m_timeout;
+  };
+
+  struct Packet {
+    rak::socket_address m_address;
+    std::string         m_data;
+    uint16_t            m_transactionId;
+  };
+
+  typedef std::map<uint16_t, Transaction> TransactionMap;
+  typedef std::deque<Packet>              PacketQueue;
+
+  bool                add_query(int type, DhtSearch* search, const std::string& id, const rak::socket_address& sa, Object& args);
+
+  void                send_reply(const rak::socket_address& sa, const std::string& transactionId, Object& reply);
+  void                send_error(const rak::socket_address& sa, const std::string& transactionId, int code, const char* msg);
+  bool                send_packet(PacketQueue* queue, const rak::socket_address& sa, const Object& message, uint16_t transactionId);
+
+  void                process_query(const rak::socket_address& sa, const Object& message);
+  void                process_response(const rak::socket_address& sa, const Object& message);
+  void                process_error(const rak::socket_address& sa, const Object& message);
+
+  void                transaction_failed(TransactionMap::iterator itr);
+
+  void                receive_timeout();
+
+  DhtRouter*          m_router;
+
+  TransactionMap      m_transactions;
+  uint16_t            m_transactionId;
+
+  PacketQueue         m_replies;
+  PacketQueue         m_queries;
+
+  uint32_t            m_queryRate;
+  uint32_t            m_queriesSent;
+
+  char                m_readBuffer[max_packet_size];
+
+  rak::priority_item  m_taskTimeout;
+};
+
+}
+
+#endif
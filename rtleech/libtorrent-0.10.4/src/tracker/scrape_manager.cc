@@ -0,0 +1,266 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <rak/functional.h>
+#include <rak/string_manip.h>
+
+#include "download/download_manager.h"
+#include "download/download_wrapper.h"
+#include "torrent/exceptions.h"
+#include "torrent/http.h"
+#include "torrent/object.h"
+#include "torrent/object_stream.h"
+
+#include "scrape_manager.h"
+#include "tracker_http.h"
+#include "tracker_manager.h"
+#include "tracker_udp.h"
+
+#include "globals.h"
+#include "manager.h"
+
+namespace torrent {
+
+class ScrapeManager::Request {
+public:
+  Request(TrackerList::iterator first, TrackerList::iterator last);
+  ~Request();
+
+  bool                is_done() const                      { return m_done; }
+
+  void                start(const std::string& url);
+  void                erase(TrackerBase* tracker);
+
+private:
+  Request(const Request&);
+  void operator = (const Request&);
+
+  void                receive_done();
+  void                receive_failed(std::string msg);
+
+  static uint32_t     scrape_value(const Object& b, const char* key);
+
+  Http*               m_get;
+  std::stringstream   m_data;
+  TrackerList         m_trackers;
+  bool                m_done;
+};
+
+ScrapeManager::Request::Request(TrackerList::iterator first, TrackerList::iterator last) :
+  m_get(Http::call_factory()),
+  m_trackers(first, last),
+  m_done(false) {
+
+  m_get->signal_done().connect(sigc::mem_fun(*this, &Request::receive_done));
+  m_get->signal_failed().connect(sigc::mem_fun(*this, &Request::receive_failed));
+}
+
+ScrapeManager::Request::~Request() {
+  if (!m_done)
+    receive_failed("Scrape request destroyed.");
+
+  delete m_get;
+}
+
+void
+ScrapeManager::Request::start(const std::string& url) {
+  std::stringstream s;
+  s.imbue(std::locale::classic());
+
+  s << url;
+
+  for (TrackerList::iterator itr = m_trackers.begin(); itr != m_trackers.end(); ++itr) {
+    s << (itr == m_trackers.begin() && url.find('?') == std::string::npos ? '?' : '&')
+      << "info_hash=" << rak::copy_escape_html((*itr)->info()->hash());
+
+    (*itr)->set_scrape_busy(true);
+    (*itr)->set_scrape_time_request(cachedTime);
+  }
+
+  m_get->set_url(s.str());
+  m_get->set_stream(&m_data);
+  m_get->set_timeout(2 * 60);
+
+  m_get->start();
+}
+
+void
+ScrapeManager::Request::erase(TrackerBase* tracker) {
+  std::replace(m_trackers.begin(), m_trackers.end(), tracker, (TrackerBase*)NULL);
+}
+
+void
+ScrapeManager::Request::receive_done() {
+  std::string data = m_data.str();
+  Object b;
+
+  if (object_read_bencode_c(data.c_str(), data.c_str() + data.size(), &b) == NULL || !b.is_map() || !b.has_key_map("files"))
+    return receive_failed("Could not parse scrape response.");
+
+  const Object::map_type& files = b.get_key_map("files");
+
+  for (TrackerList::iterator itr = m_trackers.begin(); itr != m_trackers.end(); ++itr) {
+    if (*itr == NULL)
+      continue;
+
+    Object::map_type::const_iterator entry = files.find((*itr)->info()->hash());
+
+    if (entry == files.end() || !entry->second.is_map()) {
+      (*itr)->set_scrape_busy(false);
+      continue;
+    }
+
+    (*itr)->set_scrape(scrape_value(entry->second, "complete"),
+                       scrape_value(entry->second, "downloaded"),
+                       scrape_value(entry->second, "incomplete"));
+  }
+
+  m_get->close();
+  m_get->set_stream(NULL);
+  m_done = true;
+}
+
+void
+ScrapeManager::Request::receive_failed(std::string msg) {
+  for (TrackerList::iterator itr = m_trackers.begin(); itr != m_trackers.end(); ++itr)
+    if (*itr != NULL)
+      (*itr)->set_scrape_busy(false);
+
+  m_get->close();
+  m_get->set_stream(NULL);
+  m_done = true;
+}
+
+uint32_t
+ScrapeManager::Request::scrape_value(const Object& b, const char* key) {
+  if (!b.has_key_value(key))
+    return 0;
+
+  return std::max<int64_t>(b.get_key_value(key), 0);
+}
+
+ScrapeManager::~ScrapeManager() {
+  std::for_each(m_requests.begin(), m_requests.end(), rak::call_delete<Request>());
+}
+
+void
+ScrapeManager::receive_tick() {
+  // The Http objects can't be deleted from within their own signals,
+  // so finished requests are cleaned up here.
+  for (RequestList::iterator itr = m_requests.begin(); itr != m_requests.end(); )
+    if ((*itr)->is_done()) {
+      delete *itr;
+      itr = m_requests.erase(itr);
+    } else {
+      ++itr;
+    }
+
+  if (m_interval == 0)
+    return;
+
+  typedef std::map<std::string, TrackerList> UrlMap;
+
+  UrlMap httpTrackers;
+
+  for (DownloadManager::iterator itr = manager->download_manager()->begin(), last = manager->download_manager()->end(); itr != last; ++itr) {
+    TrackerBase* tracker = select_tracker(*itr);
+
+    if (tracker == NULL)
+      continue;
+
+    if (tracker->type() == TrackerBase::TRACKER_UDP) {
+      static_cast<TrackerUdp*>(tracker)->send_scrape();
+
+    } else if (tracker->type() == TrackerBase::TRACKER_HTTP) {
+      std::string url = static_cast<TrackerHttp*>(tracker)->scrape_url();
+
+      // Don't retry trackers without scrape support every tick.
+      if (url.empty())
+        tracker->set_scrape_time_request(cachedTime);
+      else
+        httpTrackers[url].push_back(tracker);
+    }
+  }
+
+  for (UrlMap::iterator itr = httpTrackers.begin(); itr != httpTrackers.end(); ++itr)
+    for (TrackerList::iterator first = itr->second.begin(); first != itr->second.end(); ) {
+      TrackerList::iterator last = first + std::min<TrackerList::size_type>(std::distance(first, itr->second.end()), max_http_hashes);
+
+      send_http(itr->first, first, last);
+      first = last;
+    }
+}
+
+void
+ScrapeManager::erase(TrackerBase* tracker) {
+  std::for_each(m_requests.begin(), m_requests.end(), std::bind2nd(std::mem_fun(&Request::erase), tracker));
+}
+
+TrackerBase*
+ScrapeManager::select_tracker(DownloadWrapper* d) const {
+  TrackerManager* trackerManager = d->main()->tracker_manager();
+
+  if (trackerManager->size() == 0)
+    return NULL;
+
+  TrackerBase* tracker = trackerManager->get(trackerManager->focus_index() < trackerManager->size() ? trackerManager->focus_index() : 0).second;
+
+  if (!tracker->is_enabled() || tracker->is_busy() || tracker->is_scrape_busy())
+    return NULL;
+
+  rak::timer interval = rak::timer::from_seconds(m_interval);
+
+  if (tracker->scrape_time_last() + interval > cachedTime ||
+      tracker->scrape_time_request() + interval > cachedTime)
+    return NULL;
+
+  return tracker;
+}
+
+void
+ScrapeManager::send_http(const std::string& url, TrackerList::iterator first, TrackerList::iterator last) {
+  Request* request = new Request(first, last);
+
+  m_requests.push_back(request);
+  request->start(url);
+}
+
+}
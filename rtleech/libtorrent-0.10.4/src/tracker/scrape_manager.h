@@ -0,0 +1,95 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_TRACKER_SCRAPE_MANAGER_H
+#define LIBTORRENT_TRACKER_SCRAPE_MANAGER_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <inttypes.h>
+
+namespace torrent {
+
+class DownloadWrapper;
+class TrackerBase;
+
+// Periodically scrapes the focused tracker of every download. HTTP
+// trackers sharing a scrape url are queried together with up to
+// 'max_http_hashes' info hashes per request, while UDP scrapes are
+// batched per address by TrackerUdpClient.
+//
+// Trackers that returned swarm counts in a recent announce are
+// skipped, so this mostly covers inactive downloads.
+
+class ScrapeManager {
+public:
+  typedef std::vector<TrackerBase*> TrackerList;
+
+  static const uint32_t max_http_hashes = 50;
+
+  ScrapeManager() : m_interval(30 * 60) {}
+  ~ScrapeManager();
+
+  // Seconds between scrapes of a tracker, 0 disables scraping.
+  uint32_t            interval() const                     { return m_interval; }
+  void                set_interval(uint32_t s)             { m_interval = s; }
+
+  uint32_t            size_requests() const                { return m_requests.size(); }
+
+  void                receive_tick();
+
+  // Called by trackers with a pending HTTP scrape when destroyed.
+  void                erase(TrackerBase* tracker);
+
+private:
+  ScrapeManager(const ScrapeManager&);
+  void operator = (const ScrapeManager&);
+
+  class Request;
+  typedef std::list<Request*> RequestList;
+
+  TrackerBase*        select_tracker(DownloadWrapper* d) const;
+
+  void                send_http(const std::string& url, TrackerList::iterator first, TrackerList::iterator last);
+
+  uint32_t            m_interval;
+  RequestList         m_requests;
+};
+
+}
+
+#endif
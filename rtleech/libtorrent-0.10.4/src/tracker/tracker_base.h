@@ -37,13 +37,15 @@
 #ifndef LIBTORRENT_TRACKER_TRACKER_BASE_H
 #define LIBTORRENT_TRACKER_TRACKER_BASE_H
 
-#include <list>
+#include <algorithm>
+#include <vector>
 #include <inttypes.h>
 #include <rak/functional.h>
 #include <rak/socket_address.h>
 #include <rak/timer.h>
 
 #include "download/download_info.h"
+#include "globals.h"
 
 namespace torrent {
 
@@ -51,7 +53,7 @@ class TrackerControl;
 
 class TrackerBase {
 public:
-  typedef std::list<rak::socket_address>                                        AddressList;
+  typedef std::vector<rak::socket_address>                                      AddressList;
   typedef rak::mem_fun1<TrackerControl, void, int>                              SlotInt;
   typedef rak::mem_fun2<TrackerControl, void, TrackerBase*, AddressList*>       SlotTbAddressList;
   typedef rak::mem_fun2<TrackerControl, void, TrackerBase*, const std::string&> SlotTbString;
@@ -63,7 +65,9 @@ public:
   } Type;
 
   TrackerBase(DownloadInfo* info, const std::string& url) :
-    m_enabled(true), m_info(info), m_url(url), m_scrapeComplete(0), m_scrapeIncomplete(0) {}
+    m_enabled(true), m_info(info), m_url(url),
+    m_scrapeBusy(false), m_scrapeComplete(0), m_scrapeIncomplete(0), m_scrapeDownloaded(0),
+    m_statsSuccess(0), m_statsFailed(0), m_statsLatency(0), m_statsPeers(0) {}
   virtual ~TrackerBase() {}
 
   virtual bool        is_busy() const = 0;
@@ -83,11 +87,41 @@ public:
   const std::string&  tracker_id() const                    { return m_trackerId; }
   void                set_tracker_id(const std::string& id) { m_trackerId = id; }
 
+  // A scrape is in progress, either through ScrapeManager for HTTP
+  // trackers or TrackerUdpClient for UDP trackers.
+  bool                is_scrape_busy() const                { return m_scrapeBusy; }
+  void                set_scrape_busy(bool state)           { m_scrapeBusy = state; }
+
   const rak::timer&   scrape_time_last() const              { return m_scrapeTimeLast; }
+  const rak::timer&   scrape_time_request() const           { return m_scrapeTimeRequest; }
+  void                set_scrape_time_request(rak::timer t) { m_scrapeTimeRequest = t; }
+
   uint32_t            scrape_complete() const               { return m_scrapeComplete; }
   uint32_t            scrape_incomplete() const             { return m_scrapeIncomplete; }
   uint32_t            scrape_downloaded() const             { return m_scrapeDownloaded; }
 
+  void                set_scrape(uint32_t complete, uint32_t downloaded, uint32_t incomplete);
+
+  // Health statistics used to order the trackers within a group. The
+  // counts are halved when they grow past 'stats_decay' so recent
+  // requests dominate, latency is in milliseconds and peers is the
+  // average yield of a successful request.
+  static const uint32_t stats_decay = 32;
+
+  uint32_t            stats_success() const                 { return m_statsSuccess; }
+  uint32_t            stats_failed() const                  { return m_statsFailed; }
+  uint32_t            stats_latency() const                 { return m_statsLatency; }
+  uint32_t            stats_peers() const                   { return m_statsPeers; }
+  void                set_stats(uint32_t success, uint32_t failed, uint32_t latency, uint32_t peers);
+
+  uint32_t            health_score() const;
+
+  const rak::timer&   request_time() const                  { return m_requestTime; }
+  void                set_request_time(rak::timer t)        { m_requestTime = t; }
+
+  void                receive_stats_success(uint32_t peers);
+  void                receive_stats_failed();
+
   void                slot_success(SlotTbAddressList s)     { m_slotSuccess = s; }
   void                slot_failed(SlotTbString s)           { m_slotFailed = s; }
   void                slot_set_interval(SlotInt s)          { m_slotSetInterval = s; }
@@ -104,17 +138,82 @@ protected:
 
   std::string         m_trackerId;
 
+  bool                m_scrapeBusy;
   rak::timer          m_scrapeTimeLast;
+  rak::timer          m_scrapeTimeRequest;
   uint32_t            m_scrapeComplete;
   uint32_t            m_scrapeIncomplete;
   uint32_t            m_scrapeDownloaded;
 
+  rak::timer          m_requestTime;
+  uint32_t            m_statsSuccess;
+  uint32_t            m_statsFailed;
+  uint32_t            m_statsLatency;
+  uint32_t            m_statsPeers;
+
   SlotTbAddressList   m_slotSuccess;
   SlotTbString        m_slotFailed;
   SlotInt             m_slotSetInterval;
   SlotInt             m_slotSetMinInterval;
 };
 
+inline void
+TrackerBase::set_scrape(uint32_t complete, uint32_t downloaded, uint32_t incomplete) {
+  m_scrapeBusy       = false;
+  m_scrapeComplete   = complete;
+  m_scrapeDownloaded = downloaded;
+  m_scrapeIncomplete = incomplete;
+  m_scrapeTimeLast   = cachedTime;
+}
+
+inline void
+TrackerBase::set_stats(uint32_t success, uint32_t failed, uint32_t latency, uint32_t peers) {
+  uint32_t decay = stats_decay;
+
+  m_statsSuccess = std::min(success, decay);
+  m_statsFailed  = std::min(failed, decay);
+  m_statsLatency = latency;
+  m_statsPeers   = peers;
+}
+
+// Smoothed success rate scaled by 0-1000, halved for every 5 seconds
+// of latency and halved again for trackers that yield no peers.
+inline uint32_t
+TrackerBase::health_score() const {
+  uint64_t score = 1000 * (m_statsSuccess + 1) / (m_statsSuccess + m_statsFailed + 2);
+
+  score = score * 5000 / (5000 + m_statsLatency);
+  score = score * (50 + std::min<uint32_t>(m_statsPeers, 50)) / 100;
+
+  return score;
+}
+
+inline void
+TrackerBase::receive_stats_success(uint32_t peers) {
+  uint32_t latency = std::min<int64_t>(std::max<int64_t>((cachedTime - m_requestTime).usec() / 1000, 0), 10 * 60 * 1000);
+
+  if (m_statsSuccess == 0) {
+    m_statsLatency = latency;
+    m_statsPeers   = peers;
+  } else {
+    m_statsLatency = (3 * m_statsLatency + latency) / 4;
+    m_statsPeers   = (3 * m_statsPeers + peers) / 4;
+  }
+
+  if (++m_statsSuccess + m_statsFailed > stats_decay) {
+    m_statsSuccess = (m_statsSuccess + 1) / 2;
+    m_statsFailed  = m_statsFailed / 2;
+  }
+}
+
+inline void
+TrackerBase::receive_stats_failed() {
+  if (m_statsSuccess + ++m_statsFailed > stats_decay) {
+    m_statsSuccess = m_statsSuccess / 2;
+    m_statsFailed  = (m_statsFailed + 1) / 2;
+  }
+}
+
 struct address_list_add_address : public std::unary_function<rak::socket_address, void> {
   address_list_add_address(TrackerBase::AddressList* l) : m_list(l) {}
 
@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <rak/functional.h>
 
 #include "torrent/exceptions.h"
@@ -66,6 +67,20 @@ TrackerContainer::randomize() {
   }
 }
 
+struct tracker_container_health_less {
+  bool operator () (const TrackerContainer::value_type& t1, const TrackerContainer::value_type& t2) const {
+    if (t1.first != t2.first)
+      return t1.first < t2.first;
+
+    return t1.second->health_score() > t2.second->health_score();
+  }
+};
+
+void
+TrackerContainer::sort_by_health() {
+  std::stable_sort(begin(), end(), tracker_container_health_less());
+}
+
 void
 TrackerContainer::clear() {
   std::for_each(begin(), end(),
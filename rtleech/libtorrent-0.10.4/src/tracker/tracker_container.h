@@ -49,6 +49,9 @@ class TrackerBase;
 // iterate if the request failed. Upon request success move the
 // tracker to the beginning of the subgroup and start from the
 // beginning of the whole list.
+//
+// Within a group the trackers may also be ordered by their health
+// score, keeping the random order between trackers of equal score.
 
 class TrackerContainer : private std::vector<std::pair<int, TrackerBase*> > {
 public:
@@ -73,6 +76,7 @@ public:
   bool                has_enabled() const;
 
   void                randomize();
+  void                sort_by_health();
   void                clear();
 
   iterator            insert(int group, TrackerBase* t);
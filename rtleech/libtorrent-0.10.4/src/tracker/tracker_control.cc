@@ -53,8 +53,11 @@ TrackerControl::TrackerControl() :
   m_tries(-1),
   m_normalInterval(1800),
   m_minInterval(0),
+  m_fanout(3),
   m_info(NULL),
   m_state(DownloadInfo::STOPPED),
+  m_requestSending(false),
+  m_requestSuccess(false),
   m_timeLastConnection(cachedTime) {
   
   m_itr = m_list.end();
@@ -95,24 +98,67 @@ TrackerControl::cycle_group(int group) {
   m_itr = m_list.find(tb);
 }
 
+void
+TrackerControl::sort_by_health() {
+  TrackerBase* tb = (m_itr != m_list.end()) ? m_itr->second : NULL;
+
+  m_list.sort_by_health();
+  m_itr = m_list.find(tb);
+}
+
 void
 TrackerControl::send_state(DownloadInfo::State s) {
-  // Reset the target tracker since we're doing a new request.
-  if (m_itr != m_list.end())
-    m_itr->second->close();
+  // Reset the target trackers since we're doing a new request.
+  close();
 
   m_tries = -1;
   m_state = s;
 
   m_itr = m_list.find_enabled(m_itr);
 
-  if (m_itr != m_list.end())
-    m_itr->second->send_state(m_state,
-                              std::max<int64_t>(m_info->slot_completed()() - m_info->completed_baseline(), 0),
-                              std::max<int64_t>(m_info->up_rate()->total() - m_info->uploaded_baseline(), 0),
-                              m_info->slot_left()());
-  else
-    m_slotFailed("Tried all trackers.");
+  if (m_itr == m_list.end())
+    return m_slotFailed("Tried all trackers.");
+
+  m_requestSending = true;
+  m_requestSuccess = false;
+  m_requestMessage.clear();
+
+  send_request(m_itr->second);
+
+  // STOPPED is sent to every group regardless of the fanout, as any
+  // of them might have been announced to.
+  uint32_t fanout = m_state == DownloadInfo::STOPPED ? m_list.size() : m_fanout;
+
+  for (TrackerContainer::iterator itr = m_list.find_enabled(m_list.end_group(m_itr->first));
+       itr != m_list.end() && m_requests.size() < fanout;
+       itr = m_list.find_enabled(m_list.end_group(itr->first)))
+    send_request(itr->second);
+
+  m_requestSending = false;
+
+  // Trackers may fail before returning from send_state, e.g. on bad
+  // urls, so check if any are still waiting for a reply.
+  if (!m_requestSuccess && !is_busy()) {
+    m_itr++;
+    m_slotFailed(m_requestMessage);
+  }
+}
+
+void
+TrackerControl::send_request(TrackerBase* tb) {
+  m_requests.push_back(tb);
+
+  tb->set_request_time(cachedTime);
+  tb->send_state(m_state,
+                 std::max<int64_t>(m_info->slot_completed()() - m_info->completed_baseline(), 0),
+                 std::max<int64_t>(m_info->up_rate()->total() - m_info->uploaded_baseline(), 0),
+                 m_info->slot_left()());
+}
+
+void
+TrackerControl::close() {
+  std::for_each(m_requests.begin(), m_requests.end(), std::mem_fun(&TrackerBase::close));
+  m_requests.clear();
 }
 
 void
@@ -148,17 +194,29 @@ TrackerControl::receive_success(TrackerBase* tb, AddressList* l) {
 
   TrackerContainer::iterator itr = m_list.find(tb);
 
-  if (itr != m_itr || m_itr == m_list.end() || m_itr->second->is_busy())
+  if (itr == m_list.end() || tb->is_busy() || std::find(m_requests.begin(), m_requests.end(), tb) == m_requests.end())
     throw internal_error("TrackerControl::receive_success(...) called but the iterator is invalid.");
 
-  // Promote the tracker to the front of the group since it was
-  // successfull.
-  m_itr = m_list.promote(m_itr);
-
-  l->sort();
+  std::sort(l->begin(), l->end());
   l->erase(std::unique(l->begin(), l->end()), l->end());
 
+  tb->receive_stats_success(l->size());
   m_timeLastConnection = cachedTime;
+
+  // Only STOPPED requests are left running after the first success,
+  // and those replies carry nothing we need.
+  if (m_requestSuccess)
+    return;
+
+  m_requestSuccess = true;
+
+  // Promote the tracker to the front of the group since it was
+  // successfull, and make it the focus.
+  m_itr = m_list.promote(itr);
+
+  if (m_state != DownloadInfo::STOPPED)
+    close();
+
   m_slotSuccess(l);
 }
 
@@ -169,11 +227,23 @@ TrackerControl::receive_failed(TrackerBase* tb, const std::string& msg) {
 
   TrackerContainer::iterator itr = m_list.find(tb);
 
-  if (itr != m_itr || m_itr == m_list.end() || m_itr->second->is_busy())
+  if (itr == m_list.end() || tb->is_busy() || std::find(m_requests.begin(), m_requests.end(), tb) == m_requests.end())
     throw internal_error("TrackerControl::receive_failed(...) called but the iterator is invalid.");
 
+  tb->receive_stats_failed();
+
+  if (m_requestSuccess)
+    return;
+
+  // Keep the message of the focused tracker if possible.
+  if (m_requestMessage.empty() || tb == m_itr->second)
+    m_requestMessage = msg;
+
+  if (m_requestSending || is_busy())
+    return;
+
   m_itr++;
-  m_slotFailed(msg);
+  m_slotFailed(m_requestMessage);
 }
 
 void
@@ -37,8 +37,9 @@
 #ifndef LIBTORRENT_TRACKER_TRACKER_CONTROL_H
 #define LIBTORRENT_TRACKER_TRACKER_CONTROL_H
 
-#include <list>
+#include <algorithm>
 #include <string>
+#include <vector>
 #include <rak/functional.h>
 #include <rak/socket_address.h>
 
@@ -52,28 +53,39 @@
 namespace torrent {
 
 // We change to NONE once we successfully send. If STOPPED then don't
-// retry and remove from service. We only send the state to the first
-// tracker we can connect to, NONE's should be interpreted as a
+// retry and remove from service. NONE's should be interpreted as a
 // started download.
+//
+// The state is sent to the focused tracker and, in parallel, to the
+// first enabled tracker of each following group up to 'fanout'
+// trackers. The first success ends the request and closes the rest.
+// STOPPED is the exception, it is sent to the first enabled tracker
+// of every group and none are closed. The request fails once none of
+// the trackers are still busy.
 
 class TrackerManager;
 
 class TrackerControl {
 public:
-  typedef std::list<rak::socket_address>                          AddressList;
+  typedef std::vector<rak::socket_address>                        AddressList;
   typedef rak::mem_fun1<TrackerManager, void, AddressList*>       SlotSuccess;
   typedef rak::mem_fun1<TrackerManager, void, const std::string&> SlotFailed;
+  typedef std::vector<TrackerBase*>                               RequestList;
 
   TrackerControl();
 
   bool                is_busy() const;
 
   void                send_state(DownloadInfo::State s);
-  inline void         close();
+  void                close();
 
   void                insert(int group, const std::string& url);
   void                cycle_group(int group);
 
+  // Orders the trackers within each group by health, the order of
+  // the groups is kept.
+  void                sort_by_health();
+
   DownloadInfo::State get_state()                             { return m_state; }
   void                set_state(DownloadInfo::State s)        { m_state = s; }
 
@@ -85,6 +97,9 @@ public:
   uint32_t            get_normal_interval() const             { return m_normalInterval; }
   uint32_t            get_min_interval() const                { return m_minInterval; }
 
+  uint32_t            fanout() const                          { return m_fanout; }
+  void                set_fanout(uint32_t f)                  { m_fanout = std::max<uint32_t>(f, 1); }
+
   uint32_t            focus_index() const                     { return m_itr - m_list.begin(); }
   void                set_focus_index(uint32_t v);
 
@@ -106,12 +121,15 @@ private:
   void                receive_success(TrackerBase* tb, AddressList* l);
   void                receive_failed(TrackerBase* tb, const std::string& msg);
 
+  void                send_request(TrackerBase* tb);
+
   void                receive_set_normal_interval(int v);
   void                receive_set_min_interval(int v);
 
   int                 m_tries;
   int                 m_normalInterval;
   int                 m_minInterval;
+  uint32_t            m_fanout;
 
   DownloadInfo*       m_info;
   DownloadInfo::State m_state;
@@ -119,6 +137,11 @@ private:
   TrackerContainer           m_list;
   TrackerContainer::iterator m_itr;
 
+  RequestList         m_requests;
+  bool                m_requestSending;
+  bool                m_requestSuccess;
+  std::string         m_requestMessage;
+
   rak::timer          m_timeLastConnection;
 
   SlotSuccess         m_slotSuccess;
@@ -127,13 +150,7 @@ private:
 
 inline bool
 TrackerControl::is_busy() const {
-  return m_itr != m_list.end() && m_itr->second->is_busy();
-}
-
-inline void
-TrackerControl::close() {
-  if (m_itr != m_list.end())
-    m_itr->second->close();
+  return std::find_if(m_requests.begin(), m_requests.end(), std::mem_fun(&TrackerBase::is_busy)) != m_requests.end();
 }
 
 }
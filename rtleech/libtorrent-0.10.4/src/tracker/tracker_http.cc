@@ -46,6 +46,7 @@
 #include "torrent/http.h"
 #include "torrent/object_stream.h"
 
+#include "scrape_manager.h"
 #include "tracker_http.h"
 
 #include "globals.h"
@@ -64,6 +65,9 @@ TrackerHttp::TrackerHttp(DownloadInfo* info, const std::string& url) :
 }
 
 TrackerHttp::~TrackerHttp() {
+  if (m_scrapeBusy)
+    manager->scrape_manager()->erase(this);
+
   delete m_get;
   delete m_data;
 }
@@ -156,21 +160,29 @@ TrackerHttp::type() const {
   return TRACKER_HTTP;
 }
 
+std::string
+TrackerHttp::scrape_url() const {
+  std::string::size_type pos = m_url.rfind('/');
+
+  if (pos == std::string::npos || m_url.compare(pos + 1, 8, "announce") != 0)
+    return std::string();
+
+  return m_url.substr(0, pos + 1) + "scrape" + m_url.substr(pos + 9);
+}
+
 void
 TrackerHttp::receive_done() {
   if (m_data == NULL)
     throw internal_error("TrackerHttp::receive_done() called on an invalid object");
 
-  if (!m_info->signal_tracker_dump().empty()) {
-    std::string dump = m_data->str();
+  std::string data = m_data->str();
 
-    m_info->signal_tracker_dump().emit(m_get->url(), dump.c_str(), dump.size());
-  }
+  if (!m_info->signal_tracker_dump().empty())
+    m_info->signal_tracker_dump().emit(m_get->url(), data.c_str(), data.size());
 
   Object b;
-  *m_data >> b;
 
-  if (m_data->fail())
+  if (object_read_bencode_c(data.c_str(), data.c_str() + data.size(), &b) == NULL)
     return receive_failed("Could not parse bencoded data");
 
   if (!b.is_map())
@@ -249,6 +261,7 @@ TrackerHttp::parse_address(const Object& b) {
 
 void
 TrackerHttp::parse_address_normal(AddressList* l, const Object::list_type& b) {
+  l->reserve(b.size());
   std::for_each(b.begin(), b.end(), rak::on(std::ptr_fun(&TrackerHttp::parse_address), address_list_add_address(l)));
 }
 
@@ -257,9 +270,9 @@ TrackerHttp::parse_address_compact(AddressList* l, const std::string& s) {
   if (sizeof(const SocketAddressCompact) != 6)
     throw internal_error("TrackerHttp::parse_address_compact(...) bad struct size.");
 
-  std::copy(reinterpret_cast<const SocketAddressCompact*>(s.c_str()),
-	    reinterpret_cast<const SocketAddressCompact*>(s.c_str() + s.size() - s.size() % sizeof(SocketAddressCompact)),
-	    std::back_inserter(*l));
+  // Converted straight from the string in one allocation.
+  l->assign(reinterpret_cast<const SocketAddressCompact*>(s.c_str()),
+            reinterpret_cast<const SocketAddressCompact*>(s.c_str() + s.size() - s.size() % sizeof(SocketAddressCompact)));
 }
 
 }
@@ -58,6 +58,10 @@ public:
 
   virtual Type        type() const;
 
+  // Returns an empty string if the tracker does not follow the
+  // 'announce' to 'scrape' url convention.
+  std::string         scrape_url() const;
+
 private:
   void                receive_done();
   void                receive_failed(std::string msg);
@@ -36,6 +36,8 @@
 
 #include "config.h"
 
+#include <algorithm>
+
 #include "torrent/exceptions.h"
 
 #include "tracker_control.h"
@@ -85,6 +87,7 @@ void
 TrackerManager::send_start() {
   close();
 
+  m_control->sort_by_health();
   m_control->set_focus_index(0);
   m_control->send_state(DownloadInfo::STARTED);
 }
@@ -180,6 +183,16 @@ TrackerManager::group_size() const {
     return m_control->get_list().rbegin()->first + 1;
 }
 
+uint32_t
+TrackerManager::fanout() const {
+  return m_control->fanout();
+}
+
+void
+TrackerManager::set_fanout(uint32_t f) {
+  m_control->set_fanout(f);
+}
+
 TrackerManager::value_type
 TrackerManager::get(size_type idx) const {
   return m_control->get_list()[idx];
@@ -190,6 +203,25 @@ TrackerManager::focus_index() const {
   return m_control->focus_index();
 }
 
+bool
+TrackerManager::is_scraped() const {
+  for (size_type i = 0; i < m_control->get_list().size(); ++i)
+    if (m_control->get_list()[i].second->scrape_time_last() != rak::timer())
+      return true;
+
+  return false;
+}
+
+uint32_t
+TrackerManager::scrape_max(uint32_t (TrackerBase::*ftor)() const) const {
+  uint32_t result = 0;
+
+  for (size_type i = 0; i < m_control->get_list().size(); ++i)
+    result = std::max(result, (m_control->get_list()[i].second->*ftor)());
+
+  return result;
+}
+
 void
 TrackerManager::insert(int group, const std::string& url) {
   // Consider borking m_initialTracker.
@@ -279,8 +311,10 @@ TrackerManager::receive_failed(const std::string& msg) {
     // Normal retry.
 
     if (m_control->focus_index() == m_control->get_list().size()) {
-      // Tried all the trackers, start from the beginning.
+      // Tried all the trackers, start from the beginning with the
+      // healthiest ones.
       m_failedRequests++;
+      m_control->sort_by_health();
       m_control->set_focus_index(0);
     }
     
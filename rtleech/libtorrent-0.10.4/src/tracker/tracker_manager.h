@@ -37,7 +37,7 @@
 #ifndef LIBTORRENT_TRACKER_TRACKER_MANAGER_H
 #define LIBTORRENT_TRACKER_TRACKER_MANAGER_H
 
-#include <list>
+#include <vector>
 #include <rak/functional.h>
 
 #include <rak/socket_address.h>
@@ -54,7 +54,7 @@ class TrackerManager {
 public:
   typedef uint32_t                                size_type;
   typedef std::pair<int, TrackerBase*>            value_type;
-  typedef std::list<rak::socket_address>          AddressList;
+  typedef std::vector<rak::socket_address>        AddressList;
 
   typedef rak::mem_fun1<DownloadWrapper, void, AddressList*>       SlotSuccess;
   typedef rak::mem_fun1<DownloadWrapper, void, const std::string&> SlotFailed;
@@ -88,11 +88,22 @@ public:
   size_type           size() const;
   size_type           group_size() const;
 
+  // The number of trackers, each from a different group, that are
+  // sent the state in parallel.
+  uint32_t            fanout() const;
+  void                set_fanout(uint32_t f);
+
   value_type          get(size_type idx) const;
   size_type           focus_index() const;
 
   void                insert(int group, const std::string& url);
 
+  // True if any tracker has been scraped.
+  bool                is_scraped() const;
+
+  // The largest value returned by 'ftor' on any tracker.
+  uint32_t            scrape_max(uint32_t (TrackerBase::*ftor)() const) const;
+
   DownloadInfo*       info();
   const DownloadInfo* info() const;
   void                set_info(DownloadInfo* info);
@@ -36,12 +36,11 @@
 
 #include "config.h"
 
+#include <cstdio>
 #include <rak/address_info.h>
-#include <rak/error_number.h>
 
 #include "torrent/exceptions.h"
 #include "torrent/connection_manager.h"
-#include "torrent/poll.h"
 
 #include "tracker_udp.h"
 #include "manager.h"
@@ -50,72 +49,64 @@ namespace torrent {
 
 TrackerUdp::TrackerUdp(DownloadInfo* info, const std::string& url) :
   TrackerBase(info, url),
-  m_readBuffer(NULL),
-  m_writeBuffer(NULL) {
+  m_busy(false) {
 
-  m_taskTimeout.set_slot(rak::mem_fn(this, &TrackerUdp::receive_timeout));
+  m_connectAddress.clear();
 }
 
 TrackerUdp::~TrackerUdp() {
   close();
+
+  if (m_scrapeBusy)
+    manager->tracker_udp_client()->erase(this, TrackerUdpClient::action_scrape);
 }
   
 bool
 TrackerUdp::is_busy() const {
-  return get_fd().is_valid();
+  return m_busy;
 }
 
 void
 TrackerUdp::send_state(DownloadInfo::State state, uint64_t down, uint64_t up, uint64_t left) {
   close();
 
-  if (!parse_url())
+  // Only resolve the hostname again after a failed request.
+  if (!m_connectAddress.is_valid() && !parse_url())
     return receive_failed("Could not parse UDP hostname or port.");
 
-  if (!get_fd().open_datagram() ||
-      !get_fd().set_nonblock() ||
-      !get_fd().bind(*rak::socket_address::cast_from(manager->connection_manager()->bind_address())))
-    return receive_failed("Could not open UDP socket.");
-
-  m_readBuffer = new ReadBuffer;
-  m_writeBuffer = new WriteBuffer;
-
   m_sendState = state;
   m_sendDown = down;
   m_sendUp = up;
   m_sendLeft = left;
 
-  prepare_connect_input();
-
-  manager->poll()->open(this);
-  manager->poll()->insert_read(this);
-  manager->poll()->insert_write(this);
-  manager->poll()->insert_error(this);
+  if (!manager->tracker_udp_client()->insert(this, m_connectAddress, TrackerUdpClient::action_announce))
+    return receive_failed("Could not open UDP socket.");
 
-  m_tries = m_info->udp_tries();
-  priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(m_info->udp_timeout())).round_seconds());
+  m_busy = true;
 }
 
 void
-TrackerUdp::close() {
-  if (!get_fd().is_valid())
+TrackerUdp::send_scrape() {
+  if (m_scrapeBusy)
     return;
 
-  delete m_readBuffer;
-  delete m_writeBuffer;
+  if (!m_connectAddress.is_valid() && !parse_url())
+    return;
 
-  m_readBuffer = NULL;
-  m_writeBuffer = NULL;
+  if (!manager->tracker_udp_client()->insert(this, m_connectAddress, TrackerUdpClient::action_scrape))
+    return;
 
-  priority_queue_erase(&taskScheduler, &m_taskTimeout);
+  m_scrapeBusy = true;
+  m_scrapeTimeRequest = cachedTime;
+}
 
-  manager->poll()->remove_read(this);
-  manager->poll()->remove_write(this);
-  manager->poll()->remove_error(this);
-  manager->poll()->close(this);
+void
+TrackerUdp::close() {
+  if (!m_busy)
+    return;
 
-  get_fd().close();
-  get_fd().clear();
+  manager->tracker_udp_client()->erase(this, TrackerUdpClient::action_announce);
+  m_busy = false;
 }
 
 TrackerUdp::Type
@@ -124,93 +115,78 @@ TrackerUdp::type() const {
 }
 
 void
-TrackerUdp::receive_failed(const std::string& msg) {
-  close();
-  m_slotFailed(this, msg);
-}
+TrackerUdp::write_announce(TrackerUdpClient::WriteBuffer* buffer) {
+  buffer->write_range(m_info->hash().begin(), m_info->hash().end());
+  buffer->write_range(m_info->local_id().begin(), m_info->local_id().end());
 
-void
-TrackerUdp::receive_timeout() {
-  if (m_taskTimeout.is_queued())
-    throw internal_error("TrackerUdp::receive_timeout() called but m_taskTimeout is still scheduled.");
+  buffer->write_64(m_sendDown);
+  buffer->write_64(m_sendLeft);
+  buffer->write_64(m_sendUp);
+  buffer->write_32(m_sendState);
 
-  if (--m_tries == 0) {
-    receive_failed("Unable to connect to UDP tracker.");
-  } else {
-    priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(m_info->udp_timeout())).round_seconds());
-
-    manager->poll()->insert_write(this);
-  }
-}
+  const rak::socket_address* localAddress = rak::socket_address::cast_from(manager->connection_manager()->local_address());
 
-void
-TrackerUdp::event_read() {
-  rak::socket_address sa;
+  // This code assumes we're have a inet address.
+  if (localAddress->family() != rak::socket_address::af_inet)
+    throw internal_error("TrackerUdp::write_announce(...) m_info->local_address() not of family AF_INET.");
 
-  int s = read_datagram(m_readBuffer->begin(), m_readBuffer->reserved(), &sa);
+  buffer->write_32_n(localAddress->sa_inet()->address_n());
+  buffer->write_32(m_info->key());
+  buffer->write_32(m_info->numwant());
+  buffer->write_16(manager->connection_manager()->listen_port());
 
-  if (s < 0)
-    return;
+  if (buffer->size_position() != 98)
+    throw internal_error("TrackerUdp::write_announce(...) ended up with the wrong size");
+}
 
-  m_readBuffer->reset_position();
-  m_readBuffer->set_end(s);
+void
+TrackerUdp::write_scrape(TrackerUdpClient::WriteBuffer* buffer) {
+  buffer->write_range(m_info->hash().begin(), m_info->hash().end());
+}
 
+void
+TrackerUdp::receive_announce(TrackerUdpClient::ReadBuffer* buffer) {
   if (!m_info->signal_tracker_dump().empty())
-    m_info->signal_tracker_dump().emit(m_url, (const char*)m_readBuffer->begin(), s);
-
-  if (s < 4)
-    return;
-
-  // Make sure sa is from the source we expected?
-
-  // Do something with the content here.
-  switch (m_readBuffer->read_32()) {
-  case 0:
-    if (m_action != 0 || !process_connect_output())
-      return;
+    m_info->signal_tracker_dump().emit(m_url, (const char*)buffer->begin(), buffer->size_end());
 
-    prepare_announce_input();
+  if (buffer->remaining() < 12)
+    return receive_failed("Received a truncated announce response.");
 
-    priority_queue_erase(&taskScheduler, &m_taskTimeout);
-    priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(m_info->udp_timeout())).round_seconds());
+  m_busy = false;
+  m_slotSetInterval(buffer->read_32());
 
-    m_tries = m_info->udp_tries();
-    manager->poll()->insert_write(this);
-    return;
-
-  case 1:
-    if (m_action != 1 || !process_announce_output())
-      return;
-
-    return;
+  m_scrapeIncomplete = buffer->read_32();
+  m_scrapeComplete = buffer->read_32();
+  m_scrapeTimeLast = cachedTime;
 
-  case 3:
-    if (!process_error_output())
-      return;
+  AddressList l;
 
-    return;
+  l.assign(reinterpret_cast<const SocketAddressCompact*>(buffer->position()),
+           reinterpret_cast<const SocketAddressCompact*>(buffer->end() - buffer->remaining() % sizeof(SocketAddressCompact)));
 
-  default:
-    return;
-  };
+  m_slotSuccess(this, &l);
 }
 
 void
-TrackerUdp::event_write() {
-  if (m_writeBuffer->size_end() == 0)
-    throw internal_error("TrackerUdp::write() called but the write buffer is empty.");
+TrackerUdp::receive_scrape(TrackerUdpClient::ReadBuffer* buffer) {
+  uint32_t complete   = buffer->read_32();
+  uint32_t downloaded = buffer->read_32();
+  uint32_t incomplete = buffer->read_32();
 
-  int s = write_datagram(m_writeBuffer->begin(), m_writeBuffer->size_end(), &m_connectAddress);
+  set_scrape(complete, downloaded, incomplete);
+}
 
-  // TODO: If send failed, retry shortly or do i call receive_failed?
-  if (s != m_writeBuffer->size_end())
-    ;
+void
+TrackerUdp::receive_failed(const std::string& msg) {
+  m_busy = false;
+  m_connectAddress.clear();
 
-  manager->poll()->remove_write(this);
+  m_slotFailed(this, msg);
 }
 
 void
-TrackerUdp::event_error() {
+TrackerUdp::receive_scrape_failed(const std::string& msg) {
+  m_scrapeBusy = false;
 }
 
 bool
@@ -229,102 +205,17 @@ TrackerUdp::parse_url() {
   if ((err = rak::address_info::get_address_info(hostname, PF_INET, SOCK_STREAM, &ai)) != 0)
     return false;
   
-  if (ai->address()->family() != rak::socket_address::af_inet)
+  if (ai->address()->family() != rak::socket_address::af_inet) {
+    rak::address_info::free_address_info(ai);
     return false;
+  }
 
   m_connectAddress.copy(*ai->address(), ai->length());
   m_connectAddress.set_port(port);
 
-  return m_connectAddress.is_valid();
-}
-
-void
-TrackerUdp::prepare_connect_input() {
-  m_writeBuffer->reset_position();
-  m_writeBuffer->write_64(m_connectionId = magic_connection_id);
-  m_writeBuffer->write_32(m_action = 0);
-  m_writeBuffer->write_32(m_transactionId = random());
-
-  m_writeBuffer->prepare_end();
-}
-
-void
-TrackerUdp::prepare_announce_input() {
-  m_writeBuffer->reset_position();
-
-  m_writeBuffer->write_64(m_connectionId);
-  m_writeBuffer->write_32(m_action = 1);
-  m_writeBuffer->write_32(m_transactionId = random());
-
-  m_writeBuffer->write_range(m_info->hash().begin(), m_info->hash().end());
-  m_writeBuffer->write_range(m_info->local_id().begin(), m_info->local_id().end());
+  rak::address_info::free_address_info(ai);
 
-  m_writeBuffer->write_64(m_sendDown);
-  m_writeBuffer->write_64(m_sendLeft);
-  m_writeBuffer->write_64(m_sendUp);
-  m_writeBuffer->write_32(m_sendState);
-
-  const rak::socket_address* localAddress = rak::socket_address::cast_from(manager->connection_manager()->local_address());
-
-  // This code assumes we're have a inet address.
-  if (localAddress->family() != rak::socket_address::af_inet)
-    throw internal_error("TrackerUdp::prepare_announce_input() m_info->local_address() not of family AF_INET.");
-
-  m_writeBuffer->write_32_n(localAddress->sa_inet()->address_n());
-  m_writeBuffer->write_32(m_info->key());
-  m_writeBuffer->write_32(m_info->numwant());
-  m_writeBuffer->write_16(manager->connection_manager()->listen_port());
-
-  m_writeBuffer->prepare_end();
-
-  if (m_writeBuffer->size_end() != 98)
-    throw internal_error("TrackerUdp::prepare_announce_input() ended up with the wrong size");
-}
-
-bool
-TrackerUdp::process_connect_output() {
-  if (m_readBuffer->size_end() < 16 ||
-      m_readBuffer->read_32() != m_transactionId)
-    return false;
-
-  m_connectionId = m_readBuffer->read_64();
-
-  return true;
-}
-
-bool
-TrackerUdp::process_announce_output() {
-  if (m_readBuffer->size_end() < 20 ||
-      m_readBuffer->read_32() != m_transactionId)
-    return false;
-
-  m_slotSetInterval(m_readBuffer->read_32());
-
-  m_readBuffer->read_32(); // leechers
-  m_readBuffer->read_32(); // seeders
-
-  AddressList l;
-
-  std::copy(reinterpret_cast<const SocketAddressCompact*>(m_readBuffer->position()),
-	    reinterpret_cast<const SocketAddressCompact*>(m_readBuffer->end() - m_readBuffer->remaining() % sizeof(SocketAddressCompact)),
-	    std::back_inserter(l));
-
-  // Some logic here to decided on whetever we're going to close the
-  // connection or not?
-  close();
-  m_slotSuccess(this, &l);
-
-  return true;
-}
-  
-bool
-TrackerUdp::process_error_output() {
-  if (m_readBuffer->size_end() < 8 ||
-      m_readBuffer->read_32() != m_transactionId)
-    return false;
-
-  receive_failed("Received error message: " + std::string(m_readBuffer->position(), m_readBuffer->end()));
-  return true;
+  return m_connectAddress.is_valid();
 }
 
 }
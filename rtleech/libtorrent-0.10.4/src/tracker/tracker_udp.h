@@ -37,21 +37,19 @@
 #ifndef LIBTORRENT_TRACKER_TRACKER_UDP_H
 #define LIBTORRENT_TRACKER_TRACKER_UDP_H
 
-#include "net/protocol_buffer.h"
 #include <rak/socket_address.h>
-#include "net/socket_datagram.h"
+
 #include "globals.h"
 #include "tracker_base.h"
+#include "tracker_udp_client.h"
 
 namespace torrent {
 
-class TrackerUdp : public SocketDatagram, public TrackerBase {
-public:
-  typedef ProtocolBuffer<512> ReadBuffer;
-  typedef ProtocolBuffer<512> WriteBuffer;
-
-  static const uint64_t magic_connection_id = 0x0000041727101980ll;
+// The requests are sent through the TrackerUdpClient shared by all
+// UDP trackers, which calls back when a response arrives.
 
+class TrackerUdp : public TrackerBase {
+public:
   TrackerUdp(DownloadInfo* info, const std::string& url);
   ~TrackerUdp();
   
@@ -66,40 +64,30 @@ public:
 
   virtual Type        type() const;
 
-  virtual void        event_read();
-  virtual void        event_write();
-  virtual void        event_error();
+  void                send_scrape();
 
-private:
-  void                receive_failed(const std::string& msg);
-  void                receive_timeout();
+  // Called by TrackerUdpClient, the buffers are positioned after the
+  // action and transaction id.
+  void                write_announce(TrackerUdpClient::WriteBuffer* buffer);
+  void                write_scrape(TrackerUdpClient::WriteBuffer* buffer);
 
-  bool                parse_url();
+  void                receive_announce(TrackerUdpClient::ReadBuffer* buffer);
+  void                receive_scrape(TrackerUdpClient::ReadBuffer* buffer);
 
-  void                prepare_connect_input();
-  void                prepare_announce_input();
+  void                receive_failed(const std::string& msg);
+  void                receive_scrape_failed(const std::string& msg);
 
-  bool                process_connect_output();
-  bool                process_announce_output();
-  bool                process_error_output();
+private:
+  bool                parse_url();
 
   rak::socket_address m_connectAddress;
 
+  bool                m_busy;
+
   DownloadInfo::State m_sendState;
   uint64_t            m_sendUp;
   uint64_t            m_sendDown;
   uint64_t            m_sendLeft;
-
-  uint32_t            m_action;
-  uint64_t            m_connectionId;
-  uint32_t            m_transactionId;
-
-  ReadBuffer*         m_readBuffer;
-  WriteBuffer*        m_writeBuffer;
-
-  uint32_t            m_tries;
-
-  rak::priority_item  m_taskTimeout;
 };
 
 }
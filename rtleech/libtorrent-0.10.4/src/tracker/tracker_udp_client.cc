@@ -0,0 +1,446 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <rak/error_number.h>
+#include <rak/functional.h>
+
+#include "torrent/exceptions.h"
+#include "torrent/connection_manager.h"
+#include "torrent/poll.h"
+
+#include "tracker_udp.h"
+#include "tracker_udp_client.h"
+#include "manager.h"
+
+namespace torrent {
+
+TrackerUdpClient::TrackerUdpClient() {
+  m_readBuffer.reset();
+  m_writeBuffer.reset();
+
+  m_taskTimeout.set_slot(rak::mem_fn(this, &TrackerUdpClient::receive_timeout));
+}
+
+TrackerUdpClient::~TrackerUdpClient() {
+  priority_queue_erase(&taskScheduler, &m_taskTimeout);
+  close();
+}
+
+bool
+TrackerUdpClient::insert(TrackerUdp* tracker, const rak::socket_address& address, uint32_t action) {
+  if (!is_open() && !open())
+    return false;
+
+  Request request;
+  request.m_tracker = tracker;
+  request.m_address = address;
+  request.m_action = action;
+  request.m_transactionId = 0;
+  request.m_index = 0;
+  request.m_tries = tracker->info()->udp_tries();
+
+  m_requests.push_back(request);
+  manager->poll()->insert_write(this);
+
+  if (!m_taskTimeout.is_queued())
+    priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(1)).round_seconds());
+
+  return true;
+}
+
+void
+TrackerUdpClient::erase(TrackerUdp* tracker, uint32_t action) {
+  // Other requests in the same scrape packet keep their index, so
+  // the response is still read correctly.
+  for (RequestList::iterator itr = m_requests.begin(); itr != m_requests.end(); )
+    if (itr->m_tracker == tracker && itr->m_action == action)
+      itr = m_requests.erase(itr);
+    else
+      itr++;
+}
+
+bool
+TrackerUdpClient::open() {
+  if (!get_fd().open_datagram() ||
+      !get_fd().set_nonblock() ||
+      !get_fd().bind(*rak::socket_address::cast_from(manager->connection_manager()->bind_address()))) {
+
+    if (get_fd().is_valid())
+      get_fd().close();
+
+    get_fd().clear();
+    return false;
+  }
+
+  manager->poll()->open(this);
+  manager->poll()->insert_read(this);
+  manager->poll()->insert_error(this);
+
+  return true;
+}
+
+void
+TrackerUdpClient::close() {
+  if (!is_open())
+    return;
+
+  manager->poll()->remove_read(this);
+  manager->poll()->remove_write(this);
+  manager->poll()->remove_error(this);
+  manager->poll()->close(this);
+
+  get_fd().close();
+  get_fd().clear();
+
+  m_connections.clear();
+}
+
+uint32_t
+TrackerUdpClient::generate_transaction_id() {
+  uint32_t transactionId;
+
+  do {
+    transactionId = random();
+  } while (transactionId == 0);
+
+  return transactionId;
+}
+
+void
+TrackerUdpClient::event_read() {
+  rak::socket_address sa;
+
+  while (true) {
+    int s = read_datagram(m_readBuffer.begin(), m_readBuffer.reserved(), &sa);
+
+    if (s < 0)
+      return;
+
+    if (s < 8)
+      continue;
+
+    m_readBuffer.reset_position();
+    m_readBuffer.set_end(s);
+
+    uint32_t action = m_readBuffer.read_32();
+    uint32_t transactionId = m_readBuffer.read_32();
+
+    switch (action) {
+    case action_connect:
+      process_connect(sa, transactionId);
+      break;
+
+    case action_announce:
+      process_announce(sa, transactionId);
+      break;
+
+    case action_scrape:
+      process_scrape(sa, transactionId);
+      break;
+
+    case action_error:
+      process_error(sa, transactionId);
+      break;
+
+    default:
+      break;
+    }
+  }
+}
+
+void
+TrackerUdpClient::event_write() {
+  for (RequestList::iterator itr = m_requests.begin(); itr != m_requests.end(); ++itr) {
+    if (itr->m_transactionId != 0)
+      continue;
+
+    ConnectionMap::iterator connection = m_connections.find(itr->m_address);
+
+    if (connection == m_connections.end()) {
+      Connection c;
+      c.m_id = 0;
+      c.m_transactionId = 0;
+      c.m_tries = itr->m_tries;
+
+      connection = m_connections.insert(ConnectionMap::value_type(itr->m_address, c)).first;
+    }
+
+    if (connection->second.m_expires > cachedTime) {
+      if (!write_request(itr, &connection->second))
+        return;
+
+    } else if (connection->second.m_transactionId == 0) {
+      if (!write_connect(itr->m_address, &connection->second, itr->m_tracker->info()->udp_timeout()))
+        return;
+    }
+  }
+
+  manager->poll()->remove_write(this);
+}
+
+void
+TrackerUdpClient::event_error() {
+}
+
+bool
+TrackerUdpClient::write_connect(const rak::socket_address& address, Connection* connection, uint32_t timeout) {
+  m_writeBuffer.reset();
+  m_writeBuffer.write_64(magic_connection_id);
+  m_writeBuffer.write_32(action_connect);
+  m_writeBuffer.write_32(connection->m_transactionId = generate_transaction_id());
+
+  if (!write_buffer(address)) {
+    connection->m_transactionId = 0;
+    return false;
+  }
+
+  connection->m_timeout = cachedTime + rak::timer::from_seconds(timeout);
+  return true;
+}
+
+bool
+TrackerUdpClient::write_request(RequestList::iterator itr, Connection* connection) {
+  uint32_t transactionId = generate_transaction_id();
+  rak::socket_address address = itr->m_address;
+
+  m_writeBuffer.reset();
+  m_writeBuffer.write_64(connection->m_id);
+  m_writeBuffer.write_32(itr->m_action);
+  m_writeBuffer.write_32(transactionId);
+
+  if (itr->m_action == action_announce) {
+    itr->m_tracker->write_announce(&m_writeBuffer);
+
+    if (!write_buffer(address))
+      return false;
+
+    itr->m_transactionId = transactionId;
+    itr->m_index = 0;
+    itr->m_timeout = cachedTime + rak::timer::from_seconds(itr->m_tracker->info()->udp_timeout());
+
+    return true;
+  }
+
+  // Scrapes to the same address that are waiting to be sent are
+  // batched into this packet.
+  std::vector<RequestList::iterator> batch;
+
+  for (RequestList::iterator last = itr; last != m_requests.end() && batch.size() < max_scrape_size; ++last)
+    if (last->m_transactionId == 0 && last->m_action == action_scrape && last->m_address == address) {
+      last->m_tracker->write_scrape(&m_writeBuffer);
+      batch.push_back(last);
+    }
+
+  if (!write_buffer(address))
+    return false;
+
+  for (uint32_t index = 0; index != batch.size(); ++index) {
+    batch[index]->m_transactionId = transactionId;
+    batch[index]->m_index = index;
+    batch[index]->m_timeout = cachedTime + rak::timer::from_seconds(batch[index]->m_tracker->info()->udp_timeout());
+  }
+
+  return true;
+}
+
+// Returns false if the socket would block, other errors are left to
+// the request timeout.
+bool
+TrackerUdpClient::write_buffer(const rak::socket_address& address) {
+  m_writeBuffer.prepare_end();
+
+  rak::socket_address sa = address;
+
+  if (write_datagram(m_writeBuffer.begin(), m_writeBuffer.size_end(), &sa) < 0 &&
+      rak::error_number::current().is_blocked_momentary())
+    return false;
+
+  return true;
+}
+
+void
+TrackerUdpClient::process_connect(const rak::socket_address& address, uint32_t transactionId) {
+  ConnectionMap::iterator itr = m_connections.find(address);
+
+  if (itr == m_connections.end() || itr->second.m_transactionId != transactionId || m_readBuffer.remaining() < 8)
+    return;
+
+  itr->second.m_id = m_readBuffer.read_64();
+  itr->second.m_expires = cachedTime + rak::timer::from_seconds(connection_lifetime);
+  itr->second.m_transactionId = 0;
+
+  manager->poll()->insert_write(this);
+}
+
+void
+TrackerUdpClient::process_announce(const rak::socket_address& address, uint32_t transactionId) {
+  RequestList::iterator itr = std::find_if(m_requests.begin(), m_requests.end(), rak::equal(transactionId, rak::mem_ref(&Request::m_transactionId)));
+
+  if (itr == m_requests.end() || itr->m_action != action_announce || !(itr->m_address == address))
+    return;
+
+  // Remove the request before calling the tracker as it might insert
+  // new requests.
+  TrackerUdp* tracker = itr->m_tracker;
+  m_requests.erase(itr);
+
+  tracker->receive_announce(&m_readBuffer);
+}
+
+void
+TrackerUdpClient::process_scrape(const rak::socket_address& address, uint32_t transactionId) {
+  RequestList done;
+
+  for (RequestList::iterator itr = m_requests.begin(); itr != m_requests.end(); )
+    if (itr->m_transactionId == transactionId && itr->m_action == action_scrape && itr->m_address == address)
+      done.splice(done.end(), m_requests, itr++);
+    else
+      itr++;
+
+  for (RequestList::iterator itr = done.begin(); itr != done.end(); ++itr) {
+    if (m_readBuffer.size_end() < 8 + 12 * (itr->m_index + 1)) {
+      itr->m_tracker->receive_scrape_failed("Received a truncated scrape response.");
+      continue;
+    }
+
+    m_readBuffer.set_position_itr(m_readBuffer.begin() + 8 + 12 * itr->m_index);
+    itr->m_tracker->receive_scrape(&m_readBuffer);
+  }
+}
+
+void
+TrackerUdpClient::process_error(const rak::socket_address& address, uint32_t transactionId) {
+  RequestList failed;
+  ConnectionMap::iterator connection = m_connections.find(address);
+
+  // An error in reply to a connect fails everything waiting on it.
+  if (connection != m_connections.end() && connection->second.m_transactionId == transactionId) {
+    for (RequestList::iterator itr = m_requests.begin(); itr != m_requests.end(); )
+      if (itr->m_transactionId == 0 && itr->m_address == address)
+        failed.splice(failed.end(), m_requests, itr++);
+      else
+        itr++;
+
+    m_connections.erase(connection);
+
+  } else {
+    for (RequestList::iterator itr = m_requests.begin(); itr != m_requests.end(); )
+      if (itr->m_transactionId == transactionId && itr->m_address == address)
+        failed.splice(failed.end(), m_requests, itr++);
+      else
+        itr++;
+  }
+
+  receive_failed(&failed, "Received error message: " + std::string(m_readBuffer.position(), m_readBuffer.end()));
+}
+
+void
+TrackerUdpClient::receive_timeout() {
+  RequestList failed;
+
+  for (ConnectionMap::iterator itr = m_connections.begin(); itr != m_connections.end(); ) {
+    if (itr->second.m_transactionId != 0 && itr->second.m_timeout <= cachedTime) {
+
+      if (--itr->second.m_tries == 0) {
+        for (RequestList::iterator request = m_requests.begin(); request != m_requests.end(); )
+          if (request->m_transactionId == 0 && request->m_address == itr->first)
+            failed.splice(failed.end(), m_requests, request++);
+          else
+            request++;
+
+        m_connections.erase(itr++);
+        continue;
+      }
+
+      itr->second.m_transactionId = 0;
+      manager->poll()->insert_write(this);
+
+    } else if (itr->second.m_transactionId == 0 && itr->second.m_expires <= cachedTime) {
+      // Expired connection id's get a new connect when needed.
+      m_connections.erase(itr++);
+      continue;
+    }
+
+    itr++;
+  }
+
+  for (RequestList::iterator itr = m_requests.begin(); itr != m_requests.end(); ) {
+    if (itr->m_transactionId == 0 || itr->m_timeout > cachedTime) {
+      itr++;
+      continue;
+    }
+
+    if (--itr->m_tries == 0) {
+      failed.splice(failed.end(), m_requests, itr++);
+      continue;
+    }
+
+    // The tracker might have forgotten our connection id, so get a
+    // new one unless a connect is already in progress.
+    ConnectionMap::iterator connection = m_connections.find(itr->m_address);
+
+    if (connection != m_connections.end() && connection->second.m_transactionId == 0)
+      m_connections.erase(connection);
+
+    itr->m_transactionId = 0;
+    manager->poll()->insert_write(this);
+
+    itr++;
+  }
+
+  if (!m_requests.empty() || !m_connections.empty())
+    priority_queue_insert(&taskScheduler, &m_taskTimeout, (cachedTime + rak::timer::from_seconds(1)).round_seconds());
+  else
+    close();
+
+  receive_failed(&failed, "Unable to connect to UDP tracker.");
+}
+
+void
+TrackerUdpClient::receive_failed(RequestList* failed, const std::string& msg) {
+  for (RequestList::iterator itr = failed->begin(); itr != failed->end(); ++itr)
+    if (itr->m_action == action_scrape)
+      itr->m_tracker->receive_scrape_failed(msg);
+    else
+      itr->m_tracker->receive_failed(msg);
+}
+
+}
@@ -0,0 +1,146 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#ifndef LIBTORRENT_TRACKER_TRACKER_UDP_CLIENT_H
+#define LIBTORRENT_TRACKER_TRACKER_UDP_CLIENT_H
+
+#include <list>
+#include <map>
+#include <rak/priority_queue_default.h>
+#include <rak/socket_address.h>
+
+#include "net/protocol_buffer.h"
+#include "net/socket_datagram.h"
+
+namespace torrent {
+
+class TrackerUdp;
+
+// A single UDP socket shared by all UDP trackers. Requests are
+// matched to responses by their transaction id, and the connection
+// id's are kept per tracker address for the minute they are valid.
+//
+// Scrape requests queued for the same tracker address are sent in
+// one packet, up to 'max_scrape_size' info hashes.
+
+class TrackerUdpClient : public SocketDatagram {
+public:
+  typedef ProtocolBuffer<2048> ReadBuffer;
+  typedef ProtocolBuffer<1500> WriteBuffer;
+
+  static const uint64_t magic_connection_id = 0x0000041727101980ll;
+
+  static const uint32_t action_connect      = 0;
+  static const uint32_t action_announce     = 1;
+  static const uint32_t action_scrape       = 2;
+  static const uint32_t action_error        = 3;
+
+  static const uint32_t connection_lifetime = 60;
+  static const uint32_t max_scrape_size     = 74;
+
+  TrackerUdpClient();
+  ~TrackerUdpClient();
+
+  bool                is_open() const                        { return get_fd().is_valid(); }
+
+  uint32_t            size_requests() const                  { return m_requests.size(); }
+  uint32_t            size_connections() const               { return m_connections.size(); }
+
+  // Returns false if the socket could not be opened.
+  bool                insert(TrackerUdp* tracker, const rak::socket_address& address, uint32_t action);
+  void                erase(TrackerUdp* tracker, uint32_t action);
+
+  virtual void        event_read();
+  virtual void        event_write();
+  virtual void        event_error();
+
+private:
+  TrackerUdpClient(const TrackerUdpClient&);
+  void operator = (const TrackerUdpClient&);
+
+  // A zero transaction id means the request has not been sent.
+  struct Request {
+    TrackerUdp*         m_tracker;
+    rak::socket_address m_address;
+    uint32_t            m_action;
+
+    uint32_t            m_transactionId;
+    uint32_t            m_index;
+    uint32_t            m_tries;
+    rak::timer          m_timeout;
+  };
+
+  struct Connection {
+    uint64_t            m_id;
+    rak::timer          m_expires;
+
+    uint32_t            m_transactionId;
+    uint32_t            m_tries;
+    rak::timer          m_timeout;
+  };
+
+  typedef std::list<Request>                             RequestList;
+  typedef std::map<rak::socket_address, Connection>      ConnectionMap;
+
+  bool                open();
+  void                close();
+
+  uint32_t            generate_transaction_id();
+
+  bool                write_connect(const rak::socket_address& address, Connection* connection, uint32_t timeout);
+  bool                write_request(RequestList::iterator itr, Connection* connection);
+  bool                write_buffer(const rak::socket_address& address);
+
+  void                process_connect(const rak::socket_address& address, uint32_t transactionId);
+  void                process_announce(const rak::socket_address& address, uint32_t transactionId);
+  void                process_scrape(const rak::socket_address& address, uint32_t transactionId);
+  void                process_error(const rak::socket_address& address, uint32_t transactionId);
+
+  void                receive_timeout();
+  void                receive_failed(RequestList* failed, const std::string& msg);
+
+  RequestList         m_requests;
+  ConnectionMap       m_connections;
+
+  ReadBuffer          m_readBuffer;
+  WriteBuffer         m_writeBuffer;
+
+  rak::priority_item  m_taskTimeout;
+};
+
+}
+
+#endif
@@ -0,0 +1,249 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#include "config.h"
+
+#include <cstring>
+
+#include "diffie_hellman.h"
+#include "random.h"
+
+namespace torrent {
+
+static const unsigned int dh_limbs = DiffieHellman::key_size / 4;
+
+static const uint8_t dh_prime[DiffieHellman::key_size] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xC9, 0x0F, 0xDA, 0xA2,
+  0x21, 0x68, 0xC2, 0x34, 0xC4, 0xC6, 0x62, 0x8B, 0x80, 0xDC, 0x1C, 0xD1,
+  0x29, 0x02, 0x4E, 0x08, 0x8A, 0x67, 0xCC, 0x74, 0x02, 0x0B, 0xBE, 0xA6,
+  0x3B, 0x13, 0x9B, 0x22, 0x51, 0x4A, 0x08, 0x79, 0x8E, 0x34, 0x04, 0xDD,
+  0xEF, 0x95, 0x19, 0xB3, 0xCD, 0x3A, 0x43, 0x1B, 0x30, 0x2B, 0x0A, 0x6D,
+  0xF2, 0x5F, 0x14, 0x37, 0x4F, 0xE1, 0x35, 0x6D, 0x6D, 0x51, 0xC2, 0x45,
+  0xE4, 0x85, 0xB5, 0x76, 0x62, 0x5E, 0x7E, 0xC6, 0xF4, 0x4C, 0x42, 0xE9,
+  0xA6, 0x3A, 0x36, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09, 0x05, 0x63
+};
+
+// Numbers are stored as little-endian arrays of 32 bit limbs.
+
+static void
+dh_from_bytes(uint32_t* n, const uint8_t* bytes) {
+  for (unsigned int i = 0; i < dh_limbs; ++i) {
+    const uint8_t* b = bytes + (dh_limbs - 1 - i) * 4;
+
+    n[i] = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+  }
+}
+
+static void
+dh_to_bytes(uint8_t* bytes, const uint32_t* n) {
+  for (unsigned int i = 0; i < dh_limbs; ++i) {
+    uint8_t* b = bytes + (dh_limbs - 1 - i) * 4;
+
+    b[0] = n[i] >> 24;
+    b[1] = n[i] >> 16;
+    b[2] = n[i] >> 8;
+    b[3] = n[i];
+  }
+}
+
+static int
+dh_compare(const uint32_t* a, const uint32_t* b) {
+  for (unsigned int i = dh_limbs; i != 0; --i)
+    if (a[i - 1] != b[i - 1])
+      return a[i - 1] < b[i - 1] ? -1 : 1;
+
+  return 0;
+}
+
+static void
+dh_subtract(uint32_t* a, const uint32_t* b) {
+  uint64_t borrow = 0;
+
+  for (unsigned int i = 0; i < dh_limbs; ++i) {
+    uint64_t d = (uint64_t)a[i] - b[i] - borrow;
+
+    a[i] = d;
+    borrow = (d >> 32) & 1;
+  }
+}
+
+// The modulus along with the constants needed for Montgomery
+// multiplication, R = 2^768.
+struct DiffieHellmanModulus {
+  DiffieHellmanModulus();
+
+  uint32_t            m_n[dh_limbs];
+  uint32_t            m_r2[dh_limbs];
+  uint32_t            m_n0inv;
+};
+
+DiffieHellmanModulus::DiffieHellmanModulus() {
+  dh_from_bytes(m_n, dh_prime);
+
+  // -n^-1 mod 2^32 through Newton iteration.
+  uint32_t inv = 1;
+
+  for (int i = 0; i < 5; ++i)
+    inv *= 2 - m_n[0] * inv;
+
+  m_n0inv = -inv;
+
+  // R^2 mod n by repeated doubling of 1.
+  std::memset(m_r2, 0, sizeof(m_r2));
+  m_r2[0] = 1;
+
+  for (unsigned int bit = 0; bit < 2 * 32 * dh_limbs; ++bit) {
+    uint32_t carry = 0;
+
+    for (unsigned int i = 0; i < dh_limbs; ++i) {
+      uint32_t next = m_r2[i] >> 31;
+
+      m_r2[i] = (m_r2[i] << 1) | carry;
+      carry = next;
+    }
+
+    if (carry || dh_compare(m_r2, m_n) >= 0)
+      dh_subtract(m_r2, m_n);
+  }
+}
+
+// r = a * b * R^-1 mod n. 'r' may alias 'a' or 'b'.
+static void
+dh_mont_mul(const DiffieHellmanModulus& m, uint32_t* r, const uint32_t* a, const uint32_t* b) {
+  uint32_t t[dh_limbs + 2];
+  std::memset(t, 0, sizeof(t));
+
+  for (unsigned int i = 0; i < dh_limbs; ++i) {
+    uint64_t c = 0;
+
+    for (unsigned int j = 0; j < dh_limbs; ++j) {
+      c += t[j] + (uint64_t)a[j] * b[i];
+      t[j] = c;
+      c >>= 32;
+    }
+
+    c += t[dh_limbs];
+    t[dh_limbs] = c;
+    t[dh_limbs + 1] = c >> 32;
+
+    uint32_t q = t[0] * m.m_n0inv;
+    c = (t[0] + (uint64_t)q * m.m_n[0]) >> 32;
+
+    for (unsigned int j = 1; j < dh_limbs; ++j) {
+      c += t[j] + (uint64_t)q * m.m_n[j];
+      t[j - 1] = c;
+      c >>= 32;
+    }
+
+    c += t[dh_limbs];
+    t[dh_limbs - 1] = c;
+    t[dh_limbs] = t[dh_limbs + 1] + (c >> 32);
+  }
+
+  if (t[dh_limbs] != 0 || dh_compare(t, m.m_n) >= 0)
+    dh_subtract(t, m.m_n);
+
+  std::memcpy(r, t, sizeof(uint32_t) * dh_limbs);
+}
+
+// r = base ^ exponent mod n, with the exponent 'length' limbs long.
+static void
+dh_mod_exp(const DiffieHellmanModulus& m, uint32_t* r, const uint32_t* base, const uint32_t* exponent, unsigned int length) {
+  uint32_t one[dh_limbs];
+  uint32_t x[dh_limbs];
+  uint32_t acc[dh_limbs];
+
+  std::memset(one, 0, sizeof(one));
+  one[0] = 1;
+
+  dh_mont_mul(m, x, base, m.m_r2);
+  dh_mont_mul(m, acc, one, m.m_r2);
+
+  for (unsigned int i = length; i != 0; --i)
+    for (int bit = 31; bit >= 0; --bit) {
+      dh_mont_mul(m, acc, acc, acc);
+
+      if ((exponent[i - 1] >> bit) & 1)
+        dh_mont_mul(m, acc, acc, x);
+    }
+
+  dh_mont_mul(m, r, acc, one);
+}
+
+static const DiffieHellmanModulus&
+dh_modulus() {
+  static DiffieHellmanModulus modulus;
+
+  return modulus;
+}
+
+DiffieHellman::DiffieHellman() {
+  random_bytes(m_privateKey, private_size);
+
+  uint32_t generator[dh_limbs];
+  uint32_t publicKey[dh_limbs];
+
+  std::memset(generator, 0, sizeof(generator));
+  generator[0] = 2;
+
+  dh_mod_exp(dh_modulus(), publicKey, generator, m_privateKey, private_size / 4);
+  dh_to_bytes((uint8_t*)m_publicKey, publicKey);
+}
+
+bool
+DiffieHellman::compute_secret(const char* key, char* secret) const {
+  uint32_t y[dh_limbs];
+  uint32_t s[dh_limbs];
+
+  dh_from_bytes(y, (const uint8_t*)key);
+
+  // Reject 0, 1 and anything not below the prime.
+  bool small = true;
+
+  for (unsigned int i = 1; i < dh_limbs; ++i)
+    small = small && y[i] == 0;
+
+  if ((small && y[0] <= 1) || dh_compare(y, dh_modulus().m_n) >= 0)
+    return false;
+
+  dh_mod_exp(dh_modulus(), s, y, m_privateKey, private_size / 4);
+  dh_to_bytes((uint8_t*)secret, s);
+
+  return true;
+}
+
+}
@@ -0,0 +1,74 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#ifndef LIBTORRENT_UTILS_DIFFIE_HELLMAN_H
+#define LIBTORRENT_UTILS_DIFFIE_HELLMAN_H
+
+#include <inttypes.h>
+
+namespace torrent {
+
+// The 768 bit Diffie-Hellman key exchange used by the peer protocol
+// encryption, with the fixed prime P and generator 2. Keys are
+// written and read as 96 byte big-endian numbers.
+//
+// The modular exponentiation is done in Montgomery form on 32 bit
+// limbs, so there's no need for a bignum library dependency just for
+// this.
+
+class DiffieHellman {
+public:
+  static const unsigned int key_size     = 96;
+  static const unsigned int private_size = 20;
+
+  // Generates a new random private key and the matching public key.
+  DiffieHellman();
+
+  const char*         public_key() const                          { return m_publicKey; }
+
+  // Returns false if 'key' is not a valid public key. The shared
+  // secret 'S' is written to 'secret', 'key_size' bytes.
+  bool                compute_secret(const char* key, char* secret) const;
+
+private:
+  char                m_publicKey[key_size];
+  uint32_t            m_privateKey[private_size / 4];
+};
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+#include "config.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "torrent/exceptions.h"
+
+#include "random.h"
+
+namespace torrent {
+
+// Kept open, a new key is generated for every encrypted handshake.
+static int random_fd = -1;
+
+void
+random_bytes(void* buffer, uint32_t length) {
+  if (random_fd == -1 && (random_fd = ::open("/dev/urandom", O_RDONLY)) == -1)
+    throw internal_error("random_bytes(...) could not open /dev/urandom.");
+
+  char* first = static_cast<char*>(buffer);
+
+  while (length != 0) {
+    ssize_t r = ::read(random_fd, first, length);
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r <= 0)
+      throw internal_error("random_bytes(...) could not read /dev/urandom.");
+
+    first += r;
+    length -= r;
+  }
+}
+
+}
@@ -0,0 +1,132 @@
+// libTorrent - BitTorrent library
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#ifndef LIBTORRENT_UTILS_RC4_H
+#define LIBTORRENT_UTILS_RC4_H
+
+#include <inttypes.h>
+
+namespace torrent {
+
+// RC4 stream cipher as used by the peer protocol encryption. The key
+// schedule is only run once per connection, so all the effort goes
+// into 'crypt', which keeps the state indices in registers and works
+// directly on the caller's buffer.
+//
+// RC4 is inherently sequential; the keystream byte at 'n' depends on
+// the swaps done for all previous bytes, so there is nothing to gain
+// from wider loads beyond avoiding the extra pass a separate
+// keystream buffer would need.
+
+class RC4 {
+public:
+  RC4() : m_i(0), m_j(0) {}
+
+  void                set_key(const void* key, uint32_t length);
+
+  // Discard the first 'length' bytes of the keystream.
+  void                discard(uint32_t length);
+
+  void                crypt(void* buffer, uint32_t length)                  { crypt(buffer, buffer, length); }
+  inline void         crypt(const void* src, void* dest, uint32_t length);
+
+private:
+  uint8_t             m_state[256];
+  uint8_t             m_i;
+  uint8_t             m_j;
+};
+
+inline void
+RC4::set_key(const void* key, uint32_t length) {
+  const uint8_t* k = static_cast<const uint8_t*>(key);
+
+  for (unsigned int i = 0; i < 256; ++i)
+    m_state[i] = i;
+
+  uint8_t j = 0;
+
+  for (unsigned int i = 0; i < 256; ++i) {
+    j += m_state[i] + k[i % length];
+
+    uint8_t t = m_state[i];
+    m_state[i] = m_state[j];
+    m_state[j] = t;
+  }
+
+  m_i = m_j = 0;
+}
+
+inline void
+RC4::discard(uint32_t length) {
+  uint8_t buffer[256] = { 0 };
+
+  while (length != 0) {
+    uint32_t l = length < sizeof(buffer) ? length : sizeof(buffer);
+
+    crypt(buffer, l);
+    length -= l;
+  }
+}
+
+inline void
+RC4::crypt(const void* src, void* dest, uint32_t length) {
+  const uint8_t* first = static_cast<const uint8_t*>(src);
+  const uint8_t* last  = first + length;
+  uint8_t* out         = static_cast<uint8_t*>(dest);
+
+  uint8_t* s = m_state;
+  uint8_t i = m_i;
+  uint8_t j = m_j;
+
+  while (first != last) {
+    uint8_t si = s[++i];
+    j += si;
+
+    uint8_t sj = s[j];
+    s[i] = sj;
+    s[j] = si;
+
+    *out++ = *first++ ^ s[(uint8_t)(si + sj)];
+  }
+
+  m_i = i;
+  m_j = j;
+}
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+// rak - Rakshasa's toolbox
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+// An open addressing index of positions into a random access
+// container, for containers that should stay contiguous for cheap
+// iteration and random picks. 'Traits' provides static hash(...)
+// and equal(value, key) functions for the value and key types.
+//
+// Slots hold the position + 1, with zero marking an empty slot. The
+// index is kept at most half full and erase shifts the following
+// entries back, so no tombstones are needed.
+
+#ifndef RAK_HASH_INDEX_H
+#define RAK_HASH_INDEX_H
+
+#include <vector>
+#include <inttypes.h>
+
+namespace rak {
+
+template <typename Container, typename Traits>
+class hash_index {
+public:
+  typedef uint32_t                       size_type;
+  typedef typename Container::value_type value_type;
+
+  static const size_type npos = ~size_type();
+
+  explicit hash_index(const Container* c) : m_container(c) {}
+
+  void                clear()                                 { m_index.clear(); }
+
+  // Position of the element matching 'key', or npos.
+  template <typename Key>
+  size_type           find(const Key& key) const              { return m_index.empty() ? npos : m_index[find_slot(key)] - 1; }
+
+  // Call after appending the element to the container.
+  void                insert_back();
+
+  // Call before removing the element at 'pos' from the container
+  // with a swap-and-pop.
+  void                erase_position(size_type pos);
+
+  // Rebuild the index if it would become more than half full with
+  // 's' elements.
+  void                reserve(size_type s);
+
+private:
+  template <typename Key>
+  size_type           find_slot(const Key& key) const;
+
+  size_type           slot_of(size_type pos) const;
+
+  const Container*       m_container;
+  std::vector<size_type> m_index;
+};
+
+template <typename Container, typename Traits>
+template <typename Key>
+inline typename hash_index<Container, Traits>::size_type
+hash_index<Container, Traits>::find_slot(const Key& key) const {
+  size_type mask = m_index.size() - 1;
+
+  for (size_type idx = Traits::hash(key) & mask; ; idx = (idx + 1) & mask)
+    if (m_index[idx] == 0 || Traits::equal((*m_container)[m_index[idx] - 1], key))
+      return idx;
+}
+
+template <typename Container, typename Traits>
+inline typename hash_index<Container, Traits>::size_type
+hash_index<Container, Traits>::slot_of(size_type pos) const {
+  size_type mask = m_index.size() - 1;
+  size_type idx  = Traits::hash((*m_container)[pos]) & mask;
+
+  while (m_index[idx] != pos + 1)
+    idx = (idx + 1) & mask;
+
+  return idx;
+}
+
+template <typename Container, typename Traits>
+inline void
+hash_index<Container, Traits>::insert_back() {
+  reserve(m_container->size());
+
+  size_type pos  = m_container->size() - 1;
+  size_type mask = m_index.size() - 1;
+  size_type idx  = Traits::hash((*m_container)[pos]) & mask;
+
+  while (m_index[idx] != 0 && m_index[idx] != pos + 1)
+    idx = (idx + 1) & mask;
+
+  m_index[idx] = pos + 1;
+}
+
+template <typename Container, typename Traits>
+void
+hash_index<Container, Traits>::erase_position(size_type pos) {
+  size_type mask = m_index.size() - 1;
+  size_type idx  = slot_of(pos);
+
+  for (size_type next = (idx + 1) & mask; m_index[next] != 0; next = (next + 1) & mask) {
+    size_type home = Traits::hash((*m_container)[m_index[next] - 1]) & mask;
+
+    // Move the entry unless its home lies cyclically in (idx, next].
+    if (idx <= next ? (home <= idx || home > next) : (home <= idx && home > next)) {
+      m_index[idx] = m_index[next];
+      idx = next;
+    }
+  }
+
+  m_index[idx] = 0;
+
+  // The element at the back takes over the erased position.
+  if (pos != m_container->size() - 1)
+    m_index[slot_of(m_container->size() - 1)] = pos + 1;
+}
+
+template <typename Container, typename Traits>
+void
+hash_index<Container, Traits>::reserve(size_type s) {
+  if (!m_index.empty() && s * 2 <= m_index.size())
+    return;
+
+  size_type capacity = 64;
+
+  while (capacity < s * 2)
+    capacity *= 2;
+
+  m_index.assign(capacity, 0);
+
+  for (size_type pos = 0; pos != m_container->size(); ++pos) {
+    size_type idx = Traits::hash((*m_container)[pos]) & (capacity - 1);
+
+    while (m_index[idx] != 0)
+      idx = (idx + 1) & (capacity - 1);
+
+    m_index[idx] = pos + 1;
+  }
+}
+
+}
+
+#endif
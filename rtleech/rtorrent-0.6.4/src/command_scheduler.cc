@@ -90,6 +90,13 @@ CommandScheduler::call_item(value_type item) {
   if (std::find(begin(), end(), item) == end())
     throw torrent::client_error("CommandScheduler::call_item(...) called but the item isn't in the scheduler.");
 
+  // Remember the key rather than the item as it might be replaced or
+  // erased before release() is called.
+  if (m_held) {
+    m_deferred.push_back(item->key());
+    return;
+  }
+
   // Remove the item before calling the command if it should be
   // removed.
 
@@ -115,6 +122,20 @@ CommandScheduler::call_item(value_type item) {
   item->enable(next);
 }
 
+void
+CommandScheduler::release() {
+  m_held = false;
+
+  for (std::vector<std::string>::iterator itr = m_deferred.begin(), last = m_deferred.end(); itr != last; ++itr) {
+    iterator item = find(*itr);
+
+    if (item != end() && !(*item)->is_queued())
+      (*item)->enable(cachedTime);
+  }
+
+  m_deferred.clear();
+}
+
 void
 CommandScheduler::parse(const std::string& arg) {
   char key[21];
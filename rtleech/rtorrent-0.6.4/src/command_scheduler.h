@@ -54,7 +54,7 @@ public:
   using base_type::begin;
   using base_type::end;
 
-  CommandScheduler() {}
+  CommandScheduler() : m_held(false) {}
   ~CommandScheduler();
 
   void                set_slot_command(SlotString::base_type* s)       { m_slotCommand.set(s); }
@@ -72,6 +72,13 @@ public:
 
   void                parse(const std::string& arg);
 
+  // While held, items that are due are not called. They are called
+  // once released, e.g. so watch directories aren't scanned before
+  // the session torrents are loaded.
+  bool                is_held() const                                  { return m_held; }
+  void                hold()                                           { m_held = true; }
+  void                release();
+
   static uint32_t     parse_absolute(const char* str);
   static uint32_t     parse_interval(const char* str);
 
@@ -82,6 +89,9 @@ private:
 
   SlotString          m_slotCommand;
   SlotString          m_slotErrorMessage;
+
+  bool                m_held;
+  std::vector<std::string> m_deferred;
 };
 
 #endif
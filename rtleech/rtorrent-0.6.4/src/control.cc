@@ -114,7 +114,10 @@ Control::initialize() {
 
   m_core->initialize_second();
   m_core->listen_open();
+  m_core->utp_open();
+  m_core->download_store()->set_journal(m_variables->get_value("session_journal"));
   m_core->download_store()->enable(m_variables->get_value("session_lock"));
+  m_core->dht_open();
 
   m_core->set_hashing_view(*m_viewManager->find_throw("hashing"));
   m_scheduler->set_view(*m_viewManager->find_throw("scheduler"));
@@ -36,6 +36,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <sigc++/bind.h>
 #include <sigc++/hide.h>
@@ -62,6 +63,8 @@ Download::Download(download_type d) :
 
   m_chunksFailed(0) {
 
+  std::fill(m_sessionChecksum, m_sessionChecksum + session_records, 0);
+
   m_connTrackerSucceded = m_download.signal_tracker_succeded(sigc::bind(sigc::mem_fun(*this, &Download::receive_tracker_msg), ""));
   m_connTrackerFailed   = m_download.signal_tracker_failed(sigc::mem_fun(*this, &Download::receive_tracker_msg));
   m_connStorageError    = m_download.signal_storage_error(sigc::mem_fun(*this, &Download::receive_storage_error));
@@ -106,6 +109,7 @@ Download::Download(download_type d) :
   m_variables.insert("priority",           new utils::VariableValueSlot(rak::mem_fn(this, &Download::priority), rak::mem_fn(this, &Download::set_priority)));
 
   m_variables.insert("tracker_numwant",    new utils::VariableValueSlot(rak::mem_fn(&m_trackerList, &tracker_list_type::numwant), rak::mem_fn(&m_trackerList, &tracker_list_type::set_numwant)));
+  m_variables.insert("tracker_fanout",     new utils::VariableValueSlot(rak::mem_fn(&m_trackerList, &tracker_list_type::fanout), rak::mem_fn(&m_trackerList, &tracker_list_type::set_fanout)));
 
   m_variables.insert("ignore_commands",    new utils::VariableObject(bencode(), "rtorrent", "ignore_commands", torrent::Object::TYPE_VALUE));
 }
@@ -61,6 +61,12 @@ public:
   static const int variable_hashing_last    = 2;
   static const int variable_hashing_rehash  = 3;
 
+  // The session files of a download, see DownloadStore.
+  static const unsigned int session_torrent  = 0;
+  static const unsigned int session_rtorrent = 1;
+  static const unsigned int session_resume   = 2;
+  static const unsigned int session_records  = 3;
+
   Download(download_type d);
   ~Download();
 
@@ -95,6 +101,11 @@ public:
 
   uint32_t            chunks_failed() const                    { return m_chunksFailed; }
 
+  // Checksum of the session file as last written or loaded, zero if
+  // it needs to be written.
+  uint64_t            session_checksum(unsigned int r) const          { return m_sessionChecksum[r]; }
+  void                set_session_checksum(unsigned int r, uint64_t c) { m_sessionChecksum[r] = c; }
+
   void                enable_udp_trackers(bool state);
 
   uint32_t            priority();
@@ -144,6 +155,8 @@ private:
   std::string         m_message;
   uint32_t            m_chunksFailed;
 
+  uint64_t            m_sessionChecksum[session_records];
+
   variable_map_type   m_variables;
 
   sigc::connection    m_connTrackerSucceded;
@@ -112,6 +112,18 @@ DownloadFactory::receive_load() {
 
     m_variables.set("tied_to_file", (int64_t)false);
 
+  } else if (m_session && m_manager->download_store()->is_journal()) {
+    std::string data;
+    m_stream = new std::stringstream;
+
+    if (m_manager->download_store()->load_torrent(m_uri, &data)) {
+      m_stream->write(data.c_str(), data.size());
+      receive_loaded();
+
+    } else {
+      receive_failed("Could not read session journal");
+    }
+
   } else {
     std::fstream* stream = new std::fstream(rak::path_expand(m_uri).c_str(), std::ios::in | std::ios::binary);
     m_stream = stream;
@@ -155,6 +167,9 @@ DownloadFactory::receive_success() {
 
   torrent::Object* root = download->bencode();
 
+  if (m_session)
+    m_manager->download_store()->load_records(download);
+
   if (!m_session) {
     // We only allow session torrents to keep their
     // 'rtorrent/libtorrent' sections.
@@ -177,6 +192,7 @@ DownloadFactory::receive_success() {
   download->variable()->set("min_peers",        control->variable()->get("min_peers"));
   download->variable()->set("max_peers",        control->variable()->get("max_peers"));
   download->variable()->set("tracker_numwant",  control->variable()->get("tracker_numwant"));
+  download->variable()->set("tracker_fanout",   control->variable()->get("tracker_fanout"));
 
   if (download->variable()->get_value("complete") != 0) {
     if (control->variable()->get_value("min_peers_seed") >= 0)
@@ -189,6 +205,10 @@ DownloadFactory::receive_success() {
   if (!control->variable()->get_value("use_udp_trackers"))
     download->enable_udp_trackers(false);
 
+  // Setting variables may have inserted keys in 'root', which
+  // invalidates references to its entries.
+  rtorrent = &root->get_key("rtorrent");
+
   if (!rtorrent->has_key_string("directory"))
     download->variable()->set("directory", m_variables.get("directory"));
   else
@@ -223,6 +243,8 @@ DownloadFactory::receive_success() {
     if (download->variable()->get_value("hashing") != Download::variable_hashing_stopped ||
         download->variable()->get_value("state") != 0)
       m_manager->download_list()->resume(download);
+    else
+      m_manager->download_store()->release_piece_hashes(download);
 
   } else {
     // Use the state thingie here, move below.
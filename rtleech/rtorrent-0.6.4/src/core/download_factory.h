@@ -67,6 +67,10 @@ public:
   void                load();
   void                commit();
 
+  // Load and commit right away, for local files only. The factory
+  // may have been deleted by the finished slot when this returns.
+  void                load_now()            { receive_commit(); receive_load(); }
+
   utils::VariableMap* variable()            { return &m_variables; }
 
   bool                get_session() const   { return m_session; }
@@ -38,6 +38,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <sstream>
 #include <sigc++/bind.h>
 #include <torrent/exceptions.h>
 #include <torrent/object.h>
@@ -59,7 +60,9 @@ namespace core {
 inline void
 DownloadList::check_contains(Download* d) {
 #ifdef USE_EXTRA_DEBUG
-  if (std::find(begin(), end(), d) == end())
+  iterator itr = find(d->download()->info_hash());
+
+  if (itr == end() || *itr != d)
     throw torrent::client_error("DownloadList::check_contains(...) failed.");
 #endif
 }
@@ -80,6 +83,8 @@ DownloadList::clear() {
   std::for_each(begin(), end(), rak::call_delete<Download>());
 
   base_type::clear();
+  m_indexList.clear();
+  m_hashIndex.clear();
 }
 
 void
@@ -93,10 +98,15 @@ DownloadList::create(std::istream* str, bool printLog) {
   torrent::Download download;
 
   try {
-    *str >> *object;
-    
+    // Read the whole torrent in one go and parse it from the buffer,
+    // much faster than going through the stream for large torrents.
+    std::ostringstream buffer;
+    buffer << str->rdbuf();
+
+    std::string data = buffer.str();
+
     // Catch, delete.
-    if (str->fail())
+    if (torrent::object_read_bencode_c(data.c_str(), data.c_str() + data.size(), object) == NULL)
       throw torrent::input_error("Could not create download, the input is not a valid torrent.");
 
     download = torrent::download_add(object);
@@ -115,10 +125,47 @@ DownloadList::create(std::istream* str, bool printLog) {
   return new Download(download);
 }
 
+// The info hashes are SHA1 digests, so the first bytes are already
+// uniformly distributed.
+uint32_t
+DownloadList::hash_traits::hash(const std::string& hash) {
+  uint32_t h = 0;
+
+  for (std::string::const_iterator itr = hash.begin(), last = hash.begin() + std::min<std::string::size_type>(hash.size(), 4); itr != last; ++itr)
+    h = (h << 8) + (unsigned char)*itr;
+
+  return h;
+}
+
+uint32_t
+DownloadList::hash_traits::hash(const iterator& itr) {
+  return hash((*itr)->download()->info_hash());
+}
+
+bool
+DownloadList::hash_traits::equal(const iterator& itr, const std::string& hash) {
+  return (*itr)->download()->info_hash() == hash;
+}
+
+DownloadList::iterator
+DownloadList::find(const std::string& hash) {
+  hash_index_type::size_type pos = m_hashIndex.find(hash);
+
+  return pos != hash_index_type::npos ? m_indexList[pos] : end();
+}
+
 DownloadList::iterator
 DownloadList::insert(Download* download) {
+  // Checked before touching the list so a duplicate leaves it as it
+  // was.
+  if (m_hashIndex.find(download->download()->info_hash()) != hash_index_type::npos)
+    throw torrent::client_error("DownloadList::insert(...) download already in the list.");
+
   iterator itr = base_type::insert(end(), download);
 
+  m_indexList.push_back(itr);
+  m_hashIndex.insert_back();
+
   try {
     (*itr)->download()->signal_download_done(sigc::bind(sigc::mem_fun(*this, &DownloadList::received_finished), download));
     (*itr)->download()->signal_hash_done(sigc::bind(sigc::mem_fun(*this, &DownloadList::hash_done), download));
@@ -138,7 +185,7 @@ void
 DownloadList::erase(Download* download) {
   check_contains(download);
 
-  erase(std::find(begin(), end(), download));
+  erase(find(download->download()->info_hash()));
 }
 
 DownloadList::iterator
@@ -155,6 +202,12 @@ DownloadList::erase(iterator itr) {
 
   std::for_each(slot_map_erase().begin(), slot_map_erase().end(), download_list_call(*itr));
 
+  hash_index_type::size_type pos = m_hashIndex.find((*itr)->download()->info_hash());
+
+  m_hashIndex.erase_position(pos);
+  m_indexList[pos] = m_indexList.back();
+  m_indexList.pop_back();
+
   torrent::download_remove(*(*itr)->download());
   delete *itr;
 
@@ -181,6 +234,9 @@ DownloadList::open_throw(Download* download) {
 
   if (download->download()->is_open())
     return;
+
+  if (!download->download()->has_piece_hashes() && !control->core()->download_store()->load_piece_hashes(download))
+    throw torrent::input_error("Could not load the piece hashes from the session torrent.");
   
   download->download()->open();
 
@@ -221,6 +277,7 @@ DownloadList::close_throw(Download* download) {
   //control->core()->download_store()->save(download);
 
   download->download()->close();
+  control->core()->download_store()->release_piece_hashes(download);
 
   if (!download->is_hash_failed() && download->variable()->get_value("hashing") != Download::variable_hashing_stopped)
     throw torrent::client_error("DownloadList::close_throw(...) called but we're going into a hashing loop.");
@@ -317,10 +374,9 @@ DownloadList::resume(Download* download) {
     } else {
       download->set_connection_type(download->variable()->get_string("connection_leech"));
 
-      // For the moment, clear the resume data so we force hash-check
-      // on non-complete downloads after a crash. This shouldn't be
-      // needed, but for some reason linux 2.6 is very lazy about
-      // updating mtime.
+      // Don't trust the mtime of incomplete files after a crash, as
+      // they are written to while active. Samples of their completed
+      // chunks are checked instead.
       torrent::resume_save_progress(*download->download(), download->download()->bencode()->get_key("libtorrent_resume"), true);
     }
 
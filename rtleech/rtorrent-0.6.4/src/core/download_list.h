@@ -41,7 +41,10 @@
 #include <list>
 #include <map>
 #include <string>
+#include <vector>
+#include <inttypes.h>
 #include <sigc++/slot.h>
+#include <rak/hash_index.h>
 
 namespace core {
 
@@ -72,7 +75,7 @@ public:
   using base_type::empty;
   using base_type::size;
 
-  DownloadList() { }
+  DownloadList() : m_hashIndex(&m_indexList) { }
 
   void                clear();
 
@@ -83,6 +86,9 @@ public:
 
   iterator            insert(Download* d);
 
+  // Find a download by its info hash, returns end() if not found.
+  iterator            find(const std::string& hash);
+
   void                erase(Download* d);
   iterator            erase(iterator itr);
 
@@ -183,7 +189,20 @@ private:
   void                received_finished(Download* d);
   void                confirm_finished(Download* d);
 
+  struct hash_traits {
+    static uint32_t     hash(const std::string& hash);
+    static uint32_t     hash(const iterator& itr);
+    static bool         equal(const iterator& itr, const std::string& hash);
+  };
+
+  typedef std::vector<iterator>                    index_list;
+  typedef rak::hash_index<index_list, hash_traits> hash_index_type;
+
   slot_map            m_slotMaps[SLOTS_MAX_SIZE];
+
+  // Positions into 'm_indexList' by info hash.
+  index_list          m_indexList;
+  hash_index_type     m_hashIndex;
 };
 
 }
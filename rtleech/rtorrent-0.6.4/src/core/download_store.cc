@@ -38,7 +38,11 @@
 
 #include "config.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
 #include <fstream>
+#include <sstream>
 #include <stdio.h>
 #include <unistd.h>
 #include <rak/error_number.h>
@@ -74,6 +78,14 @@ DownloadStore::enable(bool lock) {
       throw torrent::input_error("Could not lock session directory: \"" + m_path + "\", " + rak::error_number::current().c_str());
     else
       throw torrent::input_error("Could not lock session directory: \"" + m_path + "\", held by \"" + m_lockfile.locked_by_as_string() + "\".");
+
+  if (m_useJournal && !m_journal.open(m_path + "rtorrent.journal")) {
+    m_lockfile.unlock();
+    throw torrent::input_error("Could not open session journal: \"" + m_path + "rtorrent.journal\".");
+  }
+
+  if (m_useJournal)
+    migrate_files();
 }
 
 void
@@ -81,9 +93,18 @@ DownloadStore::disable() {
   if (!is_enabled())
     return;
 
+  m_journal.close();
   m_lockfile.unlock();
 }
 
+void
+DownloadStore::set_journal(bool state) {
+  if (is_enabled())
+    throw torrent::input_error("Tried to change session journal while the session directory is enabled.");
+
+  m_useJournal = state;
+}
+
 void
 DownloadStore::set_path(const std::string& path) {
   if (is_enabled())
@@ -95,45 +116,227 @@ DownloadStore::set_path(const std::string& path) {
     m_path = rak::path_expand(path);
 }
 
+// Grows the string the bencode is written into, the whole string has
+// been filled when this is called.
+static torrent::object_buffer_t
+download_store_grow(void* data, torrent::object_buffer_t buffer) {
+  std::string* str = static_cast<std::string*>(data);
+  std::string::size_type used = str->size();
+
+  str->resize(2 * used);
+
+  return torrent::object_buffer_t(&(*str)[0] + used, &(*str)[0] + str->size());
+}
+
+// Never zero as that marks a record as unsaved.
+static uint64_t
+download_store_checksum(const char* first, const char* last) {
+  return SessionJournal::finish_checksum(SessionJournal::make_checksum(first, last));
+}
+
+// Serializes the object into the reused buffer and returns the
+// length. The bencode writer cannot produce invalid data, so the
+// files are not read back after saving.
+uint32_t
+DownloadStore::write_buffer(const torrent::Object& object) {
+  m_buffer.resize(std::max<std::string::size_type>(m_buffer.capacity(), 4096));
+
+  torrent::object_buffer_t result = torrent::object_write_bencode_c(&download_store_grow, &m_buffer,
+                                                                    torrent::object_buffer_t(&m_buffer[0], &m_buffer[0] + m_buffer.size()),
+                                                                    &object);
+  return result.second - m_buffer.c_str();
+}
+
+// Written with a single write() from the buffer and synced before
+// replacing the old file.
+bool
+DownloadStore::write_file(const std::string& filename, uint32_t length) {
+  const char* first = m_buffer.c_str();
+  const char* last  = first + length;
+
+  int fd = ::open((filename + ".new").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+  if (fd == -1)
+    return false;
+
+  while (first != last) {
+    ssize_t r = ::write(fd, first, last - first);
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r <= 0)
+      break;
+
+    first += r;
+  }
+
+  bool success = first == last && ::fsync(fd) == 0;
+  success = ::close(fd) == 0 && success;
+
+  if (!success || ::rename((filename + ".new").c_str(), filename.c_str()) != 0) {
+    ::unlink((filename + ".new").c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool
+DownloadStore::write_bencode(const std::string& filename, const torrent::Object& object) {
+  return write_file(filename, write_buffer(object));
+}
+
+bool
+DownloadStore::write_record(Download* d, unsigned int record, const std::string& filename, uint32_t length) {
+  if (m_useJournal)
+    return m_journal.append(d->download()->info_hash(), record, m_buffer.c_str(), m_buffer.c_str() + length);
+  else
+    return write_file(filename, length);
+}
+
 void
-DownloadStore::save(Download* d) {
-  if (!is_enabled())
+DownloadStore::save_record(Download* d, unsigned int record, const std::string& filename, const torrent::Object& object) {
+  uint32_t length = write_buffer(object);
+  uint64_t checksum = download_store_checksum(m_buffer.c_str(), m_buffer.c_str() + length);
+
+  if (checksum == d->session_checksum(record))
     return;
 
-  std::fstream f((create_filename(d) + ".new").c_str(), std::ios::out | std::ios::trunc);
+  if (write_record(d, record, filename, length))
+    d->set_session_checksum(record, checksum);
+}
+
+bool
+DownloadStore::read_record(const std::string& hash, unsigned int record, const std::string& filename, std::string* dest) {
+  if (m_useJournal)
+    return m_journal.read(hash, record, dest);
+  else
+    return read_file(filename, dest);
+}
+
+bool
+DownloadStore::read_file(const std::string& filename, std::string* dest) {
+  std::fstream f(filename.c_str(), std::ios::in | std::ios::binary);
 
   if (!f.is_open())
+    return false;
+
+  std::ostringstream buffer;
+  buffer << f.rdbuf();
+
+  *dest = buffer.str();
+  return true;
+}
+
+bool
+DownloadStore::load_record(Download* d, unsigned int record, const std::string& filename, const char* key) {
+  std::string data;
+
+  if (!read_record(d->download()->info_hash(), record, filename, &data))
+    return false;
+
+  torrent::Object object;
+
+  if (torrent::object_read_bencode_c(data.c_str(), data.c_str() + data.size(), &object) == NULL || !object.is_map())
+    return false;
+
+  d->bencode()->insert_key(key, torrent::Object()).swap(object);
+  d->set_session_checksum(record, download_store_checksum(data.c_str(), data.c_str() + data.size()));
+
+  return true;
+}
+
+void
+DownloadStore::load_records(Download* d) {
+  std::string filename = create_filename(d);
+
+  bool found = load_record(d, Download::session_rtorrent, filename + ".rtorrent", "rtorrent");
+  found = load_record(d, Download::session_resume, filename + ".libtorrent_resume", "libtorrent_resume") && found;
+
+  // The torrent file was saved without the sections, no need to
+  // rewrite it.
+  if (found)
+    d->set_session_checksum(Download::session_torrent, 1);
+}
+
+void
+DownloadStore::save(Download* d) {
+  if (!is_enabled())
     return;
 
+  torrent::Object* root = d->bencode();
+
   // Move this somewhere else?
-  d->bencode()->get_key("rtorrent").insert_key("total_uploaded", d->download()->up_rate()->total());
-  d->bencode()->get_key("rtorrent").insert_key("chunks_done", d->download()->chunks_done());
+  root->get_key("rtorrent").insert_key("total_uploaded", d->download()->up_rate()->total());
+  root->get_key("rtorrent").insert_key("chunks_done", d->download()->chunks_done());
+
+  torrent::Object& resumeObject = root->get_key("libtorrent_resume");
 
-  torrent::Object& resumeObject = d->download()->bencode()->get_key("libtorrent_resume");
+  // Keep the progress of active downloads current, so a crash only
+  // loses the chunks completed since the last save.
+  if (d->download()->is_active())
+    torrent::resume_save_progress(*d->download(), resumeObject, true);
 
   torrent::resume_save_addresses(*d->download(), resumeObject);
   torrent::resume_save_file_priorities(*d->download(), resumeObject);
   torrent::resume_save_tracker_settings(*d->download(), resumeObject);
 
-  f << *d->bencode();
+  std::string filename = create_filename(d);
 
-  if (!f.good())
+  // The sections are written before the torrent, so an interrupted
+  // first save still leaves them in the old torrent file.
+  save_record(d, Download::session_rtorrent, filename + ".rtorrent", root->get_key("rtorrent"));
+  save_record(d, Download::session_resume, filename + ".libtorrent_resume", resumeObject);
+
+  if (d->session_checksum(Download::session_torrent) != 0)
     return;
 
-  f.close();
+  // Empty objects are skipped by the writer, so swapping out the
+  // sections leaves them out of the file. The piece hashes are kept
+  // by libtorrent and only put back while writing.
+  torrent::Object rtorrent;
+  torrent::Object resume;
 
-  // Test the new file, to ensure it is a valid bencode string.
-  f.open((create_filename(d) + ".new").c_str(), std::ios::in);
+  rtorrent.swap(root->get_key("rtorrent"));
+  resume.swap(root->get_key("libtorrent_resume"));
+  root->get_key("info").insert_key("pieces", d->download()->piece_hashes());
 
-  torrent::Object tmp;
-  f >> tmp;
+  if (write_record(d, Download::session_torrent, filename, write_buffer(*root)))
+    d->set_session_checksum(Download::session_torrent, 1);
 
-  if (!f.good())
+  std::string().swap(root->get_key("info").get_key_string("pieces"));
+  root->get_key("rtorrent").swap(rtorrent);
+  root->get_key("libtorrent_resume").swap(resume);
+}
+
+void
+DownloadStore::release_piece_hashes(Download* d) {
+  if (!is_enabled() || d->download()->is_open() || d->session_checksum(Download::session_torrent) == 0)
     return;
 
-  f.close();
+  std::string hashes;
+  d->download()->swap_piece_hashes(hashes);
+}
+
+bool
+DownloadStore::load_piece_hashes(Download* d) {
+  std::string data;
+  torrent::Object object;
+
+  if (!is_enabled() ||
+      !read_record(d->download()->info_hash(), Download::session_torrent, create_filename(d), &data) ||
+      torrent::object_read_bencode_c(data.c_str(), data.c_str() + data.size(), &object) == NULL ||
+      !object.is_map() || !object.has_key_map("info") || !object.get_key("info").has_key_string("pieces"))
+    return false;
 
-  ::rename((create_filename(d) + ".new").c_str(), create_filename(d).c_str());
+  // A replaced or damaged session torrent that still parses would
+  // fail every chunk, so check the pieces belong to this download.
+  if (torrent::object_sha1(&object.get_key("info")) != d->download()->info_hash())
+    return false;
+
+  d->download()->swap_piece_hashes(object.get_key("info").get_key_string("pieces"));
+  return true;
 }
 
 void
@@ -141,7 +344,39 @@ DownloadStore::remove(Download* d) {
   if (!is_enabled())
     return;
 
-  ::unlink(create_filename(d).c_str());
+  if (m_useJournal) {
+    m_journal.erase(d->download()->info_hash());
+    return;
+  }
+
+  std::string filename = create_filename(d);
+
+  ::unlink(filename.c_str());
+  ::unlink((filename + ".rtorrent").c_str());
+  ::unlink((filename + ".libtorrent_resume").c_str());
+}
+
+bool
+DownloadStore::load_dht_cache(torrent::Object* cache) {
+  if (!is_enabled())
+    return false;
+
+  std::fstream f((m_path + "rtorrent.dht_cache").c_str(), std::ios::in);
+
+  if (!f.is_open())
+    return false;
+
+  f >> *cache;
+
+  return !f.fail() && cache->is_map();
+}
+
+void
+DownloadStore::save_dht_cache(const torrent::Object& cache) {
+  if (!is_enabled())
+    return;
+
+  write_bencode(m_path + "rtorrent.dht_cache", cache);
 }
 
 utils::Directory
@@ -159,6 +394,99 @@ DownloadStore::get_formated_entries() {
   return d;
 }
 
+// Appends the records of each session file that isn't in the journal
+// yet, then removes the files so a download erased from the journal
+// doesn't come back from them. Files that fail are kept for the next
+// start.
+void
+DownloadStore::migrate_files() {
+  static const char* suffixes[Download::session_records] = { "", ".rtorrent", ".libtorrent_resume" };
+
+  std::list<std::string> entries = get_formated_entries().make_list();
+
+  for (std::list<std::string>::iterator itr = entries.begin(), last = entries.end(); itr != last; ++itr) {
+    std::string hash = hash_from_filename(*itr);
+    std::string data;
+
+    if (hash.empty() || m_journal.checksum(hash, Download::session_torrent) != 0)
+      continue;
+
+    bool success = true;
+
+    for (unsigned int i = 0; i < Download::session_records && success; ++i)
+      if (read_file(*itr + suffixes[i], &data))
+        success = m_journal.append(hash, i, data.c_str(), data.c_str() + data.size());
+      else
+        success = i != Download::session_torrent;
+
+    // Don't leave a partial entry behind that would hide the files.
+    if (!success) {
+      m_journal.erase(hash);
+      continue;
+    }
+
+    for (unsigned int i = 0; i < Download::session_records; ++i)
+      ::unlink((*itr + suffixes[i]).c_str());
+  }
+}
+
+std::list<std::string>
+DownloadStore::session_entries() {
+  if (!m_useJournal)
+    return get_formated_entries().make_list();
+
+  std::list<std::string> entries;
+
+  if (!is_enabled())
+    return entries;
+
+  m_journal.downloads(&entries);
+
+  for (std::list<std::string>::iterator itr = entries.begin(), last = entries.end(); itr != last; ++itr)
+    *itr = m_path + rak::transform_hex(*itr) + ".torrent";
+
+  return entries;
+}
+
+bool
+DownloadStore::load_torrent(const std::string& filename, std::string* dest) {
+  std::string hash = hash_from_filename(filename);
+
+  if (!m_journal.is_open() || hash.empty())
+    return false;
+
+  return m_journal.read(hash, Download::session_torrent, dest);
+}
+
+bool
+DownloadStore::is_session_started(const std::string& filename) {
+  std::string hash = hash_from_filename(filename);
+  std::string data;
+  torrent::Object object;
+
+  if (hash.empty() || !read_record(hash, Download::session_rtorrent, filename + ".rtorrent", &data) ||
+      torrent::object_read_bencode_c(data.c_str(), data.c_str() + data.size(), &object) == NULL)
+    return false;
+
+  return object.is_map() && object.has_key_value("state") && object.get_key_value("state") == 1;
+}
+
+std::string
+DownloadStore::hash_from_filename(const std::string& filename) {
+  std::string::size_type pos = filename.rfind('/');
+  std::string basename = filename.substr(pos != std::string::npos ? pos + 1 : 0);
+
+  if (!is_correct_format(basename))
+    return std::string();
+
+  std::string hash(20, '\0');
+
+  for (unsigned int i = 0; i < 20; ++i)
+    hash[i] = (rak::hexchar_to_value(basename[2 * i]) << 4) + rak::hexchar_to_value(basename[2 * i + 1]);
+
+  return hash;
+}
+
 bool
 DownloadStore::is_correct_format(std::string f) {
   if (f.size() != 48 || f.substr(40) != ".torrent")
@@ -37,38 +37,96 @@
 #ifndef RTORRENT_CORE_DOWNLOAD_STORE_H
 #define RTORRENT_CORE_DOWNLOAD_STORE_H
 
+#include <list>
 #include <string>
 
 #include "utils/directory.h"
 #include "utils/lockfile.h"
 
+#include "session_journal.h"
+
+namespace torrent {
+  class Object;
+}
+
 namespace core {
 
 class Download;
 
 class DownloadStore {
 public:
+  DownloadStore() : m_useJournal(false) {}
 
   bool                is_enabled()                            { return m_lockfile.is_locked(); }
 
+  // Keep the session in a single append-only journal,
+  // 'rtorrent.journal', instead of files per torrent. Session files
+  // left from before the journal was enabled are moved into it.
+  bool                is_journal() const                      { return m_useJournal; }
+  void                set_journal(bool state);
+
   void                enable(bool lock);
   void                disable();
 
   const std::string&  path() const                            { return m_path; }
   void                set_path(const std::string& path);
 
+  // The torrent is saved as '<hash>.torrent' without the mutable
+  // 'rtorrent' and 'libtorrent_resume' sections, those go in
+  // '<hash>.torrent.rtorrent' and '<hash>.torrent.libtorrent_resume'.
+  // Files whose content has not changed since the last save are not
+  // rewritten, and the torrent itself is only written once.
   void                save(Download* d);
   void                remove(Download* d);
 
+  // Merge the mutable sections saved next to a session torrent back
+  // into it. Older sessions kept them in the torrent file.
+  void                load_records(Download* d);
+
+  // The piece hashes of closed downloads are dropped when they can be
+  // read back from the saved torrent, and reloaded before opening.
+  void                release_piece_hashes(Download* d);
+  bool                load_piece_hashes(Download* d);
+
+  // The DHT routing table cache, kept next to the session torrents.
+  bool                load_dht_cache(torrent::Object* cache);
+  void                save_dht_cache(const torrent::Object& cache);
+
   // Currently shows all entries in the correct format.
   utils::Directory    get_formated_entries();
 
+  // Paths of the session torrents to load, in journal mode they only
+  // name the records and are read with load_torrent.
+  std::list<std::string> session_entries();
+  bool                load_torrent(const std::string& filename, std::string* dest);
+
+  // Check the saved 'rtorrent' section of a session torrent, without
+  // loading the torrent, to see if it was started.
+  bool                is_session_started(const std::string& filename);
+
 private:
   static bool         is_correct_format(std::string f);
+  static std::string  hash_from_filename(const std::string& filename);
   std::string         create_filename(Download* d);
 
+  uint32_t            write_buffer(const torrent::Object& object);
+  bool                write_file(const std::string& filename, uint32_t length);
+  bool                write_bencode(const std::string& filename, const torrent::Object& object);
+  bool                write_record(Download* d, unsigned int record, const std::string& filename, uint32_t length);
+
+  void                save_record(Download* d, unsigned int record, const std::string& filename, const torrent::Object& object);
+  static bool         read_file(const std::string& filename, std::string* dest);
+  bool                read_record(const std::string& hash, unsigned int record, const std::string& filename, std::string* dest);
+  bool                load_record(Download* d, unsigned int record, const std::string& filename, const char* key);
+
+  void                migrate_files();
+
   std::string         m_path;
+  std::string         m_buffer;
   utils::Lockfile     m_lockfile;
+
+  bool                m_useJournal;
+  SessionJournal      m_journal;
 };
 
 }
@@ -192,6 +192,7 @@ Manager::cleanup() {
 
   m_downloadList->clear();
 
+  dht_close();
   torrent::cleanup();
   CurlStack::global_cleanup();
 
@@ -220,6 +221,8 @@ Manager::listen_open() {
   if (m_portFirst > m_portLast)
     throw torrent::input_error("Invalid port range for listening");
 
+  torrent::connection_manager()->set_listen_inet6(control->variable()->get_value("listen_inet6"));
+
   if (control->variable()->get_value("port_random")) {
     int boundary = m_portFirst + random() % (m_portLast - m_portFirst + 1);
 
@@ -235,6 +238,76 @@ Manager::listen_open() {
   throw torrent::input_error("Could not open/bind a port for listening: " + std::string(rak::error_number::current().c_str()));
 }
 
+// Shares the port with the listening socket, as peers expect.
+void
+Manager::utp_open() {
+  if (!control->variable()->get_value("utp"))
+    return;
+
+  torrent::utp_open(torrent::connection_manager()->listen_port());
+  torrent::set_utp_outgoing(control->variable()->get_value("utp_outgoing"));
+}
+
+void
+Manager::dht_open() {
+  if (!control->variable()->get_value("dht"))
+    return;
+
+  int64_t port = control->variable()->get_value("dht_port");
+
+  if (port <= 0 || port >= (1 << 16))
+    throw torrent::input_error("Invalid DHT port.");
+
+  torrent::Object cache(torrent::Object::TYPE_MAP);
+
+  if (m_downloadStore->load_dht_cache(&cache))
+    torrent::dht_start(port, &cache);
+  else
+    torrent::dht_start(port);
+}
+
+void
+Manager::dht_close() {
+  if (!torrent::dht_is_active())
+    return;
+
+  torrent::Object cache(torrent::Object::TYPE_MAP);
+
+  torrent::dht_store_cache(&cache);
+  m_downloadStore->save_dht_cache(cache);
+
+  torrent::dht_stop();
+}
+
+// Accepts "host:port", defaulting to port 6881.
+void
+Manager::dht_add_node(const std::string& addr) {
+  std::string host = addr;
+  int port = 6881;
+
+  std::string::size_type split = addr.rfind(':');
+
+  if (split != std::string::npos) {
+    host = addr.substr(0, split);
+
+    if (std::sscanf(addr.c_str() + split + 1, "%i", &port) != 1 || port <= 0 || port >= (1 << 16))
+      throw torrent::input_error("Invalid DHT node port.");
+  }
+
+  int err;
+  rak::address_info* ai;
+
+  if ((err = rak::address_info::get_address_info(host.c_str(), PF_INET, SOCK_DGRAM, &ai)) != 0)
+    throw torrent::input_error("Could not resolve DHT node: " + std::string(rak::address_info::strerror(err)) + ".");
+
+  rak::socket_address sa = *ai->address();
+  sa.set_port(port);
+
+  rak::address_info::free_address_info(ai);
+
+  torrent::dht_add_node(sa.c_sockaddr());
+}
+
 std::string
 Manager::bind_address() const {
   return rak::socket_address::cast_from(torrent::connection_manager()->bind_address())->address_str();
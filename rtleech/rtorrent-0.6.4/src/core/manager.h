@@ -82,6 +82,11 @@ public:
   void                cleanup();
 
   void                listen_open();
+  void                utp_open();
+
+  void                dht_open();
+  void                dht_close();
+  void                dht_add_node(const std::string& addr);
 
   std::string         bind_address() const;
   void                set_bind_address(const std::string& addr);
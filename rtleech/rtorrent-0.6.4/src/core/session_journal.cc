@@ -0,0 +1,415 @@
+// rTorrent - BitTorrent client
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#include "config.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "session_journal.h"
+
+namespace core {
+
+const char SessionJournal::magic[8]  = { 'r', 't', 'j', 'o', 'u', 'r', 'n', '2' };
+const char SessionJournal::marker[4] = { '\xd5', 'r', 't', 'j' };
+
+static void
+session_journal_encode(char* buffer, uint64_t value, unsigned int size) {
+  while (size-- != 0) {
+    buffer[size] = value & 0xff;
+    value >>= 8;
+  }
+}
+
+static uint64_t
+session_journal_decode(const char* buffer, unsigned int size) {
+  uint64_t value = 0;
+
+  while (size-- != 0)
+    value = (value << 8) | (unsigned char)*buffer++;
+
+  return value;
+}
+
+uint64_t
+SessionJournal::make_checksum(const char* first, const char* last, uint64_t hash) {
+  while (first != last)
+    hash = (hash ^ (unsigned char)*first++) * 1099511628211ull;
+
+  return hash;
+}
+
+bool
+SessionJournal::open(const std::string& path) {
+  close();
+
+  m_path = path;
+
+  if ((m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0666)) == -1)
+    return false;
+
+  if (!read_log()) {
+    close();
+    return false;
+  }
+
+  if (m_size > compact_min && m_size > compact_ratio * m_live)
+    compact();
+
+  return true;
+}
+
+void
+SessionJournal::close() {
+  if (m_fd == -1)
+    return;
+
+  ::close(m_fd);
+
+  m_fd = -1;
+  m_size = 0;
+  m_live = 0;
+  m_index.clear();
+}
+
+void
+SessionJournal::downloads(std::list<std::string>* dest) const {
+  for (Index::const_iterator itr = m_index.begin(), last = m_index.end(); itr != last; ++itr)
+    if (itr->second.m_records[0].m_checksum != 0)
+      dest->push_back(itr->first);
+}
+
+uint64_t
+SessionJournal::checksum(const std::string& hash, unsigned int type) const {
+  Index::const_iterator itr = m_index.find(hash);
+
+  return itr != m_index.end() ? itr->second.m_records[type].m_checksum : 0;
+}
+
+bool
+SessionJournal::read(const std::string& hash, unsigned int type, std::string* dest) const {
+  Index::const_iterator itr = m_index.find(hash);
+
+  if (itr == m_index.end() || itr->second.m_records[type].m_checksum == 0)
+    return false;
+
+  const Record& record = itr->second.m_records[type];
+
+  dest->resize(record.m_length);
+
+  for (uint32_t pos = 0; pos != record.m_length; ) {
+    ssize_t r = ::pread(m_fd, &(*dest)[pos], record.m_length - pos, record.m_offset + pos);
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r <= 0)
+      return false;
+
+    pos += r;
+  }
+
+  return true;
+}
+
+bool
+SessionJournal::append(const std::string& hash, unsigned int type, const char* first, const char* last) {
+  if (m_fd == -1 || type >= record_types || hash.size() != 20)
+    return false;
+
+  uint64_t checksum = finish_checksum(make_checksum(first, last));
+
+  if (!append_record(type, hash, first, last, checksum))
+    return false;
+
+  Record& record = m_index[hash].m_records[type];
+
+  if (record.m_checksum != 0)
+    m_live -= header_size + record.m_length;
+
+  record.m_offset   = m_size - (last - first);
+  record.m_length   = last - first;
+  record.m_checksum = checksum;
+
+  m_live += header_size + record.m_length;
+
+  if (m_size > compact_min && m_size > compact_ratio * m_live)
+    compact();
+
+  return true;
+}
+
+bool
+SessionJournal::erase(const std::string& hash) {
+  Index::iterator itr = m_index.find(hash);
+
+  if (itr == m_index.end())
+    return true;
+
+  if (!append_record(record_erase, hash, NULL, NULL, finish_checksum(make_checksum(hash.c_str(), hash.c_str() + hash.size()))))
+    return false;
+
+  erase_entry(itr);
+  return true;
+}
+
+void
+SessionJournal::write_header(char* buffer, unsigned int type, const std::string& hash, uint32_t length, uint64_t checksum) {
+  std::memcpy(buffer, marker, sizeof(marker));
+
+  buffer[4] = type;
+  std::memcpy(buffer + 5, hash.c_str(), 20);
+
+  session_journal_encode(buffer + 25, length, 4);
+  session_journal_encode(buffer + 29, checksum, 8);
+}
+
+bool
+SessionJournal::write_all(int fd, const char* first, const char* last) {
+  while (first != last) {
+    ssize_t r = ::write(fd, first, last - first);
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r <= 0)
+      return false;
+
+    first += r;
+  }
+
+  return true;
+}
+
+// The record is written with a single write() and synced. A failed
+// write is cut off so later records aren't hidden behind it.
+bool
+SessionJournal::append_record(unsigned int type, const std::string& hash, const char* first, const char* last, uint64_t checksum) {
+  std::string buffer(header_size + (last - first), '\0');
+
+  write_header(&buffer[0], type, hash, last - first, checksum);
+  std::copy(first, last, buffer.begin() + header_size);
+
+  if (!write_all(m_fd, buffer.c_str(), buffer.c_str() + buffer.size()) || ::fsync(m_fd) != 0) {
+    ::ftruncate(m_fd, m_size);
+    return false;
+  }
+
+  m_size += buffer.size();
+  return true;
+}
+
+void
+SessionJournal::erase_entry(Index::iterator itr) {
+  for (unsigned int i = 0; i < record_types; ++i)
+    if (itr->second.m_records[i].m_checksum != 0)
+      m_live -= header_size + itr->second.m_records[i].m_length;
+
+  m_index.erase(itr);
+}
+
+// Checks that a whole and valid record starts at 'first', the length
+// is checked against 'last' before the data is looked at.
+bool
+SessionJournal::is_record(const char* first, const char* last) {
+  if ((uint64_t)(last - first) < header_size || std::memcmp(first, marker, sizeof(marker)) != 0)
+    return false;
+
+  unsigned int type = (unsigned char)first[4];
+  uint64_t length   = session_journal_decode(first + 25, 4);
+  uint64_t checksum = session_journal_decode(first + 29, 8);
+
+  if (length > (uint64_t)(last - first) - header_size)
+    return false;
+
+  if (type == record_erase)
+    return length == 0 && finish_checksum(make_checksum(first + 5, first + 25)) == checksum;
+
+  return type < record_types &&
+    finish_checksum(make_checksum(first + header_size, first + header_size + length)) == checksum;
+}
+
+// Reads the log into memory and applies each record to the index. A
+// corrupt record is skipped by searching for the next marker that
+// starts a valid record, if there is none the log is truncated at the
+// corrupt record.
+bool
+SessionJournal::read_log() {
+  struct stat st;
+
+  if (fstat(m_fd, &st) != 0)
+    return false;
+
+  if (st.st_size == 0) {
+    m_size = sizeof(magic);
+    return write_all(m_fd, magic, magic + sizeof(magic)) && ::fsync(m_fd) == 0;
+  }
+
+  std::string log(st.st_size, '\0');
+
+  for (uint64_t pos = 0; pos != log.size(); ) {
+    ssize_t r = ::pread(m_fd, &log[pos], log.size() - pos, pos);
+
+    if (r == -1 && errno == EINTR)
+      continue;
+
+    if (r <= 0)
+      return false;
+
+    pos += r;
+  }
+
+  if (log.size() < sizeof(magic) || std::memcmp(log.c_str(), magic, sizeof(magic)) != 0)
+    return false;
+
+  const char* first = log.c_str();
+  const char* last  = log.c_str() + log.size();
+  const char* itr   = first + sizeof(magic);
+
+  while (itr != last) {
+    if (!is_record(itr, last)) {
+      const char* next = itr;
+
+      do {
+        next = std::search(next + 1, last, marker, marker + sizeof(marker));
+      } while (next != last && !is_record(next, last));
+
+      if (next == last)
+        break;
+
+      itr = next;
+    }
+
+    unsigned int type   = (unsigned char)itr[4];
+    std::string  hash(itr + 5, 20);
+    uint32_t     length = session_journal_decode(itr + 25, 4);
+
+    if (type == record_erase) {
+      Index::iterator indexItr = m_index.find(hash);
+
+      if (indexItr != m_index.end())
+        erase_entry(indexItr);
+
+    } else {
+      Record& record = m_index[hash].m_records[type];
+
+      if (record.m_checksum != 0)
+        m_live -= header_size + record.m_length;
+
+      record.m_offset   = (itr - first) + header_size;
+      record.m_length   = length;
+      record.m_checksum = session_journal_decode(itr + 29, 8);
+
+      m_live += header_size + record.m_length;
+    }
+
+    itr += header_size + length;
+  }
+
+  m_size = itr - first;
+
+  // Drop a partially written record at the end.
+  if (itr != last && ::ftruncate(m_fd, m_size) != 0)
+    return false;
+
+  return true;
+}
+
+// Rewrites the log with only the live records, and replaces the old
+// one once the new log has been synced.
+bool
+SessionJournal::compact() {
+  std::string path = m_path + ".new";
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+  if (fd == -1)
+    return false;
+
+  Index index(m_index);
+  uint64_t size = sizeof(magic);
+
+  bool success = write_all(fd, magic, magic + sizeof(magic));
+
+  std::string data;
+  char header[header_size];
+
+  for (Index::iterator itr = index.begin(), last = index.end(); itr != last && success; ++itr) {
+    for (unsigned int i = 0; i < record_types && success; ++i) {
+      Record& record = itr->second.m_records[i];
+
+      if (record.m_checksum == 0)
+        continue;
+
+      write_header(header, i, itr->first, record.m_length, record.m_checksum);
+
+      success = read(itr->first, i, &data) &&
+        write_all(fd, header, header + header_size) &&
+        write_all(fd, data.c_str(), data.c_str() + data.size());
+
+      record.m_offset = size + header_size;
+      size += header_size + record.m_length;
+    }
+  }
+
+  success = success && ::fsync(fd) == 0;
+  success = ::close(fd) == 0 && success;
+
+  if (!success || ::rename(path.c_str(), m_path.c_str()) != 0) {
+    ::unlink(path.c_str());
+    return false;
+  }
+
+  ::close(m_fd);
+
+  if ((m_fd = ::open(m_path.c_str(), O_RDWR | O_APPEND)) == -1) {
+    close();
+    return false;
+  }
+
+  m_index.swap(index);
+  m_size = size;
+
+  return true;
+}
+
+}
@@ -0,0 +1,143 @@
+// rTorrent - BitTorrent client
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#ifndef RTORRENT_CORE_SESSION_JOURNAL_H
+#define RTORRENT_CORE_SESSION_JOURNAL_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <inttypes.h>
+
+namespace core {
+
+// An append-only log of the session records of all downloads, used by
+// DownloadStore instead of a file per record.
+//
+// The log starts with 'magic', then each record is a header with
+// 'marker', the record type, info hash, length and checksum of the
+// data, followed by the data. Erase records have the checksum of the
+// info hash instead. The last record of each type appended for a
+// download is the live one, and an erase record drops all of them.
+//
+// Opening reads the log into memory to build the index of live
+// records. After a corrupt record the log is searched for the next
+// 'marker' that starts a valid record, and a record cut short by a
+// crash ends the log and is truncated away.
+//
+// Once the log is 'compact_ratio' times larger than the live records
+// it is rewritten with only those.
+
+class SessionJournal {
+public:
+  static const unsigned int record_types  = 3;
+  static const unsigned int record_erase  = 0xff;
+
+  static const uint32_t     header_size   = 4 + 1 + 20 + 4 + 8;
+  static const uint32_t     compact_ratio = 2;
+  static const uint64_t     compact_min   = 1 << 20;
+
+  static const char         magic[8];
+  static const char         marker[4];
+
+  SessionJournal() : m_fd(-1), m_size(0), m_live(0) {}
+  ~SessionJournal() { close(); }
+
+  bool                is_open() const { return m_fd != -1; }
+
+  bool                open(const std::string& path);
+  void                close();
+
+  // Info hashes of the downloads with a live record of type 0.
+  void                downloads(std::list<std::string>* dest) const;
+
+  // Zero if there's no live record.
+  uint64_t            checksum(const std::string& hash, unsigned int type) const;
+
+  bool                read(const std::string& hash, unsigned int type, std::string* dest) const;
+
+  bool                append(const std::string& hash, unsigned int type, const char* first, const char* last);
+  bool                erase(const std::string& hash);
+
+  // FNV-1a, never zero.
+  static uint64_t     make_checksum(const char* first, const char* last, uint64_t hash = 14695981039346656037ull);
+  static uint64_t     finish_checksum(uint64_t hash) { return hash != 0 ? hash : 1; }
+
+private:
+  SessionJournal(const SessionJournal&);
+  void operator = (const SessionJournal&);
+
+  struct Record {
+    Record() : m_offset(0), m_length(0), m_checksum(0) {}
+
+    uint64_t            m_offset;
+    uint32_t            m_length;
+    uint64_t            m_checksum;
+  };
+
+  struct Entry {
+    Record              m_records[record_types];
+  };
+
+  typedef std::map<std::string, Entry> Index;
+
+  static void         write_header(char* buffer, unsigned int type, const std::string& hash, uint32_t length, uint64_t checksum);
+  static bool         write_all(int fd, const char* first, const char* last);
+
+  static bool         is_record(const char* first, const char* last);
+
+  bool                read_log();
+  bool                append_record(unsigned int type, const std::string& hash, const char* first, const char* last, uint64_t checksum);
+
+  void                erase_entry(Index::iterator itr);
+
+  bool                compact();
+
+  std::string         m_path;
+  int                 m_fd;
+
+  // Size of the log and of the records in the index, headers
+  // included.
+  uint64_t            m_size;
+  uint64_t            m_live;
+
+  Index               m_index;
+};
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+// rTorrent - BitTorrent client
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+#include "config.h"
+
+#include <sigc++/bind.h>
+#include <rak/functional.h>
+#include <torrent/exceptions.h>
+
+#include "globals.h"
+#include "manager.h"
+
+#include "download_factory.h"
+#include "download_store.h"
+#include "session_loader.h"
+
+namespace core {
+
+SessionLoader::SessionLoader(Manager* m) :
+  m_manager(m) {
+
+  m_taskLoad.set_slot(rak::mem_fn(this, &SessionLoader::receive_load));
+}
+
+SessionLoader::~SessionLoader() {
+  priority_queue_erase(&taskScheduler, &m_taskLoad);
+}
+
+void
+SessionLoader::start() {
+  if (is_active())
+    throw torrent::client_error("SessionLoader::start() called on an active object.");
+
+  m_entries = m_manager->download_store()->session_entries();
+  m_started.clear();
+  m_stopped.clear();
+
+  priority_queue_insert(&taskScheduler, &m_taskLoad, cachedTime);
+}
+
+// The small 'rtorrent' records are read first to find the started
+// downloads, then the torrents are loaded. Both are done in batches.
+void
+SessionLoader::receive_load() {
+  rak::timer timeout = rak::timer::current() + budget;
+  DownloadStore* store = m_manager->download_store();
+
+  while (!m_entries.empty()) {
+    list_type& target = store->is_session_started(m_entries.front()) ? m_started : m_stopped;
+    target.splice(target.end(), m_entries, m_entries.begin());
+
+    if (rak::timer::current() >= timeout)
+      return reschedule();
+  }
+
+  while (!m_started.empty() || !m_stopped.empty()) {
+    list_type& source = !m_started.empty() ? m_started : m_stopped;
+
+    DownloadFactory* f = new DownloadFactory(source.front(), m_manager);
+    source.pop_front();
+
+    f->set_session(true);
+    f->slot_finished(sigc::bind(sigc::ptr_fun(&rak::call_delete_func<core::DownloadFactory>), f));
+    f->load_now();
+
+    if (remaining() != 0 && rak::timer::current() >= timeout)
+      return reschedule();
+  }
+
+  m_slotFinished();
+}
+
+// Scheduled past cachedTime so the poll and the other tasks get to run
+// before the next batch.
+void
+SessionLoader::reschedule() {
+  priority_queue_insert(&taskScheduler, &m_taskLoad, cachedTime + 1);
+}
+
+}
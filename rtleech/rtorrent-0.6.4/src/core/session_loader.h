@@ -0,0 +1,93 @@
+// rTorrent - BitTorrent client
+// Copyright (C) 2005-2006, Jari Sundell
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+// In addition, as a special exception, the copyright holders give
+// permission to link the code of portions of this program with the
+// OpenSSL library under certain conditions as described in each
+// individual source file, and distribute linked combinations
+// including the two.
+//
+// You must obey the GNU General Public License in all respects for
+// all of the code used other than OpenSSL.  If you modify file(s)
+// with this exception, you may extend this exception to your version
+// of the file(s), but you are not obligated to do so.  If you do not
+// wish to do so, delete this exception statement from your version.
+// If you delete this exception statement from all source files in the
+// program, then also delete it here.
+//
+// Contact:  Jari Sundell <jaris@ifi.uio.no>
+//
+//           Skomakerveien 33
+//           3185 Skoppum, NORWAY
+
+
+// SessionLoader adds the session torrents a few at a time from the
+// task scheduler, so the client is responsive and the first downloads
+// are announced while the rest are still loading. Downloads that were
+// started when the session was saved are loaded first.
+
+#ifndef RTORRENT_CORE_SESSION_LOADER_H
+#define RTORRENT_CORE_SESSION_LOADER_H
+
+#include <list>
+#include <string>
+#include <sigc++/slot.h>
+#include <rak/priority_queue_default.h>
+
+namespace core {
+
+class Manager;
+
+class SessionLoader {
+public:
+  typedef std::list<std::string> list_type;
+  typedef sigc::slot<void>       Slot;
+
+  // Time in microseconds spent loading torrents before returning to
+  // the main loop.
+  static const int64_t budget = 50000;
+
+  SessionLoader(Manager* m);
+  ~SessionLoader();
+
+  bool                is_active() const     { return m_taskLoad.is_queued(); }
+  list_type::size_type remaining() const    { return m_entries.size() + m_started.size() + m_stopped.size(); }
+
+  void                start();
+
+  // Called once all the session torrents have been loaded.
+  void                slot_finished(Slot s) { m_slotFinished = s; }
+
+private:
+  void                receive_load();
+  void                reschedule();
+
+  Manager*            m_manager;
+
+  // Entries whose 'rtorrent' record hasn't been read yet, and those
+  // sorted by whether the download was started.
+  list_type           m_entries;
+  list_type           m_started;
+  list_type           m_stopped;
+
+  Slot                m_slotFinished;
+  rak::priority_item  m_taskLoad;
+};
+
+}
+
+#endif
@@ -97,6 +97,24 @@ private:
   bool        m_reverse;
 };
 
+class ViewSortScrape : public ViewSort {
+public:
+  typedef uint32_t (torrent::Download::*Ftor)() const;
+
+  ViewSortScrape(Ftor ftor, bool reverse = false) : m_ftor(ftor), m_reverse(reverse) {}
+
+  virtual bool operator () (Download* d1, Download* d2) const {
+    if (m_reverse)
+      return (d2->download()->*m_ftor)() < (d1->download()->*m_ftor)();
+    else
+      return (d1->download()->*m_ftor)() < (d2->download()->*m_ftor)();
+  }
+
+private:
+  Ftor m_ftor;
+  bool m_reverse;
+};
+
 class ViewSortReverse : public ViewSort {
 public:
   ViewSortReverse(ViewSort* s) : m_sort(s) {}
@@ -110,6 +128,23 @@ private:
   ViewSort* m_sort;
 };
 
+// Downloads without a scrape reply match neither the filter nor its
+// inverse, as a count of zero means nothing for them.
+class ViewFilterScrape : public ViewFilter {
+public:
+  typedef uint32_t (torrent::Download::*Ftor)() const;
+
+  ViewFilterScrape(Ftor ftor, bool inverse = false) : m_ftor(ftor), m_inverse(inverse) {}
+
+  virtual bool operator () (Download* d1) const {
+    return d1->download()->is_scraped() && ((d1->download()->*m_ftor)() != 0) != m_inverse;
+  }
+
+private:
+  Ftor m_ftor;
+  bool m_inverse;
+};
+
 class ViewFilterVariableValue : public ViewFilter {
 public:
   ViewFilterVariableValue(const std::string& name, torrent::Object::value_type v, bool inverse = false) :
@@ -143,11 +178,21 @@ ViewManager::ViewManager(DownloadList* dl) :
   m_sort["state_changed"]         = new ViewSortVariableValue("state_changed");
   m_sort["state_changed_reverse"] = new ViewSortVariableValue("state_changed", true);
 
+  m_sort["seeders"]               = new ViewSortScrape(&torrent::Download::scrape_complete);
+  m_sort["seeders_reverse"]       = new ViewSortScrape(&torrent::Download::scrape_complete, true);
+  m_sort["leechers"]              = new ViewSortScrape(&torrent::Download::scrape_incomplete);
+  m_sort["leechers_reverse"]      = new ViewSortScrape(&torrent::Download::scrape_incomplete, true);
+  m_sort["downloaded"]            = new ViewSortScrape(&torrent::Download::scrape_downloaded);
+  m_sort["downloaded_reverse"]    = new ViewSortScrape(&torrent::Download::scrape_downloaded, true);
+
   m_filter["started"]     = new ViewFilterVariableValue("state", 1);
   m_filter["stopped"]     = new ViewFilterVariableValue("state", 0);
   m_filter["complete"]    = new ViewFilterVariableValue("complete", 0, true);
   m_filter["incomplete"]  = new ViewFilterVariableValue("complete", 0);
   m_filter["hashing"]     = new ViewFilterVariableValue("hashing", 0, true);
+  m_filter["seeded"]      = new ViewFilterScrape(&torrent::Download::scrape_complete);
+  m_filter["unseeded"]    = new ViewFilterScrape(&torrent::Download::scrape_complete, true);
+  m_filter["leeched"]     = new ViewFilterScrape(&torrent::Download::scrape_incomplete);
 }
 
 void
@@ -52,6 +52,7 @@
 #include "core/download_factory.h"
 #include "core/download_store.h"
 #include "core/manager.h"
+#include "core/session_loader.h"
 #include "display/canvas.h"
 #include "display/window.h"
 #include "display/manager.h"
@@ -96,22 +97,6 @@ parse_options(Control* c, int argc, char** argv) {
   }
 }
 
-void
-load_session_torrents(Control* c) {
-  // Load session torrents.
-  std::list<std::string> l = c->core()->download_store()->get_formated_entries().make_list();
-
-  for (std::list<std::string>::iterator first = l.begin(), last = l.end(); first != last; ++first) {
-    core::DownloadFactory* f = new core::DownloadFactory(*first, c->core());
-
-    // Replace with session torrent flag.
-    f->set_session(true);
-    f->slot_finished(sigc::bind(sigc::ptr_fun(&rak::call_delete_func<core::DownloadFactory>), f));
-    f->load();
-    f->commit();
-  }
-}
-
 void
 load_arg_torrents(Control* c, char** first, char** last) {
   //std::for_each(begin, end, std::bind1st(std::mem_fun(&core::Manager::insert), &c->get_core()));
@@ -126,6 +111,15 @@ load_arg_torrents(Control* c, char** first, char** last) {
   }
 }
 
+// Scheduled commands are held until now so that e.g. a watch
+// directory can't add a torrent before its session copy is loaded.
+void
+load_session_finished(Control* c, char** first, char** last) {
+  load_arg_torrents(c, first, last);
+
+  c->command_scheduler()->release();
+}
+
 static inline rak::timer
 client_next_timeout(Control* c) {
   if (taskScheduler.empty())
@@ -229,12 +223,14 @@ main(int argc, char** argv) {
 
     control->initialize();
 
-    // Load session torrents and perform scheduled tasks to ensure
-    // session torrents are loaded before arg torrents.
-    load_session_torrents(control);
-    rak::priority_queue_perform(&taskScheduler, cachedTime);
+    // Session torrents are loaded in batches from the task scheduler,
+    // the arg torrents are loaded once they are all in.
+    core::SessionLoader sessionLoader(control->core());
+
+    sessionLoader.slot_finished(sigc::bind(sigc::ptr_fun(&load_session_finished), control, argv + firstArg, argv + argc));
 
-    load_arg_torrents(control, argv + firstArg, argv + argc);
+    control->command_scheduler()->hold();
+    sessionLoader.start();
 
     // Make sure we update the display before any scheduled tasks can
     // run, so that loading of torrents doesn't look like it hangs on
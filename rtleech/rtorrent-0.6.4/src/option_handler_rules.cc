@@ -37,6 +37,7 @@
 #include "config.h"
 
 #include <cstdio>
+#include <fstream>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -45,11 +46,14 @@
 #include <rak/functional.h>
 #include <rak/path.h>
 #include <rak/string_manip.h>
+#include <sigc++/bind.h>
 #include <torrent/object.h>
 #include <torrent/chunk_manager.h>
 #include <torrent/connection_manager.h>
 #include <torrent/exceptions.h>
 #include <torrent/file.h>
+#include <torrent/make_torrent.h>
+#include <torrent/object_stream.h>
 #include <torrent/path.h>
 #include <torrent/rate.h>
 #include <torrent/torrent.h>
@@ -270,6 +274,42 @@ apply_tos(const std::string& arg) {
     throw torrent::input_error("Invalid TOS identifier.");
 }
 
+void
+apply_encryption(const std::string& arg) {
+  uint32_t options = torrent::ConnectionManager::encryption_none;
+
+  for (rak::split_iterator_t<std::string> itr = rak::split_iterator(arg, ','), last = rak::split_iterator(arg); itr != last; ++itr) {
+    std::string opt = rak::trim(*itr);
+
+    if (opt == "none")
+      options = torrent::ConnectionManager::encryption_none;
+    else if (opt == "allow_incoming")
+      options |= torrent::ConnectionManager::encryption_allow_incoming;
+    else if (opt == "try_outgoing")
+      options |= torrent::ConnectionManager::encryption_try_outgoing;
+    else if (opt == "require")
+      options |= torrent::ConnectionManager::encryption_require;
+    else if (opt == "enable_retry")
+      options |= torrent::ConnectionManager::encryption_enable_retry;
+    else if (opt == "prefer_plaintext")
+      options |= torrent::ConnectionManager::encryption_prefer_plaintext;
+    else
+      throw torrent::input_error("Invalid encryption option.");
+  }
+
+  torrent::connection_manager()->set_encryption_options(options);
+}
+
+void
+apply_utp_simulate(const std::string& arg) {
+  int delay, loss;
+
+  if (std::sscanf(arg.c_str(), "%i,%i", &delay, &loss) != 2 || delay < 0 || loss < 0)
+    throw torrent::input_error("Invalid uTP simulation, expected \"delay,loss\".");
+
+  torrent::utp_simulate(delay, loss);
+}
+
 void
 apply_view_filter(Control* control, const std::string& arg) {
   rak::split_iterator_t<std::string> itr = rak::split_iterator(arg, ',');
@@ -379,6 +419,58 @@ apply_view_sort_new(Control* control, const std::string& arg) {
   control->view_manager()->set_sort_new(name, sortArgs);
 }
 
+void
+make_torrent_done(Control* m, torrent::MakeTorrent* maker, std::string output) {
+  if (maker->is_done()) {
+    std::fstream out(output.c_str(), std::ios::out | std::ios::trunc);
+    out << maker->torrent();
+
+    if (out.good())
+      m->core()->push_log("Created torrent: " + output);
+    else
+      m->core()->push_log("Could not write torrent: " + output);
+
+  } else {
+    m->core()->push_log("Could not create torrent \"" + output + "\": " + maker->error());
+  }
+
+  delete maker;
+}
+
+// Hashing is done in the background, the result is logged and the
+// torrent written to 'output' when done.
+void
+apply_make_torrent(Control* m, const std::string& arg) {
+  rak::split_iterator_t<std::string> itr = rak::split_iterator(arg, ',');
+
+  std::string path = rak::trim(*itr);
+  std::string output;
+
+  if (++itr != rak::split_iterator(arg))
+    output = rak::trim(*itr);
+
+  if (path.empty() || output.empty())
+    throw torrent::input_error("Expected \"path,output[,tracker...]\".");
+
+  torrent::MakeTorrent* maker = new torrent::MakeTorrent;
+  maker->set_path(rak::path_expand(path));
+
+  while (++itr != rak::split_iterator(arg))
+    if (!rak::trim(*itr).empty())
+      maker->trackers().push_back(rak::trim(*itr));
+
+  maker->slot_done(sigc::bind(sigc::ptr_fun(&make_torrent_done), m, maker, rak::path_expand(output)));
+
+  try {
+    maker->start();
+  } catch (torrent::input_error&) {
+    delete maker;
+    throw;
+  }
+
+  m->core()->push_log("Hashing " + maker->path() + " for " + output + ".");
+}
+
 void
 apply_import(const std::string& path) {
   if (!control->variable()->process_file(path))
@@ -399,12 +491,19 @@ initialize_option_handler(Control* c) {
   variables->insert("use_udp_trackers",      new utils::VariableBool(true));
   variables->insert("port_open",             new utils::VariableBool(true));
   variables->insert("port_random",           new utils::VariableBool(true));
+  variables->insert("listen_inet6",          new utils::VariableBool(false));
+
+  variables->insert("dht",                   new utils::VariableBool(false));
+  variables->insert("dht_port",              new utils::VariableValue(6881));
+  variables->insert("dht_add_node",          new utils::VariableStringSlot(rak::value_fn(std::string()), rak::mem_fn(control->core(), &core::Manager::dht_add_node)));
+  variables->insert("dht_query_rate",        new utils::VariableValueSlot(rak::ptr_fn(&torrent::dht_query_rate), rak::ptr_fn(&torrent::set_dht_query_rate)));
 
   variables->insert("tracker_dump",          new utils::VariableAny(std::string()));
 
   variables->insert("session",               new utils::VariableStringSlot(rak::mem_fn(control->core()->download_store(), &core::DownloadStore::path),
                                                                            rak::mem_fn(control->core()->download_store(), &core::DownloadStore::set_path)));
   variables->insert("session_lock",          new utils::VariableBool(true));
+  variables->insert("session_journal",       new utils::VariableBool(false));
   variables->insert("session_on_completion", new utils::VariableBool(true));
   variables->insert("session_save",          new utils::VariableVoidSlot(rak::mem_fn(c->core()->download_list(), &core::DownloadList::session_save)));
 
@@ -414,6 +513,12 @@ initialize_option_handler(Control* c) {
   variables->insert("directory",             new utils::VariableAny("./"));
 
   variables->insert("tos",                   new utils::VariableStringSlot(rak::value_fn(std::string()), rak::ptr_fn(&apply_tos)));
+  variables->insert("encryption",            new utils::VariableStringSlot(rak::value_fn(std::string()), rak::ptr_fn(&apply_encryption)));
+
+  variables->insert("utp",                   new utils::VariableBool(false));
+  variables->insert("utp_outgoing",          new utils::VariableBool(false));
+  variables->insert("utp_target_delay",      new utils::VariableValueSlot(rak::ptr_fn(&torrent::utp_target_delay), rak::ptr_fn(&torrent::set_utp_target_delay)));
+  variables->insert("utp_simulate",          new utils::VariableStringSlot(rak::value_fn(std::string()), rak::ptr_fn(&apply_utp_simulate)));
 
   variables->insert("bind",                  new utils::VariableStringSlot(rak::mem_fn(control->core(), &core::Manager::bind_address),
                                                                            rak::mem_fn(control->core(), &core::Manager::set_bind_address)));
@@ -429,6 +534,9 @@ initialize_option_handler(Control* c) {
   variables->insert("max_peers_seed",        new utils::VariableValue(-1));
   variables->insert("max_uploads",           new utils::VariableValue(15));
   variables->insert("max_chunks_queued",     new utils::VariableValue(0));
+  variables->insert("unchoke_change_cost",   new utils::VariableValueSlot(rak::ptr_fn(&torrent::unchoke_change_cost), rak::ptr_fn(&torrent::set_unchoke_change_cost),
+                                                                          0, (1 << 10)));
+  variables->insert("scrape_interval",       new utils::VariableValueSlot(rak::ptr_fn(&torrent::scrape_interval), rak::ptr_fn(&torrent::set_scrape_interval)));
 
   variables->insert("download_rate",         new utils::VariableValueSlot(rak::ptr_fn(&torrent::down_throttle), rak::mem_fn(control->ui(), &ui::Root::set_down_throttle_i64),
                                                                           0, (1 << 10)));
@@ -436,12 +544,16 @@ initialize_option_handler(Control* c) {
                                                                           0, (1 << 10)));
 
   variables->insert("tracker_numwant",       new utils::VariableValue(-1));
+  variables->insert("tracker_fanout",        new utils::VariableValue(3));
 
   variables->insert("hash_max_tries",        new utils::VariableValueSlot(rak::ptr_fn(&torrent::hash_max_tries), rak::ptr_fn(&torrent::set_hash_max_tries)));
   variables->insert("max_open_files",        new utils::VariableValueSlot(rak::ptr_fn(&torrent::max_open_files), rak::ptr_fn(&torrent::set_max_open_files)));
   variables->insert("max_open_sockets",      new utils::VariableValueSlot(rak::ptr_fn(&torrent::max_open_sockets), rak::ptr_fn(&torrent::set_max_open_sockets)));
+  variables->insert("connect_rate",          new utils::VariableValueSlot(rak::ptr_fn(&torrent::connect_rate), rak::ptr_fn(&torrent::set_connect_rate)));
+  variables->insert("max_half_open",         new utils::VariableValueSlot(rak::ptr_fn(&torrent::max_half_open), rak::ptr_fn(&torrent::set_max_half_open)));
 
   variables->insert("print",                 new utils::VariableStringSlot(rak::value_fn(std::string()), rak::mem_fn(control->core(), &core::Manager::push_log)));
+  variables->insert("make_torrent",          new utils::VariableStringSlot(rak::value_fn(std::string()), rak::bind_ptr_fn(&apply_make_torrent, c)));
   variables->insert("import",                new utils::VariableStringSlot(rak::value_fn(std::string()), rak::ptr_fn(&apply_import)));
   variables->insert("try_import",            new utils::VariableStringSlot(rak::value_fn(std::string()), rak::ptr_fn(&apply_try_import)));
 
@@ -479,6 +591,11 @@ initialize_option_handler(Control* c) {
   variables->insert("timeout_safe_sync",     new utils::VariableValueSlot(rak::mem_fn(torrent::chunk_manager(), &torrent::ChunkManager::timeout_safe_sync),
                                                                           rak::mem_fn(torrent::chunk_manager(), &torrent::ChunkManager::set_timeout_safe_sync)));
 
+  variables->insert("listen_backlog",        new utils::VariableValueSlot(rak::mem_fn(torrent::connection_manager(), &torrent::ConnectionManager::listen_backlog),
+                                                                          rak::mem_fn(torrent::connection_manager(), &torrent::ConnectionManager::set_listen_backlog)));
+  variables->insert("listen_sockets",        new utils::VariableValueSlot(rak::mem_fn(torrent::connection_manager(), &torrent::ConnectionManager::listen_sockets),
+                                                                          rak::mem_fn(torrent::connection_manager(), &torrent::ConnectionManager::set_listen_sockets)));
+
   variables->insert("port_range",            new utils::VariableStringSlot(rak::value_fn(std::string()), rak::bind_ptr_fn(&apply_port_range, c)));
 
   variables->insert("hash_read_ahead",       new utils::VariableValueSlot(rak::ptr_fn(torrent::hash_read_ahead), rak::bind_ptr_fn(&apply_hash_read_ahead, c)));